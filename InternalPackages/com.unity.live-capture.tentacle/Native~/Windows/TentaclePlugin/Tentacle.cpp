@@ -1,9 +1,10 @@
 #include "Tentacle.h"
+#include "NativeLog.h"
 
 #include <vector>
 #include <map>
+#include <atomic>
 #include <mutex>
-#include <fstream>
 #include <sstream>
 #include <iomanip>
 
@@ -25,6 +26,7 @@ struct CachedAdvertisement
 static BluetoothLEAdvertisementWatcher s_Watcher;
 static std::map<uint64_t, CachedAdvertisement> s_AdvertisementCache;
 static std::mutex s_Lock;
+static std::atomic<int> s_LogLevel = { static_cast<int>(NativeLog::Level::Info) };
 
 template<typename T>
 std::string IntToHexStr(T i)
@@ -38,16 +40,16 @@ std::string IntToHexStr(T i)
 
 void StartScanning()
 {
-    std::ofstream log_file = std::ofstream("blelog.txt", std::ios_base::out | std::ios_base::app);
-    log_file << std::string("Start\n");
+    // The advertisements are received on a thread pool, the log is written asynchronously so that
+    // they are never delayed by the file I/O.
+    NativeLog::SetLevel(static_cast<NativeLog::Level>(s_LogLevel.load()));
+    NativeLog::Start("blelog.txt", true);
+    NativeLog::Write(NativeLog::Level::Info, "Start");
 
     auto watcher = BluetoothLEAdvertisementWatcher();
     watcher.ScanningMode(BluetoothLEScanningMode::Active);
     watcher.Received([watcher](BluetoothLEAdvertisementWatcher watcher, BluetoothLEAdvertisementReceivedEventArgs eventArgs)
     {
-        std::ofstream log_file = std::ofstream("blelog.txt", std::ios_base::out | std::ios_base::app);
-        log_file << std::string("Received ");
-
         auto advertisement = eventArgs.Advertisement();
         auto manufacturerSections = advertisement.GetManufacturerDataByCompanyId(TENTACLE_MANUFACTURER_ID);
 
@@ -58,20 +60,18 @@ void StartScanning()
 
         auto address = eventArgs.BluetoothAddress();
 
-        log_file << IntToHexStr(address);
-        log_file << std::string(" ");
-        log_file << winrt::to_string(advertisement.LocalName());
-        log_file << std::string(" ");
-
         auto manufacturerSection = manufacturerSections.GetAt(0);
         auto payload = manufacturerSection.Data();
         auto manufacturerSectionLen = payload.Length() + 2;
 
-        log_file << IntToHexStr(manufacturerSection.CompanyId());
-        log_file << std::string(" ");
-        log_file << std::to_string(payload.Length());
-        log_file << std::string(" ");
-        log_file << std::string("\n");
+        if (NativeLog::IsEnabled(NativeLog::Level::Debug))
+        {
+            const auto message = "Received " + IntToHexStr(address)
+                + " " + winrt::to_string(advertisement.LocalName())
+                + " " + IntToHexStr(manufacturerSection.CompanyId())
+                + " " + std::to_string(payload.Length());
+            NativeLog::Write(NativeLog::Level::Debug, message.c_str());
+        }
 
         // aquire the cache lock and update the device cache
         std::lock_guard<std::mutex> lock(s_Lock);
@@ -157,6 +157,12 @@ void StopScanning()
     s_Watcher.Stop();
     s_Watcher = {};
 
-    std::ofstream log_file = std::ofstream("blelog.txt", std::ios_base::out | std::ios_base::app);
-    log_file << std::string("Stop\n");
+    NativeLog::Write(NativeLog::Level::Info, "Stop");
+    NativeLog::Stop();
+}
+
+void SetLogLevel(int level)
+{
+    s_LogLevel = level;
+    NativeLog::SetLevel(static_cast<NativeLog::Level>(level));
 }
@@ -21,4 +21,7 @@ extern "C"
 {
     void TENTACLE_API StartScanning();
     void TENTACLE_API StopScanning();
+
+    // 0 Debug (every advertisement), 1 Info (default), 2 Warning, 3 Error, 4 None.
+    void TENTACLE_API SetLogLevel(int level);
 }
@@ -27,6 +27,7 @@ namespace Unity.LiveCapture.VirtualCamera.Editor
         SerializedProperty m_FrameRateProp;
         SerializedProperty m_QualityProp;
         SerializedProperty m_PrioritizeLatencyProp;
+        SerializedProperty m_IntraRefreshFramesProp;
 
         VideoEncoder[] m_EncodersSupportedOnPlatform;
         GUIContent[] m_EncoderOptions;
@@ -93,6 +94,7 @@ namespace Unity.LiveCapture.VirtualCamera.Editor
                 EditorGUILayout.PropertyField(m_FrameRateProp);
                 EditorGUILayout.PropertyField(m_QualityProp);
                 EditorGUILayout.PropertyField(m_PrioritizeLatencyProp);
+                EditorGUILayout.PropertyField(m_IntraRefreshFramesProp);
 
                 if (change.changed)
                 {
@@ -131,6 +133,7 @@ namespace Unity.LiveCapture.VirtualCamera.Editor
             m_FrameRateProp = m_SerializedObject.FindProperty("m_FrameRate");
             m_QualityProp = m_SerializedObject.FindProperty("m_Quality");
             m_PrioritizeLatencyProp = m_SerializedObject.FindProperty("m_PrioritizeLatency");
+            m_IntraRefreshFramesProp = m_SerializedObject.FindProperty("m_IntraRefreshFrames");
 
             m_EncodersSupportedOnPlatform = Enum.GetValues(typeof(VideoEncoder))
                 .Cast<VideoEncoder>()
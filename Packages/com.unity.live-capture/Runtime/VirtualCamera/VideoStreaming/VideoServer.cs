@@ -64,6 +64,7 @@ namespace Unity.LiveCapture.VirtualCamera
             if (m_VideoStreamingServer != null)
             {
                 m_VideoStreamingServer.requestedEncoder = VideoServerSettings.Instance.Encoder;
+                m_VideoStreamingServer.intraRefreshFrames = VideoServerSettings.Instance.IntraRefreshFrames;
             }
         }
 
@@ -76,7 +77,8 @@ namespace Unity.LiveCapture.VirtualCamera
             {
                 m_VideoStreamingServer = new VideoStreamingServer
                 {
-                    requestedEncoder = VideoServerSettings.Instance.Encoder
+                    requestedEncoder = VideoServerSettings.Instance.Encoder,
+                    intraRefreshFrames = VideoServerSettings.Instance.IntraRefreshFrames,
                 };
             }
 
@@ -85,6 +87,10 @@ namespace Unity.LiveCapture.VirtualCamera
                 try
                 {
                     m_VideoStreamingServer.Start();
+
+                    // Creates the encoder session before the first client connects.
+                    var resolution = GetResolution();
+                    m_VideoStreamingServer.PrewarmEncoder(resolution.x, resolution.y, GetFrameRate(), GetBitRate());
                 }
                 catch (Exception e)
                 {
@@ -187,7 +193,26 @@ namespace Unity.LiveCapture.VirtualCamera
         void IVideoStreamSink.ConsumeFrame(DirectAccessVideoFrameRequest frame)
         {
             if (m_VideoStreamingServer != null)
-                m_VideoStreamingServer.EnqueueFrame(frame, GetFrameRate(), GetBitRate());
+                m_VideoStreamingServer.EnqueueFrame(frame, GetFrameRate(), GetBitRate(), GetTimecode());
+        }
+
+        /// <summary>
+        /// Gets the timecode written in the encoded frames, which is the time shown by the companion app.
+        /// </summary>
+        /// <returns>The packed timecode, or 0 if the take recorder has no valid frame rate.</returns>
+        static uint GetTimecode()
+        {
+            var frameRate = TakeRecorder.FrameRate;
+
+            if (!frameRate.IsValid)
+                return 0;
+
+            var time = !TakeRecorder.IsPreviewPlaying() && TakeRecorder.IsRecording()
+                ? TakeRecorder.GetRecordingElapsedTime()
+                : TakeRecorder.GetPreviewTime();
+            var timecode = Timecode.FromSeconds(frameRate, time);
+
+            return EncoderUtilities.PackTimecode(timecode.Hours, timecode.Minutes, timecode.Seconds, timecode.Frames, timecode.IsDropFrame);
         }
 
         void SetActiveCamera(Camera camera)
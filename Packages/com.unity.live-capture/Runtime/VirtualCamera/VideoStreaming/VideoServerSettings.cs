@@ -10,6 +10,7 @@ namespace Unity.LiveCapture.VirtualCamera
         const float k_MinResolutionScale = 0.1f;
         const float k_MaxQuality = 100f;
         const int k_MaxFrameRate = 60;
+        const int k_MaxIntraRefreshFrames = 60;
 
         [SerializeField, Tooltip("The preferred encoder to use for video streaming.")]
         VideoEncoder m_Encoder;
@@ -24,6 +25,9 @@ namespace Unity.LiveCapture.VirtualCamera
         float m_Quality;
         [SerializeField, Tooltip("Attempt to minimize the latency of retrieving rendered frames from the GPU at the cost of performance. If you encounter stuttering in the editor while enabled, try reducing the resolution.")]
         bool m_PrioritizeLatency;
+        [SerializeField, Tooltip("The number of frames over which the encoder gradually refreshes the picture instead of sending key frames. This avoids the bit-rate peaks of key frames, but a client takes that many frames to recover after a packet loss. Set to 0 to use key frames. Only supported by the NVIDIA encoder.")]
+        [Range(0, k_MaxIntraRefreshFrames)]
+        int m_IntraRefreshFrames;
 
         /// <summary>
         /// The preferred encoder to use for video streaming.
@@ -53,6 +57,14 @@ namespace Unity.LiveCapture.VirtualCamera
         /// </summary>
         public bool PrioritizeLatency => m_PrioritizeLatency;
 
+        /// <summary>
+        /// The number of frames over which the encoder gradually refreshes the picture instead of sending key frames.
+        /// </summary>
+        /// <remarks>
+        /// Set to 0 to use key frames. Only supported by the NVIDIA encoder.
+        /// </remarks>
+        public int IntraRefreshFrames => m_IntraRefreshFrames;
+
         void OnValidate()
         {
             if (EncoderUtilities.IsSupported(m_Encoder) == EncoderSupport.NotSupportedOnPlatform)
@@ -63,6 +75,7 @@ namespace Unity.LiveCapture.VirtualCamera
             m_ResolutionScale = Mathf.Clamp(m_ResolutionScale, k_MinResolutionScale, 1f);
             m_FrameRate = Mathf.Clamp(m_FrameRate, 1, k_MaxFrameRate);
             m_Quality = Mathf.Clamp(m_Quality, 1f, k_MaxQuality);
+            m_IntraRefreshFrames = Mathf.Clamp(m_IntraRefreshFrames, 0, k_MaxIntraRefreshFrames);
         }
 
         /// <summary>
@@ -75,6 +88,7 @@ namespace Unity.LiveCapture.VirtualCamera
             m_FrameRate = 60;
             m_Quality = 50f;
             m_PrioritizeLatency = true;
+            m_IntraRefreshFrames = 0;
         }
     }
 }
@@ -6,19 +6,19 @@
 
 #if ENABLE_TRACE
 #include <codecvt>
-#include <chrono>
-#include <fstream>
 #include <locale>
-#include <mutex>
+#endif
+
 #include <sstream>
 
-static std::ofstream g_logFile;
+#include "NativeLog.h"
+
+// Messages are formatted only if their level is enabled, and written to the log by a background
+// thread. ENABLE_TRACE logs everything by default and adds the verbose diagnostics.
 #define TRACE_HEX(val) std::hex << std::uppercase << val << std::nouppercase << std::dec
-#define TRACE_TIMESTAMP (std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::time_point_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now()).time_since_epoch()).count())
-#define TRACE(msg) { std::stringstream os; os << TRACE_TIMESTAMP << " | " << msg << std::endl; g_logFile << os.str(); g_logFile.flush(); }
-#else
-#define TRACE(msg) {}
-#endif
+#define TRACE_LEVEL(level, msg) { if (NativeLog::IsEnabled(level)) { std::ostringstream os; os << msg; NativeLog::Write(level, os.str().c_str()); } }
+#define TRACE(msg) TRACE_LEVEL(NativeLog::Level::Debug, msg)
+#define TRACE_ERROR(msg) TRACE_LEVEL(NativeLog::Level::Error, msg)
 
 #include <array>
 #include <codecapi.h>
@@ -31,10 +31,17 @@ static std::ofstream g_logFile;
 #include <vector>
 #include <wmcodecdsp.h>
 
+#include "EncoderStatistics.h"
+#include "ParameterSetParser.h"
+
 #pragma comment(lib, "mfplat.lib")
 #pragma comment(lib, "mfuuid.lib")
 #pragma comment(lib, "wmcodecdspuuid.lib")
 
+// The parameter set parser and the encoder statistics are shared with the other plugins.
+using namespace Bitstream;
+using namespace Statistics;
+
 _COM_SMARTPTR_TYPEDEF(ICodecAPI, IID_ICodecAPI);
 _COM_SMARTPTR_TYPEDEF(IMFAttributes, IID_IMFAttributes);
 _COM_SMARTPTR_TYPEDEF(IMFMediaType, IID_IMFMediaType);
@@ -47,7 +54,7 @@ _COM_SMARTPTR_TYPEDEF(IMFTransform, IID_IMFTransform);
     const HRESULT hr = hrSrc; \
 	if (hr != S_OK) \
 	{ \
-        TRACE(msg << ". Error: " << TRACE_HEX(hr)); \
+        TRACE_ERROR(msg << ". Error: " << TRACE_HEX(hr)); \
 		return false; \
 	} \
 }
@@ -281,6 +288,28 @@ public:
 		return true;
 	}
 
+	// Changes the rate control of the current stream: the encoder applies the new mean bit rate from the
+	// next input sample, without starting a new GOP. The frame rate only changes the sample durations.
+	bool UpdateRateControl(
+		const uint32_t frameRateNumerator,
+		const uint32_t frameRateDenominator,
+		const uint32_t averageBitRate)
+	{
+		TRACE("H264Encoder::UpdateRateControl @" << frameRateNumerator << "/" << frameRateDenominator << "fps, " << averageBitRate << " bps");
+
+		if (!m_Codec || frameRateNumerator == 0 || frameRateDenominator == 0)
+			return false;
+
+		VARIANT var = { 0 };
+		var.vt = VT_UI4;
+		var.ulVal = averageBitRate;
+		CHECK_HR_RET(m_Codec->SetValue(&CODECAPI_AVEncCommonMeanBitRate, &var), "Failed to set mean bit rate");
+
+		m_FrameRateNumerator = frameRateNumerator;
+		m_FrameRateDenominator = frameRateDenominator;
+		return true;
+	}
+
     uint32_t GetSps(uint8_t* const spsOut)
     {
 		if (spsOut != nullptr)
@@ -297,9 +326,8 @@ public:
 
 	bool Encode(const uint8_t* const pixelData, const uint64_t timeStampNs)
 	{
-#if ENABLE_TRACE
-		auto start = TRACE_TIMESTAMP;
-#endif
+		FrameTimings timings;
+		timings.encodeTime = EncoderStatistics::Now();
 		TRACE("H264Encoder::Encode begin");
 		const DWORD bufferSize =
 #if USE_TEST_CONTENT
@@ -339,6 +367,9 @@ public:
 		TRACE("IMFMediaBuffer::SetCurrentLength");
 		CHECK_HR_RET(mediaBuffer->SetCurrentLength(bufferSize), "Could not set buffer length");
 
+		const auto copyTime = EncoderStatistics::Now();
+		m_Statistics.RecordStage(EncoderStage::Copy, timings.encodeTime, copyTime);
+
 		TRACE("IMFSample::SetSampleTime");
 		const LONGLONG sampleTimeHNS = timeStampNs / 100;
 		CHECK_HR_RET(mediaSample->SetSampleTime(sampleTimeHNS), "Could not set sample time");
@@ -352,18 +383,25 @@ public:
 		if (!SUCCEEDED(hr))
 		{
 			TRACE("The resampler H264 ProcessInput call failed");
+			if (hr == MF_E_NOTACCEPTING)
+				m_Statistics.RecordInputDropped();
 			return false;
 		}
 
-		TRACE("H264Encoder::Encode done: " << (TRACE_TIMESTAMP - start));
+		timings.submitTime = EncoderStatistics::Now();
+		m_Statistics.RecordStage(EncoderStage::Submit, copyTime, timings.submitTime);
+		m_Statistics.RecordSubmitted();
+
+		// Matched with the output sample by its sample time in BeginConsume.
+		m_PendingTimings[m_SubmittedFrameCount % m_PendingTimings.size()] = { sampleTimeHNS, timings };
+		m_SubmittedFrameCount++;
+
+		TRACE("H264Encoder::Encode done");
 		return true;
     }
 
 	bool BeginConsume(uint32_t& sizeOut)
 	{
-#if ENABLE_TRACE
-		auto start = TRACE_TIMESTAMP;
-#endif
 		TRACE("H264Encoder::BeginConsume");
 		// Make sure the previous consume is completed before starting another one.
 		if (m_OutputData.pSample != nullptr)
@@ -421,6 +459,15 @@ public:
 		if (!GetNextEncodedBuffer())
 			return false;
 
+		// The transform is polled, so the bitstream is ready when BeginConsume picks it up and the
+		// Queue stage is always empty.
+		m_ConsumedTimings = FindPendingTimings(m_OutputData.pSample);
+		m_ConsumedTimings.readyTime = EncoderStatistics::Now();
+		m_ConsumedTimings.consumeTime = m_ConsumedTimings.readyTime;
+		m_Statistics.RecordStage(EncoderStage::Encode, m_ConsumedTimings.submitTime, m_ConsumedTimings.readyTime);
+		m_Statistics.RecordStage(EncoderStage::Queue, m_ConsumedTimings.readyTime, m_ConsumedTimings.consumeTime);
+		m_OutputFrameCount++;
+
 		// If the output buffer is not set at this point, it's because the transform provide IMFSamples, so it's our
 		// job to extract the buffer from the sample.
 		if (!m_OutputBuffer)
@@ -437,7 +484,7 @@ public:
 		// FIXME: Trying something. If we expose the prefix as well, this triggers H264 slicing in the
 		// client, which will do the same job we'd have to do on the RTP packetization side. Give it a try...
 		sizeOut = length; //  -kAnnexBPrefixSize;
-		TRACE("H264Encoder::BeginConsume done: " << (TRACE_TIMESTAMP - start));
+		TRACE("H264Encoder::BeginConsume done");
 		return true;
 	}
     
@@ -493,6 +540,11 @@ public:
 		else
 			isKeyFrame = isKey != 0;
 
+		const auto now = EncoderStatistics::Now();
+		m_Statistics.RecordEncoded(bufLength, isKeyFrame, now);
+		m_Statistics.RecordStage(EncoderStage::Consume, m_ConsumedTimings.consumeTime, now);
+		m_Statistics.RecordStage(EncoderStage::Total, m_ConsumedTimings.encodeTime, now);
+
 		TRACE("H264Encoder::EndConsume isKeyFrame: " << isKey);
 		if (!isKeyFrame)
 			return true;
@@ -502,8 +554,39 @@ public:
 		return ParseSpsPps();
 	}
 
+	void GetStats(EncoderStats& stats) const
+	{
+		m_Statistics.GetStats(stats);
+
+		// Encoded frames are pulled from the transform one at a time, nothing is queued or dropped on output.
+		const uint64_t outputFrameCount = m_OutputFrameCount;
+		stats.droppedOutputFrameCount = 0;
+		stats.queueDepth = m_OutputData.pSample != nullptr ? 1 : 0;
+		stats.inFlightFrameCount = static_cast<uint32_t>(m_SubmittedFrameCount - outputFrameCount);
+	}
+
 private:
 
+	struct PendingTimings
+	{
+		LONGLONG     sampleTime;
+		FrameTimings timings;
+	};
+
+	FrameTimings FindPendingTimings(IMFSample* sample) const
+	{
+		LONGLONG sampleTime = 0;
+		if (sample != nullptr && sample->GetSampleTime(&sampleTime) == S_OK)
+		{
+			for (const auto& pending : m_PendingTimings)
+			{
+				if (pending.sampleTime == sampleTime)
+					return pending.timings;
+			}
+		}
+		return FrameTimings();
+	}
+
 	bool ParseSpsPps()
 	{
         IMFMediaTypePtr mediaType;
@@ -532,9 +615,9 @@ private:
 			return false;
 		}
 
-		// Media Foundation H.264 encoder uses the 4-bytes Annex B format (not AVCC), so each NALU is
-		// prefixed with 0x00000001.
-		const std::array<uint8_t, 4> naluHeader = { 0x00, 0x00, 0x00, 0x01 };
+		// Media Foundation H.264 encoder uses the Annex B format (not AVCC), so each NALU is prefixed
+		// with 0x000001, or 0x00000001 which ends with the same 3 bytes.
+		const std::array<uint8_t, 3> naluHeader = { 0x00, 0x00, 0x01 };
 		auto firstNaluIt = std::search(std::begin(sequenceHeaderData), std::end(sequenceHeaderData),
 			std::begin(naluHeader), std::end(naluHeader));
 
@@ -560,15 +643,19 @@ private:
 			return false;
 		}
 
-		if (std::distance(secondNaluIt, sequenceHeaderData.end()) <= 4)
+		if (std::distance(secondNaluIt, sequenceHeaderData.end()) <= static_cast<ptrdiff_t>(naluHeader.size()))
 		{
 			TRACE("second nalu size too small.");
 			return false;
 		}
 
-		// Skip the nalu header to just keep the data.
+		// Skip the nalu header to just keep the data. The zero byte preceding the second header belongs
+		// to it when it is 4 bytes long.
 		firstNaluIt += naluHeader.size();
-		std::vector<uint8_t> firstNalu(firstNaluIt, secondNaluIt);
+		auto firstNaluEndIt = secondNaluIt;
+		if (firstNaluEndIt != firstNaluIt && *(firstNaluEndIt - 1) == 0x00)
+			--firstNaluEndIt;
+		std::vector<uint8_t> firstNalu(firstNaluIt, firstNaluEndIt);
 
 		// Skip the nalu header to just keep the data.
 		secondNaluIt += naluHeader.size();
@@ -616,9 +703,26 @@ private:
 			return false;
 		}
 
+		RewriteSps();
 		return true;
 	}
 
+	// The constrained baseline profile has no B-frames, so the SPS is rewritten for decoders to output
+	// each frame as soon as it is decoded. The media type gives the same SPS for every key frame of a session,
+	// which is only rewritten once.
+	void RewriteSps()
+	{
+		if (m_Sps != m_SourceSps)
+		{
+			m_SourceSps = m_Sps;
+			if (!RewriteSpsForLowLatency(VideoCodec::H264, m_Sps.data(), static_cast<uint32_t>(m_Sps.size()), m_RewrittenSps))
+				TRACE_LEVEL(NativeLog::Level::Warning, "The SPS could not be rewritten for low latency decoding.");
+		}
+
+		if (!m_RewrittenSps.empty())
+			m_Sps = m_RewrittenSps;
+	}
+
 	bool GetNextEncodedBuffer()
 	{
 		DWORD processOutputStatus = 0;
@@ -644,45 +748,76 @@ private:
 	IMFSamplePtr           m_OutputSample;
 	std::vector<uint8_t>   m_Sps;
 	std::vector<uint8_t>   m_Pps;
+	std::vector<uint8_t>   m_SourceSps;
+	std::vector<uint8_t>   m_RewrittenSps;
+
+	EncoderStatistics               m_Statistics;
+	std::array<PendingTimings, 8>   m_PendingTimings = {};
+	FrameTimings                    m_ConsumedTimings;
+	std::atomic<uint64_t>           m_SubmittedFrameCount = { 0 };
+	std::atomic<uint64_t>           m_OutputFrameCount = { 0 };
 #if USE_TEST_CONTENT
 	std::vector<uint8_t>   m_TempImage;
 #endif
 };
 
-#if ENABLE_TRACE
-static std::once_flag InitLogOnce;
-void InitLog()
+static void StartLog()
 {
+#if ENABLE_TRACE
+	NativeLog::SetLevel(NativeLog::Level::Debug);
+#endif
+
 	std::array<char, 32768> home;
 	DWORD length = GetEnvironmentVariableA("USERPROFILE", home.data(), static_cast<DWORD>(home.size()));
-	if (length == 0)
-		return;
-	std::string logPath(home.data());
-	logPath.append("\\H264Encoder.log");
-	g_logFile.open(logPath, std::fstream::out | std::fstream::trunc);
+	std::string logPath;
+	if (length != 0)
+	{
+		logPath = home.data();
+		logPath.append("\\H264Encoder.log");
+	}
+	NativeLog::Start(logPath, false);
 }
-#endif
 
 #define PINVOKE_ENTRY_POINT extern "C" __declspec(dllexport)
 
+// Version of the exports, raised whenever an export is added or changes, so that the managed side only
+// calls the exports the loaded binary has.
+static const int32_t k_PluginApiVersion = 1;
+
+// A binary without this export only has Create, Destroy, Encode, BeginConsume, EndConsume, GetSps and GetPps.
+PINVOKE_ENTRY_POINT int32_t GetApiVersion()
+{
+	return k_PluginApiVersion;
+}
+
 PINVOKE_ENTRY_POINT H264Encoder* Create(uint32_t width, uint32_t height, uint32_t frameRateNumerator, uint32_t frameRateDenominator, uint32_t averageBitRate, uint32_t gopSize)
 {
-#if ENABLE_TRACE
-	std::call_once(InitLogOnce, InitLog);
-#endif
+	// The log stays open while at least one encoder exists.
+	StartLog();
 
 	std::unique_ptr<H264Encoder> encoder(new H264Encoder());
 
 	if (encoder->Initialize(width, height, frameRateNumerator, frameRateDenominator, averageBitRate, gopSize))
 		return encoder.release();
 
+	encoder.reset();
+	NativeLog::Stop();
 	return nullptr;
 }
 
 PINVOKE_ENTRY_POINT bool Destroy(H264Encoder* encoder)
 {
+	if (encoder == nullptr)
+		return false;
+
 	delete encoder;
-	return encoder != nullptr;
+	NativeLog::Stop();
+	return true;
+}
+
+PINVOKE_ENTRY_POINT bool UpdateRateControl(H264Encoder* encoder, uint32_t frameRateNumerator, uint32_t frameRateDenominator, uint32_t averageBitRate)
+{
+	return encoder != nullptr && encoder->UpdateRateControl(frameRateNumerator, frameRateDenominator, averageBitRate);
 }
 
 PINVOKE_ENTRY_POINT uint32_t GetSps(H264Encoder* encoder, uint8_t* spsOut)
@@ -710,3 +845,18 @@ PINVOKE_ENTRY_POINT bool EndConsume(H264Encoder* encoder, uint8_t* dst, uint64_t
 	return encoder != nullptr && dst != nullptr && timeStampNsOut != nullptr && isKeyFrameOut != nullptr && 
 		encoder->EndConsume(dst, *timeStampNsOut, *isKeyFrameOut);
 }
+
+PINVOKE_ENTRY_POINT bool GetEncoderStats(H264Encoder* encoder, EncoderStats* statsOut)
+{
+	if (encoder == nullptr || statsOut == nullptr)
+		return false;
+
+	encoder->GetStats(*statsOut);
+	return true;
+}
+
+// Sets the minimum level of the messages written to the log: 0 Debug, 1 Info, 2 Warning, 3 Error, 4 None.
+PINVOKE_ENTRY_POINT void SetLogLevel(int level)
+{
+	NativeLog::SetLevel(static_cast<NativeLog::Level>(level));
+}
@@ -9,6 +9,12 @@
 
 #include <vector>
 #include <queue>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #import <CoreMedia/CoreMedia.h>
 #import <CoreVideo/CoreVideo.h>
@@ -18,6 +24,11 @@
 
 #include "PluginUtils.hpp"
 #include "MacOSEncoderSessionDataPlugin.hpp"
+#include "EncoderProfiler.h"
+#include "SubmissionQueue.h"
+#include "AvccConverter.hpp"
+#include "ParameterSetParser.h"
+#include "TimecodeSei.hpp"
 
 namespace MacOsEncodingPlugin
 {
@@ -42,30 +53,82 @@ enum class MacOSEncoderStatus
 
 class MetalGraphicsEncoderDevice;
 
+// A frame copied by the render thread, waiting to be submitted to VideoToolbox.
+struct SubmitCommand
+{
+    uint32_t frameIndex;
+    uint64_t frameCount;
+    uint64_t copyTime;
+};
+
+// Counts the copies executed by the GPU. Shared with the command buffer completion handlers, which can
+// run after the encoder is disposed.
+struct CopyFence
+{
+    std::mutex              lock;
+    std::condition_variable condition;
+    uint64_t                completedCount = 0;
+    bool                    isClosed = false;
+};
+
 class H264Encoder
 {
     
 public: // Methods
     
-    H264Encoder(const MacOSEncoderSessionData& frameData, MetalGraphicsEncoderDevice* const device);
+    H264Encoder(const MacOSEncoderSessionData& frameData,
+                MetalGraphicsEncoderDevice* const device,
+                const EncoderPipelineDepth& depth = EncoderPipelineDepth::FromSettings(EncoderPipelineMode::Default, 0, 0),
+                VideoCodec codec = VideoCodec::H264);
     ~H264Encoder();
     
     void Initialize(bool useSRGB, bool allocateBuffers = true);
     void Dispose();
-    bool EncodeFrame(void* frameSource, unsigned long long int timestamp);
+    
+    // Only enqueues the copy of the frame, it is submitted by the submission thread. The timecode is packed
+    // as in EncoderTextureID.
+    bool EncodeFrame(void* frameSource, unsigned long long int timestamp, uint32_t timecode = 0);
+    
+    // Applies new bit rate and frame rate values to the live session, without a key frame. Returns false
+    // if other settings changed, which requires a new session.
+    bool UpdateRateControl(const MacOSEncoderSessionData& frameData);
     
     bool RemoveEncodedFrame();
     EncodedFrame*  GetEncodedFrame();
+    void GetStats(EncoderStats& stats) const;
     
     inline bool IsInitialized() { return m_InitializationResult == MacOSEncoderStatus::Success; }
+    inline VideoCodec GetCodec() const { return m_Codec; }
     inline std::queue<EncodedFrame>& GetFrameQueue() { return m_FrameQueue; }
-    inline int GetMaxQueueLength() const { return k_MaxQueueLength; }
-    inline unsigned long long int GetLatestTimestamp() { return m_LatestTimestamp; }
+    inline size_t GetMaxQueueLength() const { return m_MaxQueueLength; }
+    
+    // Called by the VideoToolbox output callback.
+    inline EncoderStatistics& GetStatistics() { return m_Statistics; }
+    inline FrameTimings& GetSubmittedTimings(uintptr_t frameIndex) { return m_SubmittedTimings[frameIndex % m_BufferedFrameNumbers]; }
+    inline const TimecodeSei& GetSubmittedTimecode(uintptr_t frameIndex) const { return m_SubmittedTimecodes[frameIndex % m_BufferedFrameNumbers]; }
+    inline void OnFrameCompleted(uintptr_t frameIndex)
+    {
+        m_InFlightFrameCount--;
+        m_IsBufferBusy[frameIndex % m_BufferedFrameNumbers] = false;
+    }
+    inline void OnFrameDropped() { m_DroppedOutputFrameCount++; }
+    
+    // Image buffers of the consumed and dropped frames, reused by the next encoded frames so that the
+    // output callback doesn't allocate once warmed up. Called by the output callback and the consumer.
+    std::vector<uint8_t> AcquireImageBuffer();
+    void ReleaseImageBuffer(std::vector<uint8_t>&& buffer);
+    
+    // Called by the output callback on key frames. The session doesn't reorder frames, so the SPS of the
+    // format description is replaced by its rewrite for low latency decoding, computed once per SPS.
+    void RewriteSps(std::vector<uint8_t>& sps);
     
 private: // Members
 
-    static const NSInteger k_BufferedFrameNumbers = 3;
-    static const int k_MaxQueueLength = 8;
+    // Only the first m_BufferedFrameNumbers buffers are used, as set by the pipeline depth.
+    static const uint32_t k_MaxBufferedFrameNumbers = k_MaxFramesInFlight;
+    const uint32_t m_BufferedFrameNumbers;
+    const size_t   m_MaxQueueLength;
+    const VideoCodec m_Codec;
     
     MetalGraphicsEncoderDevice* m_GraphicDevice;
     VTCompressionSessionRef     m_EncodingSession;
@@ -76,10 +139,32 @@ private: // Members
     MacOSEncoderSessionData     m_FrameData;
     uint64                      m_FrameCount;
     
-    CVPixelBufferRef            m_PixelBuffers[k_BufferedFrameNumbers];
-    id<MTLTexture>              m_RenderTextures[k_BufferedFrameNumbers];
+    // Read by the submission thread, which also owns the presentation time.
+    std::atomic<int>            m_FrameRate;
+    CMTime                      m_PresentationTimeStamp;
+    
+    CVPixelBufferRef            m_PixelBuffers[k_MaxBufferedFrameNumbers];
+    id<MTLTexture>              m_RenderTextures[k_MaxBufferedFrameNumbers];
     std::queue<EncodedFrame>    m_FrameQueue;
-    unsigned long long int      m_LatestTimestamp;
+    
+    EncoderStatistics           m_Statistics;
+    FrameTimings                m_SubmittedTimings[k_MaxBufferedFrameNumbers];
+    TimecodeSei                 m_SubmittedTimecodes[k_MaxBufferedFrameNumbers] = {};
+    std::atomic<uint32_t>       m_InFlightFrameCount = { 0 };
+    std::atomic<uint64_t>       m_DroppedOutputFrameCount = { 0 };
+    std::atomic<bool>           m_IsBufferBusy[k_MaxBufferedFrameNumbers] = {};
+    
+    static const size_t               k_MaxPooledImageBuffers = 4;
+    std::mutex                        m_ImageBufferLock;
+    std::vector<std::vector<uint8_t>> m_ImageBuffers;
+    
+    // Owned by the output callback.
+    std::vector<uint8_t>              m_SourceSps;
+    std::vector<uint8_t>              m_RewrittenSps;
+    
+    Threading::SubmissionQueue<SubmitCommand, k_MaxBufferedFrameNumbers> m_SubmissionQueue;
+    std::thread                 m_SubmissionThread;
+    std::shared_ptr<CopyFence>  m_CopyFence;
     
 private: // Methods
     
@@ -90,6 +175,10 @@ private: // Methods
     void releaseBuffers();
     
     bool copyBuffer(void* frameSource, int frameIndex);
+    bool waitForCopy(uint64_t copyCount);
+    void submitFrame(const SubmitCommand& command);
+    
+    static void submitFramesAsync(H264Encoder* encoder);
 };
 
 }
@@ -5,19 +5,29 @@
 
 namespace MacOsEncodingPlugin
 {
-    const NSInteger H264Encoder::k_BufferedFrameNumbers;
-    const int H264Encoder::k_MaxQueueLength;
+    // The encoders are allocated with new, which doesn't support over-aligned types in C++14.
+    static_assert(alignof(H264Encoder) <= alignof(std::max_align_t), "H264Encoder must not be over-aligned, see CacheLine.h.");
+
+    const uint32_t H264Encoder::k_MaxBufferedFrameNumbers;
 
     H264Encoder::H264Encoder(const MacOSEncoderSessionData& frameData,
-                             MetalGraphicsEncoderDevice* const device)
-        : m_GraphicDevice(device)
+                             MetalGraphicsEncoderDevice* const device,
+                             const EncoderPipelineDepth& depth,
+                             VideoCodec codec)
+        : m_BufferedFrameNumbers(depth.framesInFlight)
+        , m_MaxQueueLength(depth.maxQueueLength)
+        , m_Codec(codec)
+        , m_GraphicDevice(device)
         , m_EncodingSession(nullptr)
         , m_SessionCreated(false)
         , m_InitializationResult(MacOSEncoderStatus::NotInitialized)
         , m_FrameData(frameData)
         , m_FrameCount(0)
+        , m_FrameRate(frameData.frameRate)
+        , m_PresentationTimeStamp(kCMTimeZero)
     {
-        WriteFileDebug("Info: [H264Encoder()] - Constructor called.\n");
+        WriteFileDebug(LogLevel::Info, "Info: [H264Encoder()] - Constructor called.\n");
+        WriteFileDebug(LogLevel::Info, "Info: [H264Encoder()] - Frames in flight: ", static_cast<int>(m_BufferedFrameNumbers));
     }
     
     H264Encoder::~H264Encoder()
@@ -36,6 +46,8 @@ namespace MacOsEncodingPlugin
         {
             m_InitializationResult = MacOSEncoderStatus::Success;
             m_SessionCreated = true;
+            m_CopyFence = std::make_shared<CopyFence>();
+            m_SubmissionThread = std::thread(submitFramesAsync, this);
         }
         else
         {
@@ -46,21 +58,69 @@ namespace MacOsEncodingPlugin
 
     void H264Encoder::Dispose()
     {
-        WriteFileDebug("Info: ~[H264Encoder()] - Dispose.\n");
+        WriteFileDebug(LogLevel::Info, "Info: ~[H264Encoder()] - Dispose.\n");
+
+        // The copies still queued may never complete: Unity commits their command buffer after this
+        // render event. Their frames are dropped.
+        if (m_SubmissionThread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_CopyFence->lock);
+                m_CopyFence->isClosed = true;
+            }
+            m_CopyFence->condition.notify_all();
+            m_SubmissionQueue.Close();
+            m_SubmissionThread.join();
+            m_SubmissionQueue.Reset();
+        }
 
         if (m_EncodingSession == nullptr)
             return;
         
-        WriteFileDebug("Info: ~[H264Encoder()] - encoding session is valid.\n");
+        WriteFileDebug(LogLevel::Info, "Info: ~[H264Encoder()] - encoding session is valid.\n");
     
         endSession();
         m_EncodingSession = nullptr;
         m_SessionCreated = false;
     }
 
-    void postEncodeParser(H264Encoder* encoder, CMSampleBufferRef sampleBuffer)
+    // Reads a parameter set of the format description, with the function of the session codec.
+    static OSStatus getParameterSetAtIndex(VideoCodec codec,
+                                           CMFormatDescriptionRef description,
+                                           size_t index,
+                                           const uint8_t** parameterSet,
+                                           size_t* parameterSetSize,
+                                           size_t* parameterSetCount,
+                                           int* nalUnitHeaderLength)
+    {
+        if (codec == VideoCodec::HEVC)
+            return CMVideoFormatDescriptionGetHEVCParameterSetAtIndex(description,
+                                                                      index,
+                                                                      parameterSet,
+                                                                      parameterSetSize,
+                                                                      parameterSetCount,
+                                                                      nalUnitHeaderLength);
+        
+        return CMVideoFormatDescriptionGetH264ParameterSetAtIndex(description,
+                                                                  index,
+                                                                  parameterSet,
+                                                                  parameterSetSize,
+                                                                  parameterSetCount,
+                                                                  nalUnitHeaderLength);
+    }
+    
+    void postEncodeParser(H264Encoder* encoder, CMSampleBufferRef sampleBuffer, uintptr_t frameIndex)
     {
+        const auto codec = encoder->GetCodec();
+        
+        ProfilerScope profilerScope(ProfilerMarker::PostEncodeParser);
+        
         EncodedFrame encodedFrameClass;
+        encodedFrameClass.timings = encoder->GetSubmittedTimings(frameIndex);
+        encodedFrameClass.timings.readyTime = EncoderStatistics::Now();
+        
+        auto& statistics = encoder->GetStatistics();
+        statistics.RecordStage(EncoderStage::Encode, encodedFrameClass.timings.submitTime, encodedFrameClass.timings.readyTime);
         
         CFArrayRef attachments = CMSampleBufferGetSampleAttachmentsArray(sampleBuffer, false);
         
@@ -76,143 +136,121 @@ namespace MacOsEncodingPlugin
         
         int nalu_header_size = 0;
         size_t param_set_count = 0;
-        OSStatus status = CMVideoFormatDescriptionGetH264ParameterSetAtIndex(description,
-                                                                             0,
-                                                                             nullptr,
-                                                                             nullptr,
-                                                                             &param_set_count,
-                                                                             &nalu_header_size);
+        OSStatus status = getParameterSetAtIndex(codec,
+                                                 description,
+                                                 0,
+                                                 nullptr,
+                                                 nullptr,
+                                                 &param_set_count,
+                                                 &nalu_header_size);
         if (status != noErr)
         {
-            WriteFileDebug("Error: [postEncodeParser] - H264ParameterSetAtIndex failed.\n");
+            WriteFileDebug(LogLevel::Error, "Error: [postEncodeParser] - ParameterSetAtIndex failed.\n");
             return;
         }
         
         if (encodedFrameClass.isKeyFrame)
         {
-            // Variables for PPS/SPS
-            size_t spsSize = 0;
-            size_t ppsSize = 0;
-            
-            size_t spsCnt = 0;
-            size_t ppsCnt = 0;
-            
-            const uint8_t *sps = nullptr;
-            const uint8_t *pps = nullptr;
-            
-            // Get SPS
-            OSStatus status = CMVideoFormatDescriptionGetH264ParameterSetAtIndex(description,
-                                                                                 0,
-                                                                                 &sps,
-                                                                                 &spsSize,
-                                                                                 &spsCnt,
-                                                                                 0);
-            if (status != noErr)
+            // H.264 has an SPS and a PPS, HEVC a VPS, an SPS and a PPS: sort them by NAL unit type.
+            for (size_t i = 0; i < param_set_count; ++i)
             {
-                WriteFileDebug("Error: [postEncodeParser] - Get SPS failed.\n");
-                return;
-            }
-            
-            // Get PPS
-            status = CMVideoFormatDescriptionGetH264ParameterSetAtIndex(description,
-                                                                        1,
-                                                                        &pps,
-                                                                        &ppsSize,
-                                                                        &ppsCnt,
-                                                                        0);
-            if (status != noErr)
-            {
-                WriteFileDebug("Error: [postEncodeParser] - Get PPS failed.\n");
-                return;
+                const uint8_t* parameterSet = nullptr;
+                size_t parameterSetSize = 0;
+                
+                status = getParameterSetAtIndex(codec, description, i, &parameterSet, &parameterSetSize, nullptr, nullptr);
+                if (status != noErr || parameterSetSize == 0)
+                {
+                    WriteFileDebug(LogLevel::Error, "Error: [postEncodeParser] - Get parameter set failed.\n");
+                    return;
+                }
+                
+                const auto type = GetNalUnitType(codec, parameterSet[0]);
+                std::vector<uint8_t>* sequence = nullptr;
+                if (codec == VideoCodec::HEVC && type == k_HevcNalVps)
+                    sequence = &encodedFrameClass.vpsSequence;
+                else if (type == (codec == VideoCodec::HEVC ? k_HevcNalSps : k_H264NalSps))
+                    sequence = &encodedFrameClass.spsSequence;
+                else if (type == (codec == VideoCodec::HEVC ? k_HevcNalPps : k_H264NalPps))
+                    sequence = &encodedFrameClass.ppsSequence;
+                
+                if (sequence != nullptr && sequence->empty())
+                    sequence->assign(parameterSet, parameterSet + parameterSetSize);
             }
             
-            encodedFrameClass.spsSequence.insert(encodedFrameClass.spsSequence.end(),
-                                                 &sps[0],
-                                                 &sps[spsSize]);
-            
-            encodedFrameClass.ppsSequence.insert(encodedFrameClass.ppsSequence.end(),
-                                                 &pps[0],
-                                                 &pps[ppsSize]);
+            encoder->RewriteSps(encodedFrameClass.spsSequence);
+
+            const auto& vps = encodedFrameClass.vpsSequence;
+            const auto& sps = encodedFrameClass.spsSequence;
+            const auto& pps = encodedFrameClass.ppsSequence;
+            if (!ParseSequenceInfo(codec,
+                                   vps.data(), static_cast<uint32_t>(vps.size()),
+                                   sps.data(), static_cast<uint32_t>(sps.size()),
+                                   pps.data(), static_cast<uint32_t>(pps.size()),
+                                   encodedFrameClass.sequenceInfo))
+                WriteFileDebug(LogLevel::Warning, "Warning: [postEncodeParser] - The parameter sets could not be parsed.\n");
         }
         
         CMBlockBufferRef block_buffer = CMSampleBufferGetDataBuffer(sampleBuffer);
 
         if (block_buffer == nullptr)
         {
-            WriteFileDebug("Error: [postEncodeParser] - CMSampleBufferGetDataBuffer failed.\n");
+            WriteFileDebug(LogLevel::Error, "Error: [postEncodeParser] - CMSampleBufferGetDataBuffer failed.\n");
             return;
         }
         
-        CMBlockBufferRef contiguous_buffer = nullptr;
+        // VideoToolbox outputs the NAL units with 4 bytes length prefixes: they are copied once into a pooled
+        // buffer of the encoder, where the prefixes are replaced by start codes in place. The rare block
+        // buffers that are not contiguous are gathered first.
+        const size_t block_buffer_size = CMBlockBufferGetDataLength(block_buffer);
+        const uint8_t* avcc_data = nullptr;
+        std::vector<uint8_t> gathered_data;
         
-        // Make sure block buffer is contiguous.
-        if (!CMBlockBufferIsRangeContiguous(block_buffer, 0, 0))
+        if (CMBlockBufferIsRangeContiguous(block_buffer, 0, 0))
         {
-            WriteFileDebug("Info: [postEncodeParser] - Create contiguous buffer.\n");
-            status = CMBlockBufferCreateContiguous(nullptr,
-                                                   block_buffer,
-                                                   nullptr,
-                                                   nullptr,
-                                                   0,
-                                                   0,
-                                                   0,
-                                                   &contiguous_buffer);
-            if (status != noErr)
-            {
-                WriteFileDebug("Error: [postEncodeParser] - Buffer is not contiguous.\n");
-                return;
-            }
+            char* data_ptr = nullptr;
+            status = CMBlockBufferGetDataPointer(block_buffer, 0, nullptr, nullptr, &data_ptr);
+            avcc_data = reinterpret_cast<const uint8_t*>(data_ptr);
         }
         else
         {
-            contiguous_buffer = block_buffer;
-            CFRetain(contiguous_buffer);
-            block_buffer = nullptr;
+            WriteFileDebug(LogLevel::Info, "Info: [postEncodeParser] - Gather non contiguous buffer.\n");
+            gathered_data.resize(block_buffer_size);
+            status = CMBlockBufferCopyDataBytes(block_buffer, 0, block_buffer_size, gathered_data.data());
+            avcc_data = gathered_data.data();
         }
         
-        // Now copy the actual data.
-        char* data_ptr = nullptr;
-        size_t block_buffer_size = CMBlockBufferGetDataLength(contiguous_buffer);
-        status = CMBlockBufferGetDataPointer(contiguous_buffer,
-                                             0,
-                                             nullptr,
-                                             nullptr,
-                                             &data_ptr);
         if (status != noErr)
         {
-            WriteFileDebug("Error: [postEncodeParser] - Failed to get block buffer data.\n");
-            CFRelease(contiguous_buffer);
+            WriteFileDebug(LogLevel::Error, "Error: [postEncodeParser] - Failed to get block buffer data.\n");
             return;
         }
         
-        const char kAnnexBHeaderBytes[4] = {0, 0, 0, 1};
-        size_t bytes_remaining = block_buffer_size;
+        encodedFrameClass.imageData = encoder->AcquireImageBuffer();
+        const bool converted = ConvertAvccToAnnexB(codec,
+                                                   avcc_data,
+                                                   block_buffer_size,
+                                                   nalu_header_size,
+                                                   encodedFrameClass.imageData,
+                                                   encodedFrameClass.nalUnits);
         
-        while (bytes_remaining > 0)
+        if (!converted)
         {
-            uint32_t* uint32_data_ptr = reinterpret_cast<uint32*>(data_ptr);
-            uint32_t packet_size = CFSwapInt32BigToHost(*uint32_data_ptr);
-
-            encodedFrameClass.imageData.insert(encodedFrameClass.imageData.end(),
-                                               &kAnnexBHeaderBytes[0],
-                                               &kAnnexBHeaderBytes[4]);
-              
-            encodedFrameClass.imageData.insert(encodedFrameClass.imageData.end(),
-                                               data_ptr + nalu_header_size,
-                                               data_ptr + nalu_header_size + packet_size);
-    
-            size_t bytes_written = packet_size + nalu_header_size;
-              
-            bytes_remaining -= bytes_written;
-            data_ptr += bytes_written;
+            WriteFileDebug(LogLevel::Error, "Error: [postEncodeParser] - Failed to convert the block buffer data to Annex-B.\n");
+            encoder->ReleaseImageBuffer(std::move(encodedFrameClass.imageData));
+            return;
         }
         
-        if (bytes_remaining > 0)
-        {
-            WriteFileDebug("Error: [postEncodeParser] - bytes_remaining > 0.\n");
-        }
+        // The timing of the frame itself, the render thread may have submitted the next ones already.
+        const auto& timecode = encoder->GetSubmittedTimecode(frameIndex);
+        if (!InsertTimecodeSei(codec, timecode, encodedFrameClass.imageData, encodedFrameClass.nalUnits))
+            WriteFileDebug(LogLevel::Warning, "Warning: [postEncodeParser] - No slice data for the timecode SEI message.\n");
+        
+        encodedFrameClass.timestamp = timecode.timestamp;
+        
+        const auto frameSize = static_cast<uint32_t>(encodedFrameClass.imageData.size());
+        const auto encodeTime = encodedFrameClass.timings.readyTime - encodedFrameClass.timings.submitTime;
+        statistics.RecordEncoded(frameSize, encodedFrameClass.isKeyFrame, encodedFrameClass.timings.readyTime);
         
-        encodedFrameClass.timestamp = encoder->GetLatestTimestamp();
         auto& frameQueue = encoder->GetFrameQueue();
         
         if (frameQueue.size() < encoder->GetMaxQueueLength())
@@ -221,11 +259,20 @@ namespace MacOsEncodingPlugin
         }
         else
         {
-            WriteFileDebug("Warning: [postEncodeParser] - too much encoded frames in the queue.\n");
+            WriteFileDebug(LogLevel::Warning, "Warning: [postEncodeParser] - too much encoded frames in the queue.\n");
             
+            encoder->OnFrameDropped();
+            encoder->ReleaseImageBuffer(std::move(frameQueue.front().imageData));
             frameQueue.pop();
             frameQueue.push(std::move(encodedFrameClass));
         }
+        
+        if (EncoderProfiler::IsEnabled())
+        {
+            EncoderStats stats;
+            encoder->GetStats(stats);
+            EncoderProfiler::EmitCounters(stats, frameSize, encodeTime);
+        }
     }
 
     void postEncodeCallback(void *outputCallbackRefCon,
@@ -234,27 +281,38 @@ namespace MacOsEncodingPlugin
                             VTEncodeInfoFlags infoFlags,
                             CMSampleBufferRef sampleBuffer )
     {
-        if (status != noErr)
+        H264Encoder* encoder = reinterpret_cast<H264Encoder*>(outputCallbackRefCon);
+        
+        if(encoder == nullptr)
         {
-            WriteFileDebug("Error: [postEncodeCallback] - Frame received is invalid.\n");
+            WriteFileDebug(LogLevel::Error, "Error: [postEncodeCallback] - Params received are invalid.\n");
             return;
         }
         
-        if (!CMSampleBufferDataIsReady(sampleBuffer))
+        encoder->OnFrameCompleted(reinterpret_cast<uintptr_t>(sourceFrameRefCon));
+        
+        // The callback runs on VideoToolbox threads, register them once so that their samples are recorded.
+        static thread_local bool s_IsThreadRegistered = false;
+        if (!s_IsThreadRegistered)
         {
-            WriteFileDebug("Error: [postEncodeCallback] - Frame received is not ready.\n");
-            return;
+            EncoderProfiler::RegisterThread("VideoToolbox Output");
+            s_IsThreadRegistered = true;
         }
         
-        H264Encoder* encoder = reinterpret_cast<H264Encoder*>(outputCallbackRefCon);
+        if (status != noErr)
+        {
+            WriteFileDebug(LogLevel::Error, "Error: [postEncodeCallback] - Frame received is invalid.\n");
+            return;
+        }
         
-        if(encoder == nullptr)
+        if (!CMSampleBufferDataIsReady(sampleBuffer))
         {
-            WriteFileDebug("Error: [postEncodeCallback] - Params received are invalid.\n");
+            WriteFileDebug(LogLevel::Error, "Error: [postEncodeCallback] - Frame received is not ready.\n");
             return;
         }
         
-        postEncodeParser(encoder, sampleBuffer);
+        // The source frame reference carries the index of the buffer the frame was submitted from.
+        postEncodeParser(encoder, sampleBuffer, reinterpret_cast<uintptr_t>(sourceFrameRefCon));
     }
 
     namespace internal
@@ -314,7 +372,7 @@ namespace MacOsEncodingPlugin
         OSStatus status = VTCompressionSessionCreate(NULL,
                                                      m_FrameData.width,
                                                      m_FrameData.height,
-                                                     kCMVideoCodecType_H264,
+                                                     m_Codec == VideoCodec::HEVC ? kCMVideoCodecType_HEVC : kCMVideoCodecType_H264,
                                                      nullptr,//encoderSpecifications,
                                                      source_attributes,//imageAttr,
                                                      NULL,
@@ -324,13 +382,14 @@ namespace MacOsEncodingPlugin
          
         if (status != 0)
         {
-            WriteFileDebug("Error: [createSession] - VTCompressionSessionCreate session creation failed.\n");
+            WriteFileDebug(LogLevel::Error, "Error: [createSession] - VTCompressionSessionCreate session creation failed.\n");
             return false;
         }
         
         NSNumber *frameRate = [NSNumber numberWithInt:m_FrameData.frameRate];
         NSNumber *bitRate = [NSNumber numberWithInt:m_FrameData.bitRate];
         NSNumber *gopSize = [NSNumber numberWithInt:(m_FrameData.gopSize)];
+        NSNumber *maxFrameDelay = [NSNumber numberWithUnsignedInt:m_BufferedFrameNumbers];
 
         // Set the properties
         VTSessionSetProperty(m_EncodingSession,
@@ -341,6 +400,11 @@ namespace MacOsEncodingPlugin
                              kVTCompressionPropertyKey_AllowFrameReordering,
                              kCFBooleanFalse);
         
+        // VideoToolbox never holds more frames than the session keeps in flight.
+        VTSessionSetProperty(m_EncodingSession,
+                             kVTCompressionPropertyKey_MaxFrameDelayCount,
+                             (__bridge CFTypeRef _Nonnull)(maxFrameDelay));
+        
         VTSessionSetProperty(m_EncodingSession,
                              kVTVideoEncoderSpecification_EnableHardwareAcceleratedVideoEncoder,
                              kCFBooleanTrue);
@@ -351,7 +415,7 @@ namespace MacOsEncodingPlugin
         
         VTSessionSetProperty(m_EncodingSession,
                              kVTCompressionPropertyKey_ProfileLevel,
-                             kVTProfileLevel_H264_Baseline_AutoLevel);
+                             m_Codec == VideoCodec::HEVC ? kVTProfileLevel_HEVC_Main_AutoLevel : kVTProfileLevel_H264_Baseline_AutoLevel);
                 
         VTSessionSetProperty(m_EncodingSession,
                              kVTCompressionPropertyKey_ExpectedFrameRate,
@@ -366,7 +430,7 @@ namespace MacOsEncodingPlugin
         
         if (status != 0)
         {
-            WriteFileDebug("Error: [createSession] - VTCompressionSessionPrepareToEncodeFrames session creation failed.\n");
+            WriteFileDebug(LogLevel::Error, "Error: [createSession] - VTCompressionSessionPrepareToEncodeFrames session creation failed.\n");
             return false;
         }
         
@@ -391,12 +455,12 @@ namespace MacOsEncodingPlugin
         CVPixelBufferPoolRef pixelBufferPool;
         pixelBufferPool = VTCompressionSessionGetPixelBufferPool(m_EncodingSession);
         
-        for(NSInteger i = 0; i < k_BufferedFrameNumbers; i++)
+        for(uint32_t i = 0; i < m_BufferedFrameNumbers; i++)
         {
             CVReturn result = CVPixelBufferPoolCreatePixelBuffer(NULL, pixelBufferPool, &m_PixelBuffers[i]);
             if (result != kCVReturnSuccess)
             {
-                WriteFileDebug("Error: [allocateBuffers] - CVPixelBufferPoolCreatePixelBuffer failed.\n");
+                WriteFileDebug(LogLevel::Error, "Error: [allocateBuffers] - CVPixelBufferPoolCreatePixelBuffer failed.\n");
                 return false;
             }
             
@@ -406,7 +470,7 @@ namespace MacOsEncodingPlugin
             result = CVMetalTextureCacheCreate(kCFAllocatorDefault, nil, device_, nil, &textureCache);
             if(result != kCVReturnSuccess)
             {
-                WriteFileDebug("Error: [allocateBuffers] - CVMetalTextureCacheCreate failed.\n");
+                WriteFileDebug(LogLevel::Error, "Error: [allocateBuffers] - CVMetalTextureCacheCreate failed.\n");
                 return false;
             }
 
@@ -426,7 +490,7 @@ namespace MacOsEncodingPlugin
                                                                &imageTexture);
             if (result != kCVReturnSuccess)
             {
-                WriteFileDebug("Error: [allocateBuffers] - CVMetalTextureCacheCreateTextureFromImage failed.\n");
+                WriteFileDebug(LogLevel::Error, "Error: [allocateBuffers] - CVMetalTextureCacheCreateTextureFromImage failed.\n");
                 return false;
             }
             
@@ -442,7 +506,7 @@ namespace MacOsEncodingPlugin
         if (m_InitializationResult != MacOSEncoderStatus::Success)
             return;
         
-        for (int i = 0; i < k_BufferedFrameNumbers; ++i)
+        for (uint32_t i = 0; i < m_BufferedFrameNumbers; ++i)
         {
             [m_RenderTextures[i] release];
             CVPixelBufferRelease(m_PixelBuffers[i]);
@@ -463,55 +527,188 @@ namespace MacOsEncodingPlugin
         
         if (tex == nullptr)
         {
-            WriteFileDebug("Error: [copyBuffer] - current renderTexture is null.\n");
+            WriteFileDebug(LogLevel::Error, "Error: [copyBuffer] - current renderTexture is null.\n");
             return false;
         }
         
+        ProfilerScope profilerScope(ProfilerMarker::CopyTexture);
         return m_GraphicDevice->CopyResourceFromNative(tex, frameSource);
     }
 
-    bool H264Encoder::EncodeFrame(void* frameSource, unsigned long long int timestamp)
+    bool H264Encoder::EncodeFrame(void* frameSource, unsigned long long int timestamp, uint32_t timecode)
     {
         if (frameSource == nullptr)
         {
-            WriteFileDebug("Error: [encodeFrame] - Received frame is invalid.\n");
+            WriteFileDebug(LogLevel::Error, "Error: [encodeFrame] - Received frame is invalid.\n");
             return false;
         }
         
-        uint32 bufferIndexToWrite = m_FrameCount % k_BufferedFrameNumbers;
+        ProfilerScope profilerScope(ProfilerMarker::EncodeFrame);
+        const auto encodeTime = EncoderStatistics::Now();
+        uint32 bufferIndexToWrite = m_FrameCount % m_BufferedFrameNumbers;
         
-        if (!copyBuffer(frameSource, bufferIndexToWrite))
+        // The pixel buffer of a frame still being encoded must not be overwritten.
+        if (m_IsBufferBusy[bufferIndexToWrite])
         {
-            WriteFileDebug("Error: [encodeFrame] - Received frame source is invalid.\n");
+            WriteFileDebug(LogLevel::Warning, "Warning: [encodeFrame] - All the buffers are being encoded, frame skipped.\n");
+            m_Statistics.RecordInputDropped();
             return false;
         }
         
-        CMTime presentationTimeStamp = CMTimeMake(m_FrameCount * 1000 / m_FrameData.frameRate, 1000);
+        // The source texture is only valid during the render event: the copy is encoded in Unity's command
+        // buffer here, the submission thread waits for the GPU to execute it.
+        if (!m_SubmissionThread.joinable() || !copyBuffer(frameSource, bufferIndexToWrite))
+        {
+            WriteFileDebug(LogLevel::Error, "Error: [encodeFrame] - Received frame source is invalid.\n");
+            return false;
+        }
+        
+        const auto copyTime = EncoderStatistics::Now();
+        m_Statistics.RecordStage(EncoderStage::Copy, encodeTime, copyTime);
+        
+        // Set before submitting: the output callback can run before VTCompressionSessionEncodeFrame returns.
+        auto& timings = m_SubmittedTimings[bufferIndexToWrite];
+        timings = FrameTimings();
+        timings.encodeTime = encodeTime;
+        m_SubmittedTimecodes[bufferIndexToWrite] = { timecode, timestamp, m_FrameCount };
+        m_IsBufferBusy[bufferIndexToWrite] = true;
+        m_InFlightFrameCount++;
+        
+        SubmitCommand command;
+        command.frameIndex = bufferIndexToWrite;
+        command.frameCount = m_FrameCount;
+        command.copyTime = copyTime;
+        
+        auto copyFence = m_CopyFence;
+        const uint64_t copyCount = m_FrameCount + 1;
+        [m_GraphicDevice->GetCurrentCommandBuffer() addCompletedHandler:^(id<MTLCommandBuffer>)
+        {
+            {
+                std::lock_guard<std::mutex> lock(copyFence->lock);
+                copyFence->completedCount = std::max(copyFence->completedCount, copyCount);
+            }
+            copyFence->condition.notify_all();
+        }];
+        
+        m_FrameCount++;
+        
+        // Never full: a command is only pushed for a buffer that isn't busy.
+        m_SubmissionQueue.Push(command);
+        return true;
+    }
+    
+    bool H264Encoder::UpdateRateControl(const MacOSEncoderSessionData& frameData)
+    {
+        MacOSEncoderSessionData newFrameData;
+        newFrameData.Update(frameData);
+        
+        if (!m_SessionCreated || newFrameData.frameRate <= 0
+            || newFrameData.width != m_FrameData.width
+            || newFrameData.height != m_FrameData.height
+            || newFrameData.gopSize != m_FrameData.gopSize)
+            return false;
+        
+        // VideoToolbox applies the rate control properties to the next frames of the session.
+        NSNumber *frameRate = [NSNumber numberWithInt:newFrameData.frameRate];
+        NSNumber *bitRate = [NSNumber numberWithInt:newFrameData.bitRate];
+        
+        auto status = VTSessionSetProperty(m_EncodingSession,
+                                           kVTCompressionPropertyKey_ExpectedFrameRate,
+                                           (__bridge CFTypeRef _Nonnull)(frameRate));
+        if (status == noErr)
+            status = VTSessionSetProperty(m_EncodingSession,
+                                          kVTCompressionPropertyKey_AverageBitRate,
+                                          (__bridge CFTypeRef _Nonnull)(bitRate));
+        if (status != noErr)
+        {
+            WriteFileDebug(LogLevel::Error, "Error: [UpdateRateControl] - VTSessionSetProperty failed.\n");
+            return false;
+        }
+        
+        m_FrameData.frameRate = newFrameData.frameRate;
+        m_FrameData.bitRate = newFrameData.bitRate;
+        m_FrameRate.store(newFrameData.frameRate);
+        
+        WriteFileDebug(LogLevel::Info, "Info: [UpdateRateControl] - Bitrate: ", newFrameData.bitRate);
+        WriteFileDebug(LogLevel::Info, "Info: [UpdateRateControl] - FrameRate: ", newFrameData.frameRate);
+        return true;
+    }
+    
+    bool H264Encoder::waitForCopy(uint64_t copyCount)
+    {
+        std::unique_lock<std::mutex> lock(m_CopyFence->lock);
+        m_CopyFence->condition.wait(lock, [this, copyCount]
+        {
+            return m_CopyFence->completedCount >= copyCount || m_CopyFence->isClosed;
+        });
+        return m_CopyFence->completedCount >= copyCount;
+    }
+    
+    void H264Encoder::submitFrame(const SubmitCommand& command)
+    {
+        // Unity commits the command buffer at the end of the frame, the pixel buffer is ready once it completes.
+        if (!waitForCopy(command.frameCount + 1))
+        {
+            WriteFileDebug(LogLevel::Warning, "Warning: [submitFrame] - Encoder disposed before the copy completed, frame skipped.\n");
+            m_Statistics.RecordInputDropped();
+            OnFrameCompleted(command.frameIndex);
+            return;
+        }
+        
+        const auto submitTime = EncoderStatistics::Now();
+        m_SubmittedTimings[command.frameIndex].submitTime = submitTime;
+        
+        // Accumulated frame by frame so that the timestamps keep increasing when the frame rate changes.
+        const auto presentationTimeStamp = m_PresentationTimeStamp;
+        m_PresentationTimeStamp = CMTimeAdd(m_PresentationTimeStamp, CMTimeMake(1, m_FrameRate.load()));
         
         VTEncodeInfoFlags flags;
+        EncoderProfiler::BeginSample(ProfilerMarker::EncodePicture);
         OSStatus status = VTCompressionSessionEncodeFrame(m_EncodingSession,
-                                                          m_PixelBuffers[bufferIndexToWrite],
+                                                          m_PixelBuffers[command.frameIndex],
                                                           presentationTimeStamp,
                                                           kCMTimeInvalid,
                                                           nullptr,
-                                                          nullptr,
+                                                          reinterpret_cast<void*>(static_cast<uintptr_t>(command.frameIndex)),
                                                           &flags);
+        EncoderProfiler::EndSample(ProfilerMarker::EncodePicture);
         
         if (status != noErr)
         {
-            WriteFileDebug("Error: [encodeFrame] - Encoding failed for the current frame.\n");
-            return false;
+            WriteFileDebug(LogLevel::Error, "Error: [encodeFrame] - Encoding failed for the current frame.\n");
+            OnFrameCompleted(command.frameIndex);
+            return;
         }
         
-        m_LatestTimestamp = timestamp;
-        m_FrameCount++;
-        return true;
+        m_Statistics.RecordStage(EncoderStage::Submit, command.copyTime, submitTime);
+        m_Statistics.RecordSubmitted();
+    }
+    
+    void H264Encoder::submitFramesAsync(H264Encoder* encoder)
+    {
+        EncoderProfiler::RegisterThread("VideoToolbox Submission");
+        
+        SubmitCommand command;
+        while (encoder->m_SubmissionQueue.WaitPop(command))
+        {
+            encoder->submitFrame(command);
+            encoder->m_SubmissionQueue.Done();
+        }
+        
+        EncoderProfiler::UnregisterThread();
     }
 
     EncodedFrame* H264Encoder::GetEncodedFrame()
     {
         if (m_FrameQueue.size() > 0)
         {
+            // The same frame is returned until it is removed, only time the first call.
+            auto& timings = m_FrameQueue.front().timings;
+            if (timings.consumeTime == 0)
+            {
+                timings.consumeTime = EncoderStatistics::Now();
+                m_Statistics.RecordStage(EncoderStage::Queue, timings.readyTime, timings.consumeTime);
+            }
             return &m_FrameQueue.front();
         }
         return nullptr;
@@ -521,9 +718,61 @@ namespace MacOsEncodingPlugin
     {
         if (m_FrameQueue.size() > 0)
         {
+            const auto& timings = m_FrameQueue.front().timings;
+            const auto now = EncoderStatistics::Now();
+            m_Statistics.RecordStage(EncoderStage::Consume, timings.consumeTime, now);
+            m_Statistics.RecordStage(EncoderStage::Total, timings.encodeTime, now);
+            
+            ReleaseImageBuffer(std::move(m_FrameQueue.front().imageData));
             m_FrameQueue.pop();
             return true;
         }
         return false;
     }
+    
+    std::vector<uint8_t> H264Encoder::AcquireImageBuffer()
+    {
+        std::lock_guard<std::mutex> lock(m_ImageBufferLock);
+        if (m_ImageBuffers.empty())
+            return std::vector<uint8_t>();
+        
+        auto buffer = std::move(m_ImageBuffers.back());
+        m_ImageBuffers.pop_back();
+        return buffer;
+    }
+    
+    void H264Encoder::ReleaseImageBuffer(std::vector<uint8_t>&& buffer)
+    {
+        std::lock_guard<std::mutex> lock(m_ImageBufferLock);
+        if (m_ImageBuffers.size() < k_MaxPooledImageBuffers)
+        {
+            buffer.clear();
+            m_ImageBuffers.push_back(std::move(buffer));
+        }
+    }
+
+    void H264Encoder::RewriteSps(std::vector<uint8_t>& sps)
+    {
+        if (sps.empty())
+            return;
+
+        if (sps != m_SourceSps)
+        {
+            m_SourceSps = sps;
+            if (!RewriteSpsForLowLatency(m_Codec, sps.data(), static_cast<uint32_t>(sps.size()), m_RewrittenSps))
+                WriteFileDebug(LogLevel::Warning, "Warning: [RewriteSps] - The SPS could not be rewritten for low latency decoding.\n");
+        }
+
+        if (!m_RewrittenSps.empty())
+            sps = m_RewrittenSps;
+    }
+
+    void H264Encoder::GetStats(EncoderStats& stats) const
+    {
+        m_Statistics.GetStats(stats);
+        
+        stats.droppedOutputFrameCount = m_DroppedOutputFrameCount;
+        stats.inFlightFrameCount = m_InFlightFrameCount;
+        stats.queueDepth = static_cast<uint32_t>(m_FrameQueue.size());
+    }
 }
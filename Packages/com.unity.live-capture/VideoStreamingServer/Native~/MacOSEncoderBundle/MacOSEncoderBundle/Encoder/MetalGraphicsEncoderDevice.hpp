@@ -17,6 +17,9 @@ namespace MacOsEncodingPlugin
 
         void* GetEncodeDevicePtr();
         bool CopyResourceFromNative(id<MTLTexture> dest, void* nativeTexturePtr);
+
+        // The command buffer the copies are encoded into, committed by Unity at the end of the frame.
+        id<MTLCommandBuffer> GetCurrentCommandBuffer();
         
     private:
         id<MTLDevice>         m_Device;
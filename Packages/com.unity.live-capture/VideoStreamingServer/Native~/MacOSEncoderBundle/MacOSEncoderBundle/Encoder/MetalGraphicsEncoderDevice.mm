@@ -21,6 +21,11 @@ namespace MacOsEncodingPlugin
         return m_Device;
     }
 
+    id<MTLCommandBuffer> MetalGraphicsEncoderDevice::GetCurrentCommandBuffer()
+    {
+        return m_UnityGraphicsMetal->CurrentCommandBuffer();
+    }
+
     bool MetalGraphicsEncoderDevice::CopyResourceFromNative(id<MTLTexture> dest, void* nativeTexturePtr)
     {
         if(nativeTexturePtr == nullptr)
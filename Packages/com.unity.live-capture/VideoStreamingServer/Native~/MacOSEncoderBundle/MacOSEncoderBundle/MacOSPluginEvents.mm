@@ -1,11 +1,14 @@
 #import <Foundation/Foundation.h>
 #include "TargetConditionals.h"
 
+#include <algorithm>
+
 #include "Unity/IUnityGraphicsMetal.h"
 #include "Unity/IUnityRenderingExtensions.h"
 
-#include "ObjectIDMap.hpp"
+#include "SlotMap.h"
 #include "PluginUtils.hpp"
+#include "EncoderProfiler.h"
 #include "MacOSEncoderSessionDataPlugin.hpp"
 
 #include "Encoder/H264Encoder.mm"
@@ -29,15 +32,22 @@ namespace MacOsEncodingPlugin
     static IUnityInterfaces*         s_UnityInterfaces = nullptr;
     static IUnityGraphics*           s_UnityGraphics = nullptr;
     static IUnityGraphicsMetalV1*    s_MetalGraphics = nullptr;
-    static MetalGraphicsEncoderDevice* s_GraphicsEncoderDevice = nullptr;
     static bool                      s_Initialized = false;
     
-    static IDObjectMap<H264Encoder>  s_EncoderMap;
-    static IDObjectMap<EncodedFrame> s_EncodedFrameMap;
+    // Shared by the encoders: created with the first one and destroyed with the last one. Only
+    // accessed from the render thread.
+    static MetalGraphicsEncoderDevice* s_GraphicsEncoderDevice = nullptr;
+    static uint32_t                    s_GraphicsEncoderDeviceRefCount = 0;
     
-#ifdef DEBUG_LOG
-    static std::once_flag InitLogOnce;
-#endif
+    // Bound by Initialize and retired by Finalize on the render thread, looked up by the exports on the
+    // main thread.
+    using EncoderMap = Handles::SlotMap<H264Encoder>;
+    static EncoderMap s_EncoderMap;
+
+    static EncoderMap::Ref AcquireEncoder(const int* id)
+    {
+        return (id != nullptr) ? s_EncoderMap.Acquire(*id) : EncoderMap::Ref();
+    }
     
     static bool GetRenderDeviceInterface(UnityGfxRenderer renderer)
     {
@@ -47,7 +57,7 @@ namespace MacOsEncodingPlugin
             s_MetalGraphics = s_UnityInterfaces->Get<IUnityGraphicsMetalV1>();
             return true;
         default:
-            WriteFileDebug("Error - [GetRenderDeviceInterface] graphics API not supported.\n");
+            WriteFileDebug(LogLevel::Error, "Error - [GetRenderDeviceInterface] graphics API not supported.\n");
             return false;
         }
     }
@@ -57,7 +67,7 @@ namespace MacOsEncodingPlugin
         OnGraphicsDeviceEvent(UnityGfxDeviceEventType eventType)
     {
 #ifdef DEBUG_LOG
-        WriteFileDebug("Info - [OnGraphicsDeviceEvent] On graphics device event.\n");
+        WriteFileDebug(LogLevel::Info, "Info - [OnGraphicsDeviceEvent] On graphics device event.\n");
 #endif
 
         if (eventType == kUnityGfxDeviceEventInitialize && !s_Initialized)
@@ -83,15 +93,25 @@ namespace MacOsEncodingPlugin
     extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API
         UnityPluginLoad(IUnityInterfaces * unityInterfaces)
     {
-#ifdef DEBUG_LOG
-        std::call_once(InitLogOnce, MacOsEncodingPlugin::InitLog);
-#endif
-        
-        WriteFileDebug("Info - [UnityPluginLoad] Load plugin.\n", false);
+        InitLog();
+
+        WriteFileDebug(LogLevel::Info, "Info - [UnityPluginLoad] Load plugin.\n", false);
         if (unityInterfaces)
         {
             s_UnityInterfaces = unityInterfaces;
 
+            static const char* const k_ProfilerMarkerNames[] =
+            {
+                "VTEnc.EncodeFrame",
+                "VTEnc.CopyTexture",
+                "VTEnc.EncodePicture",
+                "VTEnc.PostEncodeParser"
+            };
+            static_assert(sizeof(k_ProfilerMarkerNames) / sizeof(k_ProfilerMarkerNames[0]) == static_cast<uint32_t>(ProfilerMarker::Count),
+                          "A name is required for each profiler marker.");
+            EncoderProfiler::Initialize(unityInterfaces, k_ProfilerMarkerNames, static_cast<uint32_t>(ProfilerMarker::Count),
+                                        "VTEnc.Counters");
+
             const auto unityGraphics = s_UnityInterfaces->Get<IUnityGraphics>();
             if (unityGraphics)
             {
@@ -106,11 +126,13 @@ namespace MacOsEncodingPlugin
     // Override the function defining the unload of the plugin
     extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API UnityPluginUnload()
     {
-        WriteFileDebug("Info - [UnityPluginUnload] Unload plugin.\n");
+        WriteFileDebug(LogLevel::Info, "Info - [UnityPluginUnload] Unload plugin.\n");
         if (s_UnityGraphics != nullptr)
         {
             s_UnityGraphics->UnregisterDeviceEventCallback(OnGraphicsDeviceEvent);
         }
+        EncoderProfiler::Shutdown();
+        ShutdownLog();
     }
 
     void Initialize(void* data);
@@ -160,83 +182,127 @@ namespace MacOsEncodingPlugin
     {
         if (!data)
         {
-            WriteFileDebug("Error, Data send is null.\n");
+            WriteFileDebug(LogLevel::Error, "Error, Data send is null.\n");
             return true;
         }
 
         if (!s_MetalGraphics)
         {
-            WriteFileDebug("Error, s_MetalGraphics is null.\n");
+            WriteFileDebug(LogLevel::Error, "Error, s_MetalGraphics is null.\n");
             return true;
         }
 
         return true;
     }
     
+    static MetalGraphicsEncoderDevice* AcquireGraphicsEncoderDevice()
+    {
+        if (s_GraphicsEncoderDevice == nullptr)
+        {
+            if (s_MetalGraphics == nullptr)
+                return nullptr;
+            
+            id<MTLDevice> device = s_MetalGraphics->MetalDevice();
+            s_GraphicsEncoderDevice = new MetalGraphicsEncoderDevice(device, s_MetalGraphics);
+        }
+        
+        s_GraphicsEncoderDeviceRefCount++;
+        return s_GraphicsEncoderDevice;
+    }
+    
+    // The device is destroyed once the last encoder using it is.
+    static void ReleaseGraphicsEncoderDevice()
+    {
+        if (s_GraphicsEncoderDeviceRefCount == 0 || --s_GraphicsEncoderDeviceRefCount > 0)
+            return;
+        
+        delete s_GraphicsEncoderDevice;
+        s_GraphicsEncoderDevice = nullptr;
+    }
+    
     void Initialize(void* data)
     {
-        WriteFileDebug("Info - [Initialize] Calling event.\n");
+        WriteFileDebug(LogLevel::Info, "Info - [Initialize] Calling event.\n");
         
         if (!AreParametersValid(data))
         {
-            WriteFileDebug("Error - [Initialize] Invalid data.\n");
+            WriteFileDebug(LogLevel::Error, "Error - [Initialize] Invalid data.\n");
             return;
         }
         
         auto encoderData = static_cast<EncoderSettingsID*>(data);
         if (encoderData == nullptr)
         {
-            WriteFileDebug("Error - [Initialize] Invalid encoder data.\n");
+            WriteFileDebug(LogLevel::Error, "Error - [Initialize] Invalid encoder data.\n");
             return;
         }
         
-        WriteFileDebug("Info - [Initialize] Width: ", encoderData->settings.width);
-        WriteFileDebug("Info - [Initialize] Height: ", encoderData->settings.height);
-        WriteFileDebug("Info - [Initialize] FrameRate: ", encoderData->settings.frameRate);
-        WriteFileDebug("Info - [Initialize] Bitrate: ", encoderData->settings.bitRate);
-        WriteFileDebug("Info - [Initialize] GopSize: ", encoderData->settings.gopSize);
+        WriteFileDebug(LogLevel::Info, "Info - [Initialize] Width: ", encoderData->settings.width);
+        WriteFileDebug(LogLevel::Info, "Info - [Initialize] Height: ", encoderData->settings.height);
+        WriteFileDebug(LogLevel::Info, "Info - [Initialize] FrameRate: ", encoderData->settings.frameRate);
+        WriteFileDebug(LogLevel::Info, "Info - [Initialize] Bitrate: ", encoderData->settings.bitRate);
+        WriteFileDebug(LogLevel::Info, "Info - [Initialize] GopSize: ", encoderData->settings.gopSize);
         
-        if (s_GraphicsEncoderDevice == nullptr && s_MetalGraphics)
+        if (s_EncoderMap.Acquire(encoderData->id))
         {
-            id<MTLDevice> device = s_MetalGraphics->MetalDevice();
-            s_GraphicsEncoderDevice = new MetalGraphicsEncoderDevice(device, s_MetalGraphics);
+            WriteFileDebug(LogLevel::Warning, "Warning - [Initialize] Encoder already initialized ", encoderData->id);
+            return;
         }
-        else
+        
+        // The handle reserved by CreateEncoderHandle is freed when the encoder can't be created: the
+        // managed side only finalizes the encoders that initialized.
+        auto metalDevice = AcquireGraphicsEncoderDevice();
+        if (metalDevice == nullptr)
         {
-            WriteFileDebug("Error - [Initialize] Encoder device is invalid.\n");
+            WriteFileDebug(LogLevel::Error, "Error - [Initialize] Encoder device is invalid.\n");
+            s_EncoderMap.Retire(encoderData->id);
+            return;
         }
         
-        auto metalDevice = static_cast<MetalGraphicsEncoderDevice*>(s_GraphicsEncoderDevice);
-        auto instanceEncoder = new H264Encoder(encoderData->settings, metalDevice);
+        const auto depth = EncoderPipelineDepth::FromSettings(encoderData->pipelineMode,
+                                                              encoderData->framesInFlight,
+                                                              encoderData->maxQueueLength);
+        auto instanceEncoder = new H264Encoder(encoderData->settings, metalDevice, depth, encoderData->codec);
         instanceEncoder->Initialize(encoderData->useSRGB);
         
-        s_EncoderMap.Add(encoderData->id, instanceEncoder);
+        if (!s_EncoderMap.Bind(encoderData->id, instanceEncoder))
+        {
+            WriteFileDebug(LogLevel::Error, "Error - [Initialize] Invalid encoder handle ", encoderData->id);
+            instanceEncoder->Dispose();
+            delete instanceEncoder;
+            ReleaseGraphicsEncoderDevice();
+            return;
+        }
         
-        WriteFileDebug("Error - [Initialize] Added encoder ", encoderData->id);
+        WriteFileDebug(LogLevel::Error, "Error - [Initialize] Added encoder ", encoderData->id);
     }
 
+    // Only the bit rate and the frame rate can change, the other settings require a new encoder.
     void Update(void* data)
     {
-        /*
-        WriteFileDebug("Info - [Initialize] Calling event.\n");
+        WriteFileDebug(LogLevel::Info, "Info - [Update] Calling event.\n");
         
         if (!AreParametersValid(data))
             return;
         
         auto encoderData = static_cast<EncoderSettingsID*>(data);
-        if (encoderData && encoderData->id > 0)
+        if (encoderData == nullptr)
         {
-            auto encoder = s_EncoderMap.GetInstance(encoderData->id);
-            if (encoder && encoder->UpdateEncoderSessionData(encoderData->settings))
-            {
-                WriteFileDebug("Info - [Update] Data has been updated.\n");
-            }
+            WriteFileDebug(LogLevel::Error, "Error - [Update] invalid parameters.\n");
+            return;
         }
-        else
+        
+        auto encoder = s_EncoderMap.Acquire(encoderData->id);
+        if (!encoder)
         {
-            WriteFileDebug("Error - [Update] invalid parameters.\n");
+            WriteFileDebug(LogLevel::Error, "Error - [Update] encoder is null.\n");
+            return;
         }
-         */
+        
+        if (encoder->UpdateRateControl(encoderData->settings))
+            WriteFileDebug(LogLevel::Info, "Info - [Update] Data has been updated.\n");
+        else
+            WriteFileDebug(LogLevel::Warning, "Warning - [Update] Data could not be updated ", encoderData->id);
     }
 
     void Encode(void* data)
@@ -247,57 +313,70 @@ namespace MacOsEncodingPlugin
         auto encoderData = static_cast<EncoderTextureID*>(data);
         if (encoderData && encoderData->id > 0)
         {
-            auto encoder = s_EncoderMap.GetInstance(encoderData->id);
+            auto encoder = s_EncoderMap.Acquire(encoderData->id);
             if (encoder)
             {
-                encoder->EncodeFrame(encoderData->renderTexture, encoderData->timestamp);
+                encoder->EncodeFrame(encoderData->renderTexture, encoderData->timestamp, encoderData->timecode);
             }
         }
     }
     
     void Finalize(void* data)
     {
-        WriteFileDebug("Info - [Finalize] Calling event.\n");
+        WriteFileDebug(LogLevel::Info, "Info - [Finalize] Calling event.\n");
         
         if (!AreParametersValid(data))
             return;
         
-        WriteFileDebug("Info - [Finalize] Parameters are valid.\n");
+        WriteFileDebug(LogLevel::Info, "Info - [Finalize] Parameters are valid.\n");
         
         auto id = *(int*)data;
         
         if (id > 0)
         {
-            WriteFileDebug("Info - [Finalize] id is valid ", id);
+            WriteFileDebug(LogLevel::Info, "Info - [Finalize] id is valid ", id);
             
-            auto encoder = s_EncoderMap.GetInstance(id);
+            // Returned once the exports running on the main thread are done with the encoder, and no new
+            // call can look it up.
+            auto encoder = s_EncoderMap.Retire(id);
             if (encoder)
             {
-                WriteFileDebug("Info - [Finalize] encoder is valid.\n");
+                WriteFileDebug(LogLevel::Info, "Info - [Finalize] encoder is valid.\n");
 
                 encoder->Dispose();
                 delete encoder;
                 encoder = nullptr;
-                s_EncoderMap.Remove(id);
-                WriteFileDebug("Info - [Finalize] Device deleted and removed ", id);
+                ReleaseGraphicsEncoderDevice();
+                WriteFileDebug(LogLevel::Info, "Info - [Finalize] Device deleted and removed ", id);
             }
             else
             {
-                WriteFileDebug("Info - [Finalize] encoder is null.\n");
+                WriteFileDebug(LogLevel::Info, "Info - [Finalize] encoder is null.\n");
             }
         }
-        
-        s_Initialized = false;
     }
     
+    // A binary without this export only has the original consume exports: BeginConsume, EndConsume,
+    // GetSps, GetPps, GetEncodedData, GetTimeStamp and GetIsKeyFrame.
+    extern "C" int32_t UNITY_INTERFACE_EXPORT GetApiVersion()
+    {
+        return k_PluginApiVersion;
+    }
+
+    // Reserves the handle of a new encoder, passed as its ID to Initialize. A handle is never valid again
+    // once its encoder is finalized. Returns 0 if there are too many encoders.
+    extern "C" int UNITY_INTERFACE_EXPORT CreateEncoderHandle()
+    {
+        const auto handle = s_EncoderMap.Reserve();
+        if (handle == 0)
+            WriteFileDebug(LogLevel::Error, "Error - [CreateEncoderHandle] Too many encoders.\n");
+        return handle;
+    }
+
     extern "C" bool UNITY_INTERFACE_EXPORT EncoderIsInitialized(int* id)
     {
-        if (id && *id > 0)
-        {
-            auto encoder = s_EncoderMap.GetInstance(*id);
-            return (encoder && encoder->IsInitialized());
-        }
-        return false;
+        auto encoder = AcquireEncoder(id);
+        return (encoder && encoder->IsInitialized());
     }
 
     extern "C" int UNITY_INTERFACE_EXPORT EncoderIsCompatible()
@@ -305,42 +384,90 @@ namespace MacOsEncodingPlugin
         return static_cast<int>(true);
     }
 
-    extern "C" bool UNITY_INTERFACE_EXPORT BeginConsume(int* id)
+    // The frame consumed between BeginConsume and EndConsume is the oldest one, which only EndConsume
+    // removes.
+    static EncodedFrame* GetConsumedFrame(const EncoderMap::Ref& encoder)
     {
-        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
+        return (encoder && encoder->IsInitialized()) ? encoder->GetEncodedFrame() : nullptr;
+    }
 
-        auto currentFrame = (encoder && encoder->IsInitialized())
-            ? encoder->GetEncodedFrame()
-            : nullptr;
-        
-        bool isValid = currentFrame != nullptr;
-        if (isValid)
-        {
-            s_EncodedFrameMap.Add(*id, currentFrame);
-        }
-        
-        return isValid;
+    extern "C" bool UNITY_INTERFACE_EXPORT BeginConsume(int* id)
+    {
+        return GetConsumedFrame(AcquireEncoder(id)) != nullptr;
     }
 
     extern "C" bool UNITY_INTERFACE_EXPORT EndConsume(int* id)
     {
-        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
-        if (encoder && encoder->IsInitialized() && s_EncodedFrameMap[*id] != nullptr)
-        {
-            s_EncodedFrameMap.Remove(*id);
-            return encoder->RemoveEncodedFrame();
-        }
-        return false;
+        auto encoder = AcquireEncoder(id);
+        return GetConsumedFrame(encoder) != nullptr && encoder->RemoveEncodedFrame();
+    }
+
+    // Fills the frame descriptor and, when dataOut can hold descriptorOut->totalSize bytes, copies the
+    // VPS, SPS, PPS and image data into it and consumes the frame. Otherwise the frame is kept so that the
+    // caller can retry with a larger buffer. Returns true if the frame has been consumed.
+    extern "C" bool UNITY_INTERFACE_EXPORT ConsumeEncodedFrame(int* id,
+                                                               EncodedFrameDescriptor* descriptorOut,
+                                                               uint8_t* dataOut,
+                                                               uint32_t dataSize)
+    {
+        auto encoder = AcquireEncoder(id);
+        if (!encoder || !encoder->IsInitialized() || descriptorOut == nullptr)
+            return false;
+
+        auto encodedFrame = encoder->GetEncodedFrame();
+        if (encodedFrame == nullptr)
+            return false;
+
+        auto& descriptor = *descriptorOut;
+        descriptor.timestamp = encodedFrame->timestamp;
+        descriptor.isKeyFrame = encodedFrame->isKeyFrame;
+        descriptor.sliceIndex = 0;
+        descriptor.isLastSlice = 1;
+        descriptor.sequenceInfo = encodedFrame->sequenceInfo;
+        descriptor.vpsOffset = 0;
+        descriptor.vpsSize = static_cast<uint32_t>(encodedFrame->vpsSequence.size());
+        descriptor.spsOffset = descriptor.vpsOffset + descriptor.vpsSize;
+        descriptor.spsSize = static_cast<uint32_t>(encodedFrame->spsSequence.size());
+        descriptor.ppsOffset = descriptor.spsOffset + descriptor.spsSize;
+        descriptor.ppsSize = static_cast<uint32_t>(encodedFrame->ppsSequence.size());
+        descriptor.imageOffset = descriptor.ppsOffset + descriptor.ppsSize;
+        descriptor.imageSize = static_cast<uint32_t>(encodedFrame->imageData.size());
+        descriptor.totalSize = descriptor.imageOffset + descriptor.imageSize;
+
+        const auto nalUnitCount = std::min<size_t>(encodedFrame->nalUnits.size(), k_MaxNalUnitCount);
+        descriptor.nalUnitCount = static_cast<uint32_t>(nalUnitCount);
+        std::copy_n(encodedFrame->nalUnits.begin(), nalUnitCount, descriptor.nalUnits);
+
+        if (dataOut == nullptr || dataSize < descriptor.totalSize)
+            return false;
+
+        memcpy(dataOut + descriptor.vpsOffset, encodedFrame->vpsSequence.data(), descriptor.vpsSize);
+        memcpy(dataOut + descriptor.spsOffset, encodedFrame->spsSequence.data(), descriptor.spsSize);
+        memcpy(dataOut + descriptor.ppsOffset, encodedFrame->ppsSequence.data(), descriptor.ppsSize);
+        memcpy(dataOut + descriptor.imageOffset, encodedFrame->imageData.data(), descriptor.imageSize);
+
+        return encoder->RemoveEncodedFrame();
     }
 
-    EncodedFrame* IsEncodedFrameValid(int* id)
+    // Per-stage latencies and throughput of the encoder since it was created.
+    extern "C" bool UNITY_INTERFACE_EXPORT GetEncoderStats(int* id, EncoderStats* statsOut)
     {
-        if (id && *id > 0)
-            return s_EncodedFrameMap[*id];
+        auto encoder = AcquireEncoder(id);
+        if (!encoder || statsOut == nullptr)
+            return false;
 
-        return nullptr;
+        encoder->GetStats(*statsOut);
+        return true;
     }
 
+    // Sets the minimum level of the messages written to the debug log: 0 Debug, 1 Info, 2 Warning,
+    // 3 Error, 4 None.
+    extern "C" void UNITY_INTERFACE_EXPORT SetLogLevel(int level)
+    {
+        SetDebugLogLevel(level);
+    }
+
+
  
 
 
@@ -363,7 +490,7 @@ namespace MacOsEncodingPlugin
             ossSPS << "\n";
         }
         
-        WriteFileDebug("Info: [postEncodeParser] - SPS DATA IS: ", (int)frame->spsSequence.size(), true);
+        WriteFileDebug(LogLevel::Info, "Info: [postEncodeParser] - SPS DATA IS: ", (int)frame->spsSequence.size(), true);
         WriteFileDebug(ossSPS.str().c_str());
     }
 
@@ -382,7 +509,7 @@ namespace MacOsEncodingPlugin
             ossPPS << "\n";
         }
         
-        WriteFileDebug("Info: [postEncodeParser] - PPS DATA IS: ", (int)frame->ppsSequence.size(), true);
+        WriteFileDebug(LogLevel::Info, "Info: [postEncodeParser] - PPS DATA IS: ", (int)frame->ppsSequence.size(), true);
         WriteFileDebug(ossPPS.str().c_str());
     }
 
@@ -402,7 +529,7 @@ namespace MacOsEncodingPlugin
             ossImg << "\n";
         }
         
-        WriteFileDebug("Info: [postEncodeParser] - IMG DATA IS: ", (int)frame->imageData.size(), true);
+        WriteFileDebug(LogLevel::Info, "Info: [postEncodeParser] - IMG DATA IS: ", (int)frame->imageData.size(), true);
         WriteFileDebug(ossImg.str().c_str());
     }
 
@@ -411,7 +538,8 @@ namespace MacOsEncodingPlugin
 
     extern "C" uint32_t UNITY_INTERFACE_EXPORT GetSps(int* id, uint8_t * spsOut)
     {
-        auto encodedFrame = IsEncodedFrameValid(id);
+        auto encoder = AcquireEncoder(id);
+        auto encodedFrame = GetConsumedFrame(encoder);
         if (encodedFrame == nullptr)
             return 0;
 
@@ -420,7 +548,7 @@ namespace MacOsEncodingPlugin
         {
             memcpy(spsOut, encodedFrame->spsSequence.data(), sizeSpsData);
             
-            ///WriteFileDebug("Info - [GetSps] SPS size: ", sizeSpsData, true);
+            ///WriteFileDebug(LogLevel::Info, "Info - [GetSps] SPS size: ", sizeSpsData, true);
             //LogDataSPS(encodedFrame);
         }
         return static_cast<uint32_t>(sizeSpsData);
@@ -428,7 +556,8 @@ namespace MacOsEncodingPlugin
 
     extern "C" uint32_t UNITY_INTERFACE_EXPORT GetPps(int* id, uint8_t * ppsOut)
     {
-        auto encodedFrame = IsEncodedFrameValid(id);
+        auto encoder = AcquireEncoder(id);
+        auto encodedFrame = GetConsumedFrame(encoder);
         if (encodedFrame == nullptr)
             return 0;
 
@@ -436,7 +565,7 @@ namespace MacOsEncodingPlugin
         if (ppsOut != nullptr)
         {
             memcpy(ppsOut, encodedFrame->ppsSequence.data(), sizePpsData);
-            ///WriteFileDebug("Info - [GetSps] PPS size: ", sizePpsData, true);
+            ///WriteFileDebug(LogLevel::Info, "Info - [GetSps] PPS size: ", sizePpsData, true);
             //LogDataPPS(encodedFrame);
         }
         return static_cast<uint32_t>(sizePpsData);
@@ -444,7 +573,8 @@ namespace MacOsEncodingPlugin
 
     extern "C" uint32_t UNITY_INTERFACE_EXPORT GetEncodedData(int* id, uint8_t * dataOut)
     {
-        auto encodedFrame = IsEncodedFrameValid(id);
+        auto encoder = AcquireEncoder(id);
+        auto encodedFrame = GetConsumedFrame(encoder);
         if (encodedFrame == nullptr)
             return 0;
 
@@ -452,7 +582,7 @@ namespace MacOsEncodingPlugin
         if (dataOut != nullptr)
         {
             memcpy(dataOut, encodedFrame->imageData.data(), sizeImageData);
-            ///WriteFileDebug("Info - [GetSps] IMG size: ", sizeImageData, true);
+            ///WriteFileDebug(LogLevel::Info, "Info - [GetSps] IMG size: ", sizeImageData, true);
             //LogDataIMG(encodedFrame);
         }
         return static_cast<uint32_t>(sizeImageData);
@@ -460,7 +590,8 @@ namespace MacOsEncodingPlugin
 
     extern "C" unsigned long long int UNITY_INTERFACE_EXPORT GetTimeStamp(int* id)
     {
-        auto encodedFrame = IsEncodedFrameValid(id);
+        auto encoder = AcquireEncoder(id);
+        auto encodedFrame = GetConsumedFrame(encoder);
         if (encodedFrame == nullptr)
             return 0;
 
@@ -469,7 +600,8 @@ namespace MacOsEncodingPlugin
 
     extern "C" bool UNITY_INTERFACE_EXPORT GetIsKeyFrame(int* id)
     {
-        auto encodedFrame = IsEncodedFrameValid(id);
+        auto encoder = AcquireEncoder(id);
+        auto encodedFrame = GetConsumedFrame(encoder);
         if (encodedFrame == nullptr)
             return 0;
 
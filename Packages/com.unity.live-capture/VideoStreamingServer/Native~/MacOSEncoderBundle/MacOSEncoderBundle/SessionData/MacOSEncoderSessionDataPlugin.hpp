@@ -1,12 +1,34 @@
 #pragma once
 
 #include <iostream>
+#include <cstdint>
 #include <vector>
 
+#include "Bitstream.h"
+#include "EncoderStatistics.h"
+
 namespace MacOsEncodingPlugin
 {
+    // VideoCodec, SequenceInfo, the NAL unit definitions and the statistics are shared with the other plugins.
+    using namespace Bitstream;
+    using namespace Statistics;
+
     static const uint64_t BitRateInKilobits = 1000;
 
+    // Version of the exports, returned by GetApiVersion. Raised whenever an export is added or an exported
+    // struct changes, so that the managed side only calls the exports the loaded binary has.
+    static const int32_t k_PluginApiVersion = 3;
+
+    // The Unity Profiler markers of the plugin, named when the plugin is loaded.
+    enum class ProfilerMarker : uint32_t
+    {
+        EncodeFrame,
+        CopyTexture,
+        EncodePicture,
+        PostEncodeParser,
+        Count
+    };
+
     struct MacOSEncoderSessionData
     {
         MacOSEncoderSessionData() = default;
@@ -35,13 +57,44 @@ namespace MacOsEncodingPlugin
         R8G8B8
     };
 
+    // Trade-off between latency and throughput of an encoder session, chosen when it is created.
+    enum class EncoderPipelineMode : int32_t
+    {
+        // The depths used before the presets existed.
+        Default = 0,
+
+        // Few frames in flight: a frame is dropped as soon as the encoder or the consumer falls behind.
+        Latency,
+
+        // Deep pipeline for recording: frames are only dropped under sustained overload.
+        Throughput
+    };
+
+    static const uint32_t k_MaxFramesInFlight = 16;
+    static const uint32_t k_MaxEncodedQueueLength = 64;
+
+    // How many frames an encoder session keeps in flight and waiting to be consumed.
+    struct EncoderPipelineDepth
+    {
+        uint32_t framesInFlight;
+        uint32_t maxQueueLength;
+
+        // A value of 0 selects the one of the preset, the others are clamped to the supported range.
+        static EncoderPipelineDepth FromSettings(EncoderPipelineMode mode, int framesInFlight, int maxQueueLength);
+    };
+
     // Retrieve the encoder by using the id parameter and set it's new settings.
+    // The pipeline and codec fields are only read when the encoder is initialized.
     struct EncoderSettingsID
     {
         MacOSEncoderSessionData settings;
         int id;
         EncoderFormat encoderFormat;
         bool useSRGB;
+        EncoderPipelineMode pipelineMode;
+        int framesInFlight;
+        int maxQueueLength;
+        VideoCodec codec;
     };
 
     // Retrieve the encoder by using the id parameter and encode the renderTexture parameter.
@@ -50,6 +103,11 @@ namespace MacOsEncodingPlugin
         void* renderTexture;
         int id;
         unsigned long long int timestamp;
+
+        // SMPTE timecode of the frame, written in its timecode SEI message: frames in bits 0-7, seconds in
+        // bits 8-15, minutes in bits 16-23, hours in bits 24-29, the drop frame flag in bit 30 and the flag
+        // telling that the timecode is set in bit 31.
+        uint32_t timecode;
     };
 
     // Retrieve the encoder by using the id parameter, and get it's status.
@@ -59,11 +117,48 @@ namespace MacOsEncodingPlugin
         int id;
     };
 
+    static const uint32_t k_MaxNalUnitCount = 32;
+
+    // Location of a NAL unit payload (start code excluded) in the encoded image data.
+    struct NalUnitEntry
+    {
+        uint32_t offset;
+        uint32_t size;
+        uint32_t type;
+    };
+
+    // Everything the caller needs to consume a frame in a single call. Offsets are relative to the
+    // start of the caller buffer, which receives the VPS (HEVC only), the SPS, the PPS and the image
+    // data contiguously. NAL unit offsets are relative to imageOffset.
+    struct EncodedFrameDescriptor
+    {
+        unsigned long long int timestamp;
+        uint32_t               spsOffset;
+        uint32_t               spsSize;
+        uint32_t               ppsOffset;
+        uint32_t               ppsSize;
+        uint32_t               imageOffset;
+        uint32_t               imageSize;
+        uint32_t               totalSize;
+        uint32_t               isKeyFrame;
+        uint32_t               nalUnitCount;
+        NalUnitEntry           nalUnits[k_MaxNalUnitCount];
+        uint32_t               vpsOffset;
+        uint32_t               vpsSize;
+        uint32_t               sliceIndex;   // Always 0, frames aren't split into slices.
+        uint32_t               isLastSlice;  // Always 1.
+        SequenceInfo           sequenceInfo; // Zeroed unless the frame is a key frame.
+    };
+
     struct EncodedFrame
     {
+        std::vector<uint8_t>   vpsSequence; // Only set for HEVC.
         std::vector<uint8_t>   spsSequence;
         std::vector<uint8_t>   ppsSequence;
         std::vector<uint8_t>   imageData;
+        std::vector<NalUnitEntry> nalUnits;
+        SequenceInfo           sequenceInfo = {}; // Only set for key frames.
+        FrameTimings           timings;
         unsigned long long int timestamp;
         bool                   isKeyFrame;
     };
@@ -0,0 +1,94 @@
+#include "AvccConverter.hpp"
+
+#include <cstring>
+
+namespace MacOsEncodingPlugin
+{
+    static const uint8_t k_StartCode[4] = { 0x00, 0x00, 0x00, 0x01 };
+
+    static inline uint32_t ReadLength(const uint8_t* data, int lengthSize)
+    {
+        uint32_t length = 0;
+        for (int i = 0; i < lengthSize; ++i)
+            length = (length << 8) | data[i];
+        return length;
+    }
+
+    bool RewriteAvccInPlace(VideoCodec codec, uint8_t* data, size_t size, std::vector<NalUnitEntry>& nalUnits)
+    {
+        nalUnits.clear();
+
+        size_t offset = 0;
+        while (offset < size)
+        {
+            if (size - offset < sizeof(k_StartCode))
+                return false;
+
+            const auto length = ReadLength(data + offset, sizeof(k_StartCode));
+            const auto payload = offset + sizeof(k_StartCode);
+            if (length == 0 || length > size - payload)
+                return false;
+
+            std::memcpy(data + offset, k_StartCode, sizeof(k_StartCode));
+            nalUnits.push_back({ static_cast<uint32_t>(payload), length, GetNalUnitType(codec, data[payload]) });
+            offset = payload + length;
+        }
+        return true;
+    }
+
+    bool ConvertAvccToAnnexB(VideoCodec codec,
+                             const uint8_t* data,
+                             size_t size,
+                             int lengthSize,
+                             std::vector<uint8_t>& output,
+                             std::vector<NalUnitEntry>& nalUnits)
+    {
+        nalUnits.clear();
+
+        if (lengthSize != 1 && lengthSize != 2 && lengthSize != 4)
+            return false;
+
+        if (lengthSize == sizeof(k_StartCode))
+        {
+            output.assign(data, data + size);
+            return RewriteAvccInPlace(codec, output.data(), size, nalUnits);
+        }
+
+        // Validates the prefixes and sizes the output, without touching the NAL unit payloads.
+        size_t nalUnitCount = 0;
+        size_t offset = 0;
+        while (offset < size)
+        {
+            if (size - offset < static_cast<size_t>(lengthSize))
+                return false;
+
+            const auto length = ReadLength(data + offset, lengthSize);
+            if (length == 0 || length > size - offset - lengthSize)
+                return false;
+
+            offset += lengthSize + length;
+            nalUnitCount++;
+        }
+
+        output.resize(size + nalUnitCount * (sizeof(k_StartCode) - lengthSize));
+
+        auto out = output.data();
+        offset = 0;
+        while (offset < size)
+        {
+            const auto length = ReadLength(data + offset, lengthSize);
+            offset += lengthSize;
+
+            std::memcpy(out, k_StartCode, sizeof(k_StartCode));
+            out += sizeof(k_StartCode);
+
+            const auto payload = static_cast<uint32_t>(out - output.data());
+            std::memcpy(out, data + offset, length);
+            nalUnits.push_back({ payload, length, GetNalUnitType(codec, data[offset]) });
+
+            out += length;
+            offset += length;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef AvccConverter_hpp
+#define AvccConverter_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "MacOSEncoderSessionDataPlugin.hpp"
+
+namespace MacOsEncodingPlugin
+{
+    // Converts the length prefixed NAL units (AVCC / HVCC) output by VideoToolbox to the Annex-B format
+    // the consumers expect, and indexes them on the way so that they never scan the frame for start codes.
+    // Doesn't depend on VideoToolbox, the conversion is tested and benchmarked on Linux by the NVENC CMake
+    // project.
+    //
+    // Both return false if the data is not a sequence of non-empty NAL units, each prefixed by its size.
+
+    // Replaces 4 bytes big-endian length prefixes with 4 bytes start codes: the Annex-B access unit has the
+    // same size, so the conversion is done in place.
+    bool RewriteAvccInPlace(VideoCodec codec, uint8_t* data, size_t size, std::vector<NalUnitEntry>& nalUnits);
+
+    // Converts NAL units with 1, 2 or 4 bytes length prefixes into output, which is resized once and keeps
+    // its capacity from one frame to the next. With 4 bytes prefixes, the data is copied as is and then
+    // rewritten in place.
+    bool ConvertAvccToAnnexB(VideoCodec codec,
+                             const uint8_t* data,
+                             size_t size,
+                             int lengthSize,
+                             std::vector<uint8_t>& output,
+                             std::vector<NalUnitEntry>& nalUnits);
+}
+
+#endif /*AvccConverter_hpp*/
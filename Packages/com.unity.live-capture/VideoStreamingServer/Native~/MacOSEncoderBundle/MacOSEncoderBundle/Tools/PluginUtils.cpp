@@ -1,74 +1,63 @@
 #include "PluginUtils.hpp"
 
+#include <cstdlib>
+
 namespace MacOsEncodingPlugin
 {
     static const std::string k_FileName = "/MacOS_debug_file.log";
-    static std::string k_DefinitiveFilePath = "";
 
     void InitLog()
     {
         char* home = getenv("HOME");
         if (home == nullptr)
             return;
-        
-        k_DefinitiveFilePath = home;
-        k_DefinitiveFilePath.append(k_FileName);
+
+        std::string path = home;
+        path.append(k_FileName);
+
+#ifdef DEBUG_LOG
+        NativeLog::SetLevel(NativeLog::Level::Debug);
+#endif
+        NativeLog::Start(path, false);
     }
 
-    void WriteFileDebug(const char* const message, const bool append)
+    void ShutdownLog()
     {
-#ifdef DEBUG_LOG
-        std::ofstream myfile;
-        
-        if (append)
-        {
-            myfile.open(k_DefinitiveFilePath, std::ios_base::app | std::ios_base::out);
-        }
-        else
-        {
-            myfile.open(k_DefinitiveFilePath);
-        }
+        NativeLog::Stop();
+    }
 
-        myfile << message;
-        myfile.close();
-#endif
+    void SetDebugLogLevel(int level)
+    {
+        NativeLog::SetLevel(static_cast<NativeLog::Level>(level));
     }
 
-    void WriteFileDebug(const char* const message, int value, const bool append)
+    void WriteFileDebug(const char* const message, const bool /*append*/)
     {
-#ifdef DEBUG_LOG
-        std::ofstream myfile;
+        NativeLog::Write(LogLevel::Debug, message);
+    }
 
-        if (append)
-        {
-            myfile.open(k_DefinitiveFilePath, std::ios_base::app | std::ios_base::out);
-        }
-        else
-        {
-            myfile.open(k_DefinitiveFilePath);
-        }
+    void WriteFileDebug(const char* const message, int value, const bool /*append*/)
+    {
+        NativeLog::Write(LogLevel::Debug, message, value);
+    }
 
-        myfile << message << value << "\n";
-        myfile.close();
-#endif
+    void WriteFileDebug(const char* const message, unsigned long long value, const bool /*append*/)
+    {
+        NativeLog::Write(LogLevel::Debug, message, static_cast<int64_t>(value));
     }
 
-    void WriteFileDebug(const char* const message, unsigned long long value, const bool append)
+    void WriteFileDebug(LogLevel level, const char* const message, const bool /*append*/)
     {
-    #ifdef DEBUG_LOG
-        std::ofstream myfile;
+        NativeLog::Write(level, message);
+    }
 
-        if (append)
-        {
-            myfile.open(k_DefinitiveFilePath, std::ios_base::app | std::ios_base::out);
-        }
-        else
-        {
-            myfile.open(k_DefinitiveFilePath);
-        }
+    void WriteFileDebug(LogLevel level, const char* const message, int value, const bool /*append*/)
+    {
+        NativeLog::Write(level, message, value);
+    }
 
-        myfile << message << value << "\n";
-        myfile.close();
-    #endif
+    void WriteFileDebug(LogLevel level, const char* const message, unsigned long long value, const bool /*append*/)
+    {
+        NativeLog::Write(level, message, static_cast<int64_t>(value));
     }
 }
@@ -3,13 +3,32 @@
 #include <fstream>
 #include <sstream>
 
+#include "NativeLog.h"
+
 namespace MacOsEncodingPlugin
 {
+    using LogLevel = NativeLog::Level;
+
+    // Starts and stops the asynchronous writer of the debug log. Messages are only recorded at or above
+    // the runtime log level, which is Debug in DEBUG_LOG builds and None otherwise. Nothing is written,
+    // nor the file truncated, until a level is enabled.
     void InitLog();
 
+    void ShutdownLog();
+
+    void SetDebugLogLevel(int level);
+
+    // Messages without a level are Debug ones. The file is truncated when the log starts, append is kept for
+    // compatibility and ignored.
     void WriteFileDebug(const char* const message, const bool append = true);
 
     void WriteFileDebug(const char* const message, int value, const bool append = true);
 
     void WriteFileDebug(const char* const message, unsigned long long value, const bool append = true);
+
+    void WriteFileDebug(LogLevel level, const char* const message, const bool append = true);
+
+    void WriteFileDebug(LogLevel level, const char* const message, int value, const bool append = true);
+
+    void WriteFileDebug(LogLevel level, const char* const message, unsigned long long value, const bool append = true);
 }
@@ -0,0 +1,71 @@
+#include "TimecodeSei.hpp"
+
+#include <cstring>
+
+#include "BitWriter.h"
+
+namespace MacOsEncodingPlugin
+{
+    // sei_message of the timing: payloadType user_data_unregistered and payloadSize fit in a byte each.
+    static const uint8_t k_UserDataUnregistered = 5;
+    static const uint8_t k_TimecodeSeiPayloadSize = sizeof(k_TimecodeSeiUuid) + 4 + 8 + 8;
+    static const uint32_t k_TimecodeSeiRbspSize = 2 + k_TimecodeSeiPayloadSize + 1;
+
+    static inline void WriteBigEndian(uint64_t value, uint32_t byteCount, uint8_t* output)
+    {
+        for (uint32_t i = 0; i < byteCount; ++i)
+            output[i] = static_cast<uint8_t>(value >> (8 * (byteCount - 1 - i)));
+    }
+
+    bool InsertTimecodeSei(VideoCodec codec, const TimecodeSei& sei, std::vector<uint8_t>& data, std::vector<NalUnitEntry>& nalUnits)
+    {
+        size_t first = 0;
+        while (first < nalUnits.size() && !IsVclNalUnit(codec, nalUnits[first].type))
+            first++;
+
+        if (first == nalUnits.size())
+            return false;
+
+        // The SEI NAL unit is inserted before the start code of the VCL NAL unit, and its leading zero byte
+        // when it is 4 bytes long.
+        auto position = nalUnits[first].offset - 3;
+        if (position > 0 && data[position - 1] == 0)
+            position--;
+
+        // sei_rbsp: a single sei_message, then the trailing bits.
+        uint8_t rbsp[k_TimecodeSeiRbspSize];
+        rbsp[0] = k_UserDataUnregistered;
+        rbsp[1] = k_TimecodeSeiPayloadSize;
+        std::memcpy(rbsp + 2, k_TimecodeSeiUuid, sizeof(k_TimecodeSeiUuid));
+        WriteBigEndian(sei.timecode, 4, rbsp + 18);
+        WriteBigEndian(sei.timestamp, 8, rbsp + 22);
+        WriteBigEndian(sei.frameCount, 8, rbsp + 30);
+        rbsp[k_TimecodeSeiRbspSize - 1] = 0x80;
+
+        // Built apart then inserted, which moves the VCL NAL units once.
+        static const uint8_t k_StartCode[] = { 0x00, 0x00, 0x00, 0x01 };
+        std::vector<uint8_t> nalUnit(k_StartCode, k_StartCode + sizeof(k_StartCode));
+        nalUnit.reserve(2 * sizeof(k_StartCode) + 2 * k_TimecodeSeiRbspSize);
+
+        const auto seiType = codec == VideoCodec::HEVC ? k_HevcNalPrefixSei : k_H264NalSei;
+        if (codec == VideoCodec::HEVC)
+        {
+            nalUnit.push_back(static_cast<uint8_t>(seiType << 1));
+            nalUnit.push_back(0x01); // nuh_layer_id 0, nuh_temporal_id_plus1 1.
+        }
+        else
+        {
+            nalUnit.push_back(static_cast<uint8_t>(seiType));
+        }
+        AddEmulationPrevention(rbsp, sizeof(rbsp), nalUnit);
+
+        const auto shift = static_cast<uint32_t>(nalUnit.size());
+        data.insert(data.begin() + position, nalUnit.begin(), nalUnit.end());
+
+        for (auto i = first; i < nalUnits.size(); ++i)
+            nalUnits[i].offset += shift;
+        const auto seiOffset = position + static_cast<uint32_t>(sizeof(k_StartCode));
+        nalUnits.insert(nalUnits.begin() + first, { seiOffset, shift - static_cast<uint32_t>(sizeof(k_StartCode)), seiType });
+        return true;
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef TimecodeSei_hpp
+#define TimecodeSei_hpp
+
+#include <cstdint>
+#include <vector>
+
+#include "MacOSEncoderSessionDataPlugin.hpp"
+
+namespace MacOsEncodingPlugin
+{
+    // Identifies the user data unregistered SEI messages written by the plugins, see ITU-T H.264 D.1.7.
+    static const uint8_t k_TimecodeSeiUuid[16] =
+    {
+        0x6C, 0x1B, 0x3E, 0x2A, 0x95, 0x04, 0x4F, 0x0D, 0xA7, 0x61, 0x3C, 0xE8, 0x52, 0x9F, 0x0B, 0x74
+    };
+
+    // Timing of a captured frame, written in its access unit so that the clients can match it without a side
+    // channel. The SEI payload is the UUID followed by the three fields in big-endian order, the same as the
+    // NVENC plugin writes, which is where it is tested.
+    struct TimecodeSei
+    {
+        uint32_t timecode;   // Packed as in EncoderTextureID.
+        uint64_t timestamp;  // Capture time in nanoseconds, the RTP timestamp source.
+        uint64_t frameCount; // Frames submitted to the encoder before this one.
+    };
+
+    // Inserts a SEI NAL unit carrying the TimecodeSei before the first VCL NAL unit of an Annex-B access unit
+    // indexed by ConvertAvccToAnnexB, and updates the NAL unit table. Returns false if there is no slice data.
+    bool InsertTimecodeSei(VideoCodec codec, const TimecodeSei& sei, std::vector<uint8_t>& data, std::vector<NalUnitEntry>& nalUnits);
+}
+
+#endif /*TimecodeSei_hpp*/
@@ -15,15 +15,16 @@ namespace NvencPlugin
         virtual ~D3D11EncoderDevice();
 
         virtual bool Initialize() override;
-        virtual void InitializeConverter(const int width, const int height) override;
+        virtual INV12Converter* CreateConverter(const int width, const int height) override;
         virtual bool InitializeMultithreadingSecurity() override;
         virtual void Cleanup() override;
 
         virtual GraphicsDeviceType GetDeviceType() override;
         virtual ITexture2D* CreateDefaultTexture(uint32_t width, uint32_t height, bool forceNV12) override;
 
-        virtual bool ConvertRGBToNV12(IUnknown* nativeSrc, void* nativeDest) override;
+        virtual bool ConvertRGBToNV12(INV12Converter* converter, IUnknown* nativeSrc, void* nativeDest) override;
         virtual bool CopyResource(IUnknown* nativeDest, void* nativeSrc) override;
+        virtual void WaitForCopies() override;
 
         inline IUnknown* GetDevice() { return m_D3d11Device; }
 
@@ -34,6 +35,5 @@ namespace NvencPlugin
     private:
         ID3D11Device* m_D3d11Device;
         ID3D11DeviceContext* m_D3d11Context;
-        std::unique_ptr<RGBToNV12ConverterD3D11> m_Converter;
     };
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <comdef.h>
 #include <iostream>
 #include "d3d11_4.h"
@@ -23,36 +24,38 @@ namespace NvencPlugin
         virtual ~D3D12EncoderDevice();
 
         virtual bool Initialize() override;
-        virtual void InitializeConverter(const int width, const int height) override;
+        virtual INV12Converter* CreateConverter(const int width, const int height) override;
         virtual bool InitializeMultithreadingSecurity() override;
         virtual void Cleanup() override;
 
         virtual GraphicsDeviceType GetDeviceType() override;
         virtual ITexture2D* CreateDefaultTexture(uint32_t w, uint32_t h, bool forceNV12) override;
 
-        virtual bool ConvertRGBToNV12(IUnknown* nativeSrc, void* nativeDest) override;
+        virtual bool ConvertRGBToNV12(INV12Converter* converter, IUnknown* nativeSrc, void* nativeDest) override;
         virtual bool CopyResource(IUnknown* nativeDest, void* nativeSrc) override;
+        virtual void WaitForCopies() override;
 
         // Since NVENC does not support D3D12, we use new a D3D12 resource to create a ID3D11Texture2D
         // that can be shared with the D3D12 device and passed to the NvEncoder instance.
         inline IUnknown* GetDevice() { return m_d3d11Device; }
 
     private:
-        void WaitForFence(ID3D12Fence* fence, HANDLE handle, uint64_t* fenceValue);
+        void WaitForFence(ID3D12Fence* fence, HANDLE handle, uint64_t fenceValue);
 
         ID3D12Device* m_d3d12Device;
         ID3D12CommandQueue* m_d3d12CommandQueue;
 
         ID3D11Device5* m_d3d11Device;
         ID3D11DeviceContext4* m_d3d11Context;
-        std::unique_ptr<RGBToNV12ConverterD3D11> m_Converter;
 
         ID3D12CommandAllocatorPtr m_commandAllocator;
         ID3D12GraphicsCommandList4Ptr m_commandList;
 
-        ID3D12Fence* m_copyResourceFence;
-        HANDLE       m_copyResourceEventHandle;
-        uint64_t     m_copyResourceFenceValue;
+        // The render thread signals the fence after each copy, the submission threads of the encoder
+        // sessions wait for it.
+        ID3D12Fence*          m_copyResourceFence;
+        HANDLE                m_copyResourceEventHandle;
+        std::atomic<uint64_t> m_copyResourceFenceValue;
 
         // Create a D3D11 NV12 texture.
         ID3D11Texture2D* CreateNV12Texture(uint32_t width, uint32_t height);
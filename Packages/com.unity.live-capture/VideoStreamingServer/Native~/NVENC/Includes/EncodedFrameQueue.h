@@ -0,0 +1,206 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <limits>
+
+#include "CacheLine.h"
+
+namespace NvencPlugin
+{
+    // A bounded single-producer/single-consumer queue of preallocated slots.
+    //
+    // The producer (encoder completion thread) fills a slot in place with BeginWrite/EndWrite.
+    // The consumer (Unity main thread) borrows the oldest slot with Front and gives it back with Pop,
+    // so no element is copied, moved or allocated once the slots have reached their working size.
+    //
+    // A slot holds a frame or one of its slices. When more than maxLength slots are waiting, the producer
+    // drops the oldest frame, like the previous std::queue implementation did. The slot borrowed by the
+    // consumer is never overwritten: if the producer would wrap onto it, the new frame is dropped instead.
+    //
+    // Frames are dropped whole, since a decoder can't use a part of one: once a slice is dropped, the
+    // next slices of its frame are refused and the ones still queued are dropped as well. The consumer
+    // skips the slices of a frame whose start it hasn't received. Every dropped frame is counted once.
+    template <typename T> class EncodedFrameQueue final
+    {
+        static constexpr uint64_t k_None = std::numeric_limits<uint64_t>::max();
+
+        struct SlotInfo
+        {
+            uint64_t frame = 0;
+            bool     isFrameStart = true;
+        };
+
+    public:
+        EncodedFrameQueue() = default;
+        EncodedFrameQueue(const EncodedFrameQueue&) = delete;
+        EncodedFrameQueue& operator=(const EncodedFrameQueue&) = delete;
+
+        // Allocates the slots. Must not be called while a producer or consumer is active.
+        inline void Initialize(uint32_t maxLength)
+        {
+            m_MaxLength = maxLength;
+
+            // One extra slot for the frame borrowed by the consumer and one for the frame being written.
+            m_Slots.resize(static_cast<size_t>(maxLength) + 2);
+            m_SlotInfos.resize(m_Slots.size());
+            Clear();
+        }
+
+        // Producer: returns the slot to fill, or nullptr if the frame has to be dropped. isFrameStart is
+        // false for the slices of a frame after the first one.
+        inline T* BeginWrite(bool isFrameStart = true)
+        {
+            if (isFrameStart)
+                m_WriteFrame++;
+            else if (m_DroppedFrame == m_WriteFrame)
+                return nullptr;
+
+            const auto tail = m_Tail.load(std::memory_order_relaxed);
+            auto head = m_Head.load();
+
+            // Only the producer writes the slot infos: reading the one of a slot the consumer just claimed
+            // is safe, the compare exchange then fails.
+            while (head != tail)
+            {
+                const auto frame = m_SlotInfos[head % m_Slots.size()].frame;
+                if (tail - head < m_MaxLength && frame != m_DroppedFrame)
+                    break;
+
+                if (m_Head.compare_exchange_weak(head, head + 1))
+                {
+                    DropFrame(frame);
+                    head++;
+                }
+            }
+
+            const auto borrowed = m_Borrowed.load();
+            if (borrowed != k_None && (tail - borrowed) % m_Slots.size() == 0)
+            {
+                DropFrame(m_WriteFrame);
+                return nullptr;
+            }
+
+            auto& slotInfo = m_SlotInfos[tail % m_Slots.size()];
+            slotInfo.frame = m_WriteFrame;
+            slotInfo.isFrameStart = isFrameStart;
+            return &m_Slots[tail % m_Slots.size()];
+        }
+
+        // Producer: drops the frame being written, e.g. when one of its slices is invalid. isFrameStart is
+        // true if none of its slices was written yet. Its next slices are refused, as after an overflow.
+        inline void DropWrite(bool isFrameStart = true)
+        {
+            if (isFrameStart)
+                m_WriteFrame++;
+            DropFrame(m_WriteFrame);
+        }
+
+        // Producer: publishes the slot returned by BeginWrite.
+        inline void EndWrite()
+        {
+            m_Tail.store(m_Tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        // Consumer: borrows the oldest frame until Pop is called. Returns nullptr if the queue is empty.
+        inline T* Front()
+        {
+            const auto borrowed = m_Borrowed.load(std::memory_order_relaxed);
+            if (borrowed != k_None)
+                return &m_Slots[borrowed % m_Slots.size()];
+
+            auto head = m_Head.load();
+            for (;;)
+            {
+                if (head == m_Tail.load(std::memory_order_acquire))
+                {
+                    m_Borrowed.store(k_None);
+                    return nullptr;
+                }
+
+                // Announce the slot before claiming it so the producer never wraps onto it.
+                m_Borrowed.store(head);
+                if (m_Head.compare_exchange_weak(head, head + 1))
+                {
+                    // The start of the frame was dropped: the slice can't be decoded.
+                    const auto& slotInfo = m_SlotInfos[head % m_Slots.size()];
+                    if (slotInfo.isFrameStart || slotInfo.frame == m_ReadFrame)
+                    {
+                        m_ReadFrame = slotInfo.frame;
+                        return &m_Slots[head % m_Slots.size()];
+                    }
+                    head++;
+                }
+            }
+        }
+
+        // Consumer: gives back the frame returned by Front.
+        inline bool Pop()
+        {
+            return m_Borrowed.exchange(k_None) != k_None;
+        }
+
+        // Consumer: the position of the frame returned by Front, unique for the lifetime of the queue.
+        inline bool GetBorrowedIndex(uint64_t& index) const
+        {
+            index = m_Borrowed.load(std::memory_order_relaxed);
+            return index != k_None;
+        }
+
+        // Must not be called while a producer or consumer is active.
+        inline void Clear()
+        {
+            m_Head = 0;
+            m_Tail = 0;
+            m_Borrowed = k_None;
+            m_WriteFrame = 0;
+            m_DroppedFrame = k_None;
+            m_ReadFrame = k_None;
+        }
+
+        inline uint32_t Size() const
+        {
+            return static_cast<uint32_t>(m_Tail.load(std::memory_order_acquire) - m_Head.load());
+        }
+
+        // The number of frames dropped, whatever their number of slices.
+        inline uint64_t GetDroppedCount() const { return m_DroppedCount; }
+
+    private:
+        // Producer: counts the frame the first time one of its slices is dropped.
+        inline void DropFrame(uint64_t frame)
+        {
+            if (frame != m_DroppedFrame)
+            {
+                m_DroppedFrame = frame;
+                m_DroppedCount++;
+            }
+        }
+
+        std::vector<T>        m_Slots;
+        std::vector<SlotInfo> m_SlotInfos;
+        uint32_t              m_MaxLength = 0;
+
+        // Only accessed by the producer.
+        uint64_t m_WriteFrame = 0;
+        uint64_t m_DroppedFrame = k_None;
+
+        // Only accessed by the consumer.
+        uint64_t m_ReadFrame = k_None;
+
+        // Each on its own cache line, see CacheLine.h.
+        using Padding = Threading::CacheLinePadding<sizeof(std::atomic<uint64_t>)>;
+
+        Threading::CacheLinePadding<0> m_FirstPadding;
+        std::atomic<uint64_t>          m_Head = { 0 };
+        Padding                        m_HeadPadding;
+        std::atomic<uint64_t>          m_Tail = { 0 };
+        Padding                        m_TailPadding;
+        std::atomic<uint64_t>          m_Borrowed = { k_None };
+        Padding                        m_BorrowedPadding;
+        std::atomic<uint64_t>          m_DroppedCount = { 0 };
+        Padding                        m_DroppedCountPadding;
+    };
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cstdint>
+
+#include "NvencPlatform.h"
+
 namespace NvencPlugin
 {
     enum class GraphicsDeviceType
@@ -9,9 +13,20 @@ namespace NvencPlugin
         GRAPHICS_DEVICE_OPENGL,
         GRAPHICS_DEVICE_METAL,
         GRAPHICS_DEVICE_VULKAN,
+        GRAPHICS_DEVICE_CPU,
+    };
+
+    // The RGB to NV12 conversion state of one encoder session, sized to its frames.
+    class INV12Converter
+    {
+    public:
+        virtual ~INV12Converter() {}
     };
 
     class ITexture2D;
+
+    // Shared by all the encoder sessions of the graphics device: the state specific to a session, like
+    // its converter, is owned by the session.
     class IGraphicsEncoderDevice
     {
     public:
@@ -19,13 +34,17 @@ namespace NvencPlugin
         virtual ~IGraphicsEncoderDevice() {}
 
         virtual bool Initialize() = 0;
-        virtual void InitializeConverter(const int width, const int height) = 0;
+        virtual INV12Converter* CreateConverter(const int width, const int height) = 0;
         virtual bool InitializeMultithreadingSecurity() = 0;
         virtual void Cleanup() = 0;
 
-        virtual bool ConvertRGBToNV12(IUnknown* nativeSrc, void* nativeDest) = 0;
+        virtual bool ConvertRGBToNV12(INV12Converter* converter, IUnknown* nativeSrc, void* nativeDest) = 0;
         virtual bool CopyResource(IUnknown* nativeSrc, void* nativeDest) = 0;
 
+        // Copies may only be enqueued on the GPU. Blocks until the ones enqueued so far can be read by
+        // the encoder; can be called from another thread than the copies.
+        virtual void WaitForCopies() = 0;
+
         virtual ITexture2D* CreateDefaultTexture(uint32_t width, uint32_t height, bool forceNV12) = 0;
 
         virtual GraphicsDeviceType GetDeviceType() = 0;
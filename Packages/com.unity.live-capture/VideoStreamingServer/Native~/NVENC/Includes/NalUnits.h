@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "NvencEncoderSessionData.h"
+
+namespace NvencPlugin
+{
+    // VPS, SPS & PPS of an encoder session without their start codes, shared by all the key frames
+    // encoded with the same settings. The VPS is only used by HEVC.
+    struct ParameterSets
+    {
+        std::vector<uint8_t> vpsSequence;
+        std::vector<uint8_t> spsSequence;
+        std::vector<uint8_t> ppsSequence;
+        SequenceInfo         sequenceInfo = {};
+    };
+
+    // Identifies the user data unregistered SEI messages written by the plugin, see ITU-T H.264 D.1.7.
+    static const uint8_t k_TimecodeSeiUuid[16] =
+    {
+        0x6C, 0x1B, 0x3E, 0x2A, 0x95, 0x04, 0x4F, 0x0D, 0xA7, 0x61, 0x3C, 0xE8, 0x52, 0x9F, 0x0B, 0x74
+    };
+
+    // Timing of a captured frame, written in its access unit so that the clients can match it without a side
+    // channel. The SEI payload is the UUID followed by the three fields in big-endian order.
+    struct TimecodeSei
+    {
+        uint32_t timecode;   // Packed as in EncoderTextureID.
+        uint64_t timestamp;  // Capture time in nanoseconds, the RTP timestamp source.
+        uint64_t frameCount; // Frames submitted to the encoder before this one.
+    };
+
+    // payloadType of the user data unregistered SEI messages, and payloadSize of the timecode ones.
+    static const uint32_t k_UserDataUnregisteredSei = 5;
+    static const uint32_t k_TimecodeSeiPayloadSize = sizeof(k_TimecodeSeiUuid) + 4 + 8 + 8;
+
+    // Writes the k_TimecodeSeiPayloadSize bytes of the payload of a timecode SEI message, as passed to the
+    // driver in NV_ENC_SEI_PAYLOAD.
+    void WriteTimecodeSeiPayload(const TimecodeSei& sei, uint8_t* payload);
+
+    // Appends a 4 bytes start code and a SEI NAL unit carrying a single sei_message, like the driver writes
+    // each NV_ENC_SEI_PAYLOAD.
+    void AppendSeiNalUnit(VideoCodec codec, uint32_t payloadType, const uint8_t* payload, uint32_t payloadSize,
+                          std::vector<uint8_t>& output);
+
+    // Indexes the Annex-B NAL units of an access unit (3 or 4 bytes start codes). The start codes are
+    // searched with SSE2 (AVX2 when the build targets it) or NEON, 16 or 32 bytes at a time.
+    void FindNalUnits(VideoCodec codec, const uint8_t* data, uint32_t size, std::vector<NalUnitEntry>& nalUnits);
+
+    // Copies an access unit, or its first slice, and inserts a SEI NAL unit carrying the TimecodeSei before its
+    // first VCL NAL unit, after the SEI messages the encoder wrote. Indexes the NAL units of the copy. The
+    // encoder has the driver write the message instead, this is for the streams encoded without it.
+    void CopyWithTimecodeSei(VideoCodec codec, const uint8_t* data, uint32_t size, const TimecodeSei& sei,
+                             std::vector<uint8_t>& output, std::vector<NalUnitEntry>& nalUnits);
+
+    // Reads a SEI NAL unit (start code excluded) carrying a timecode SEI message. Returns false for the other
+    // SEI messages.
+    bool ReadTimecodeSei(VideoCodec codec, const uint8_t* data, uint32_t size, TimecodeSei& sei);
+
+    // Splits the Annex-B parameter sets returned by the driver. Returns false if the SPS or the PPS,
+    // or the VPS for HEVC, is missing. The sequence info is left invalid if they can't be parsed.
+    bool ExtractParameterSets(VideoCodec codec, const uint8_t* data, uint32_t size, ParameterSets& parameterSets);
+}
@@ -3,37 +3,26 @@
 #include <mutex>
 #include <queue>
 #include <list>
+#include <memory>
+#include <chrono>
+#include <condition_variable>
 
 #include "nvEncodeAPI.h"
-#include "d3d11.h"
 
 #include "Unity/IUnityGraphics.h"
+#include "NvencPlatform.h"
+#include "NvencModule.h"
 #include "NvencFrame.h"
 #include "NvencEncoderSessionData.h"
 #include "IGraphicsEncoderDevice.h"
+#include "EncodedFrameQueue.h"
+#include "EncoderStatistics.h"
+#include "SubmissionQueue.h"
 
 #include "NvThread.h"
 
 namespace NvencPlugin
 {
-    enum class ENvencSupport
-    {
-        Supported,
-        NotSupportedOnPlatform,
-        NoDriver,
-        DriverVersionNotSupported
-    };
-
-    enum class ENvencStatus
-    {
-        NotInitialized,
-        Success,
-        DriverNotInstalled,
-        DriverVersionDoesNotSupportAPI,
-        APINotFound,
-        EncoderInitializationFailed
-    };
-
     struct EncodedFrameDataKey
     {
         int index;
@@ -41,20 +30,37 @@ namespace NvencPlugin
         bool isKeyFrame;
     };
 
-    class NvEncoder
+    // A frame copied by the render thread, waiting to be submitted to the driver.
+    struct SubmitCommand
     {
-        using NvEncodeAPICreateInstance_Type = NVENCSTATUS(NVENCAPI*)(NV_ENCODE_API_FUNCTION_LIST*);
-        using DataSequence = std::vector<uint8_t>;
+        int                    frameIndex;
+        uint64_t               frameCount;
+        unsigned long long int timeStamp;
+        uint32_t               timecode;
+        uint64_t               copyTime;
+    };
 
+    class NvEncoder
+    {
         const int  k_MaxWidth = 3840;
         const int  k_MaxHeight = 2160;
-        const int  k_MaxQueueLength = 8;
+
+        // Frames kept in the DPB as short-term references, long-term references, and the number of
+        // frames between two long-term references.
+        static const uint32_t k_MaxReferenceFrames = 4;
+        static const uint32_t k_MaxLtrFrames = 2;
+        static const uint64_t k_LtrPeriod = 30;
+        static const uint64_t k_NoLostFrame = UINT64_MAX;
 
     public:
         NvEncoder(NV_ENC_DEVICE_TYPE deviceType,
                   const NvencEncoderSessionData& other,
                   IGraphicsEncoderDevice* device,
-                  bool forceNv12);
+                  bool forceNv12,
+                  const EncoderPipelineDepth& depth = EncoderPipelineDepth::FromSettings(EncoderPipelineMode::Default, 0, 0),
+                  VideoCodec codec = VideoCodec::H264,
+                  int sliceCount = 1,
+                  int intraRefreshFrames = 0);
 
         ~NvEncoder() = default;
 
@@ -64,24 +70,43 @@ namespace NvencPlugin
         ENvencStatus InitEncoder();
         void         DestroyResources();
 
-        // Update & Encode
+        // Update & Encode. EncodeFrame only copies the frame, it is submitted by the submission thread. The
+        // timecode is packed as in EncoderTextureID.
         bool         UpdateEncoderSessionData(const NvencEncoderSessionData& other);
-        void         EncodeFrame(void* frameSourceData, unsigned long long int timeStamp);
+        void         EncodeFrame(void* frameSourceData, unsigned long long int timeStamp, uint32_t timecode = 0);
+
+        // Forces the next encoded frame to be an IDR frame. Can be called from any thread.
+        void         RequestKeyFrame();
+
+        // A client lost the frames encoded from the timestamp onward. The next frame references a frame
+        // the client still has, or is an IDR frame if there is none. Can be called from any thread.
+        void         InvalidateReferenceFrames(unsigned long long int timeStamp);
 
         // Get encoded frames
         bool          RemoveEncodedFrame();
         EncodedFrame* GetEncodedFrame();
-        void          GetSequenceParams(DataSequence& spsSequence, DataSequence& ppsSequence);
+        uint64_t      GetDroppedFrameCount() const;
+        void          GetStats(EncoderStats& stats) const;
+
+        // Lend the oldest encoded frame without copying it.
+        bool          AcquireEncodedFrame(EncodedFrameView& view);
+        bool          ReleaseEncodedFrame(uint64_t token);
+        bool          GetSequenceParams(ParameterSets& parameterSets);
 
         // Getters
         inline bool  IsInitialized() { return m_InitializationResult == ENvencStatus::Success; }
+        inline VideoCodec GetCodec() const { return m_Codec; }
+        CompletionThreadLoad GetCompletionThreadLoad() const;
 
     private:
         // Initialize / destroy resources
-        static HMODULE LoadModule();
-        static bool    CheckDriverVersion(HMODULE module);
         ENvencStatus   LoadCodec();
         void           SetEncoderParameters();
+        void           SetSliceMode();
+        bool           SetIntraRefresh();
+        bool           IsIntraRefreshEnabled() const;
+        void           SetReferenceFrames();
+        int            GetEncodeCaps(NV_ENC_CAPS caps);
 
         // Initialize encoding resources
         void                  MapResources(InputFrame& inputFrame);
@@ -91,17 +116,33 @@ namespace NvencPlugin
 
         //Encoding frames
         void UpdateSettings();
+        void WaitForCompletionIdle();
+        bool SetRateControl(int bitRate, int frameRate);
+        bool ReconfigureEncoder(bool resetEncoder);
+        void ApplyPendingRateControl();
+        void RefreshParameterSets();
+
+        // Loss recovery, on the thread submitting the frames.
+        bool     RecoverLostFrames(uint64_t lostTimeStamp, NV_ENC_PIC_PARAMS& picParams);
+        uint32_t MarkLongTermReference(bool isKeyFrame, NV_ENC_PIC_PARAMS& picParams);
+        void     AddReferenceFrame(const SubmitCommand& command, bool isKeyFrame, uint32_t ltrIndex);
+
+        static uint64_t PackRateControl(int bitRate, int frameRate);
         bool CopyBufferResources(int frameIndex, void* frameSourceData);
+        void SubmitFrame(const SubmitCommand& command);
         void ProcessEncodedFrame(Frame& frame, unsigned long long int timeStamp, bool isKeyFrame);
+        uint32_t ReadBitstream(Frame& frame, unsigned long long int timeStamp, bool isKeyFrame);
+        uint32_t ReadBitstreamSlices(Frame& frame, unsigned long long int timeStamp, bool isKeyFrame);
 
         // Release Resources
-        void UnloadModule();
         void ReleaseFrameInputBuffer(Frame& frame);
         void ReleaseEncoderResources();
         void ClearEncodedFrameQueue();
 
         // Encoded frame actions
-        void AddEncodedFrame(Frame& frame, unsigned long long int timeStamp, bool isKeyFrame);
+        void AddEncodedFrame(const uint8_t* data, uint32_t size, unsigned long long int timeStamp, bool isKeyFrame,
+                             const Frame& frame, uint32_t sliceIndex, bool isLastSlice);
+        void RecordConsumedFrame();
 
         // Async methods
         void InitializeAsyncResources();
@@ -111,13 +152,14 @@ namespace NvencPlugin
         Frame& GetBufferedFrame(int index);
 
         static void ProcessEncodedFrameAsyncSingle(NvEncoder* encoder);
+        static void SubmitFramesAsync(NvEncoder* encoder);
 
     private:
-        // Device specific
-        IGraphicsEncoderDevice* m_Device;
+        // Device specific. The device is shared with the other sessions, the converter isn't.
+        IGraphicsEncoderDevice*         m_Device;
+        std::unique_ptr<INV12Converter> m_Converter;
 
-        // Load Codec
-        void* m_HModule;
+        // The library is shared by the sessions, see NvencModule.
         void* m_HEncoder;
 
         // Open an encode session
@@ -134,25 +176,82 @@ namespace NvencPlugin
         NvencEncoderSessionData m_FrameData;
         uint64_t                m_FrameCount;
         uint64_t                m_GOPCount;
+        std::atomic<bool>       m_KeyFrameRequested = { true };
         bool                    m_ForceNV12;
+        const VideoCodec        m_Codec;
+
+        // Requested number of slices per frame; above 1, each slice is queued as soon as it is written
+        // (sub-frame output). The frame slice count is the one used for the current height.
+        const uint32_t          m_SliceCount;
+        std::atomic<uint32_t>   m_FrameSliceCount = { 1 };
+
+        // Number of frames an intra refresh is spread over, 0 for periodic IDR frames.
+        const uint32_t          m_IntraRefreshFrames;
+
+        // Loss recovery. The lost timestamp is set by any thread, the references are only used by the
+        // thread submitting the frames: the frames of the DPB (oldest first) and the long-term ones.
+        struct ReferenceFrame
+        {
+            unsigned long long int timeStamp;
+            uint64_t               inputTimeStamp;
+            bool                   isValid;
+        };
+        std::atomic<uint64_t>   m_LostTimeStamp = { k_NoLostFrame };
+        bool                    m_IsRefInvalidationSupported = false;
+        uint32_t                m_LtrFrameCount = 0;
+        ReferenceFrame          m_References[k_MaxReferenceFrames] = {};
+        uint32_t                m_ReferenceCount = 0;
+        ReferenceFrame          m_LtrFrames[k_MaxLtrFrames] = {};
+        uint32_t                m_NextLtrIndex = 0;
+        uint64_t                m_FramesSinceLtr = 0;
         
         // Global resources. Note from NVIDIA doc:
         // "It is also recommended to allocate many input and output buffers
         // in order to avoid resource hazards and improve overall encoder throughput."
-        ITexture2D* m_RenderTextures[k_BufferedFrameNum];
-        Frame       m_BufferedFrames[k_BufferedFrameNum];
+        // Only the first m_BufferedFrameNum frames are used, as set by the pipeline depth.
+        const uint32_t m_BufferedFrameNum;
+        ITexture2D*    m_RenderTextures[k_MaxFramesInFlight];
+        Frame          m_BufferedFrames[k_MaxFramesInFlight];
 
-        std::queue<EncodedFrame>  m_FrameQueue;
+        // Queried from the driver once per (re)configuration instead of once per frame.
+        std::shared_ptr<const ParameterSets> m_ParameterSets;
+
+        // Filled by the completion thread (or the render thread in sync mode), consumed by the main thread.
+        EncodedFrameQueue<EncodedFrame> m_FrameQueue;
 
         // Async members
         std::vector<void*> m_vpCompletionEvent;
         std::queue<EncodedFrameDataKey> m_BufferToRead;
 
+        // The completion thread sleeps on this condition until a submitted frame is pending
+        // or the encoder is destroyed, then blocks on the frame completion event.
         NvThread* m_Thread;
-        NvSpinlock m_NvSpinlock;
+        std::mutex m_PendingLock;
+        std::condition_variable m_PendingCondition;
+
+        // Notified by the completion thread each time it has read a frame, see WaitForCompletionIdle.
+        std::condition_variable m_CompletionIdleCondition;
+
+        // Frames copied by the render thread, submitted to the driver by the submission thread. Without
+        // it (the device can't be shared between threads), the render thread submits the frames itself.
+        Threading::SubmissionQueue<SubmitCommand, k_MaxFramesInFlight> m_SubmissionQueue;
+        NvThread* m_SubmissionThread;
+
+        // Bit rate (high 32 bits) and frame rate set by the render thread, applied by the submission
+        // thread before its next frame. 0 when nothing is pending. m_FrameData keeps the rates of the
+        // last full update: the render thread remembers the ones it requested since in m_RequestedRateControl.
+        std::atomic<uint64_t> m_PendingRateControl = { 0 };
+        uint64_t              m_RequestedRateControl = 0;
+
+        std::atomic<uint64_t> m_CompletionIdleTime = { 0 };
+        std::atomic<uint64_t> m_CompletionBusyTime = { 0 };
+        std::atomic<uint64_t> m_CompletionWaitTime = { 0 };
+        std::atomic<uint64_t> m_CompletionFrameCount = { 0 };
+
+        EncoderStatistics m_Statistics;
 
         int32_t m_nEncoderBuffer = 0;
         bool m_IsAsync;
-        
+
     };
 }
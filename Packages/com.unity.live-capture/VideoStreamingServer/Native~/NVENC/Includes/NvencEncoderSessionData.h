@@ -1,11 +1,34 @@
 #pragma once
 
 #include <iostream>
+#include <cstdint>
+
+#include "Bitstream.h"
+#include "EncoderStatistics.h"
 
 namespace NvencPlugin
 {
+    // VideoCodec, SequenceInfo, the NAL unit definitions and the statistics are shared with the other plugins.
+    using namespace Bitstream;
+    using namespace Statistics;
+
     static const uint64_t BitRateInKilobits = 1000;
 
+    // Version of the exports, returned by GetApiVersion. Raised whenever an export is added or an exported
+    // struct changes, so that the managed side only calls the exports the loaded binary has.
+    static const int32_t k_PluginApiVersion = 4;
+
+    // The Unity Profiler markers of the plugin, named when the plugin is loaded.
+    enum class ProfilerMarker : uint32_t
+    {
+        EncodeFrame,
+        CopyResource,
+        ConvertRGBToNV12,
+        EncodePicture,
+        LockBitstream,
+        Count
+    };
+
     struct NvencEncoderSessionData
     {
         NvencEncoderSessionData() = default;
@@ -34,14 +57,52 @@ namespace NvencPlugin
         R8G8B8
     };
 
+    // Trade-off between latency and throughput of an encoder session, chosen when it is created.
+    enum class EncoderPipelineMode : int32_t
+    {
+        // The depths used before the presets existed.
+        Default = 0,
+
+        // Few frames in flight: a frame is dropped as soon as the encoder or the consumer falls behind.
+        Latency,
+
+        // Deep pipeline for recording: frames are only dropped under sustained overload.
+        Throughput
+    };
+
+    static const uint32_t k_MaxFramesInFlight = 16;
+    static const uint32_t k_MaxEncodedQueueLength = 64;
+    static const uint32_t k_MaxSliceCount = 16;
+
+    // How many frames an encoder session keeps in flight and waiting to be consumed.
+    struct EncoderPipelineDepth
+    {
+        uint32_t framesInFlight;
+        uint32_t maxQueueLength;
+
+        // A value of 0 selects the one of the preset, the others are clamped to the supported range.
+        static EncoderPipelineDepth FromSettings(EncoderPipelineMode mode, int framesInFlight, int maxQueueLength);
+    };
+
     class NvEncoder;
 
     // Retrieve the encoder by using the id parameter and set it's new settings.
+    // The pipeline, codec, slice and intra refresh fields are only read when the encoder is initialized.
+    // With a sliceCount above 1, every frame is split in slices that are queued as soon as they are
+    // encoded. With intraRefreshFrames above 0, gradual intra refreshes spread over that many frames
+    // replace the periodic IDR frames. They follow each other, or start every gopSize frames when the
+    // GOP is longer than a refresh.
     struct EncoderSettingsID
     {
         NvencEncoderSessionData settings;
         int id;
         EncoderFormat encoderFormat;
+        EncoderPipelineMode pipelineMode;
+        int framesInFlight;
+        int maxQueueLength;
+        VideoCodec codec;
+        int sliceCount;
+        int intraRefreshFrames;
     };
 
     // Retrieve the encoder by using the id parameter and encode the renderTexture parameter.
@@ -50,6 +111,11 @@ namespace NvencPlugin
         void* renderTexture;
         int id;
         unsigned long long int timestamp;
+
+        // SMPTE timecode of the frame, written in its timecode SEI message: frames in bits 0-7, seconds in
+        // bits 8-15, minutes in bits 16-23, hours in bits 24-29, the drop frame flag in bit 30 and the flag
+        // telling that the timecode is set in bit 31.
+        uint32_t timecode;
     };
 
     // Retrieve the encoder by using the id parameter, and get it's status.
@@ -58,4 +124,73 @@ namespace NvencPlugin
         bool isValid;
         int id;
     };
+
+    static const uint32_t k_MaxNalUnitCount = 32;
+
+    // Location of a NAL unit payload (start code excluded) in the encoded image data.
+    struct NalUnitEntry
+    {
+        uint32_t offset;
+        uint32_t size;
+        uint32_t type;
+    };
+
+    // Everything the caller needs to consume a frame in a single call. Offsets are relative to the
+    // start of the caller buffer, which receives the VPS (HEVC only), the SPS, the PPS and the image
+    // data contiguously. NAL unit offsets are relative to imageOffset. With sub-frame output, the
+    // image is a single slice of the frame and only the first slice carries the parameter sets.
+    struct EncodedFrameDescriptor
+    {
+        unsigned long long int timestamp;
+        uint32_t               spsOffset;
+        uint32_t               spsSize;
+        uint32_t               ppsOffset;
+        uint32_t               ppsSize;
+        uint32_t               imageOffset;
+        uint32_t               imageSize;
+        uint32_t               totalSize;
+        uint32_t               isKeyFrame;
+        uint32_t               nalUnitCount;
+        NalUnitEntry           nalUnits[k_MaxNalUnitCount];
+        uint32_t               vpsOffset;
+        uint32_t               vpsSize;
+        uint32_t               sliceIndex;
+        uint32_t               isLastSlice;
+        SequenceInfo           sequenceInfo; // Zeroed unless the image is the first slice of a key frame.
+    };
+
+    // A frame lent to the caller by AcquireEncodedFrame, laid out like EncodedFrameDescriptor but pointing
+    // at the plugin buffers instead of a copy. The pointers stay valid and unchanged until the frame is
+    // given back with ReleaseEncodedFrame and the token. The parameter sets are null unless the image is
+    // the first slice of a key frame.
+    struct EncodedFrameView
+    {
+        unsigned long long int timestamp;
+        uint64_t               token;
+        const uint8_t*         vps;
+        const uint8_t*         sps;
+        const uint8_t*         pps;
+        const uint8_t*         image;
+        const NalUnitEntry*    nalUnits;
+        uint32_t               vpsSize;
+        uint32_t               spsSize;
+        uint32_t               ppsSize;
+        uint32_t               imageSize;
+        uint32_t               nalUnitCount;
+        uint32_t               isKeyFrame;
+        uint32_t               sliceIndex;
+        uint32_t               isLastSlice;
+        SequenceInfo           sequenceInfo;
+    };
+
+    // Time spent by the async completion thread waiting for work (idle), waiting for the
+    // driver to finish encoding a submitted frame (wait) and reading back and queuing encoded
+    // frames (busy), in microseconds.
+    struct CompletionThreadLoad
+    {
+        uint64_t idleTime;
+        uint64_t busyTime;
+        uint64_t frameCount;
+        uint64_t waitTime;
+    };
 }
@@ -1,9 +1,11 @@
 #pragma once
 
 #include "nvEncodeAPI.h"
-#include "d3d11.h"
+#include "NvencEncoderSessionData.h"
+#include "NalUnits.h"
 
 #include <vector>
+#include <memory>
 #include <atomic>
 #include <fstream>
 #include <sstream>
@@ -13,9 +15,6 @@ namespace NvencPlugin
 {
     using OutputFrame = NV_ENC_OUTPUT_PTR;
 
-    const uint32_t k_BufferedFrameNum = 4;
-    const uint32_t k_GOPSize = 2;
-
     struct InputFrame
     {
         NV_ENC_REGISTERED_PTR registeredResource;
@@ -27,17 +26,24 @@ namespace NvencPlugin
     {
         InputFrame           inputFrame;
         OutputFrame          outputFrame;
-        std::vector<uint8_t> encodedFrame;
-        std::atomic<bool>    isEncoding = false;
-        std::atomic<bool>    isEncoded = false;
+        FrameTimings         timings;
+        // The timecode SEI message of the frame, written by the driver: kept until the frame is read.
+        NV_ENC_SEI_PAYLOAD   timecodeSei = {};
+        uint8_t              timecodeSeiPayload[k_TimecodeSeiPayloadSize] = {};
+        std::atomic<bool>    isEncoding = { false };
+        std::atomic<bool>    isEncoded = { false };
     };
 
+    // A whole frame, or a single slice of it with sub-frame output.
     struct EncodedFrame
     {
-        std::vector<uint8_t>   spsSequence;
-        std::vector<uint8_t>   ppsSequence;
+        std::shared_ptr<const ParameterSets> parameterSets; // Only set on key frames, on their first slice.
         std::vector<uint8_t>   imageData;
+        std::vector<NalUnitEntry> nalUnits;
+        FrameTimings           timings;
         unsigned long long int timestamp;
         bool                   isKeyFrame;
+        uint32_t               sliceIndex;
+        bool                   isLastSlice;
     };
 }
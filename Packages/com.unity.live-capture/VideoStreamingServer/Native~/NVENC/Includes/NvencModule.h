@@ -0,0 +1,56 @@
+#pragma once
+
+#include "nvEncodeAPI.h"
+
+#include "NvencPlatform.h"
+
+namespace NvencPlugin
+{
+    enum class ENvencSupport
+    {
+        Supported,
+        NotSupportedOnPlatform,
+        NoDriver,
+        DriverVersionNotSupported
+    };
+
+    enum class ENvencStatus
+    {
+        NotInitialized,
+        Success,
+        DriverNotInstalled,
+        DriverVersionDoesNotSupportAPI,
+        APINotFound,
+        EncoderInitializationFailed
+    };
+
+    // The NVENC library, loaded once for the process instead of once per session, and the results of the
+    // queries that don't depend on the session: its capabilities and the preset configurations. The first
+    // session of a device and codec queries the driver, the next ones read the cached values.
+    //
+    // Can be called from any thread.
+    class NvencModule final
+    {
+    public:
+        // Loads the library and checks the driver version on the first call.
+        static ENvencSupport GetSupport();
+
+        // Fills the function list of a session, loading the library if needed.
+        static ENvencStatus GetFunctionList(NV_ENCODE_API_FUNCTION_LIST& functionList);
+
+        // 0 if the query fails, which is not cached.
+        static int GetEncodeCaps(const NV_ENCODE_API_FUNCTION_LIST& functionList, void* encoder, void* device,
+                                 GUID encodeGUID, NV_ENC_CAPS caps);
+
+        static bool GetPresetConfig(const NV_ENCODE_API_FUNCTION_LIST& functionList, void* encoder, void* device,
+                                    GUID encodeGUID, GUID presetGUID, NV_ENC_CONFIG& config);
+
+        // Frees the library and clears the cached queries. Must not be called while a session is open.
+        static void Unload();
+
+    private:
+        static void    Load();
+        static HMODULE LoadModule();
+        static bool    CheckDriverVersion(HMODULE module);
+    };
+}
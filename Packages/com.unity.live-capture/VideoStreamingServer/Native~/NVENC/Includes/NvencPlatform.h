@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dlfcn.h>
+
+// The encoder core only passes graphics resources around as opaque COM pointers.
+struct IUnknown;
+using HMODULE = void*;
+#endif
+
+namespace NvencPlugin
+{
+    // Auto-reset events signaled by the driver when an asynchronous encode completes. They map to
+    // Win32 events on Windows and are emulated elsewhere, where only the mock API signals them.
+    void* CreateCompletionEvent();
+    void  DestroyCompletionEvent(void* event);
+    void  SignalCompletionEvent(void* event);
+    bool  WaitForCompletionEvent(void* event, uint32_t timeoutMs);
+}
@@ -1,7 +1,7 @@
 #pragma once
 
 #include "nvEncodeAPI.h"
-#include "d3d11.h"
+#include "NativeLog.h"
 
 #include <vector>
 #include <atomic>
@@ -11,9 +11,26 @@
 
 namespace NvencPlugin
 {
+    using LogLevel = NativeLog::Level;
+
+    // Starts and stops the asynchronous writer of the debug log. Messages are only recorded at or above
+    // the runtime log level, which is Debug in DEBUG_MODE builds and None otherwise. Nothing is written,
+    // nor the file truncated, until a level is enabled.
+    void StartLog();
+
+    void StopLog();
+
+    void SetDebugLogLevel(int level);
+
+    // Messages without a level are Debug ones. The file is truncated when the log starts, append is kept for
+    // compatibility and ignored.
     void WriteFileDebug(const char* const message, const bool append = true);
 
     void WriteFileDebug(const char* const message, int value, const bool append = true);
 
-    void WriteFileDebug(const char* const message, NVENCSTATUS status, const bool append = true);
+    void WriteFileDebug(LogLevel level, const char* const message, const bool append = true);
+
+    void WriteFileDebug(LogLevel level, const char* const message, int value, const bool append = true);
+
+    void WriteFileDebug(LogLevel level, const char* const message, NVENCSTATUS status, const bool append = true);
 }
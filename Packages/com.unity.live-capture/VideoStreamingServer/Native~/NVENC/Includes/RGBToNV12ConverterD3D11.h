@@ -2,6 +2,7 @@
 
 #include "nvEncodeAPI.h"
 #include "d3d11.h"
+#include "IGraphicsEncoderDevice.h"
 
 #include <vector>
 #include <atomic>
@@ -11,7 +12,7 @@
 
 namespace NvencPlugin
 {
-    class RGBToNV12ConverterD3D11
+    class RGBToNV12ConverterD3D11 : public INV12Converter
     {
         using MapTextureOutputView = std::unordered_map<ID3D11Texture2D*, ID3D11VideoProcessorOutputView*>;
 
@@ -21,7 +22,7 @@ namespace NvencPlugin
                                 int nWidth,
                                 int nHeight);
 
-        ~RGBToNV12ConverterD3D11();
+        virtual ~RGBToNV12ConverterD3D11();
 
         bool ConvertRGBToNV12(ID3D11Texture2D* pRGBSrcTexture,
                               ID3D11Texture2D* pDestTexture);
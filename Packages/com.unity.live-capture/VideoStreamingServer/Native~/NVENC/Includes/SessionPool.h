@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+
+#include "NvencEncoderSessionData.h"
+
+namespace NvencPlugin
+{
+    class IGraphicsEncoderDevice;
+
+    // What an encoder session is created with and keeps for its lifetime. The rates and the GOP size
+    // aren't part of it: they are updated when a pooled session is checked out.
+    struct SessionPoolKey
+    {
+        IGraphicsEncoderDevice* device;
+        int                     width;
+        int                     height;
+        VideoCodec              codec;
+        bool                    forceNv12;
+        EncoderPipelineDepth    depth;
+        int                     sliceCount;
+        int                     intraRefreshFrames;
+
+        inline bool operator==(const SessionPoolKey& other) const
+        {
+            return device == other.device
+                && width == other.width
+                && height == other.height
+                && codec == other.codec
+                && forceNv12 == other.forceNv12
+                && depth.framesInFlight == other.depth.framesInFlight
+                && depth.maxQueueLength == other.depth.maxQueueLength
+                && sliceCount == other.sliceCount
+                && intraRefreshFrames == other.intraRefreshFrames;
+        }
+    };
+
+    // Encoder sessions created ahead of time for the sizes a stream is expected to use. Checking one out
+    // costs a lookup, instead of opening the session, configuring it and allocating its buffers on the
+    // render thread when the stream starts.
+    //
+    // The pool owns the sessions it holds until they are checked out or popped. It isn't thread safe:
+    // the plugin only uses it from the render thread.
+    template <typename T, uint32_t Capacity = 4> class SessionPool final
+    {
+    public:
+        SessionPool() = default;
+        SessionPool(const SessionPool&) = delete;
+        SessionPool& operator=(const SessionPool&) = delete;
+
+        // Returns false if the pool is full, the caller keeps the session.
+        inline bool Add(const SessionPoolKey& key, T* session)
+        {
+            if (m_Count == Capacity || session == nullptr)
+                return false;
+
+            m_Entries[m_Count++] = { key, session };
+            return true;
+        }
+
+        // The oldest session created with the key, or nullptr.
+        inline T* Checkout(const SessionPoolKey& key)
+        {
+            for (uint32_t i = 0; i < m_Count; ++i)
+            {
+                if (m_Entries[i].key == key)
+                {
+                    auto session = m_Entries[i].session;
+                    for (uint32_t j = i + 1; j < m_Count; ++j)
+                        m_Entries[j - 1] = m_Entries[j];
+                    m_Count--;
+                    return session;
+                }
+            }
+            return nullptr;
+        }
+
+        // Removes the newest session, to empty the pool. Returns nullptr once empty.
+        inline T* Pop()
+        {
+            return m_Count > 0 ? m_Entries[--m_Count].session : nullptr;
+        }
+
+        inline bool IsFull() const { return m_Count == Capacity; }
+        inline uint32_t GetCount() const { return m_Count; }
+
+    private:
+        struct Entry
+        {
+            SessionPoolKey key;
+            T*             session;
+        };
+
+        Entry    m_Entries[Capacity] = {};
+        uint32_t m_Count = 0;
+    };
+}
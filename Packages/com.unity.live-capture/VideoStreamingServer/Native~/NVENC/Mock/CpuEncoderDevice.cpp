@@ -0,0 +1,100 @@
+#include "CpuEncoderDevice.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace NvencPlugin
+{
+    CpuTexture2D::CpuTexture2D(uint32_t w, uint32_t h, bool isNV12) :
+        ITexture2D(w, h),
+        m_Pixels(isNV12 ? static_cast<size_t>(w) * h * 3 / 2 : static_cast<size_t>(w) * h * 4)
+    {
+    }
+
+    CpuTexture2D::~CpuTexture2D()
+    {
+    }
+
+    void* CpuTexture2D::GetNativeTexturePtrV()
+    {
+        return this;
+    }
+
+    const void* CpuTexture2D::GetNativeTexturePtrV() const
+    {
+        return this;
+    }
+
+    void* CpuTexture2D::GetEncodeTexturePtrV()
+    {
+        return m_Pixels.data();
+    }
+
+    const void* CpuTexture2D::GetEncodeTexturePtrV() const
+    {
+        return m_Pixels.data();
+    }
+
+    void* CpuTexture2D::GetNV12Texture()
+    {
+        return m_Pixels.data();
+    }
+
+    const void* CpuTexture2D::GetNV12Texture() const
+    {
+        return m_Pixels.data();
+    }
+
+    bool CpuEncoderDevice::Initialize()
+    {
+        return true;
+    }
+
+    INV12Converter* CpuEncoderDevice::CreateConverter(const int width, const int height)
+    {
+        return new CpuNV12Converter();
+    }
+
+    bool CpuEncoderDevice::InitializeMultithreadingSecurity()
+    {
+        return true;
+    }
+
+    void CpuEncoderDevice::Cleanup()
+    {
+    }
+
+    GraphicsDeviceType CpuEncoderDevice::GetDeviceType()
+    {
+        return GraphicsDeviceType::GRAPHICS_DEVICE_CPU;
+    }
+
+    ITexture2D* CpuEncoderDevice::CreateDefaultTexture(uint32_t width, uint32_t height, bool forceNV12)
+    {
+        return new CpuTexture2D(width, height, forceNV12);
+    }
+
+    bool CpuEncoderDevice::ConvertRGBToNV12(INV12Converter* converter, IUnknown* nativeSrc, void* nativeDest)
+    {
+        // The conversion cost isn't simulated, only the copy.
+        return CopyResource(nativeSrc, nativeDest);
+    }
+
+    void CpuEncoderDevice::WaitForCopies()
+    {
+        // The copies are done on the CPU, before CopyResource returns.
+    }
+
+    bool CpuEncoderDevice::CopyResource(IUnknown* nativeSrc, void* nativeDest)
+    {
+        auto src = reinterpret_cast<CpuTexture2D*>(nativeSrc);
+        auto dest = static_cast<CpuTexture2D*>(static_cast<ITexture2D*>(nativeDest));
+        if (src == nullptr || dest == nullptr)
+            return false;
+
+        auto& srcPixels = src->GetPixels();
+        auto& destPixels = dest->GetPixels();
+        std::memcpy(destPixels.data(), srcPixels.data(), std::min(srcPixels.size(), destPixels.size()));
+        return true;
+    }
+}
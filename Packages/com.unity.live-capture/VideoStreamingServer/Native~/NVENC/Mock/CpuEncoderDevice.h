@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+
+#include "IGraphicsEncoderDevice.h"
+#include "ITexture2D.h"
+
+namespace NvencPlugin
+{
+    // A texture in system memory: 32 bits per pixel, or NV12 when forceNV12 is set.
+    struct CpuTexture2D : public ITexture2D
+    {
+    public:
+        CpuTexture2D(uint32_t w, uint32_t h, bool isNV12);
+        virtual ~CpuTexture2D();
+
+        virtual void* GetNativeTexturePtrV() override;
+        virtual const void* GetNativeTexturePtrV() const override;
+        virtual void* GetEncodeTexturePtrV() override;
+        virtual const void* GetEncodeTexturePtrV() const override;
+
+        virtual void* GetNV12Texture() override;
+        virtual const void* GetNV12Texture() const override;
+
+        inline std::vector<uint8_t>& GetPixels() { return m_Pixels; }
+
+    private:
+        std::vector<uint8_t> m_Pixels;
+    };
+
+    // The conversion isn't simulated, the converter has no state.
+    class CpuNV12Converter : public INV12Converter
+    {
+    };
+
+    // Stands in for the D3D11/D3D12 devices when the encoder core runs against the mock API:
+    // the source textures handed to EncodeFrame are CpuTexture2D pointers, copied on the CPU.
+    class CpuEncoderDevice : public IGraphicsEncoderDevice
+    {
+    public:
+        CpuEncoderDevice() = default;
+        virtual ~CpuEncoderDevice() = default;
+
+        virtual bool Initialize() override;
+        virtual INV12Converter* CreateConverter(const int width, const int height) override;
+        virtual bool InitializeMultithreadingSecurity() override;
+        virtual void Cleanup() override;
+
+        virtual GraphicsDeviceType GetDeviceType() override;
+        virtual ITexture2D* CreateDefaultTexture(uint32_t width, uint32_t height, bool forceNV12) override;
+
+        virtual bool ConvertRGBToNV12(INV12Converter* converter, IUnknown* nativeSrc, void* nativeDest) override;
+        virtual bool CopyResource(IUnknown* nativeSrc, void* nativeDest) override;
+        virtual void WaitForCopies() override;
+
+        inline IUnknown* GetDevice() override { return reinterpret_cast<IUnknown*>(this); }
+    };
+}
@@ -0,0 +1,652 @@
+#include "NvencMockApi.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "nvEncodeAPI.h"
+#include "NalUnits.h"
+#include "NvencPlatform.h"
+
+// A software stand-in for the NVENC driver: it implements the subset of the function table used by
+// NvEncoder, produces Annex-B access units of configurable sizes and completes them after a
+// configurable latency, signaling the registered completion events like the driver does. With sub-frame
+// write, the slices of a frame complete one after the other over that latency. With intra refresh, the
+// cost of a key frame is spread over the frames of each refresh. The DPB and the long-term references are
+// tracked so that invalid reference invalidations and long-term references are rejected.
+namespace NvencPlugin
+{
+    namespace Mock
+    {
+        using Clock = std::chrono::steady_clock;
+
+        static std::mutex   s_SettingsLock;
+        static MockSettings s_Settings;
+
+        static std::atomic<uint64_t> s_SubmittedFrames = { 0 };
+        static std::atomic<uint64_t> s_KeyFrames = { 0 };
+        static std::atomic<uint64_t> s_LockedFrames = { 0 };
+        static std::atomic<uint64_t> s_BitstreamPolls = { 0 };
+        static std::atomic<uint64_t> s_EmptySlices = { 0 };
+        static std::atomic<uint64_t> s_Reconfigurations = { 0 };
+        static std::atomic<uint64_t> s_IntraRefreshes = { 0 };
+        static std::atomic<uint64_t> s_InvalidatedFrames = { 0 };
+        static std::atomic<uint64_t> s_LtrRecoveries = { 0 };
+        static std::atomic<uint64_t> s_ApiInstances = { 0 };
+        static std::atomic<uint64_t> s_CapsQueries = { 0 };
+        static std::atomic<uint64_t> s_PresetQueries = { 0 };
+
+        // Baseline profile parameter sets, as returned by nvEncGetSequenceParams.
+        static const uint8_t k_SpsPps[] =
+        {
+            0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xC0, 0x28, 0xDA, 0x01, 0xE0, 0x08, 0x9F, 0x96,
+            0x10, 0x00, 0x00, 0x03, 0x00, 0x10, 0x00, 0x00, 0x03, 0x03, 0xC8, 0xF1, 0x83, 0x2A,
+            0x00, 0x00, 0x00, 0x01, 0x68, 0xCE, 0x3C, 0x80
+        };
+
+        // Main profile 1280x720 parameter sets, returned for the HEVC sessions.
+        static const uint8_t k_VpsSpsPps[] =
+        {
+            0x00, 0x00, 0x00, 0x01, 0x40, 0x01, 0x0C, 0x01, 0xFF, 0xFF, 0x01, 0x60, 0x00, 0x00, 0x03, 0x00,
+            0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x5D, 0x95, 0x98, 0x09,
+            0x00, 0x00, 0x00, 0x01, 0x42, 0x01, 0x01, 0x01, 0x60, 0x00, 0x00, 0x03, 0x00, 0x90, 0x00, 0x00,
+            0x03, 0x00, 0x00, 0x03, 0x00, 0x5D, 0xA0, 0x02, 0x80, 0x80, 0x2D, 0x16, 0x59, 0x59, 0xA4, 0x93,
+            0x2B, 0xC0, 0x5A, 0x70, 0x80, 0x00, 0x01, 0xF4, 0x80, 0x00, 0x3A, 0x98, 0x04,
+            0x00, 0x00, 0x00, 0x01, 0x44, 0x01, 0xC1, 0x72, 0xB4, 0x62, 0x40
+        };
+
+        struct Bitstream
+        {
+            std::vector<uint8_t> data;
+            Clock::time_point    readyTime;
+
+            // Start of every slice in data and the time it is written, only used with sub-frame write.
+            std::vector<uint32_t>          sliceOffsets;
+            std::vector<Clock::time_point> sliceReadyTimes;
+
+            NV_ENC_PIC_TYPE      pictureType = NV_ENC_PIC_TYPE_UNKNOWN;
+            uint64_t             timestamp = 0;
+            bool                 isSubFrameWrite = false;
+        };
+
+        struct Reference
+        {
+            uint64_t timestamp;
+            bool     isValid;
+        };
+
+        struct PendingEvent
+        {
+            Clock::time_point readyTime;
+            void*             event;
+        };
+
+        struct Session
+        {
+            MockSettings settings;
+            uint64_t     frameCount = 0;
+            bool         isHevc = false;
+            bool         isSubFrameWrite = false;
+            uint32_t     sliceCount = 1;
+
+            // Intra refresh configuration, and frames encoded since the last IDR frame.
+            uint32_t     intraRefreshPeriod = 0;
+            uint32_t     intraRefreshCnt = 0;
+            uint64_t     framesSinceIdr = 0;
+
+            // The short-term references of the DPB, oldest first, and the long-term references.
+            uint32_t               dpbSize = 1;
+            std::deque<Reference>  references;
+            std::vector<Reference> ltrFrames;
+
+            // Set by a reconfiguration with forceIDR, the next picture is an IDR.
+            bool         isIdrRequested = false;
+
+            // Signals the completion events once their frame is "encoded".
+            std::thread               eventThread;
+            std::mutex                eventLock;
+            std::condition_variable   eventCondition;
+            std::deque<PendingEvent>  pendingEvents;
+            bool                      isClosing = false;
+        };
+
+        static void SignalEvents(Session* session)
+        {
+            std::unique_lock<std::mutex> lock(session->eventLock);
+            for (;;)
+            {
+                session->eventCondition.wait(lock, [session]
+                {
+                    return session->isClosing || !session->pendingEvents.empty();
+                });
+
+                if (session->pendingEvents.empty())
+                    return;
+
+                // The latency is constant, so the events complete in submission order.
+                const auto pending = session->pendingEvents.front();
+                if (Clock::now() < pending.readyTime)
+                {
+                    session->eventCondition.wait_until(lock, pending.readyTime);
+                    continue;
+                }
+
+                session->pendingEvents.pop_front();
+                SignalCompletionEvent(pending.event);
+            }
+        }
+
+        static NVENCSTATUS NVENCAPI OpenEncodeSessionEx(NV_ENC_OPEN_ENCODE_SESSION_EX_PARAMS* params, void** encoder)
+        {
+            if (params == nullptr || encoder == nullptr || params->device == nullptr)
+                return NV_ENC_ERR_INVALID_PTR;
+
+            auto session = new Session();
+            session->settings = GetSettings();
+            session->eventThread = std::thread(SignalEvents, session);
+
+            *encoder = session;
+            return NV_ENC_SUCCESS;
+        }
+
+        static NVENCSTATUS NVENCAPI GetEncodeCaps(void* encoder, GUID encodeGUID, NV_ENC_CAPS_PARAM* capsParam, int* capsVal)
+        {
+            if (encoder == nullptr || capsParam == nullptr || capsVal == nullptr)
+                return NV_ENC_ERR_INVALID_PTR;
+
+            s_CapsQueries++;
+
+            const auto session = static_cast<Session*>(encoder);
+            switch (capsParam->capsToQuery)
+            {
+                case NV_ENC_CAPS_ASYNC_ENCODE_SUPPORT:
+                    *capsVal = static_cast<int>(session->settings.isAsyncSupported);
+                    break;
+                case NV_ENC_CAPS_SUPPORT_REF_PIC_INVALIDATION:
+                    *capsVal = static_cast<int>(session->settings.isRefInvalidationSupported);
+                    break;
+                case NV_ENC_CAPS_NUM_MAX_LTR_FRAMES:
+                    *capsVal = static_cast<int>(session->settings.maxLtrFrames);
+                    break;
+                default:
+                    *capsVal = 0;
+                    break;
+            }
+            return NV_ENC_SUCCESS;
+        }
+
+        static NVENCSTATUS NVENCAPI GetEncodePresetConfig(void* encoder, GUID encodeGUID, GUID presetGUID, NV_ENC_PRESET_CONFIG* presetConfig)
+        {
+            if (encoder == nullptr || presetConfig == nullptr)
+                return NV_ENC_ERR_INVALID_PTR;
+
+            s_PresetQueries++;
+
+            std::memset(&presetConfig->presetCfg, 0, sizeof(presetConfig->presetCfg));
+            presetConfig->presetCfg.version = NV_ENC_CONFIG_VER;
+            return NV_ENC_SUCCESS;
+        }
+
+        // Slice mode 3 sets the number of slices per frame, the other modes are encoded as a single slice.
+        // Like the driver, the intra refresh period is only used with an infinite GOP.
+        static void ReadEncodeConfig(Session* session, const NV_ENC_INITIALIZE_PARAMS& params)
+        {
+            session->sliceCount = 1;
+            session->intraRefreshPeriod = 0;
+            session->intraRefreshCnt = 0;
+            session->dpbSize = 1;
+            if (params.encodeConfig == nullptr)
+            {
+                session->ltrFrames.clear();
+                return;
+            }
+
+            const auto& codecConfig = params.encodeConfig->encodeCodecConfig;
+            const auto sliceMode = session->isHevc ? codecConfig.hevcConfig.sliceMode : codecConfig.h264Config.sliceMode;
+            const auto sliceModeData = session->isHevc ? codecConfig.hevcConfig.sliceModeData : codecConfig.h264Config.sliceModeData;
+            if (sliceMode == 3 && sliceModeData > 1)
+                session->sliceCount = sliceModeData;
+
+            const auto enableIntraRefresh = session->isHevc ? codecConfig.hevcConfig.enableIntraRefresh : codecConfig.h264Config.enableIntraRefresh;
+            const auto period = session->isHevc ? codecConfig.hevcConfig.intraRefreshPeriod : codecConfig.h264Config.intraRefreshPeriod;
+            const auto count = session->isHevc ? codecConfig.hevcConfig.intraRefreshCnt : codecConfig.h264Config.intraRefreshCnt;
+            if (enableIntraRefresh && params.encodeConfig->gopLength == NVENC_INFINITE_GOPLENGTH && count > 0 && count < period)
+            {
+                session->intraRefreshPeriod = period;
+                session->intraRefreshCnt = count;
+            }
+
+            const auto dpbSize = session->isHevc ? codecConfig.hevcConfig.maxNumRefFramesInDPB : codecConfig.h264Config.maxNumRefFrames;
+            const auto enableLTR = session->isHevc ? codecConfig.hevcConfig.enableLTR : codecConfig.h264Config.enableLTR;
+            const auto ltrNumFrames = session->isHevc ? codecConfig.hevcConfig.ltrNumFrames : codecConfig.h264Config.ltrNumFrames;
+            session->dpbSize = std::max<uint32_t>(dpbSize, 1);
+            session->ltrFrames.resize(enableLTR ? std::min(ltrNumFrames, session->settings.maxLtrFrames) : 0, Reference{ 0, false });
+        }
+
+        static NVENCSTATUS NVENCAPI InvalidateRefFrames(void* encoder, uint64_t invalidRefFrameTimeStamp)
+        {
+            if (encoder == nullptr)
+                return NV_ENC_ERR_INVALID_PTR;
+
+            auto session = static_cast<Session*>(encoder);
+            if (!session->settings.isRefInvalidationSupported)
+                return NV_ENC_ERR_UNSUPPORTED_PARAM;
+
+            // Like the driver, only the frames still in the DPB can be invalidated.
+            for (auto& reference : session->references)
+            {
+                if (reference.timestamp == invalidRefFrameTimeStamp)
+                {
+                    reference.isValid = false;
+                    s_InvalidatedFrames++;
+                    return NV_ENC_SUCCESS;
+                }
+            }
+            return NV_ENC_ERR_INVALID_PARAM;
+        }
+
+        static NVENCSTATUS NVENCAPI InitializeEncoder(void* encoder, NV_ENC_INITIALIZE_PARAMS* params)
+        {
+            if (encoder == nullptr || params == nullptr)
+                return NV_ENC_ERR_INVALID_PTR;
+
+            auto session = static_cast<Session*>(encoder);
+            session->isHevc = std::memcmp(&params->encodeGUID, &NV_ENC_CODEC_HEVC_GUID, sizeof(GUID)) == 0;
+            session->isSubFrameWrite = params->enableSubFrameWrite != 0;
+            ReadEncodeConfig(session, *params);
+
+            // Like the driver, the slice offsets can't be reported in asynchronous mode.
+            if (params->reportSliceOffsets && params->enableEncodeAsync)
+                return NV_ENC_ERR_INVALID_PARAM;
+
+            return (params->encodeWidth > 0 && params->encodeHeight > 0 && params->frameRateNum > 0)
+                ? NV_ENC_SUCCESS
+                : NV_ENC_ERR_INVALID_PARAM;
+        }
+
+        static NVENCSTATUS NVENCAPI ReconfigureEncoder(void* encoder, NV_ENC_RECONFIGURE_PARAMS* params)
+        {
+            if (encoder == nullptr || params == nullptr)
+                return NV_ENC_ERR_INVALID_PTR;
+
+            // Like the driver, a reconfiguration that doesn't force an IDR keeps the current GOP going.
+            auto session = static_cast<Session*>(encoder);
+            if (params->forceIDR)
+                session->isIdrRequested = true;
+            ReadEncodeConfig(session, params->reInitEncodeParams);
+
+            s_Reconfigurations++;
+            return NV_ENC_SUCCESS;
+        }
+
+        static NVENCSTATUS NVENCAPI GetSequenceParams(void* encoder, NV_ENC_SEQUENCE_PARAM_PAYLOAD* payload)
+        {
+            if (encoder == nullptr || payload == nullptr || payload->spsppsBuffer == nullptr)
+                return NV_ENC_ERR_INVALID_PTR;
+
+            const auto isHevc = static_cast<Session*>(encoder)->isHevc;
+            const auto data = isHevc ? k_VpsSpsPps : k_SpsPps;
+            const auto size = static_cast<uint32_t>(isHevc ? sizeof(k_VpsSpsPps) : sizeof(k_SpsPps));
+
+            if (payload->inBufferSize < size)
+                return NV_ENC_ERR_NOT_ENOUGH_BUFFER;
+
+            std::memcpy(payload->spsppsBuffer, data, size);
+            if (payload->outSPSPPSPayloadSize != nullptr)
+                *payload->outSPSPPSPayloadSize = size;
+            return NV_ENC_SUCCESS;
+        }
+
+        static NVENCSTATUS NVENCAPI RegisterAsyncEvent(void* encoder, NV_ENC_EVENT_PARAMS* params)
+        {
+            return (encoder != nullptr && params != nullptr) ? NV_ENC_SUCCESS : NV_ENC_ERR_INVALID_PTR;
+        }
+
+        static NVENCSTATUS NVENCAPI RegisterResource(void* encoder, NV_ENC_REGISTER_RESOURCE* params)
+        {
+            if (encoder == nullptr || params == nullptr || params->resourceToRegister == nullptr)
+                return NV_ENC_ERR_INVALID_PTR;
+
+            params->registeredResource = params->resourceToRegister;
+            return NV_ENC_SUCCESS;
+        }
+
+        static NVENCSTATUS NVENCAPI UnregisterResource(void* encoder, NV_ENC_REGISTERED_PTR resource)
+        {
+            return encoder != nullptr ? NV_ENC_SUCCESS : NV_ENC_ERR_INVALID_PTR;
+        }
+
+        static NVENCSTATUS NVENCAPI MapInputResource(void* encoder, NV_ENC_MAP_INPUT_RESOURCE* params)
+        {
+            if (encoder == nullptr || params == nullptr || params->registeredResource == nullptr)
+                return NV_ENC_ERR_INVALID_PTR;
+
+            params->mappedResource = params->registeredResource;
+            return NV_ENC_SUCCESS;
+        }
+
+        static NVENCSTATUS NVENCAPI UnmapInputResource(void* encoder, NV_ENC_INPUT_PTR resource)
+        {
+            return encoder != nullptr ? NV_ENC_SUCCESS : NV_ENC_ERR_INVALID_PTR;
+        }
+
+        static NVENCSTATUS NVENCAPI CreateBitstreamBuffer(void* encoder, NV_ENC_CREATE_BITSTREAM_BUFFER* params)
+        {
+            if (encoder == nullptr || params == nullptr)
+                return NV_ENC_ERR_INVALID_PTR;
+
+            params->bitstreamBuffer = new Bitstream();
+            return NV_ENC_SUCCESS;
+        }
+
+        static NVENCSTATUS NVENCAPI DestroyBitstreamBuffer(void* encoder, NV_ENC_OUTPUT_PTR buffer)
+        {
+            if (encoder == nullptr)
+                return NV_ENC_ERR_INVALID_PTR;
+
+            delete static_cast<Bitstream*>(buffer);
+            return NV_ENC_SUCCESS;
+        }
+
+        static NVENCSTATUS NVENCAPI EncodePicture(void* encoder, NV_ENC_PIC_PARAMS* params)
+        {
+            if (encoder == nullptr || params == nullptr || params->inputBuffer == nullptr || params->outputBitstream == nullptr)
+                return NV_ENC_ERR_INVALID_PTR;
+
+            auto session = static_cast<Session*>(encoder);
+            auto bitstream = static_cast<Bitstream*>(params->outputBitstream);
+
+            if (session->settings.submitCostUs > 0)
+                std::this_thread::sleep_for(std::chrono::microseconds(session->settings.submitCostUs));
+
+            const auto isKeyFrame = session->frameCount == 0 || session->isIdrRequested
+                || (params->encodePicFlags & NV_ENC_PIC_FLAG_FORCEIDR) != 0;
+
+            // A P-frame can only use the valid long-term references, an IDR frame clears them.
+            const auto ltrUseFrames = session->isHevc ? params->codecPicParams.hevcPicParams.ltrUseFrames : params->codecPicParams.h264PicParams.ltrUseFrames;
+            const auto ltrUseFrameBitmap = session->isHevc ? params->codecPicParams.hevcPicParams.ltrUseFrameBitmap : params->codecPicParams.h264PicParams.ltrUseFrameBitmap;
+            const auto ltrMarkFrame = session->isHevc ? params->codecPicParams.hevcPicParams.ltrMarkFrame : params->codecPicParams.h264PicParams.ltrMarkFrame;
+            const auto ltrMarkFrameIdx = session->isHevc ? params->codecPicParams.hevcPicParams.ltrMarkFrameIdx : params->codecPicParams.h264PicParams.ltrMarkFrameIdx;
+            if (ltrMarkFrame && ltrMarkFrameIdx >= session->ltrFrames.size())
+                return NV_ENC_ERR_INVALID_PARAM;
+
+            if (isKeyFrame)
+            {
+                session->references.clear();
+                for (auto& ltrFrame : session->ltrFrames)
+                    ltrFrame.isValid = false;
+            }
+            else if (ltrUseFrames)
+            {
+                auto isUsable = ltrUseFrameBitmap != 0;
+                for (uint32_t i = 0; i < 32 && isUsable; ++i)
+                {
+                    if ((ltrUseFrameBitmap & (1u << i)) != 0)
+                        isUsable = i < session->ltrFrames.size() && session->ltrFrames[i].isValid;
+                }
+                if (!isUsable)
+                    return NV_ENC_ERR_INVALID_PARAM;
+                s_LtrRecoveries++;
+            }
+
+            session->references.push_back({ params->inputTimeStamp, true });
+            if (session->references.size() > session->dpbSize)
+                session->references.pop_front();
+            if (ltrMarkFrame)
+                session->ltrFrames[ltrMarkFrameIdx] = { params->inputTimeStamp, true };
+
+            session->isIdrRequested = false;
+            session->framesSinceIdr = isKeyFrame ? 0 : session->framesSinceIdr + 1;
+
+            // A refresh starts every period after the IDR frame, its frames share the cost of a key frame.
+            auto frameSize = isKeyFrame ? session->settings.keyFrameSize : session->settings.frameSize;
+            if (!isKeyFrame && session->intraRefreshPeriod > 0)
+            {
+                const auto refreshFrame = session->framesSinceIdr % session->intraRefreshPeriod;
+                if (refreshFrame == 0)
+                    s_IntraRefreshes++;
+                if (refreshFrame < session->intraRefreshCnt && session->settings.keyFrameSize > frameSize)
+                    frameSize += (session->settings.keyFrameSize - frameSize) / session->intraRefreshCnt;
+            }
+
+            const auto sliceCount = session->sliceCount;
+            const auto size = std::max<uint32_t>(frameSize, 6 * sliceCount);
+
+            // The SEI messages of the client come first, in the first slice.
+            const auto seiPayloadCount = session->isHevc ? params->codecPicParams.hevcPicParams.seiPayloadArrayCnt : params->codecPicParams.h264PicParams.seiPayloadArrayCnt;
+            const auto seiPayloads = static_cast<const NV_ENC_SEI_PAYLOAD*>(session->isHevc
+                ? params->codecPicParams.hevcPicParams.seiPayloadArray : params->codecPicParams.h264PicParams.seiPayloadArray);
+            bitstream->data.clear();
+            for (uint32_t i = 0; i < seiPayloadCount; ++i)
+            {
+                AppendSeiNalUnit(session->isHevc ? VideoCodec::HEVC : VideoCodec::H264, seiPayloads[i].payloadType,
+                                 seiPayloads[i].payload, seiPayloads[i].payloadSize, bitstream->data);
+            }
+            const auto seiSize = static_cast<uint32_t>(bitstream->data.size());
+
+            // One slice NAL unit per slice; the payloads never contain a start code. The HEVC slices are
+            // IDR_W_RADL and TRAIL_R NAL units, with a two bytes header.
+            bitstream->data.resize(seiSize + size, 0xA5);
+            bitstream->sliceOffsets.resize(sliceCount);
+            bitstream->sliceReadyTimes.resize(sliceCount);
+
+            const auto submitTime = Clock::now();
+            for (uint32_t i = 0; i < sliceCount; ++i)
+            {
+                const auto offset = seiSize + size / sliceCount * i;
+                auto slice = bitstream->data.data() + offset;
+                slice[0] = 0x00;
+                slice[1] = 0x00;
+                slice[2] = 0x00;
+                slice[3] = 0x01;
+                if (session->isHevc)
+                {
+                    slice[4] = isKeyFrame ? 0x26 : 0x02;
+                    slice[5] = 0x01;
+                }
+                else
+                {
+                    slice[4] = isKeyFrame ? 0x65 : 0x41;
+                }
+
+                bitstream->sliceOffsets[i] = i == 0 ? 0 : offset;
+                bitstream->sliceReadyTimes[i] = submitTime
+                    + std::chrono::microseconds(static_cast<uint64_t>(session->settings.encodeLatencyUs) * (i + 1) / sliceCount);
+            }
+
+            const auto emptySlicePeriod = session->settings.emptySlicePeriod;
+            if (sliceCount > 1 && emptySlicePeriod > 0 && (session->frameCount + 1) % emptySlicePeriod == 0)
+            {
+                bitstream->sliceOffsets.back() = static_cast<uint32_t>(bitstream->data.size());
+                s_EmptySlices++;
+            }
+
+            bitstream->pictureType = isKeyFrame ? NV_ENC_PIC_TYPE_IDR : NV_ENC_PIC_TYPE_P;
+            bitstream->timestamp = params->inputTimeStamp;
+            bitstream->readyTime = bitstream->sliceReadyTimes.back();
+            bitstream->isSubFrameWrite = session->isSubFrameWrite;
+
+            session->frameCount++;
+            s_SubmittedFrames++;
+            if (isKeyFrame)
+                s_KeyFrames++;
+
+            const auto missedEventPeriod = session->settings.missedEventPeriod;
+            const auto isEventMissed = missedEventPeriod > 0 && session->frameCount % missedEventPeriod == 0;
+            if (params->completionEvent != nullptr && !isEventMissed)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(session->eventLock);
+                    session->pendingEvents.push_back({ bitstream->readyTime, params->completionEvent });
+                }
+                session->eventCondition.notify_one();
+            }
+            return NV_ENC_SUCCESS;
+        }
+
+        static NVENCSTATUS NVENCAPI LockBitstream(void* encoder, NV_ENC_LOCK_BITSTREAM* params)
+        {
+            if (encoder == nullptr || params == nullptr || params->outputBitstream == nullptr)
+                return NV_ENC_ERR_INVALID_PTR;
+
+            auto bitstream = static_cast<Bitstream*>(params->outputBitstream);
+            const auto sliceCount = static_cast<uint32_t>(bitstream->sliceOffsets.size());
+
+            // With sub-frame write, the slices written so far are returned without waiting. Otherwise,
+            // like the driver, block until the frame is encoded.
+            uint32_t readySliceCount = sliceCount;
+            if (params->doNotWait)
+                s_BitstreamPolls++;
+
+            if (bitstream->isSubFrameWrite && params->doNotWait)
+            {
+                const auto now = Clock::now();
+                readySliceCount = 0;
+                while (readySliceCount < sliceCount && bitstream->sliceReadyTimes[readySliceCount] <= now)
+                    readySliceCount++;
+
+                if (readySliceCount == 0)
+                    return NV_ENC_ERR_LOCK_BUSY;
+            }
+            else if (Clock::now() < bitstream->readyTime)
+            {
+                if (params->doNotWait)
+                    return NV_ENC_ERR_LOCK_BUSY;
+
+                std::this_thread::sleep_until(bitstream->readyTime);
+            }
+
+            const auto isComplete = readySliceCount == sliceCount;
+            params->bitstreamBufferPtr = bitstream->data.data();
+            params->bitstreamSizeInBytes = isComplete
+                ? static_cast<uint32_t>(bitstream->data.size())
+                : bitstream->sliceOffsets[readySliceCount];
+            params->outputTimeStamp = bitstream->timestamp;
+            params->pictureType = bitstream->pictureType;
+            params->numSlices = readySliceCount;
+            params->hwEncodeStatus = isComplete ? 2 : 1;
+
+            if (params->sliceOffsets != nullptr)
+                std::copy_n(bitstream->sliceOffsets.begin(), readySliceCount, params->sliceOffsets);
+
+            if (isComplete)
+                s_LockedFrames++;
+            return NV_ENC_SUCCESS;
+        }
+
+        static NVENCSTATUS NVENCAPI UnlockBitstream(void* encoder, NV_ENC_OUTPUT_PTR buffer)
+        {
+            return (encoder != nullptr && buffer != nullptr) ? NV_ENC_SUCCESS : NV_ENC_ERR_INVALID_PTR;
+        }
+
+        static NVENCSTATUS NVENCAPI DestroyEncoder(void* encoder)
+        {
+            if (encoder == nullptr)
+                return NV_ENC_ERR_INVALID_PTR;
+
+            auto session = static_cast<Session*>(encoder);
+            {
+                std::lock_guard<std::mutex> lock(session->eventLock);
+                session->isClosing = true;
+                session->pendingEvents.clear();
+            }
+            session->eventCondition.notify_one();
+            session->eventThread.join();
+
+            delete session;
+            return NV_ENC_SUCCESS;
+        }
+
+        void SetSettings(const MockSettings& settings)
+        {
+            std::lock_guard<std::mutex> lock(s_SettingsLock);
+            s_Settings = settings;
+        }
+
+        MockSettings GetSettings()
+        {
+            std::lock_guard<std::mutex> lock(s_SettingsLock);
+            return s_Settings;
+        }
+
+        MockCounters GetCounters()
+        {
+            MockCounters counters;
+            counters.submittedFrames = s_SubmittedFrames;
+            counters.keyFrames = s_KeyFrames;
+            counters.lockedFrames = s_LockedFrames;
+            counters.bitstreamPolls = s_BitstreamPolls;
+            counters.emptySlices = s_EmptySlices;
+            counters.reconfigurations = s_Reconfigurations;
+            counters.intraRefreshes = s_IntraRefreshes;
+            counters.invalidatedFrames = s_InvalidatedFrames;
+            counters.ltrRecoveries = s_LtrRecoveries;
+            counters.apiInstances = s_ApiInstances;
+            counters.capsQueries = s_CapsQueries;
+            counters.presetQueries = s_PresetQueries;
+            return counters;
+        }
+
+        void ResetCounters()
+        {
+            s_SubmittedFrames = 0;
+            s_KeyFrames = 0;
+            s_LockedFrames = 0;
+            s_BitstreamPolls = 0;
+            s_EmptySlices = 0;
+            s_Reconfigurations = 0;
+            s_IntraRefreshes = 0;
+            s_InvalidatedFrames = 0;
+            s_LtrRecoveries = 0;
+            s_ApiInstances = 0;
+            s_CapsQueries = 0;
+            s_PresetQueries = 0;
+        }
+    }
+}
+
+using namespace NvencPlugin::Mock;
+
+extern "C" NVENCSTATUS NVENCAPI NvEncodeAPIGetMaxSupportedVersion(uint32_t* version)
+{
+    if (version == nullptr)
+        return NV_ENC_ERR_INVALID_PTR;
+
+    *version = (NVENCAPI_MAJOR_VERSION << 4) | NVENCAPI_MINOR_VERSION;
+    return NV_ENC_SUCCESS;
+}
+
+extern "C" NVENCSTATUS NVENCAPI NvEncodeAPICreateInstance(NV_ENCODE_API_FUNCTION_LIST* functionList)
+{
+    if (functionList == nullptr)
+        return NV_ENC_ERR_INVALID_PTR;
+
+    s_ApiInstances++;
+
+    functionList->nvEncOpenEncodeSessionEx = OpenEncodeSessionEx;
+    functionList->nvEncGetEncodeCaps = GetEncodeCaps;
+    functionList->nvEncGetEncodePresetConfig = GetEncodePresetConfig;
+    functionList->nvEncInitializeEncoder = InitializeEncoder;
+    functionList->nvEncReconfigureEncoder = ReconfigureEncoder;
+    functionList->nvEncGetSequenceParams = GetSequenceParams;
+    functionList->nvEncRegisterAsyncEvent = RegisterAsyncEvent;
+    functionList->nvEncUnregisterAsyncEvent = RegisterAsyncEvent;
+    functionList->nvEncRegisterResource = RegisterResource;
+    functionList->nvEncUnregisterResource = UnregisterResource;
+    functionList->nvEncMapInputResource = MapInputResource;
+    functionList->nvEncUnmapInputResource = UnmapInputResource;
+    functionList->nvEncCreateBitstreamBuffer = CreateBitstreamBuffer;
+    functionList->nvEncDestroyBitstreamBuffer = DestroyBitstreamBuffer;
+    functionList->nvEncEncodePicture = EncodePicture;
+    functionList->nvEncLockBitstream = LockBitstream;
+    functionList->nvEncUnlockBitstream = UnlockBitstream;
+    functionList->nvEncDestroyEncoder = DestroyEncoder;
+    functionList->nvEncInvalidateRefFrames = InvalidateRefFrames;
+    return NV_ENC_SUCCESS;
+}
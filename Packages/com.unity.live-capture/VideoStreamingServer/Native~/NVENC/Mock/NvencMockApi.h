@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+namespace NvencPlugin
+{
+    namespace Mock
+    {
+        // Behavior of the mock NVENC driver, shared by all its sessions.
+        struct MockSettings
+        {
+            // Time between nvEncEncodePicture and the bitstream being ready.
+            uint32_t encodeLatencyUs = 4000;
+
+            // Time nvEncEncodePicture blocks the calling thread, like a busy driver.
+            uint32_t submitCostUs = 0;
+
+            // Size of the generated access units (start code included).
+            uint32_t keyFrameSize = 64 * 1024;
+            uint32_t frameSize = 16 * 1024;
+
+            // Every missedEventPeriod-th frame of a session never signals its completion event, like a
+            // lost driver signal. 0 signals every event.
+            uint32_t missedEventPeriod = 0;
+
+            // With several slices, the last slice of every emptySlicePeriod-th frame of a session is reported
+            // empty, its data counted in the previous slice. 0 never reports an empty slice.
+            uint32_t emptySlicePeriod = 0;
+
+            // Reported by NV_ENC_CAPS_ASYNC_ENCODE_SUPPORT.
+            bool     isAsyncSupported = true;
+
+            // Reported by NV_ENC_CAPS_SUPPORT_REF_PIC_INVALIDATION and NV_ENC_CAPS_NUM_MAX_LTR_FRAMES.
+            bool     isRefInvalidationSupported = true;
+            uint32_t maxLtrFrames = 2;
+        };
+
+        struct MockCounters
+        {
+            uint64_t submittedFrames;
+            uint64_t keyFrames;
+            uint64_t lockedFrames;
+            uint64_t bitstreamPolls;
+            uint64_t emptySlices;
+            uint64_t reconfigurations;
+            uint64_t intraRefreshes;
+            uint64_t invalidatedFrames;
+            uint64_t ltrRecoveries;
+            uint64_t apiInstances;
+            uint64_t capsQueries;
+            uint64_t presetQueries;
+        };
+
+        // Must be called before the sessions are opened.
+        void         SetSettings(const MockSettings& settings);
+        MockSettings GetSettings();
+
+        MockCounters GetCounters();
+        void         ResetCounters();
+    }
+}
@@ -0,0 +1,641 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "NvencEncoder.h"
+#include "NalUnits.h"
+#include "NativeLog.h"
+#include "SessionPool.h"
+#include "CpuEncoderDevice.h"
+#include "NvencMockApi.h"
+
+// Drives NvEncoder against the mock NVENC API the way the plugin is driven by Unity: a render thread
+// submits frames at a fixed rate and a main thread consumes them at its own pace. Reports the cost of
+// the submission, the end to end latency and how frames were dropped. With --sessions, several encoders
+// of different sizes share the graphics device, like several cameras streamed from one editor. With
+// --rate-change-period, the bit rate alternates between two values while streaming, which must not
+// produce any key frame. --codec 1 encodes HEVC instead of H.264. With --slices, the frames are output
+// slice by slice and the latency to the first slice is reported as well. With --intra-refresh and a GOP,
+// the key frames after the first one are replaced by refreshes spread over N frames, which must keep
+// every frame smaller than a key frame. With --loss-period, the consumer reports every N frames the loss
+// of a recent frame or of an older one, like RTCP NACKs: the encoder must recover with P-frames, from a
+// short-term or a long-term reference, without any key frame. With --prewarm 1, the sessions are created
+// ahead of time and checked out of a session pool, like the plugin does when a stream starts; the time to
+// start a session is reported either way, and the sessions must share a single load of the NVENC module.
+//
+// Returns a non-zero exit code if a frame is unaccounted for, so it can be used as a CI smoke test.
+
+using namespace NvencPlugin;
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+    const uint32_t k_MaxPrewarmedSessions = 16;
+    const uint64_t k_MaxBitstreamPollsPerFrame = 100;
+
+    struct BenchmarkOptions
+    {
+        int      frames = 600;
+        int      width = 1280;
+        int      height = 720;
+        int      frameRate = 120;
+        int      gopSize = 0;
+        int      sessions = 1;
+        int      pipelineMode = 0;
+        int      framesInFlight = 0;
+        int      rateChangePeriod = 0;
+        int      resizePeriod = 0;
+        int      codec = 0;
+        int      slices = 0;
+        int      intraRefreshFrames = 0;
+        int      lossPeriod = 0;
+        int      prewarm = 0;
+        uint32_t encodeLatencyUs = 4000;
+        uint32_t consumePeriodUs = 1000;
+        uint32_t submitCostUs = 0;
+        uint32_t missedEventPeriod = 0;
+        uint32_t emptySlicePeriod = 0;
+        const char* logPath = nullptr;
+    };
+
+    uint64_t Now()
+    {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+    }
+
+    double Percentile(std::vector<uint64_t>& values, double percentile)
+    {
+        if (values.empty())
+            return 0.0;
+
+        const auto index = static_cast<size_t>(percentile * (values.size() - 1));
+        std::nth_element(values.begin(), values.begin() + index, values.end());
+        return values[index] / 1000.0;
+    }
+
+    bool ParseOptions(int argc, char** argv, BenchmarkOptions& options)
+    {
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            const auto value = std::atoi(argv[i + 1]);
+            if (std::strcmp(argv[i], "--log") == 0)
+                options.logPath = argv[i + 1];
+            else if (std::strcmp(argv[i], "--frames") == 0)
+                options.frames = value;
+            else if (std::strcmp(argv[i], "--width") == 0)
+                options.width = value;
+            else if (std::strcmp(argv[i], "--height") == 0)
+                options.height = value;
+            else if (std::strcmp(argv[i], "--fps") == 0)
+                options.frameRate = value;
+            else if (std::strcmp(argv[i], "--gop") == 0)
+                options.gopSize = value;
+            else if (std::strcmp(argv[i], "--sessions") == 0)
+                options.sessions = value;
+            else if (std::strcmp(argv[i], "--pipeline") == 0)
+                options.pipelineMode = value;
+            else if (std::strcmp(argv[i], "--in-flight") == 0)
+                options.framesInFlight = value;
+            else if (std::strcmp(argv[i], "--rate-change-period") == 0)
+                options.rateChangePeriod = value;
+            else if (std::strcmp(argv[i], "--resize-period") == 0)
+                options.resizePeriod = value;
+            else if (std::strcmp(argv[i], "--codec") == 0)
+                options.codec = value;
+            else if (std::strcmp(argv[i], "--slices") == 0)
+                options.slices = value;
+            else if (std::strcmp(argv[i], "--intra-refresh") == 0)
+                options.intraRefreshFrames = value;
+            else if (std::strcmp(argv[i], "--loss-period") == 0)
+                options.lossPeriod = value;
+            else if (std::strcmp(argv[i], "--prewarm") == 0)
+                options.prewarm = value;
+            else if (std::strcmp(argv[i], "--latency-us") == 0)
+                options.encodeLatencyUs = static_cast<uint32_t>(value);
+            else if (std::strcmp(argv[i], "--submit-us") == 0)
+                options.submitCostUs = static_cast<uint32_t>(value);
+            else if (std::strcmp(argv[i], "--consume-period-us") == 0)
+                options.consumePeriodUs = static_cast<uint32_t>(value);
+            else if (std::strcmp(argv[i], "--missed-event-period") == 0)
+                options.missedEventPeriod = static_cast<uint32_t>(value);
+            else if (std::strcmp(argv[i], "--empty-slice-period") == 0)
+                options.emptySlicePeriod = static_cast<uint32_t>(value);
+            else
+                return false;
+        }
+        return (argc % 2) == 1 && options.frames > 0 && options.frameRate > 0 && options.sessions > 0
+            && (options.codec == 0 || options.codec == 1)
+            && options.slices >= 0 && options.slices <= static_cast<int>(k_MaxSliceCount)
+            && options.intraRefreshFrames >= 0 && options.lossPeriod >= 0
+            && (options.prewarm == 0 || options.sessions <= static_cast<int>(k_MaxPrewarmedSessions));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        std::printf("Usage: %s [--frames N] [--width W] [--height H] [--fps F] [--gop G] [--sessions S]"
+                    " [--pipeline 0 default|1 latency|2 throughput] [--in-flight N] [--rate-change-period N] [--resize-period N] [--codec 0 h264|1 hevc] [--slices N]"
+                    " [--intra-refresh N] [--loss-period N] [--prewarm 0|1]"
+                    " [--latency-us L] [--submit-us S] [--consume-period-us P] [--missed-event-period N] [--empty-slice-period N] [--log PATH]\n", argv[0]);
+        return 2;
+    }
+
+    // Logs everything, so that the plugin messages go through the asynchronous writer while encoding.
+    if (options.logPath != nullptr)
+    {
+        NativeLog::SetLevel(NativeLog::Level::Debug);
+        NativeLog::Start(options.logPath, false);
+    }
+
+    Mock::MockSettings mockSettings;
+    mockSettings.encodeLatencyUs = options.encodeLatencyUs;
+    mockSettings.submitCostUs = options.submitCostUs;
+    mockSettings.missedEventPeriod = options.missedEventPeriod;
+    mockSettings.emptySlicePeriod = options.emptySlicePeriod;
+    Mock::SetSettings(mockSettings);
+    Mock::ResetCounters();
+
+    CpuEncoderDevice device;
+    device.Initialize();
+
+    const auto codec = static_cast<VideoCodec>(options.codec);
+    const auto slicesPerFrame = static_cast<uint32_t>(std::max(options.slices, 1));
+    const auto depth = EncoderPipelineDepth::FromSettings(static_cast<EncoderPipelineMode>(options.pipelineMode),
+                                                          options.framesInFlight, 0);
+
+    // Every session has its own size: the first one uses the requested size, the next ones are smaller.
+    const auto getSessionData = [&options](int session)
+    {
+        NvencEncoderSessionData sessionData;
+        sessionData.width = std::max(options.width - session * 128, 64);
+        sessionData.height = std::max(options.height - session * 72, 64);
+        sessionData.frameRate = options.frameRate;
+        sessionData.bitRate = 8000;
+        sessionData.gopSize = options.gopSize;
+        return sessionData;
+    };
+
+    const auto getSessionPoolKey = [&](const NvencEncoderSessionData& sessionData)
+    {
+        const SessionPoolKey key = { &device, sessionData.width, sessionData.height, codec, false, depth,
+                                     options.slices, options.intraRefreshFrames };
+        return key;
+    };
+
+    // Like the plugin, the bit rate is given in kilobits and converted by the encoder.
+    const auto createEncoder = [&](const NvencEncoderSessionData& sessionData) -> NvEncoder*
+    {
+        std::unique_ptr<NvEncoder> encoder(new NvEncoder(NV_ENC_DEVICE_TYPE_DIRECTX, sessionData, &device, false, depth,
+                                                         codec, options.slices, options.intraRefreshFrames));
+        return encoder->InitEncoder() == ENvencStatus::Success ? encoder.release() : nullptr;
+    };
+
+    SessionPool<NvEncoder, k_MaxPrewarmedSessions> sessionPool;
+    if (options.prewarm != 0)
+    {
+        for (int i = 0; i < options.sessions; ++i)
+        {
+            const auto sessionData = getSessionData(i);
+            auto encoder = createEncoder(sessionData);
+            if (encoder == nullptr || !sessionPool.Add(getSessionPoolKey(sessionData), encoder))
+            {
+                std::printf("Failed to prewarm the encoder against the mock API.\n");
+                return 1;
+            }
+        }
+    }
+
+    std::vector<NvencEncoderSessionData> sessionDatas;
+    std::vector<std::unique_ptr<NvEncoder>> encoders;
+    std::vector<std::unique_ptr<CpuTexture2D>> sources;
+    std::vector<uint64_t> startTimes;
+    for (int i = 0; i < options.sessions; ++i)
+    {
+        const auto sessionData = getSessionData(i);
+
+        const auto start = Now();
+        NvEncoder* encoder = nullptr;
+        if (options.prewarm != 0)
+        {
+            encoder = sessionPool.Checkout(getSessionPoolKey(sessionData));
+            if (encoder != nullptr)
+                encoder->UpdateEncoderSessionData(sessionData);
+        }
+        else
+            encoder = createEncoder(sessionData);
+        startTimes.push_back(Now() - start);
+
+        if (encoder == nullptr)
+        {
+            std::printf("Failed to initialize the encoder against the mock API.\n");
+            return 1;
+        }
+        encoders.emplace_back(encoder);
+
+        ParameterSets parameterSets;
+        if (!encoders.back()->GetSequenceParams(parameterSets)
+            || parameterSets.vpsSequence.empty() != (codec != VideoCodec::HEVC))
+        {
+            std::printf("Error: invalid parameter sets.\n");
+            return 1;
+        }
+
+        sources.emplace_back(new CpuTexture2D(sessionData.width, sessionData.height, false));
+        sessionDatas.push_back(sessionData);
+    }
+
+    std::atomic<bool> isProducing = { true };
+    std::vector<uint64_t> latencies;
+    std::vector<uint64_t> firstSliceLatencies;
+    latencies.reserve(static_cast<size_t>(options.frames) * options.sessions * slicesPerFrame);
+    firstSliceLatencies.reserve(static_cast<size_t>(options.frames) * options.sessions);
+    uint64_t consumedFrames = 0;
+    uint64_t consumedSlices = 0;
+    uint64_t consumedBytes = 0;
+    uint64_t invalidKeyFrames = 0;
+    uint64_t invalidSlices = 0;
+    uint64_t invalidTimecodes = 0;
+    uint32_t maxFrameSize = 0;
+    uint64_t lossReports = 0;
+    uint64_t recoveryFrames = 0;
+    uint64_t idrRecoveryFrames = 0;
+
+    // The timecode of a frame at the benchmark frame rate, packed as in EncoderTextureID.
+    const auto getTimecode = [&options](int frame)
+    {
+        const auto seconds = frame / options.frameRate;
+        return 0x80000000u
+            | static_cast<uint32_t>((seconds / 3600 % 24) << 24)
+            | static_cast<uint32_t>((seconds / 60 % 60) << 16)
+            | static_cast<uint32_t>((seconds % 60) << 8)
+            | static_cast<uint32_t>(frame % options.frameRate);
+    };
+
+    // A key frame must start with an IDR slice of the session codec.
+    const auto isIdr = [codec](uint32_t type)
+    {
+        return codec == VideoCodec::HEVC ? (type == k_HevcNalIdrWRadl || type == k_HevcNalIdrNLp) : type == k_H264NalIdr;
+    };
+
+    std::thread consumer([&]
+    {
+        std::vector<NalUnitEntry> nalUnits;
+        std::vector<uint32_t> nextSliceIndices(encoders.size(), 0);
+        std::vector<uint64_t> nextFrameCounts(encoders.size(), 0);
+        std::vector<uint32_t> lastTimecodes(encoders.size(), 0);
+
+        // The timestamps of the last frames consumed by each session, to report their loss.
+        static const size_t k_LossHistory = 8;
+        std::vector<std::vector<uint64_t>> consumedTimestamps(encoders.size());
+
+        // When each session last reported a loss, 0 once the first frame submitted after it is consumed.
+        std::vector<uint64_t> lossReportTimes(encoders.size(), 0);
+        for (;;)
+        {
+            // Read the flag first so that the frames submitted before it was cleared are drained.
+            const auto isDone = !isProducing;
+
+            for (size_t session = 0; session < encoders.size(); ++session)
+            {
+                auto& encoder = encoders[session];
+                EncodedFrameView view;
+                while (encoder->AcquireEncodedFrame(view))
+                {
+                    const auto data = view.image;
+                    const auto size = view.imageSize;
+                    const auto latency = Now() - view.timestamp;
+                    latencies.push_back(latency);
+                    consumedBytes += size;
+                    consumedSlices++;
+
+                    // The slices of a frame come in order, the last one closes the frame. Frames are dropped
+                    // whole: a slice starts a frame or follows the previous slice of its frame.
+                    auto& nextSliceIndex = nextSliceIndices[session];
+                    if ((view.sliceIndex != 0 && view.sliceIndex != nextSliceIndex)
+                        || (view.isLastSlice && view.sliceIndex + 1 != slicesPerFrame))
+                        invalidSlices++;
+                    nextSliceIndex = view.isLastSlice ? 0 : view.sliceIndex + 1;
+
+                    if (view.sliceIndex == 0)
+                        firstSliceLatencies.push_back(latency);
+                    if (view.isLastSlice)
+                    {
+                        consumedFrames++;
+
+                        // Alternately lose the last frame, usually still in the DPB, and an older one.
+                        auto& timestamps = consumedTimestamps[session];
+                        timestamps.push_back(view.timestamp);
+                        if (timestamps.size() > k_LossHistory)
+                            timestamps.erase(timestamps.begin());
+
+                        if (options.lossPeriod > 0 && timestamps.size() == k_LossHistory && consumedFrames % options.lossPeriod == 0)
+                        {
+                            encoder->InvalidateReferenceFrames(lossReports % 2 == 0 ? timestamps.back() : timestamps.front());
+                            lossReportTimes[session] = Now();
+                            lossReports++;
+                        }
+                    }
+
+                    if (!view.isKeyFrame)
+                        maxFrameSize = std::max(maxFrameSize, size);
+
+                    // The first slice of a frame starts with its timecode SEI message, then with an IDR slice
+                    // on key frames. Dropped frames skip frame counts and timecodes.
+                    if (view.sliceIndex == 0)
+                    {
+                        FindNalUnits(codec, data, size, nalUnits);
+
+                        TimecodeSei sei;
+                        auto& nextFrameCount = nextFrameCounts[session];
+                        auto& lastTimecode = lastTimecodes[session];
+                        if (nalUnits.empty()
+                            || !ReadTimecodeSei(codec, data + nalUnits[0].offset, nalUnits[0].size, sei)
+                            || sei.timestamp != view.timestamp || sei.frameCount < nextFrameCount
+                            || sei.timecode <= lastTimecode)
+                        {
+                            invalidTimecodes++;
+                        }
+                        else
+                        {
+                            nextFrameCount = sei.frameCount + 1;
+                            lastTimecode = sei.timecode;
+                        }
+
+                        if (view.isKeyFrame && (nalUnits.size() < 2 || !isIdr(nalUnits[1].type)))
+                            invalidKeyFrames++;
+
+                        // The first frame submitted after a loss report recovers from it, or a frame before
+                        // it did: either way it must not be an IDR frame when a reference is left.
+                        auto& lossReportTime = lossReportTimes[session];
+                        if (lossReportTime != 0 && view.timestamp > lossReportTime)
+                        {
+                            recoveryFrames++;
+                            if (view.isKeyFrame || (nalUnits.size() >= 2 && isIdr(nalUnits[1].type)))
+                                idrRecoveryFrames++;
+                            lossReportTime = 0;
+                        }
+                    }
+                    encoder->ReleaseEncodedFrame(view.token);
+                }
+            }
+
+            if (isDone)
+                break;
+
+            std::this_thread::sleep_for(std::chrono::microseconds(options.consumePeriodUs));
+        }
+    });
+
+    std::vector<uint64_t> submitTimes;
+    submitTimes.reserve(static_cast<size_t>(options.frames) * options.sessions);
+
+    const auto framePeriod = std::chrono::nanoseconds(1000000000LL / options.frameRate);
+    auto nextFrame = Clock::now();
+    uint64_t rateChanges = 0;
+    uint64_t resizes = 0;
+
+    for (int i = 0; i < options.frames; ++i)
+    {
+        std::this_thread::sleep_until(nextFrame);
+        nextFrame += framePeriod;
+
+        const auto isRateChange = options.rateChangePeriod > 0 && i > 0 && i % options.rateChangePeriod == 0;
+        const auto isResize = options.resizePeriod > 0 && i > 0 && i % options.resizePeriod == 0;
+
+        for (int session = 0; session < options.sessions; ++session)
+        {
+            const auto start = Now();
+            if (isRateChange)
+            {
+                auto& sessionData = sessionDatas[session];
+                sessionData.bitRate = sessionData.bitRate == 8000 ? 4000 : 8000;
+                encoders[session]->UpdateEncoderSessionData(sessionData);
+                rateChanges++;
+            }
+            if (isResize)
+            {
+                // Alternates between the full and the half height, the buffers are released and recreated.
+                auto& sessionData = sessionDatas[session];
+                sessionData.height = sessionData.height == options.height ? options.height / 2 : options.height;
+                encoders[session]->UpdateEncoderSessionData(sessionData);
+                resizes++;
+            }
+            encoders[session]->EncodeFrame(reinterpret_cast<IUnknown*>(sources[session].get()), start, getTimecode(i));
+            submitTimes.push_back(Now() - start);
+        }
+    }
+
+    // Wait for the submission thread, then for the last frames to come out of the mock driver and to be
+    // queued: a frame is locked in the driver before it reaches the queue.
+    const auto isSubmitted = [&encoders, &options]
+    {
+        for (auto& encoder : encoders)
+        {
+            EncoderStats stats;
+            encoder->GetStats(stats);
+            if (stats.submittedFrameCount + stats.droppedInputFrameCount < static_cast<uint64_t>(options.frames)
+                || stats.inFlightFrameCount > 0)
+                return false;
+        }
+        return true;
+    };
+
+    const auto deadline = Clock::now() + std::chrono::seconds(5);
+    while ((!isSubmitted() || Mock::GetCounters().lockedFrames < Mock::GetCounters().submittedFrames) && Clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    isProducing = false;
+    consumer.join();
+
+    // The counters are summed over the sessions, the stage latencies are the ones of the first session.
+    CompletionThreadLoad load = {};
+    uint64_t droppedFrames = 0;
+    uint64_t encoderSubmittedFrames = 0;
+    uint64_t totalStageFrames = 0;
+
+    EncoderStats stats;
+    for (auto it = encoders.rbegin(); it != encoders.rend(); ++it)
+    {
+        const auto sessionLoad = (*it)->GetCompletionThreadLoad();
+        load.busyTime += sessionLoad.busyTime;
+        load.idleTime += sessionLoad.idleTime;
+        load.waitTime += sessionLoad.waitTime;
+        load.frameCount += sessionLoad.frameCount;
+        droppedFrames += (*it)->GetDroppedFrameCount();
+
+        (*it)->GetStats(stats);
+        encoderSubmittedFrames += stats.submittedFrameCount;
+        totalStageFrames += stats.stages[static_cast<uint32_t>(EncoderStage::Total)].count;
+        (*it)->DestroyResources();
+    }
+
+    if (options.logPath != nullptr)
+    {
+        NativeLog::Stop();
+        std::printf("log: %s, %llu records dropped\n", options.logPath,
+                    static_cast<unsigned long long>(NativeLog::GetDroppedCount()));
+    }
+
+    const auto counters = Mock::GetCounters();
+    const auto skippedFrames = static_cast<uint64_t>(options.frames) * options.sessions - counters.submittedFrames;
+
+    std::printf("codec: %s\n", codec == VideoCodec::HEVC ? "HEVC" : "H.264");
+    std::printf("frames: %d x %d sessions at %d fps, %dx%d, gop %d, encode latency %u us, submit cost %u us, consume period %u us\n",
+                options.frames, options.sessions, options.frameRate, options.width, options.height, options.gopSize,
+                options.encodeLatencyUs, options.submitCostUs, options.consumePeriodUs);
+    std::printf("pipeline: %u frames in flight, %u frames queued at most\n", depth.framesInFlight, depth.maxQueueLength);
+    std::printf("submitted: %llu (key frames %llu), skipped (buffers busy): %llu\n",
+                static_cast<unsigned long long>(counters.submittedFrames),
+                static_cast<unsigned long long>(counters.keyFrames),
+                static_cast<unsigned long long>(skippedFrames));
+    std::printf("rate changes: %llu, resizes: %llu, reconfigurations: %llu\n",
+                static_cast<unsigned long long>(rateChanges),
+                static_cast<unsigned long long>(resizes),
+                static_cast<unsigned long long>(counters.reconfigurations));
+    std::printf("consumed: %llu (%llu slices, %llu bytes), dropped (queue full or empty slice): %llu, empty slices: %llu\n",
+                static_cast<unsigned long long>(consumedFrames),
+                static_cast<unsigned long long>(consumedSlices),
+                static_cast<unsigned long long>(consumedBytes),
+                static_cast<unsigned long long>(droppedFrames),
+                static_cast<unsigned long long>(counters.emptySlices));
+    std::printf("session start (%s): p50 %.1f us, max %.1f us, module loads %llu, caps queries %llu, preset queries %llu\n",
+                options.prewarm != 0 ? "prewarmed" : "cold", Percentile(startTimes, 0.5), Percentile(startTimes, 1.0),
+                static_cast<unsigned long long>(counters.apiInstances),
+                static_cast<unsigned long long>(counters.capsQueries),
+                static_cast<unsigned long long>(counters.presetQueries));
+    std::printf("EncodeFrame: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+                Percentile(submitTimes, 0.5), Percentile(submitTimes, 0.99), Percentile(submitTimes, 1.0));
+    std::printf("submit to consume: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+                Percentile(latencies, 0.5), Percentile(latencies, 0.99), Percentile(latencies, 1.0));
+    if (slicesPerFrame > 1)
+    {
+        std::printf("submit to first slice (%u slices per frame): p50 %.1f us, p99 %.1f us, max %.1f us\n", slicesPerFrame,
+                    Percentile(firstSliceLatencies, 0.5), Percentile(firstSliceLatencies, 0.99), Percentile(firstSliceLatencies, 1.0));
+        std::printf("bitstream polls: %.1f per frame\n",
+                    static_cast<double>(counters.bitstreamPolls) / std::max<uint64_t>(counters.lockedFrames, 1));
+    }
+    if (options.intraRefreshFrames > 0)
+    {
+        std::printf("intra refresh over %d frames: %llu refreshes, largest frame %u bytes\n", options.intraRefreshFrames,
+                    static_cast<unsigned long long>(counters.intraRefreshes), maxFrameSize);
+    }
+    if (options.lossPeriod > 0)
+    {
+        std::printf("loss reports: %llu, invalidated frames: %llu, long-term reference recoveries: %llu, IDR recovery frames: %llu/%llu\n",
+                    static_cast<unsigned long long>(lossReports),
+                    static_cast<unsigned long long>(counters.invalidatedFrames),
+                    static_cast<unsigned long long>(counters.ltrRecoveries),
+                    static_cast<unsigned long long>(idrRecoveryFrames),
+                    static_cast<unsigned long long>(recoveryFrames));
+    }
+    std::printf("completion thread: busy %llu us, waiting for the driver %llu us, idle %llu us, %llu frames\n",
+                static_cast<unsigned long long>(load.busyTime),
+                static_cast<unsigned long long>(load.waitTime),
+                static_cast<unsigned long long>(load.idleTime),
+                static_cast<unsigned long long>(load.frameCount));
+
+    static const char* const k_StageNames[k_EncoderStageCount] = { "copy", "submit", "encode", "queue", "consume", "total" };
+    for (uint32_t i = 0; i < k_EncoderStageCount; ++i)
+    {
+        const auto& stage = stats.stages[i];
+        std::printf("stage %-8s %6llu frames, p50 %u us, p99 %u us, max %u us\n", k_StageNames[i],
+                    static_cast<unsigned long long>(stage.count), stage.p50, stage.p99, stage.max);
+    }
+    std::printf("output: %llu bytes/s, average frame %u bytes, key frames %llu (average %u, max %u bytes)\n",
+                static_cast<unsigned long long>(stats.bytesPerSecond), stats.averageFrameSize,
+                static_cast<unsigned long long>(stats.keyFrameCount), stats.averageKeyFrameSize, stats.maxKeyFrameSize);
+
+    // The queue holds slices, but drops whole frames: a frame is either consumed up to its last slice or
+    // dropped, possibly after its first slices were consumed.
+    if (counters.lockedFrames != counters.submittedFrames
+        || consumedFrames + droppedFrames != counters.lockedFrames
+        || (droppedFrames == 0 && consumedSlices != counters.lockedFrames * slicesPerFrame)
+        || encoderSubmittedFrames != counters.submittedFrames || totalStageFrames != consumedSlices)
+    {
+        std::printf("Error: frames are unaccounted for.\n");
+        return 1;
+    }
+
+    // The slices are polled with a backoff: spinning on the lock would poll thousands of times per frame.
+    if (slicesPerFrame > 1 && counters.bitstreamPolls > counters.lockedFrames * k_MaxBitstreamPollsPerFrame)
+    {
+        std::printf("Error: the completion thread spins on the bitstream lock.\n");
+        return 1;
+    }
+
+    // A frame the driver returned an invalid slice for is dropped whole.
+    if (droppedFrames < counters.emptySlices)
+    {
+        std::printf("Error: %llu frames with an empty slice weren't dropped.\n",
+                    static_cast<unsigned long long>(counters.emptySlices - droppedFrames));
+        return 1;
+    }
+
+    if (invalidSlices > 0)
+    {
+        std::printf("Error: %llu slices out of order or missing.\n", static_cast<unsigned long long>(invalidSlices));
+        return 1;
+    }
+
+    // The sessions share the module and the driver queries of the first one.
+    if (counters.apiInstances != 1 || counters.presetQueries != 1)
+    {
+        std::printf("Error: the NVENC module or its queries weren't shared by the sessions.\n");
+        return 1;
+    }
+
+    if (invalidTimecodes > 0)
+    {
+        std::printf("Error: %llu frames don't start with their timecode SEI message.\n", static_cast<unsigned long long>(invalidTimecodes));
+        return 1;
+    }
+
+    if (invalidKeyFrames > 0)
+    {
+        std::printf("Error: %llu key frames don't start with an IDR slice.\n", static_cast<unsigned long long>(invalidKeyFrames));
+        return 1;
+    }
+
+    // Without a GOP, the frames that follow a NACK are P-frames referencing what the client still has.
+    if (options.lossPeriod > 0 && options.gopSize == 0 && (recoveryFrames == 0 || idrRecoveryFrames > 0))
+    {
+        std::printf("Error: %llu of the %llu frames that followed a loss report are IDR frames.\n",
+                    static_cast<unsigned long long>(idrRecoveryFrames), static_cast<unsigned long long>(recoveryFrames));
+        return 1;
+    }
+
+    // Without a GOP, only the first frame of each session and the frames after a resize are key frames,
+    // whatever the rate changes.
+    if (options.gopSize == 0 && counters.keyFrames != options.sessions + resizes)
+    {
+        std::printf("Error: a rate change or a loss produced a key frame.\n");
+        return 1;
+    }
+
+    if (options.lossPeriod > 0 && lossReports > 0 && (counters.invalidatedFrames == 0 || counters.ltrRecoveries == 0))
+    {
+        std::printf("Error: the losses weren't recovered from the references.\n");
+        return 1;
+    }
+
+    // With intra refresh, the GOP only sets the refresh period: the first frame is the only key frame
+    // and the refreshes keep the frames smaller than a key frame.
+    if (options.intraRefreshFrames > 0
+        && (counters.keyFrames != static_cast<uint64_t>(options.sessions) || counters.intraRefreshes == 0
+            || maxFrameSize >= mockSettings.keyFrameSize))
+    {
+        std::printf("Error: the intra refresh produced a key frame or a frame as large as one.\n");
+        return 1;
+    }
+    return 0;
+}
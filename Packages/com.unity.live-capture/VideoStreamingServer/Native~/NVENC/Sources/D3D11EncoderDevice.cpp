@@ -25,12 +25,12 @@ namespace NvencPlugin
         return m_D3d11Device != nullptr && m_D3d11Context != nullptr;
     }
 
-    void D3D11EncoderDevice::InitializeConverter(const int width, const int height)
+    INV12Converter* D3D11EncoderDevice::CreateConverter(const int width, const int height)
     {
-        m_Converter.reset(new RGBToNV12ConverterD3D11(m_D3d11Device,
+        return new RGBToNV12ConverterD3D11(m_D3d11Device,
             m_D3d11Context,
             width,
-            height));
+            height);
     }
 
     bool D3D11EncoderDevice::InitializeMultithreadingSecurity()
@@ -39,6 +39,7 @@ namespace NvencPlugin
         if (SUCCEEDED(m_D3d11Device->QueryInterface(__uuidof(ID3D10Multithread), (void**)&spMultithread)))
         {
             spMultithread->SetMultithreadProtected(true);
+            spMultithread->Release();
             return true;
         }
         return false;
@@ -75,12 +76,12 @@ namespace NvencPlugin
         return new D3D11Texture2D(width, height, texture);
     }
 
-    bool D3D11EncoderDevice::ConvertRGBToNV12(IUnknown* nativeSrc, void* tex2DDest)
+    bool D3D11EncoderDevice::ConvertRGBToNV12(INV12Converter* converter, IUnknown* nativeSrc, void* tex2DDest)
     {
         auto text2D = static_cast<D3D11Texture2D*>(tex2DDest);
         auto nativeDest = text2D->GetNativeTexturePtrV();
 
-        return m_Converter->ConvertRGBToNV12(static_cast<ID3D11Texture2D*>(nativeSrc),
+        return static_cast<RGBToNV12ConverterD3D11*>(converter)->ConvertRGBToNV12(static_cast<ID3D11Texture2D*>(nativeSrc),
                                              static_cast<ID3D11Texture2D*>(nativeDest));
     }
 
@@ -93,4 +94,9 @@ namespace NvencPlugin
                                      static_cast<ID3D11Resource*>(nativeSrc));
         return true;
     }
+
+    void D3D11EncoderDevice::WaitForCopies()
+    {
+        // The encoder uses the same device, the driver orders its reads after the copies.
+    }
 }
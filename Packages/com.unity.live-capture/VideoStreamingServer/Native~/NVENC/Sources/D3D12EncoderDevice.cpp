@@ -13,7 +13,7 @@ namespace NvencPlugin
         m_d3d11Context(nullptr),
         m_copyResourceEventHandle(nullptr),
         m_copyResourceFence(nullptr),
-        m_copyResourceFenceValue(1)
+        m_copyResourceFenceValue(0)
     {
     }
 
@@ -58,12 +58,12 @@ namespace NvencPlugin
         return true;
     }
 
-    void D3D12EncoderDevice::InitializeConverter(const int width, const int height)
+    INV12Converter* D3D12EncoderDevice::CreateConverter(const int width, const int height)
     {
-        m_Converter.reset(new RGBToNV12ConverterD3D11(m_d3d11Device,
-                          m_d3d11Context,
-                          width,
-                          height));
+        return new RGBToNV12ConverterD3D11(m_d3d11Device,
+                                           m_d3d11Context,
+                                           width,
+                                           height);
     }
 
     bool D3D12EncoderDevice::InitializeMultithreadingSecurity()
@@ -124,17 +124,19 @@ namespace NvencPlugin
         return new D3D12Texture2D(width, height, nativeTex, handle, sharedTex, nv12Tex);
     }
 
-    bool D3D12EncoderDevice::ConvertRGBToNV12(IUnknown* nativeSrcD3D12, void* tex2DDest)
+    bool D3D12EncoderDevice::ConvertRGBToNV12(INV12Converter* converter, IUnknown* nativeSrcD3D12, void* tex2DDest)
     {
         // Convert the shared D3D11Texture to another one in the NV12 format.
         auto text2D = static_cast<D3D12Texture2D*>(tex2DDest);
 
-        // Copy shared resources (initial RGB texture to the D3D12 shared resource).
+        // Copy shared resources (initial RGB texture to the D3D12 shared resource). The conversion
+        // reads it from the D3D11 device, so the copy has to be done first.
         CopyResource(nativeSrcD3D12, tex2DDest);
+        WaitForFence(m_copyResourceFence, m_copyResourceEventHandle, m_copyResourceFenceValue);
 
         auto nativeSrcD3D11 = static_cast<ID3D11Texture2D*>(text2D->GetEncodeTexturePtrV());
         auto nativeDstD3D11 = static_cast<ID3D11Texture2D*>(text2D->GetNV12Texture());
-        return m_Converter->ConvertRGBToNV12(nativeSrcD3D11, nativeDstD3D11);
+        return static_cast<RGBToNV12ConverterD3D11*>(converter)->ConvertRGBToNV12(nativeSrcD3D11, nativeDstD3D11);
     }
 
     bool D3D12EncoderDevice::CopyResource(IUnknown* nativeSrc, void* tex2DDest)
@@ -148,6 +150,8 @@ namespace NvencPlugin
         if (nativeSrcRes == nullptr || nativeDestRes == nullptr)
             return false;
 
+        // The allocator can only be reset once the previous copy is done, which it almost always is.
+        WaitForFence(m_copyResourceFence, m_copyResourceEventHandle, m_copyResourceFenceValue);
         m_commandAllocator->Reset();
 
         m_commandList->Reset(m_commandAllocator, nullptr);
@@ -157,17 +161,29 @@ namespace NvencPlugin
         ID3D12CommandList* cmdList[] = { m_commandList };
         m_d3d12CommandQueue->ExecuteCommandLists(_countof(cmdList), cmdList);
 
-        WaitForFence(m_copyResourceFence, m_copyResourceEventHandle, &m_copyResourceFenceValue);
+        // The encoder waits for the copy in WaitForCopies, the render thread doesn't.
+        const auto fenceValue = m_copyResourceFenceValue.load() + 1;
+        m_d3d12CommandQueue->Signal(m_copyResourceFence, fenceValue);
+        m_copyResourceFenceValue.store(fenceValue);
 
         return true;
     }
 
-    void D3D12EncoderDevice::WaitForFence(ID3D12Fence* fence, HANDLE handle, uint64_t* fenceValue)
+    void D3D12EncoderDevice::WaitForCopies()
     {
-        m_d3d12CommandQueue->Signal(fence, *fenceValue);
-        fence->SetEventOnCompletion(*fenceValue, handle);
-        WaitForSingleObject(handle, INFINITE);
-        ++(*fenceValue);
+        // Several encoder sessions can wait at the same time: without an event, SetEventOnCompletion
+        // blocks the calling thread until the fence reaches the value.
+        WaitForFence(m_copyResourceFence, nullptr, m_copyResourceFenceValue);
+    }
+
+    void D3D12EncoderDevice::WaitForFence(ID3D12Fence* fence, HANDLE handle, uint64_t fenceValue)
+    {
+        if (fence->GetCompletedValue() >= fenceValue)
+            return;
+
+        fence->SetEventOnCompletion(fenceValue, handle);
+        if (handle != nullptr)
+            WaitForSingleObject(handle, INFINITE);
     }
 
     ID3D12Resource* D3D12EncoderDevice::CreateD3D12Resource(uint32_t width, uint32_t height)
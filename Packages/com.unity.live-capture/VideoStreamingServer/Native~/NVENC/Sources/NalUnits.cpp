@@ -0,0 +1,277 @@
+#include "NalUnits.h"
+#include "BitReader.h"
+#include "BitWriter.h"
+#include "ParameterSetParser.h"
+
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define NALUNITS_SCAN_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NALUNITS_SCAN_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define NALUNITS_SCAN_NEON
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace NvencPlugin
+{
+    namespace
+    {
+        // Returns the index of the lowest set bit of a non-zero mask.
+        inline uint32_t CountTrailingZeros(uint32_t mask)
+        {
+#if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return static_cast<uint32_t>(index);
+#else
+            return static_cast<uint32_t>(__builtin_ctz(mask));
+#endif
+        }
+
+        // Returns the index of the first 00 00 01 sequence at or after begin, or size if there is none.
+        // The vector loops compare 16 or 32 candidate positions at once against the three bytes of the
+        // start code; they stop 2 bytes early so that the shifted loads stay in the buffer.
+        uint32_t FindStartCode(const uint8_t* data, uint32_t begin, uint32_t size)
+        {
+            uint32_t i = begin;
+
+#if defined(NALUNITS_SCAN_AVX2)
+            const auto zero32 = _mm256_setzero_si256();
+            const auto one32 = _mm256_set1_epi8(1);
+            for (; i + 34 <= size; i += 32)
+            {
+                const auto b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                const auto b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 1));
+                const auto b2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 2));
+                const auto match = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(b0, zero32), _mm256_cmpeq_epi8(b1, zero32)),
+                                                    _mm256_cmpeq_epi8(b2, one32));
+                const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(match));
+                if (mask != 0)
+                    return i + CountTrailingZeros(mask);
+            }
+#endif
+
+#if defined(NALUNITS_SCAN_SSE2)
+            const auto zero = _mm_setzero_si128();
+            const auto one = _mm_set1_epi8(1);
+            for (; i + 18 <= size; i += 16)
+            {
+                const auto b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                const auto b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 1));
+                const auto b2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 2));
+                const auto match = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)),
+                                                 _mm_cmpeq_epi8(b2, one));
+                const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(match));
+                if (mask != 0)
+                    return i + CountTrailingZeros(mask);
+            }
+#elif defined(NALUNITS_SCAN_NEON)
+            const auto zero = vdupq_n_u8(0);
+            const auto one = vdupq_n_u8(1);
+            for (; i + 18 <= size; i += 16)
+            {
+                const auto match = vandq_u8(vandq_u8(vceqq_u8(vld1q_u8(data + i), zero), vceqq_u8(vld1q_u8(data + i + 1), zero)),
+                                            vceqq_u8(vld1q_u8(data + i + 2), one));
+
+                // NEON has no movemask, the scalar loop below finds the position within the block.
+                if (vmaxvq_u8(match) != 0)
+                    break;
+            }
+#endif
+
+            for (; i + 3 <= size; i++)
+            {
+                if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1)
+                    return i;
+            }
+            return size;
+        }
+
+        // sei_message of the timing: payloadType user_data_unregistered and payloadSize fit in a byte each.
+        const uint32_t k_TimecodeSeiRbspSize = 2 + k_TimecodeSeiPayloadSize + 1;
+
+        inline void WriteBigEndian(uint64_t value, uint32_t byteCount, uint8_t* output)
+        {
+            for (uint32_t i = 0; i < byteCount; ++i)
+                output[i] = static_cast<uint8_t>(value >> (8 * (byteCount - 1 - i)));
+        }
+
+        inline uint64_t ReadBigEndian(const uint8_t* data, uint32_t byteCount)
+        {
+            uint64_t value = 0;
+            for (uint32_t i = 0; i < byteCount; ++i)
+                value = (value << 8) | data[i];
+            return value;
+        }
+    }
+
+    void FindNalUnits(VideoCodec codec, const uint8_t* data, uint32_t size, std::vector<NalUnitEntry>& nalUnits)
+    {
+        nalUnits.clear();
+
+        auto i = FindStartCode(data, 0, size);
+        while (i + 3 < size)
+        {
+            const auto offset = i + 3;
+            i = FindStartCode(data, offset, size);
+
+            // The zero byte preceding a 3 bytes start code belongs to a 4 bytes start code.
+            const auto end = (i < size && i > offset && data[i - 1] == 0) ? i - 1 : i;
+            nalUnits.push_back({ offset, end - offset, GetNalUnitType(codec, data[offset]) });
+        }
+    }
+
+    void WriteTimecodeSeiPayload(const TimecodeSei& sei, uint8_t* payload)
+    {
+        std::memcpy(payload, k_TimecodeSeiUuid, sizeof(k_TimecodeSeiUuid));
+        WriteBigEndian(sei.timecode, 4, payload + 16);
+        WriteBigEndian(sei.timestamp, 8, payload + 20);
+        WriteBigEndian(sei.frameCount, 8, payload + 28);
+    }
+
+    void AppendSeiNalUnit(VideoCodec codec, uint32_t payloadType, const uint8_t* payload, uint32_t payloadSize,
+                          std::vector<uint8_t>& output)
+    {
+        // sei_rbsp: a single sei_message, its type and size coded as 0xFF bytes followed by the remainder, then
+        // the trailing bits.
+        std::vector<uint8_t> rbsp;
+        rbsp.reserve(payloadSize + 4);
+        for (auto value : { payloadType, payloadSize })
+        {
+            for (; value >= 0xFF; value -= 0xFF)
+                rbsp.push_back(0xFF);
+            rbsp.push_back(static_cast<uint8_t>(value));
+        }
+        rbsp.insert(rbsp.end(), payload, payload + payloadSize);
+        rbsp.push_back(0x80);
+
+        static const uint8_t k_StartCode[] = { 0x00, 0x00, 0x00, 0x01 };
+        output.insert(output.end(), k_StartCode, k_StartCode + sizeof(k_StartCode));
+        if (codec == VideoCodec::HEVC)
+        {
+            output.push_back(static_cast<uint8_t>(k_HevcNalPrefixSei << 1));
+            output.push_back(0x01); // nuh_layer_id 0, nuh_temporal_id_plus1 1.
+        }
+        else
+        {
+            output.push_back(static_cast<uint8_t>(k_H264NalSei));
+        }
+        AddEmulationPrevention(rbsp.data(), rbsp.size(), output);
+    }
+
+    void CopyWithTimecodeSei(VideoCodec codec, const uint8_t* data, uint32_t size, const TimecodeSei& sei,
+                             std::vector<uint8_t>& output, std::vector<NalUnitEntry>& nalUnits)
+    {
+        FindNalUnits(codec, data, size, nalUnits);
+
+        size_t first = 0;
+        while (first < nalUnits.size() && !IsVclNalUnit(codec, nalUnits[first].type))
+            first++;
+
+        output.clear();
+        if (first == nalUnits.size())
+        {
+            output.assign(data, data + size);
+            return;
+        }
+
+        // The SEI NAL unit is inserted before the start code of the VCL NAL unit, and its leading zero byte
+        // when it is 4 bytes long.
+        auto position = nalUnits[first].offset - 3;
+        if (position > 0 && data[position - 1] == 0)
+            position--;
+
+        uint8_t payload[k_TimecodeSeiPayloadSize];
+        WriteTimecodeSeiPayload(sei, payload);
+
+        output.reserve(size + 4 + 2 + k_TimecodeSeiRbspSize * 3 / 2);
+        output.insert(output.end(), data, data + position);
+
+        // Past the start code.
+        const auto seiOffset = static_cast<uint32_t>(output.size()) + 4;
+        const auto seiType = codec == VideoCodec::HEVC ? k_HevcNalPrefixSei : k_H264NalSei;
+        AppendSeiNalUnit(codec, k_UserDataUnregisteredSei, payload, sizeof(payload), output);
+        const auto seiSize = static_cast<uint32_t>(output.size()) - seiOffset;
+
+        output.insert(output.end(), data + position, data + size);
+
+        const auto shift = static_cast<uint32_t>(output.size()) - size;
+        for (auto i = first; i < nalUnits.size(); ++i)
+            nalUnits[i].offset += shift;
+        nalUnits.insert(nalUnits.begin() + first, { seiOffset, seiSize, seiType });
+    }
+
+    bool ReadTimecodeSei(VideoCodec codec, const uint8_t* data, uint32_t size, TimecodeSei& sei)
+    {
+        const auto isHevc = codec == VideoCodec::HEVC;
+        const uint32_t headerSize = isHevc ? 2 : 1;
+        if (data == nullptr || size <= headerSize
+            || GetNalUnitType(codec, data[0]) != (isHevc ? k_HevcNalPrefixSei : k_H264NalSei))
+            return false;
+
+        std::vector<uint8_t> rbsp;
+        RemoveEmulationPrevention(data + headerSize, size - headerSize, rbsp);
+        if (rbsp.size() < k_TimecodeSeiRbspSize
+            || rbsp[0] != k_UserDataUnregisteredSei
+            || rbsp[1] != k_TimecodeSeiPayloadSize
+            || std::memcmp(rbsp.data() + 2, k_TimecodeSeiUuid, sizeof(k_TimecodeSeiUuid)) != 0)
+            return false;
+
+        sei.timecode = static_cast<uint32_t>(ReadBigEndian(rbsp.data() + 18, 4));
+        sei.timestamp = ReadBigEndian(rbsp.data() + 22, 8);
+        sei.frameCount = ReadBigEndian(rbsp.data() + 30, 8);
+        return true;
+    }
+
+    bool ExtractParameterSets(VideoCodec codec, const uint8_t* data, uint32_t size, ParameterSets& parameterSets)
+    {
+        parameterSets.vpsSequence.clear();
+        parameterSets.spsSequence.clear();
+        parameterSets.ppsSequence.clear();
+        parameterSets.sequenceInfo = {};
+
+        std::vector<NalUnitEntry> nalUnits;
+        FindNalUnits(codec, data, size, nalUnits);
+
+        const auto isHevc = codec == VideoCodec::HEVC;
+        for (const auto& nalUnit : nalUnits)
+        {
+            std::vector<uint8_t>* sequence = nullptr;
+            if (isHevc && nalUnit.type == k_HevcNalVps)
+                sequence = &parameterSets.vpsSequence;
+            else if (nalUnit.type == (isHevc ? k_HevcNalSps : k_H264NalSps))
+                sequence = &parameterSets.spsSequence;
+            else if (nalUnit.type == (isHevc ? k_HevcNalPps : k_H264NalPps))
+                sequence = &parameterSets.ppsSequence;
+
+            // Only the first parameter set of each type is kept, the plugin uses a single one.
+            if (sequence != nullptr && sequence->empty())
+                sequence->assign(data + nalUnit.offset, data + nalUnit.offset + nalUnit.size);
+        }
+
+        if (parameterSets.spsSequence.empty()
+            || parameterSets.ppsSequence.empty()
+            || (isHevc && parameterSets.vpsSequence.empty()))
+            return false;
+
+        const auto& vps = parameterSets.vpsSequence;
+        const auto& sps = parameterSets.spsSequence;
+        const auto& pps = parameterSets.ppsSequence;
+        ParseSequenceInfo(codec,
+                          vps.data(), static_cast<uint32_t>(vps.size()),
+                          sps.data(), static_cast<uint32_t>(sps.size()),
+                          pps.data(), static_cast<uint32_t>(pps.size()),
+                          parameterSets.sequenceInfo);
+        return true;
+    }
+}
@@ -2,36 +2,28 @@
 #include <sstream>
 #include <fstream>
 #include <algorithm>
+#include <cstring>
+#include <thread>
 
 #include "NvencEncoder.h"
-#include "windows.h"
-#include "D3D12Texture2D.h"
+#include "ITexture2D.h"
 #include "PluginUtils.h"
-#include "D3D11EncoderDevice.h"
-
-#include "Unity/IUnityProfiler.h"
+#include "EncoderProfiler.h"
+#include "ParameterSetParser.h"
 
 // Disable the 'unscoped enum' Nvenc warnings
 #pragma warning(disable : 26812)
 
 namespace NvencPlugin
 {
+    // The encoders are allocated with new, which doesn't support over-aligned types in C++14.
+    static_assert(alignof(NvEncoder) <= alignof(std::max_align_t), "NvEncoder must not be over-aligned, see CacheLine.h.");
+
 #pragma region Codec & Initialize API
 
     ENvencSupport NvEncoder::IsEncoderAvailable()
     {
-        auto module = LoadModule();
-
-        if (module == nullptr)
-        {
-            return ENvencSupport::NoDriver;
-        }
-        else if (!CheckDriverVersion(module))
-        {
-            return ENvencSupport::DriverVersionNotSupported;
-        }
-
-        return ENvencSupport::Supported;
+        return NvencModule::GetSupport();
     }
 
     ENvencStatus NvEncoder::LoadCodec()
@@ -40,84 +32,26 @@ namespace NvencPlugin
 
         m_Nvenc = { NV_ENCODE_API_FUNCTION_LIST_VER };
 
-        auto module = LoadModule();
-        if (module == nullptr)
-        {
-            WriteFileDebug("Error, DriverNotInstalled in NVENC library\n");
-            return ENvencStatus::DriverNotInstalled;
-        }
-        m_HModule = module;
-
-        if (!CheckDriverVersion(module))
-        {
-            WriteFileDebug("Error, DriverVersionDoesNotSupportAPI in NVENC library\n");
-            return ENvencStatus::DriverVersionDoesNotSupportAPI;
-        }
-
-#if defined(_WIN32)
-        auto NvEncodeAPICreateInstance =
-            (NvEncodeAPICreateInstance_Type)GetProcAddress((HMODULE)m_HModule, "NvEncodeAPICreateInstance");
-#else
-        auto NvEncodeAPICreateInstance =
-            (NvEncodeAPICreateInstance_Type)dlsym(s_HModule, "NvEncodeAPICreateInstance");
-#endif
-
-        if (!NvEncodeAPICreateInstance)
-        {
-            WriteFileDebug("Error, APINotFound (NvEncodeAPICreateInstance) in NVENC library\n");
-            return ENvencStatus::APINotFound;
-        }
-
-        if (NvEncodeAPICreateInstance(&m_Nvenc) != NV_ENC_SUCCESS)
-        {
-            WriteFileDebug("Error, APINotFound (NvEncodeAPICreateInstance) in Nvenc.\n");
-            return ENvencStatus::APINotFound;
-        }
+        const auto status = NvencModule::GetFunctionList(m_Nvenc);
+        if (status != ENvencStatus::Success)
+            return status;
 
         WriteFileDebug("End to call: LoadCodec\n");
 
         return ENvencStatus::Success;
     }
-
-    bool NvEncoder::CheckDriverVersion(HMODULE module)
-    {
-        using NvEncodeAPIGetMaxSupportedVersion_Type = NVENCSTATUS(NVENCAPI*)(uint32_t*);
-#if defined(_WIN32)
-        auto NvEncodeAPIGetMaxSupportedVersion =
-            (NvEncodeAPIGetMaxSupportedVersion_Type)GetProcAddress(module, "NvEncodeAPIGetMaxSupportedVersion");
-#else
-        auto NvEncodeAPIGetMaxSupportedVersion =
-            (NvEncodeAPIGetMaxSupportedVersion_Type)dlsym(s_HModule, "NvEncodeAPIGetMaxSupportedVersion");
-#endif
-        uint32_t version = 0;
-        uint32_t currentVersion = (NVENCAPI_MAJOR_VERSION << 4) | NVENCAPI_MINOR_VERSION;
-        NvEncodeAPIGetMaxSupportedVersion(&version);
-        return (currentVersion > version) ? false : true;
-    }
-
-    HMODULE NvEncoder::LoadModule()
-    {
-#if defined(_WIN32)
-#if defined(_WIN64)
-        HMODULE module = LoadLibrary(TEXT("nvEncodeAPI64.dll"));
-#else
-        HMODULE module = LoadLibrary(TEXT("nvEncodeAPI.dll"));
-#endif
-#else
-        void* module = dlopen("libnvidia-encode.so.1", RTLD_LAZY);
-#endif
-
-        return module;
-    }
 #pragma endregion
 
 #pragma region Constructor & Initialize
     NvEncoder::NvEncoder(const NV_ENC_DEVICE_TYPE deviceType,
         const NvencEncoderSessionData& other,
         IGraphicsEncoderDevice* device,
-        bool forceNv12) :
+        bool forceNv12,
+        const EncoderPipelineDepth& depth,
+        VideoCodec codec,
+        int sliceCount,
+        int intraRefreshFrames) :
         m_Device(device),
-        m_HModule(nullptr),
         m_HEncoder(nullptr),
         m_InitializationResult(ENvencStatus::NotInitialized),
         m_IsIdrFrame(false),
@@ -127,15 +61,30 @@ namespace NvencPlugin
         m_FrameCount(0),
         m_GOPCount(0),
         m_ForceNV12(forceNv12),
+        m_Codec(codec),
+        m_SliceCount(static_cast<uint32_t>(std::max(1, std::min(sliceCount, static_cast<int>(k_MaxSliceCount))))),
+        m_IntraRefreshFrames(static_cast<uint32_t>(std::max(0, intraRefreshFrames))),
+        m_BufferedFrameNum(depth.framesInFlight),
         m_Thread(nullptr),
+        m_SubmissionThread(nullptr),
         m_IsAsync(false)
     {
         WriteFileDebug("--- Initialize NvEncoder ---\n", false);
 
+        m_RequestedRateControl = PackRateControl(m_FrameData.bitRate, m_FrameData.frameRate);
+
         for (auto& renderTexture : m_RenderTextures)
         {
             renderTexture = nullptr;
         }
+
+        // With sub-frame output, the queue holds slices.
+        m_FrameQueue.Initialize(depth.maxQueueLength * m_SliceCount);
+
+        WriteFileDebug("Frames in flight: ", static_cast<int>(m_BufferedFrameNum));
+        WriteFileDebug("Encoded queue length: ", static_cast<int>(depth.maxQueueLength));
+        WriteFileDebug("Slices per frame: ", static_cast<int>(m_SliceCount));
+        WriteFileDebug("Intra refresh frames: ", static_cast<int>(m_IntraRefreshFrames));
     }
 
     ENvencStatus NvEncoder::InitEncoder()
@@ -149,20 +98,20 @@ namespace NvencPlugin
 
         if (m_InitializationResult != ENvencStatus::Success)
         {
-            WriteFileDebug("Nvec failed to initialize (LoadCodec).\n");
+            WriteFileDebug(LogLevel::Error, "Nvec failed to initialize (LoadCodec).\n");
             return m_InitializationResult;
         }
 
         auto device = m_Device->GetDevice();
         if (device == nullptr)
         {
-            WriteFileDebug("Error, graphics device is null.\n");
+            WriteFileDebug(LogLevel::Error, "Error, graphics device is null.\n");
             return ENvencStatus::NotInitialized;
         }
 
         if (!m_Nvenc.nvEncOpenEncodeSession)
         {
-            WriteFileDebug("Error, EncodeAPI not found.\n");
+            WriteFileDebug(LogLevel::Error, "Error, EncodeAPI not found.\n");
         }
 
         NV_ENC_OPEN_ENCODE_SESSION_EX_PARAMS openEncodeSessionExParams = { 0 };
@@ -174,14 +123,15 @@ namespace NvencPlugin
         const auto errorCode = m_Nvenc.nvEncOpenEncodeSessionEx(&openEncodeSessionExParams, &m_HEncoder);
         if (errorCode != NV_ENC_SUCCESS)
         {
-            WriteFileDebug("Error, nvEncOpenEncodeSessionEx failed.\n");
+            WriteFileDebug(LogLevel::Error, "Error, nvEncOpenEncodeSessionEx failed.\n");
             m_InitializationResult = ENvencStatus::EncoderInitializationFailed;
             return m_InitializationResult;
         }
 
         SetEncoderParameters();
 
-        m_Device->InitializeConverter(m_FrameData.width, m_FrameData.height);
+        if (m_ForceNV12)
+            m_Converter.reset(m_Device->CreateConverter(m_FrameData.width, m_FrameData.height));
 
         WriteFileDebug("End to call: InitEncoder\n");
         m_InitializationResult = ENvencStatus::Success;
@@ -199,7 +149,7 @@ namespace NvencPlugin
         if (m_FrameData.width > k_MaxWidth || m_FrameData.height > k_MaxHeight ||
             m_FrameData.width < 0 || m_FrameData.height < 0)
         {
-            WriteFileDebug("Error, size is invalid.\n");
+            WriteFileDebug(LogLevel::Error, "Error, size is invalid.\n");
         }
 
         // Set initialization parameters
@@ -209,7 +159,7 @@ namespace NvencPlugin
         m_NvEncInitializeParams.encodeHeight = m_FrameData.height;
         m_NvEncInitializeParams.darWidth = m_NvEncInitializeParams.encodeWidth;
         m_NvEncInitializeParams.darHeight = m_NvEncInitializeParams.encodeHeight;
-        m_NvEncInitializeParams.encodeGUID = NV_ENC_CODEC_H264_GUID;
+        m_NvEncInitializeParams.encodeGUID = (m_Codec == VideoCodec::HEVC) ? NV_ENC_CODEC_HEVC_GUID : NV_ENC_CODEC_H264_GUID;
         m_NvEncInitializeParams.presetGUID = NV_ENC_PRESET_LOW_LATENCY_HP_GUID;
         m_NvEncInitializeParams.frameRateNum = m_FrameData.frameRate;
         m_NvEncInitializeParams.frameRateDen = 1;
@@ -220,64 +170,75 @@ namespace NvencPlugin
         m_NvEncInitializeParams.maxEncodeHeight = 2160;
 
         // Get encoder capability
-        NV_ENC_CAPS_PARAM capsParam = { 0 };
-        capsParam.version = NV_ENC_CAPS_PARAM_VER;
-        capsParam.capsToQuery = NV_ENC_CAPS_ASYNC_ENCODE_SUPPORT;
-        signed int asyncMode = 0;
-        auto errorCode = m_Nvenc.nvEncGetEncodeCaps(m_HEncoder,
-                                                    m_NvEncInitializeParams.encodeGUID,
-                                                    &capsParam,
-                                                    &asyncMode);
-        if (errorCode != NV_ENC_SUCCESS)
+        const auto asyncMode = GetEncodeCaps(NV_ENC_CAPS_ASYNC_ENCODE_SUPPORT);
+
+        // The frames are submitted to the driver by a dedicated thread, which needs the device to be
+        // protected against concurrent use.
+        const auto isMultithreaded = m_Device->InitializeMultithreadingSecurity();
+        const auto hasCompletionThread = isMultithreaded && std::thread::hardware_concurrency() > 0;
+
+        if (m_SliceCount > 1)
         {
-            WriteFileDebug("Error, Failed to get NVEncoder capability params.\n");
+            // The slice offsets are only reported in synchronous mode: instead of waiting for a
+            // completion event, the bitstream is polled for the slices written so far.
+            m_IsAsync = hasCompletionThread;
+            m_NvEncInitializeParams.enableEncodeAsync = 0;
+            m_NvEncInitializeParams.reportSliceOffsets = 1;
+            m_NvEncInitializeParams.enableSubFrameWrite = 1;
+            WriteFileDebug(LogLevel::Info, "Info, sub-frame output is enabled.\n");
         }
-
-        if (asyncMode == 1)
+        else if (asyncMode == 1)
         {
-            m_IsAsync = m_Device->InitializeMultithreadingSecurity() && std::thread::hardware_concurrency() > 0;
+            m_IsAsync = hasCompletionThread;
             m_NvEncInitializeParams.enableEncodeAsync = static_cast<int>(m_IsAsync);
+        }
+        else
+            WriteFileDebug(LogLevel::Error, "Error, AsyncMode is disabled.\n");
 
-            if (m_IsAsync)
-            {
-                WriteFileDebug("Info, AsyncMode is enabled.\n");
-                // The second thread is used to retrieve the data when async mode is available.
-                m_Thread = new NvThread(std::thread(ProcessEncodedFrameAsyncSingle, this));
-            }
-            else
-                WriteFileDebug("Info, AsyncMode is disabled.\n");
+        if (m_IsAsync)
+        {
+            WriteFileDebug(LogLevel::Info, "Info, AsyncMode is enabled.\n");
+            // The second thread is used to retrieve the data when async mode is available.
+            m_Thread = new NvThread(std::thread(ProcessEncodedFrameAsyncSingle, this));
         }
         else
-            WriteFileDebug("Error, AsyncMode is disabled.\n");
+            WriteFileDebug(LogLevel::Info, "Info, AsyncMode is disabled.\n");
 
         m_NvEncInitializeParams.encodeConfig = &m_NvEncConfig;
 
         // Get and set preset config
-        NV_ENC_PRESET_CONFIG presetConfig = { NV_ENC_PRESET_CONFIG_VER, { NV_ENC_CONFIG_VER } };
-
-        errorCode = m_Nvenc.nvEncGetEncodePresetConfig(m_HEncoder,
-            m_NvEncInitializeParams.encodeGUID,
-            m_NvEncInitializeParams.presetGUID,
-            &presetConfig);
-
-        if (errorCode != NV_ENC_SUCCESS)
-        {
-            WriteFileDebug("Error, Failed to select NVEncoder preset config.\n");
-        }
-
-        std::memcpy(&m_NvEncConfig, &presetConfig.presetCfg, sizeof(NV_ENC_CONFIG));
-        m_NvEncConfig.profileGUID = NV_ENC_H264_PROFILE_BASELINE_GUID;
+        NvencModule::GetPresetConfig(m_Nvenc, m_HEncoder, m_Device->GetDevice(),
+                                     m_NvEncInitializeParams.encodeGUID,
+                                     m_NvEncInitializeParams.presetGUID,
+                                     m_NvEncConfig);
         m_NvEncConfig.frameIntervalP = 1;
         m_NvEncConfig.gopLength = NVENC_INFINITE_GOPLENGTH;
 
-        m_NvEncConfig.encodeCodecConfig.h264Config.idrPeriod = m_NvEncConfig.gopLength;
-        m_NvEncConfig.encodeCodecConfig.h264Config.sliceMode = 0;
-        m_NvEncConfig.encodeCodecConfig.h264Config.sliceModeData = 0;
-        m_NvEncConfig.encodeCodecConfig.h264Config.disableSPSPPS = 1;
-        m_NvEncConfig.encodeCodecConfig.h264Config.repeatSPSPPS = 1;
-        m_NvEncConfig.encodeCodecConfig.h264Config.enableIntraRefresh = 1;
-        m_NvEncConfig.encodeCodecConfig.h264Config.level = NV_ENC_LEVEL_AUTOSELECT;
+        if (m_Codec == VideoCodec::HEVC)
+        {
+            // Main profile, 8 bits 4:2:0: the HEVC equivalent of the H.264 baseline stream.
+            m_NvEncConfig.profileGUID = NV_ENC_HEVC_PROFILE_MAIN_GUID;
+            m_NvEncConfig.encodeCodecConfig.hevcConfig.idrPeriod = m_NvEncConfig.gopLength;
+            m_NvEncConfig.encodeCodecConfig.hevcConfig.disableSPSPPS = 1;
+            m_NvEncConfig.encodeCodecConfig.hevcConfig.repeatSPSPPS = 1;
+            m_NvEncConfig.encodeCodecConfig.hevcConfig.enableIntraRefresh = 1;
+            m_NvEncConfig.encodeCodecConfig.hevcConfig.chromaFormatIDC = 1;
+            m_NvEncConfig.encodeCodecConfig.hevcConfig.pixelBitDepthMinus8 = 0;
+            m_NvEncConfig.encodeCodecConfig.hevcConfig.level = NV_ENC_LEVEL_AUTOSELECT;
+        }
+        else
+        {
+            m_NvEncConfig.profileGUID = NV_ENC_H264_PROFILE_BASELINE_GUID;
+            m_NvEncConfig.encodeCodecConfig.h264Config.idrPeriod = m_NvEncConfig.gopLength;
+            m_NvEncConfig.encodeCodecConfig.h264Config.disableSPSPPS = 1;
+            m_NvEncConfig.encodeCodecConfig.h264Config.repeatSPSPPS = 1;
+            m_NvEncConfig.encodeCodecConfig.h264Config.enableIntraRefresh = 1;
+            m_NvEncConfig.encodeCodecConfig.h264Config.level = NV_ENC_LEVEL_AUTOSELECT;
+        }
         m_NvEncConfig.version = NV_ENC_CONFIG_VER;
+        SetSliceMode();
+        SetIntraRefresh();
+        SetReferenceFrames();
 
         m_NvEncConfig.rcParams.rateControlMode = NV_ENC_PARAMS_RC_CBR;
 
@@ -303,12 +264,12 @@ namespace NvencPlugin
         m_NvEncConfig.rcParams.vbvInitialDelay = m_NvEncConfig.rcParams.vbvBufferSize;
 
         // Initialize hardware encoder session
-        errorCode = m_Nvenc.nvEncInitializeEncoder(m_HEncoder, &m_NvEncInitializeParams);
+        const auto errorCode = m_Nvenc.nvEncInitializeEncoder(m_HEncoder, &m_NvEncInitializeParams);
 
         if (errorCode != NV_ENC_SUCCESS)
         {
             std::ostringstream errorLog;
-            WriteFileDebug("Error, Failed to initialize NVEncoder.\n");
+            WriteFileDebug(LogLevel::Error, "Error, Failed to initialize NVEncoder.\n");
             errorLog << "Error is: " << errorCode << "\n";
             auto test = errorLog.str();
             WriteFileDebug(test.c_str());
@@ -319,21 +280,135 @@ namespace NvencPlugin
             WriteFileDebug("Success, initialized NVEncoder.\n");
         }
 
-        if (m_IsAsync)
+        RefreshParameterSets();
+
+        if (m_NvEncInitializeParams.enableEncodeAsync == 1)
         {
             InitializeAsyncResources();
         }
 
         InitEncoderResources();
+
+        if (isMultithreaded)
+        {
+            m_SubmissionThread = new NvThread(std::thread(SubmitFramesAsync, this));
+        }
+        else
+            WriteFileDebug(LogLevel::Warning, "Warning, frames are submitted on the render thread.\n");
+    }
+
+    void NvEncoder::SetSliceMode()
+    {
+        // Slice mode 3 splits the frame in sliceModeData slices of equal height. A slice holds at least
+        // one row of macroblocks (16 pixels) or of coding tree units (at most 32 pixels by default).
+        const auto rowHeight = (m_Codec == VideoCodec::HEVC) ? 32u : 16u;
+        const auto rowCount = (m_NvEncInitializeParams.encodeHeight + rowHeight - 1) / rowHeight;
+        const auto sliceCount = std::max(1u, std::min(m_SliceCount, rowCount));
+        const auto sliceMode = (sliceCount > 1) ? 3u : 0u;
+        const auto sliceModeData = (sliceCount > 1) ? sliceCount : 0u;
+
+        if (m_Codec == VideoCodec::HEVC)
+        {
+            m_NvEncConfig.encodeCodecConfig.hevcConfig.sliceMode = sliceMode;
+            m_NvEncConfig.encodeCodecConfig.hevcConfig.sliceModeData = sliceModeData;
+        }
+        else
+        {
+            m_NvEncConfig.encodeCodecConfig.h264Config.sliceMode = sliceMode;
+            m_NvEncConfig.encodeCodecConfig.h264Config.sliceModeData = sliceModeData;
+        }
+        m_FrameSliceCount = sliceCount;
+    }
+
+    bool NvEncoder::IsIntraRefreshEnabled() const
+    {
+        return m_IntraRefreshFrames > 0;
+    }
+
+    bool NvEncoder::SetIntraRefresh()
+    {
+        // Every period, the intra blocks sweep the picture over intraRefreshCnt frames: the frame sizes
+        // stay flat, unlike with an IDR frame, and a decoder that joined or lost data recovers once the
+        // refresh is over. The period is only used with an infinite GOP, which is always the case here.
+        // A GOP longer than the refresh sets the period, otherwise a refresh starts as soon as the previous
+        // one is over.
+        uint32_t period = 0;
+        uint32_t count = 0;
+        if (IsIntraRefreshEnabled())
+        {
+            count = m_IntraRefreshFrames;
+            period = std::max(count + 1, static_cast<uint32_t>(std::max(0, m_FrameData.gopSize)));
+        }
+
+        auto changed = false;
+        if (m_Codec == VideoCodec::HEVC)
+        {
+            auto& hevcConfig = m_NvEncConfig.encodeCodecConfig.hevcConfig;
+            changed = hevcConfig.intraRefreshPeriod != period || hevcConfig.intraRefreshCnt != count;
+            hevcConfig.intraRefreshPeriod = period;
+            hevcConfig.intraRefreshCnt = count;
+        }
+        else
+        {
+            // The recovery point SEI tells the decoder when the picture is whole again.
+            auto& h264Config = m_NvEncConfig.encodeCodecConfig.h264Config;
+            changed = h264Config.intraRefreshPeriod != period || h264Config.intraRefreshCnt != count;
+            h264Config.intraRefreshPeriod = period;
+            h264Config.intraRefreshCnt = count;
+            h264Config.outputRecoveryPointSEI = (period > 0) ? 1 : 0;
+        }
+
+        if (changed)
+        {
+            WriteFileDebug("Intra refresh period: ", static_cast<int>(period));
+            WriteFileDebug("Intra refresh count: ", static_cast<int>(count));
+        }
+        return changed;
+    }
+
+    int NvEncoder::GetEncodeCaps(NV_ENC_CAPS caps)
+    {
+        return NvencModule::GetEncodeCaps(m_Nvenc, m_HEncoder, m_Device->GetDevice(),
+                                          m_NvEncInitializeParams.encodeGUID, caps);
+    }
+
+    void NvEncoder::SetReferenceFrames()
+    {
+        // A few frames in the DPB let the encoder fall back to an older reference when the newest ones
+        // are invalidated after a loss. The long-term references cover the older losses.
+        m_IsRefInvalidationSupported = GetEncodeCaps(NV_ENC_CAPS_SUPPORT_REF_PIC_INVALIDATION) > 0;
+        m_LtrFrameCount = static_cast<uint32_t>(std::max(0, std::min(GetEncodeCaps(NV_ENC_CAPS_NUM_MAX_LTR_FRAMES),
+                                                                     static_cast<int>(k_MaxLtrFrames))));
+
+        // The client marks and uses the long-term references itself (trust mode 0).
+        if (m_Codec == VideoCodec::HEVC)
+        {
+            auto& hevcConfig = m_NvEncConfig.encodeCodecConfig.hevcConfig;
+            hevcConfig.maxNumRefFramesInDPB = k_MaxReferenceFrames;
+            hevcConfig.enableLTR = m_LtrFrameCount > 0 ? 1 : 0;
+            hevcConfig.ltrNumFrames = m_LtrFrameCount;
+            hevcConfig.ltrTrustMode = 0;
+        }
+        else
+        {
+            auto& h264Config = m_NvEncConfig.encodeCodecConfig.h264Config;
+            h264Config.maxNumRefFrames = k_MaxReferenceFrames;
+            h264Config.enableLTR = m_LtrFrameCount > 0 ? 1 : 0;
+            h264Config.ltrNumFrames = m_LtrFrameCount;
+            h264Config.ltrTrustMode = 0;
+        }
+
+        WriteFileDebug("Reference invalidation supported: ", static_cast<int>(m_IsRefInvalidationSupported));
+        WriteFileDebug("Long-term reference frames: ", static_cast<int>(m_LtrFrameCount));
     }
 
     void NvEncoder::InitializeAsyncResources()
     {
-        m_vpCompletionEvent.resize(k_BufferedFrameNum, nullptr);
+        m_vpCompletionEvent.resize(m_BufferedFrameNum, nullptr);
 
         for (uint32_t i = 0; i < m_vpCompletionEvent.size(); i++)
         {
-            m_vpCompletionEvent[i] = CreateEvent(NULL, FALSE, FALSE, NULL);
+            m_vpCompletionEvent[i] = CreateCompletionEvent();
             NV_ENC_EVENT_PARAMS eventParams = { NV_ENC_EVENT_PARAMS_VER };
             eventParams.completionEvent = m_vpCompletionEvent[i];
             m_Nvenc.nvEncRegisterAsyncEvent(m_HEncoder, &eventParams);
@@ -342,7 +417,7 @@ namespace NvencPlugin
 
     void NvEncoder::InitEncoderResources()
     {
-        for (auto i = 0; i < k_BufferedFrameNum; i++)
+        for (uint32_t i = 0; i < m_BufferedFrameNum; i++)
         {
             m_RenderTextures[i] = m_Device->CreateDefaultTexture(m_FrameData.width, m_FrameData.height, m_ForceNV12);
 
@@ -373,7 +448,7 @@ namespace NvencPlugin
 
         if (!registerResource.resourceToRegister)
         {
-            WriteFileDebug("Error, ResourceToRegister: resource is not initialized.\n");
+            WriteFileDebug(LogLevel::Error, "Error, ResourceToRegister: resource is not initialized.\n");
         }
         registerResource.width = m_FrameData.width;
         registerResource.height = m_FrameData.height;
@@ -383,7 +458,7 @@ namespace NvencPlugin
         const auto errorCode = m_Nvenc.nvEncRegisterResource(m_HEncoder, &registerResource);
         if (errorCode != NV_ENC_SUCCESS)
         {
-            WriteFileDebug("Error, Error on register resource: nvEncRegisterResource.\n");
+            WriteFileDebug(LogLevel::Error, "Error, Error on register resource: nvEncRegisterResource.\n");
         }
         return registerResource.registeredResource;
     }
@@ -396,7 +471,7 @@ namespace NvencPlugin
         const auto errorCode = m_Nvenc.nvEncCreateBitstreamBuffer(m_HEncoder, &createBitstreamBuffer);
         if (errorCode != NV_ENC_SUCCESS)
         {
-            WriteFileDebug("Error, Error on creation: nvEncCreateBitstreamBuffer.\n");
+            WriteFileDebug(LogLevel::Error, "Error, Error on creation: nvEncCreateBitstreamBuffer.\n");
         }
         return createBitstreamBuffer.bitstreamBuffer;
     }
@@ -410,7 +485,7 @@ namespace NvencPlugin
         const auto errorCode = m_Nvenc.nvEncMapInputResource(m_HEncoder, &mapInputResource);
         if (errorCode != NV_ENC_SUCCESS)
         {
-            WriteFileDebug("Error on creation: nvEncCreateBitstreamBuffer.\n");
+            WriteFileDebug(LogLevel::Error, "Error on creation: nvEncCreateBitstreamBuffer.\n");
         }
         inputFrame.mappedResource = mapInputResource.mappedResource;
     }
@@ -420,83 +495,179 @@ namespace NvencPlugin
 #pragma region Update settings & Encode frames
     bool NvEncoder::UpdateEncoderSessionData(const NvencEncoderSessionData& other)
     {
+        NvencEncoderSessionData frameData(m_FrameData);
+        frameData.Update(other);
+
+        const auto isRateChange = frameData.width == m_FrameData.width
+            && frameData.height == m_FrameData.height
+            && frameData.gopSize == m_FrameData.gopSize;
+
+        // Bit rate and frame rate changes are applied by the submission thread before its next frame,
+        // the render thread doesn't wait for the frames already queued. The submission thread reads
+        // m_FrameData: the new rates are only handed over through m_PendingRateControl.
+        if (isRateChange && m_SubmissionThread != nullptr)
+        {
+            const auto rateControl = PackRateControl(frameData.bitRate, frameData.frameRate);
+            if (rateControl == m_RequestedRateControl)
+                return false;
+
+            m_RequestedRateControl = rateControl;
+            m_PendingRateControl.store(rateControl);
+            return true;
+        }
+
         const auto updateData = !(other == m_FrameData);
         if (updateData)
         {
+            // The session and its buffers can't change under the submission thread.
+            if (m_SubmissionThread != nullptr)
+                m_SubmissionQueue.WaitIdle();
+
             m_FrameData.Update(other);
+            m_PendingRateControl.store(0);
+            m_RequestedRateControl = PackRateControl(m_FrameData.bitRate, m_FrameData.frameRate);
             UpdateSettings();
         }
         return updateData;
     }
 
-    void NvEncoder::UpdateSettings()
+    uint64_t NvEncoder::PackRateControl(int bitRate, int frameRate)
     {
-        auto settingChanged = false;
-        auto sizeChanged = false;
+        return (static_cast<uint64_t>(static_cast<uint32_t>(bitRate)) << 32) | static_cast<uint32_t>(frameRate);
+    }
 
-        if (m_NvEncInitializeParams.frameRateNum != m_FrameData.frameRate)
+    bool NvEncoder::SetRateControl(int bitRate, int frameRate)
+    {
+        const auto frameRateNum = static_cast<uint32_t>(frameRate);
+        const auto averageBitRate = static_cast<uint32_t>(bitRate);
+        if (frameRateNum == 0 || (m_NvEncInitializeParams.frameRateNum == frameRateNum
+            && m_NvEncConfig.rcParams.averageBitRate == averageBitRate))
+            return false;
+
+        m_NvEncInitializeParams.frameRateNum = frameRateNum;
+        m_NvEncConfig.rcParams.averageBitRate = averageBitRate;
+        m_NvEncConfig.rcParams.maxBitRate = averageBitRate;
+
+        // One frame worth of VBV, like at initialization, so that the new rate applies to the next frame.
+        m_NvEncConfig.rcParams.vbvBufferSize = static_cast<uint32_t>(static_cast<uint64_t>(averageBitRate)
+            * m_NvEncInitializeParams.frameRateDen / frameRateNum);
+        m_NvEncConfig.rcParams.vbvInitialDelay = m_NvEncConfig.rcParams.vbvBufferSize;
+
+        WriteFileDebug("New bitrate value: ", bitRate);
+        WriteFileDebug("New FrameRate: ", frameRate);
+        return true;
+    }
+
+    bool NvEncoder::ReconfigureEncoder(bool resetEncoder)
+    {
+        NV_ENC_RECONFIGURE_PARAMS nvEncReconfigureParams = { 0 };
+        std::memcpy(&nvEncReconfigureParams.reInitEncodeParams,
+            &m_NvEncInitializeParams,
+            sizeof(m_NvEncInitializeParams));
+
+        // Resetting the encoder (for a new size) starts a new stream with an IDR frame, the rate
+        // control parameters can change in the middle of a GOP.
+        nvEncReconfigureParams.version = NV_ENC_RECONFIGURE_PARAMS_VER;
+        nvEncReconfigureParams.forceIDR = resetEncoder ? 1 : 0;
+        nvEncReconfigureParams.resetEncoder = resetEncoder ? 1 : 0;
+
+        const auto result = m_Nvenc.nvEncReconfigureEncoder(m_HEncoder, &nvEncReconfigureParams);
+        if (result != NV_ENC_SUCCESS)
         {
-            m_NvEncInitializeParams.frameRateNum = m_FrameData.frameRate;
-            settingChanged = true;
+            WriteFileDebug(LogLevel::Error, "Failed to reconfigure encoder setting.\n");
+            return false;
         }
+        return true;
+    }
+
+    void NvEncoder::ApplyPendingRateControl()
+    {
+        const auto rateControl = m_PendingRateControl.exchange(0);
+        if (rateControl == 0)
+            return;
+
+        const auto bitRate = static_cast<int>(rateControl >> 32);
+        const auto frameRate = static_cast<int>(rateControl & 0xFFFFFFFF);
+        if (SetRateControl(bitRate, frameRate))
+            ReconfigureEncoder(false);
+    }
+
+    void NvEncoder::UpdateSettings()
+    {
+        auto sizeChanged = false;
+        const auto rateChanged = SetRateControl(m_FrameData.bitRate, m_FrameData.frameRate);
+        const auto refreshChanged = SetIntraRefresh();
 
         if (m_NvEncInitializeParams.encodeWidth != m_FrameData.width)
         {
             m_NvEncInitializeParams.encodeWidth = m_FrameData.width;
             m_NvEncInitializeParams.darWidth = m_FrameData.width;
-            settingChanged = sizeChanged = true;
+            sizeChanged = true;
         }
 
         if (m_NvEncInitializeParams.encodeHeight != m_FrameData.height)
         {
             m_NvEncInitializeParams.encodeHeight = m_FrameData.height;
             m_NvEncInitializeParams.darHeight = m_FrameData.height;
-            settingChanged = sizeChanged = true;
+            sizeChanged = true;
         }
 
-        if (m_NvEncConfig.rcParams.averageBitRate != m_FrameData.bitRate)
+        if (sizeChanged)
+            SetSliceMode();
+
+        if (!sizeChanged)
         {
-            m_NvEncConfig.rcParams.averageBitRate = m_FrameData.bitRate;
-            m_NvEncConfig.rcParams.maxBitRate = m_FrameData.bitRate;
-            settingChanged = true;
-            WriteFileDebug("New bitrate value: ", m_FrameData.bitRate);
+            if (rateChanged || refreshChanged)
+                ReconfigureEncoder(false);
+            return;
         }
 
-        if (settingChanged)
+        // The submission queue is idle, but the completion thread may still be reading the last frames
+        // out of the buffers that are about to be released.
+        WaitForCompletionIdle();
+
+        if (ReconfigureEncoder(true))
         {
-            NV_ENC_RECONFIGURE_PARAMS nvEncReconfigureParams;
-            std::memcpy(&nvEncReconfigureParams.reInitEncodeParams,
-                &m_NvEncInitializeParams,
-                sizeof(m_NvEncInitializeParams));
+            RefreshParameterSets();
 
-            nvEncReconfigureParams.version = NV_ENC_RECONFIGURE_PARAMS_VER;
-            nvEncReconfigureParams.forceIDR = 1;
-            nvEncReconfigureParams.resetEncoder = 1;
+            // The reconfiguration forces an IDR frame, flag it as such.
+            RequestKeyFrame();
+        }
 
-            const auto result = m_Nvenc.nvEncReconfigureEncoder(m_HEncoder, &nvEncReconfigureParams);
-            if (result != NV_ENC_SUCCESS)
-            {
-                WriteFileDebug("Failed to reconfigure encoder setting.\n");
-            }
+        // Reconfigure the Textures size (width & height).
+        ReleaseEncoderResources();
+        InitEncoderResources();
 
-            // Reconfigure the Textures size (width & height).
-            if (sizeChanged)
-            {
-                ReleaseEncoderResources();
-                InitEncoderResources();
+        if (m_ForceNV12)
+            m_Converter.reset(m_Device->CreateConverter(m_FrameData.width, m_FrameData.height));
+
+        WriteFileDebug("New Width: ", m_FrameData.width);
+        WriteFileDebug("New Height: ", m_FrameData.height);
+    }
 
-                m_Device->InitializeConverter(m_FrameData.width, m_FrameData.height);
+    void NvEncoder::WaitForCompletionIdle()
+    {
+        if (!m_IsAsync || m_Thread == nullptr)
+            return;
 
-                WriteFileDebug("New Width: ", m_FrameData.width);
-                WriteFileDebug("New Height: ", m_FrameData.height);
-                WriteFileDebug("New FrameRate: ", m_FrameData.frameRate);
+        std::unique_lock<std::mutex> lock(m_PendingLock);
+        m_CompletionIdleCondition.wait(lock, [this]
+        {
+            if (!m_BufferToRead.empty())
+                return false;
+
+            for (uint32_t i = 0; i < m_BufferedFrameNum; i++)
+            {
+                if (m_BufferedFrames[i].isEncoding)
+                    return false;
             }
-        }
+            return true;
+        });
     }
 
     void* NvEncoder::GetCompletionEvent(uint32_t eventIdx)
     {
-        return (m_vpCompletionEvent.size() == k_BufferedFrameNum)
+        return (m_vpCompletionEvent.size() == m_BufferedFrameNum)
             ? m_vpCompletionEvent[eventIdx]
             : nullptr;
     }
@@ -507,7 +678,7 @@ namespace NvencPlugin
 
         if (!destTexture || !frameSourceData)
         {
-            WriteFileDebug("Error, incorrect input texture(s).\n");
+            WriteFileDebug(LogLevel::Error, "Error, incorrect input texture(s).\n");
             return false;
         }
 
@@ -515,22 +686,24 @@ namespace NvencPlugin
 
         if (!destTexture || !nativeSrc)
         {
-            WriteFileDebug("Error, invalid IUnknown resource(s).\n");
+            WriteFileDebug(LogLevel::Error, "Error, invalid IUnknown resource(s).\n");
             return false;
         }
 
         if (m_ForceNV12)
         {
-            if (!m_Device->ConvertRGBToNV12(nativeSrc, destTexture))
+            ProfilerScope profilerScope(ProfilerMarker::ConvertRGBToNV12);
+            if (!m_Device->ConvertRGBToNV12(m_Converter.get(), nativeSrc, destTexture))
             {
-                WriteFileDebug("Error, Conversion from RGB to NV12 failed.\n");
+                WriteFileDebug(LogLevel::Error, "Error, Conversion from RGB to NV12 failed.\n");
             }
         }
         else
         {
+            ProfilerScope profilerScope(ProfilerMarker::CopyResource);
             if (!m_Device->CopyResource(nativeSrc, destTexture))
             {
-                WriteFileDebug("Error, Couldn't copy resources.\n");
+                WriteFileDebug(LogLevel::Error, "Error, Couldn't copy resources.\n");
                 return false;
             }
 
@@ -538,34 +711,66 @@ namespace NvencPlugin
         return true;
     }
 
-    void NvEncoder::EncodeFrame(void* frameSourceData, unsigned long long int timeStamp)
+    void NvEncoder::EncodeFrame(void* frameSourceData, unsigned long long int timeStamp, uint32_t timecode)
     {
         if (frameSourceData == nullptr)
         {
-            WriteFileDebug("Error, Encoded frame data is null.\n");
+            WriteFileDebug(LogLevel::Error, "Error, Encoded frame data is null.\n");
             return;
         }
 
-        const int frameIndex = m_FrameCount % k_BufferedFrameNum;
+        ProfilerScope profilerScope(ProfilerMarker::EncodeFrame);
+        const auto encodeTime = EncoderStatistics::Now();
+        const int frameIndex = static_cast<int>(m_FrameCount % m_BufferedFrameNum);
+        auto& bufferedFrame = m_BufferedFrames[frameIndex];
 
-        if (!CopyBufferResources(frameIndex, frameSourceData))
+        // Check before the copy: the input texture of a frame being encoded must not be overwritten.
+        if (bufferedFrame.isEncoding)
         {
-            WriteFileDebug("Error, copy resources failed.\n");
+            WriteFileDebug(LogLevel::Error, "Error: frame is already encoding.\n");
+            m_Statistics.RecordInputDropped();
             return;
         }
 
-        WriteFileDebug("Info, Start encoding new frame.\n");
-
-        auto& bufferedFrame = m_BufferedFrames[frameIndex];
-
-        if (bufferedFrame.isEncoding)
+        // The source texture is only valid during the render event, so the copy is always enqueued by
+        // the render thread. Everything else happens on the submission thread.
+        if (!CopyBufferResources(frameIndex, frameSourceData))
         {
-            WriteFileDebug("Error: frame is already encoding.\n");
+            WriteFileDebug(LogLevel::Error, "Error, copy resources failed.\n");
             return;
         }
+
+        const auto copyTime = EncoderStatistics::Now();
+        m_Statistics.RecordStage(EncoderStage::Copy, encodeTime, copyTime);
+
+        WriteFileDebug(LogLevel::Info, "Info, Start encoding new frame.\n");
         bufferedFrame.isEncoded = false;
+        bufferedFrame.timings = FrameTimings();
+        bufferedFrame.timings.encodeTime = encodeTime;
         bufferedFrame.isEncoding = true;
 
+        SubmitCommand command;
+        command.frameIndex = frameIndex;
+        command.frameCount = m_FrameCount;
+        command.timeStamp = timeStamp;
+        command.timecode = timecode;
+        command.copyTime = copyTime;
+        m_FrameCount++;
+
+        // Never full: a command is only pushed for a buffered frame that isn't encoding.
+        if (m_SubmissionThread == nullptr || !m_SubmissionQueue.Push(command))
+            SubmitFrame(command);
+    }
+
+    void NvEncoder::SubmitFrame(const SubmitCommand& command)
+    {
+        auto& bufferedFrame = m_BufferedFrames[command.frameIndex];
+
+        // The copy has only been enqueued on the GPU.
+        m_Device->WaitForCopies();
+
+        ApplyPendingRateControl();
+
         NV_ENC_PIC_PARAMS picParams = { 0 };
         picParams.version = NV_ENC_PIC_PARAMS_VER;
         picParams.encodePicFlags = 0;
@@ -575,19 +780,52 @@ namespace NvencPlugin
         picParams.inputWidth = m_NvEncInitializeParams.encodeWidth;
         picParams.inputHeight = m_NvEncInitializeParams.encodeHeight;
         picParams.outputBitstream = bufferedFrame.outputFrame;
-        picParams.inputTimeStamp = m_FrameCount;
+        picParams.inputTimeStamp = command.frameCount;
 
         if (m_NvEncInitializeParams.enableEncodeAsync == 1)
         {
-            picParams.completionEvent = GetCompletionEvent(m_FrameCount % k_BufferedFrameNum);
+            picParams.completionEvent = GetCompletionEvent(command.frameIndex);
+        }
+
+        // The driver writes the timecode SEI message before the first slice, so the bitstream isn't copied
+        // again to insert it.
+        WriteTimecodeSeiPayload({ command.timecode, command.timeStamp, command.frameCount }, bufferedFrame.timecodeSeiPayload);
+        bufferedFrame.timecodeSei.payloadSize = k_TimecodeSeiPayloadSize;
+        bufferedFrame.timecodeSei.payloadType = k_UserDataUnregisteredSei;
+        bufferedFrame.timecodeSei.payload = bufferedFrame.timecodeSeiPayload;
+        if (m_Codec == VideoCodec::HEVC)
+        {
+            picParams.codecPicParams.hevcPicParams.seiPayloadArrayCnt = 1;
+            picParams.codecPicParams.hevcPicParams.seiPayloadArray = &bufferedFrame.timecodeSei;
+        }
+        else
+        {
+            picParams.codecPicParams.h264PicParams.seiPayloadArrayCnt = 1;
+            picParams.codecPicParams.h264PicParams.seiPayloadArray = &bufferedFrame.timecodeSei;
         }
 
-        const int gopIndex = m_GOPCount % k_GOPSize;
-        bool isKeyFrame = gopIndex == 0;
+        // A gopSize of 0 (or less) means an infinite GOP: IDR frames are only sent on request. With intra
+        // refresh, the encoder refreshes the picture by itself and IDR frames are also only sent on request.
+        const auto gopSize = (m_FrameData.gopSize > 0 && !IsIntraRefreshEnabled()) ? static_cast<uint64_t>(m_FrameData.gopSize) : 0;
+        auto isKeyFrame = m_KeyFrameRequested.exchange(false) || (gopSize > 0 && m_GOPCount >= gopSize);
+
+        // A client lost frames: reference one it still has, which costs a P-frame instead of an IDR frame.
+        const auto lostTimeStamp = m_LostTimeStamp.exchange(k_NoLostFrame);
+        if (!isKeyFrame && lostTimeStamp != k_NoLostFrame && !RecoverLostFrames(lostTimeStamp, picParams))
+        {
+            WriteFileDebug(LogLevel::Info, "Info, the lost frames are recovered with an IDR frame.\n");
+            isKeyFrame = true;
+        }
+        const auto ltrIndex = MarkLongTermReference(isKeyFrame, picParams);
 
         if (isKeyFrame)
         {
             picParams.encodePicFlags = NV_ENC_PIC_FLAG_FORCEIDR | NV_ENC_PIC_FLAG_OUTPUT_SPSPPS;
+            m_GOPCount = 0;
+        }
+        else if (m_Codec == VideoCodec::HEVC)
+        {
+            picParams.codecPicParams.hevcPicParams.refPicFlag = 1;
         }
         else
         {
@@ -595,33 +833,188 @@ namespace NvencPlugin
         }
         m_GOPCount++;
 
+        EncoderProfiler::BeginSample(ProfilerMarker::EncodePicture);
         const auto errorCode = m_Nvenc.nvEncEncodePicture(m_HEncoder, &picParams);
+        EncoderProfiler::EndSample(ProfilerMarker::EncodePicture);
         if (errorCode != NV_ENC_SUCCESS)
         {
-            WriteFileDebug("Failed to encode frame: ", errorCode, true);
+            WriteFileDebug(LogLevel::Error, "Failed to encode frame: ", errorCode, true);
             bufferedFrame.isEncoding = false;
+
+            // Don't lose the IDR frame nor the recovery: the next frame will carry it.
+            if (isKeyFrame)
+                RequestKeyFrame();
+            else if (lostTimeStamp != k_NoLostFrame)
+                InvalidateReferenceFrames(lostTimeStamp);
             return;
         }
+        AddReferenceFrame(command, isKeyFrame, ltrIndex);
 
-        if (m_NvEncInitializeParams.enableEncodeAsync == 1)
+        // Set before the frame is handed over to the completion thread.
+        bufferedFrame.timings.submitTime = EncoderStatistics::Now();
+        m_Statistics.RecordStage(EncoderStage::Submit, command.copyTime, bufferedFrame.timings.submitTime);
+        m_Statistics.RecordSubmitted();
+
+        if (m_IsAsync)
         {
             EncodedFrameDataKey dataKey;
-            dataKey.index = frameIndex;
-            dataKey.timestamp = timeStamp;
-            dataKey.isKeyFrame = (isKeyFrame);
+            dataKey.index = command.frameIndex;
+            dataKey.timestamp = command.timeStamp;
+            dataKey.isKeyFrame = isKeyFrame;
 
-            std::lock_guard<NvSpinlock> lock(m_NvSpinlock);
-            m_BufferToRead.push(dataKey);
+            {
+                std::lock_guard<std::mutex> lock(m_PendingLock);
+                m_BufferToRead.push(dataKey);
+            }
+            m_PendingCondition.notify_one();
 
-            WriteFileDebug("Info, frameIndex added to the queue.\n");
+            WriteFileDebug(LogLevel::Info, "Info, frameIndex added to the queue.\n");
         }
         else
         {
-            ProcessEncodedFrame(bufferedFrame, timeStamp, gopIndex == 0);
+            ProcessEncodedFrame(bufferedFrame, command.timeStamp, isKeyFrame);
             bufferedFrame.isEncoded = true;
         }
+    }
 
-        m_FrameCount++;
+    void NvEncoder::SubmitFramesAsync(NvEncoder* encoder)
+    {
+        EncoderProfiler::RegisterThread("NVENC Submission");
+
+        SubmitCommand command;
+        while (encoder->m_SubmissionQueue.WaitPop(command))
+        {
+            encoder->SubmitFrame(command);
+            encoder->m_SubmissionQueue.Done();
+        }
+
+        EncoderProfiler::UnregisterThread();
+    }
+
+    void NvEncoder::RequestKeyFrame()
+    {
+        m_KeyFrameRequested = true;
+    }
+
+    void NvEncoder::InvalidateReferenceFrames(unsigned long long int timeStamp)
+    {
+        // The earliest loss wins: the frames after it are lost as well.
+        auto lostTimeStamp = m_LostTimeStamp.load();
+        while (timeStamp < lostTimeStamp && !m_LostTimeStamp.compare_exchange_weak(lostTimeStamp, timeStamp))
+        {
+        }
+    }
+
+    bool NvEncoder::RecoverLostFrames(uint64_t lostTimeStamp, NV_ENC_PIC_PARAMS& picParams)
+    {
+        // The frames from the lost one onward can't be decoded by the client, the driver must not
+        // reference them anymore.
+        auto hasValidReference = false;
+        for (uint32_t i = 0; i < m_ReferenceCount; ++i)
+        {
+            auto& reference = m_References[i];
+            if (!reference.isValid)
+                continue;
+
+            if (reference.timeStamp < lostTimeStamp)
+            {
+                hasValidReference = true;
+                continue;
+            }
+
+            reference.isValid = false;
+            if (m_IsRefInvalidationSupported)
+            {
+                const auto errorCode = m_Nvenc.nvEncInvalidateRefFrames(m_HEncoder, reference.inputTimeStamp);
+                if (errorCode != NV_ENC_SUCCESS)
+                {
+                    WriteFileDebug(LogLevel::Error, "Error, failed to invalidate a reference frame: ", errorCode);
+                    return false;
+                }
+            }
+        }
+
+        if (m_IsRefInvalidationSupported && hasValidReference)
+        {
+            WriteFileDebug(LogLevel::Info, "Info, the lost frames are recovered from a short-term reference.\n");
+            return true;
+        }
+
+        // The loss is older than the DPB: use the newest long-term reference encoded before it.
+        auto ltrIndex = k_MaxLtrFrames;
+        for (uint32_t i = 0; i < m_LtrFrameCount; ++i)
+        {
+            auto& ltrFrame = m_LtrFrames[i];
+            if (ltrFrame.isValid && ltrFrame.timeStamp >= lostTimeStamp)
+                ltrFrame.isValid = false;
+            else if (ltrFrame.isValid && (ltrIndex == k_MaxLtrFrames || ltrFrame.timeStamp > m_LtrFrames[ltrIndex].timeStamp))
+                ltrIndex = i;
+        }
+
+        if (ltrIndex == k_MaxLtrFrames)
+            return false;
+
+        if (m_Codec == VideoCodec::HEVC)
+        {
+            picParams.codecPicParams.hevcPicParams.ltrUseFrames = 1;
+            picParams.codecPicParams.hevcPicParams.ltrUseFrameBitmap = 1u << ltrIndex;
+        }
+        else
+        {
+            picParams.codecPicParams.h264PicParams.ltrUseFrames = 1;
+            picParams.codecPicParams.h264PicParams.ltrUseFrameBitmap = 1u << ltrIndex;
+        }
+
+        WriteFileDebug(LogLevel::Info, "Info, the lost frames are recovered from a long-term reference.\n");
+        return true;
+    }
+
+    uint32_t NvEncoder::MarkLongTermReference(bool isKeyFrame, NV_ENC_PIC_PARAMS& picParams)
+    {
+        // Every IDR frame and every k_LtrPeriod frames, the slots are overwritten in turn.
+        if (m_LtrFrameCount == 0 || (!isKeyFrame && m_FramesSinceLtr < k_LtrPeriod))
+            return k_MaxLtrFrames;
+
+        const auto ltrIndex = isKeyFrame ? 0 : m_NextLtrIndex;
+        if (m_Codec == VideoCodec::HEVC)
+        {
+            picParams.codecPicParams.hevcPicParams.ltrMarkFrame = 1;
+            picParams.codecPicParams.hevcPicParams.ltrMarkFrameIdx = ltrIndex;
+        }
+        else
+        {
+            picParams.codecPicParams.h264PicParams.ltrMarkFrame = 1;
+            picParams.codecPicParams.h264PicParams.ltrMarkFrameIdx = ltrIndex;
+        }
+        return ltrIndex;
+    }
+
+    void NvEncoder::AddReferenceFrame(const SubmitCommand& command, bool isKeyFrame, uint32_t ltrIndex)
+    {
+        // An IDR frame clears the DPB and the long-term references.
+        if (isKeyFrame)
+        {
+            m_ReferenceCount = 0;
+            for (auto& ltrFrame : m_LtrFrames)
+                ltrFrame.isValid = false;
+        }
+
+        if (m_ReferenceCount == k_MaxReferenceFrames)
+        {
+            std::move(m_References + 1, m_References + k_MaxReferenceFrames, m_References);
+            m_ReferenceCount--;
+        }
+
+        const ReferenceFrame reference = { command.timeStamp, command.frameCount, true };
+        m_References[m_ReferenceCount++] = reference;
+
+        m_FramesSinceLtr++;
+        if (ltrIndex < k_MaxLtrFrames)
+        {
+            m_LtrFrames[ltrIndex] = reference;
+            m_NextLtrIndex = (ltrIndex + 1) % m_LtrFrameCount;
+            m_FramesSinceLtr = 0;
+        }
     }
 
     Frame& NvEncoder::GetBufferedFrame(int index)
@@ -631,38 +1024,107 @@ namespace NvencPlugin
 
     void NvEncoder::ProcessEncodedFrameAsyncSingle(NvEncoder* encoder)
     {
-        while (encoder->m_IsAsync)
+        using Clock = std::chrono::steady_clock;
+
+        const auto elapsed = [](Clock::time_point start)
+        {
+            return static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+        };
+
+        EncoderProfiler::RegisterThread("NVENC Completion");
+
+        for (;;)
         {
             EncodedFrameDataKey dataKey;
+            auto idleStart = Clock::now();
             {
-                std::lock_guard<NvSpinlock> lock(encoder->m_NvSpinlock);
+                // Sleep until a frame is submitted; keep draining the pending frames on shutdown so
+                // that no bitstream buffer is still owned by the driver when resources are released.
+                std::unique_lock<std::mutex> lock(encoder->m_PendingLock);
+                encoder->m_PendingCondition.wait(lock, [encoder]
+                {
+                    return !encoder->m_IsAsync || !encoder->m_BufferToRead.empty();
+                });
+
                 if (encoder->m_BufferToRead.empty())
-                    continue;
+                    break;
+
                 dataKey = encoder->m_BufferToRead.front();
                 encoder->m_BufferToRead.pop();
             }
 
-            if (WaitForSingleObject(encoder->m_vpCompletionEvent[dataKey.index], 1000) == WAIT_FAILED)
+            encoder->m_CompletionIdleTime += elapsed(idleStart);
+
+            // With sub-frame output, the bitstream is polled instead. If the event isn't signaled in
+            // time, the bitstream is still locked, which blocks until the frame is encoded: the frame
+            // must be read for its buffers to be used again.
+            const auto waitStart = Clock::now();
+            if (encoder->m_SliceCount <= 1
+                && !WaitForCompletionEvent(encoder->m_vpCompletionEvent[dataKey.index], 1000))
             {
-                WriteFileDebug("Failed in the ProcessEncodedFrameAsync.\n");
-                continue;
+                WriteFileDebug(LogLevel::Warning, "Warning, the completion event wasn't signaled, waiting on the bitstream lock.\n");
             }
+            encoder->m_CompletionWaitTime += elapsed(waitStart);
+
+            const auto busyStart = Clock::now();
             auto& frame = encoder->GetBufferedFrame(dataKey.index);
             encoder->ProcessEncodedFrame(frame, dataKey.timestamp, dataKey.isKeyFrame);
             frame.isEncoded = true;
-            WriteFileDebug("Info, frameIndex used from the queue.\n");
+            encoder->m_CompletionBusyTime += elapsed(busyStart);
+            encoder->m_CompletionFrameCount++;
+
+            // Taken so that WaitForCompletionIdle can't miss the notification between its check and
+            // its wait.
+            {
+                std::lock_guard<std::mutex> lock(encoder->m_PendingLock);
+            }
+            encoder->m_CompletionIdleCondition.notify_all();
+            WriteFileDebug(LogLevel::Info, "Info, frameIndex used from the queue.\n");
         }
+
+        EncoderProfiler::UnregisterThread();
+    }
+
+    CompletionThreadLoad NvEncoder::GetCompletionThreadLoad() const
+    {
+        CompletionThreadLoad load;
+        load.idleTime = m_CompletionIdleTime;
+        load.busyTime = m_CompletionBusyTime;
+        load.waitTime = m_CompletionWaitTime;
+        load.frameCount = m_CompletionFrameCount;
+        return load;
     }
 
     void NvEncoder::ProcessEncodedFrame(Frame& frame, unsigned long long int timestamp, bool isKeyFrame)
     {
         if (!frame.isEncoding)
         {
-            WriteFileDebug("Error; the frame hasn't been encoded.\n");
+            WriteFileDebug(LogLevel::Error, "Error; the frame hasn't been encoded.\n");
             return;
         }
+
+        EncoderProfiler::BeginSample(ProfilerMarker::LockBitstream);
+
+        const auto size = (m_SliceCount > 1)
+            ? ReadBitstreamSlices(frame, timestamp, isKeyFrame)
+            : ReadBitstream(frame, timestamp, isKeyFrame);
+
+        EncoderProfiler::EndSample(ProfilerMarker::LockBitstream);
+
+        if (EncoderProfiler::IsEnabled())
+        {
+            EncoderStats stats;
+            GetStats(stats);
+            EncoderProfiler::EmitCounters(stats, size, frame.timings.readyTime - frame.timings.submitTime);
+        }
+
+        // Only now can EncodeFrame reuse the buffers of this frame.
         frame.isEncoding = false;
+    }
 
+    uint32_t NvEncoder::ReadBitstream(Frame& frame, unsigned long long int timestamp, bool isKeyFrame)
+    {
         NV_ENC_LOCK_BITSTREAM lockBitStream = { 0 };
         lockBitStream.version = NV_ENC_LOCK_BITSTREAM_VER;
         lockBitStream.outputBitstream = frame.outputFrame;
@@ -671,185 +1133,398 @@ namespace NvencPlugin
         auto errorCode = m_Nvenc.nvEncLockBitstream(m_HEncoder, &lockBitStream);
         if (errorCode != NV_ENC_SUCCESS)
         {
-            WriteFileDebug("Error, failed to lock bit stream.\n");
+            WriteFileDebug(LogLevel::Error, "Error, failed to lock bit stream.\n");
         }
 
+        frame.timings.readyTime = EncoderStatistics::Now();
+        m_Statistics.RecordStage(EncoderStage::Encode, frame.timings.submitTime, frame.timings.readyTime);
+
         if (lockBitStream.bitstreamSizeInBytes)
         {
             WriteFileDebug("Success, encoded size: ", static_cast<int>(lockBitStream.bitstreamSizeInBytes));
-            frame.encodedFrame.resize(lockBitStream.bitstreamSizeInBytes);
-            std::memcpy(frame.encodedFrame.data(), lockBitStream.bitstreamBufferPtr, lockBitStream.bitstreamSizeInBytes);
+            m_Statistics.RecordEncoded(lockBitStream.bitstreamSizeInBytes, isKeyFrame, frame.timings.readyTime);
+
+            // Add encoded data to a queue.
+            AddEncodedFrame(static_cast<const uint8_t*>(lockBitStream.bitstreamBufferPtr),
+                            lockBitStream.bitstreamSizeInBytes,
+                            timestamp,
+                            isKeyFrame,
+                            frame,
+                            0,
+                            true);
         }
 
         errorCode = m_Nvenc.nvEncUnlockBitstream(m_HEncoder, frame.outputFrame);
         if (errorCode != NV_ENC_SUCCESS)
         {
-            WriteFileDebug("Error, failed to unlock bit stream.\n");
+            WriteFileDebug(LogLevel::Error, "Error, failed to unlock bit stream.\n");
+        }
+        return lockBitStream.bitstreamSizeInBytes;
+    }
+
+    uint32_t NvEncoder::ReadBitstreamSlices(Frame& frame, unsigned long long int timestamp, bool isKeyFrame)
+    {
+        // The driver writes the bitstream slice by slice: each slice is queued as soon as it is complete,
+        // so that it can be packetized and sent while the next ones are encoded.
+        const auto frameSliceCount = m_FrameSliceCount.load();
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(1000);
+
+        uint32_t sliceOffsets[k_MaxSliceCount] = {};
+        uint32_t readSliceCount = 0;
+        uint32_t frameSize = 0;
+        bool     isDropped = false;
+
+        // The driver doesn't signal the completion of a slice, and there is no completion event for the
+        // whole frame either: the slice offsets are only reported in synchronous mode. Until the next slice
+        // is ready, sleep with a bounded backoff instead of spinning on the lock. The period starts over
+        // with each slice so that the next one is picked up quickly, and a slice is read at most 800 us
+        // after it is written: below a tenth of a frame at 120 fps, and overlapped with the sending of the
+        // previous slices.
+        const auto minPollPeriod = std::chrono::microseconds(50);
+        const auto maxPollPeriod = std::chrono::microseconds(800);
+        auto pollPeriod = minPollPeriod;
+        const auto waitForSlice = [&pollPeriod, maxPollPeriod]
+        {
+            std::this_thread::sleep_for(pollPeriod);
+            pollPeriod = std::min(pollPeriod * 2, maxPollPeriod);
+        };
+
+        for (;;)
+        {
+            // Past the deadline, wait for the whole frame in case the driver produced fewer slices.
+            const auto isLate = std::chrono::steady_clock::now() >= deadline;
+
+            NV_ENC_LOCK_BITSTREAM lockBitStream = { 0 };
+            lockBitStream.version = NV_ENC_LOCK_BITSTREAM_VER;
+            lockBitStream.outputBitstream = frame.outputFrame;
+            lockBitStream.sliceOffsets = sliceOffsets;
+            lockBitStream.doNotWait = isLate ? 0 : 1;
+
+            auto errorCode = m_Nvenc.nvEncLockBitstream(m_HEncoder, &lockBitStream);
+            if (errorCode == NV_ENC_ERR_LOCK_BUSY)
+            {
+                waitForSlice();
+                continue;
+            }
+
+            if (errorCode != NV_ENC_SUCCESS)
+            {
+                WriteFileDebug(LogLevel::Error, "Error, failed to lock bit stream.\n");
+                break;
+            }
+
+            const auto sliceCount = std::min(lockBitStream.numSlices, k_MaxSliceCount);
+            const auto isComplete = isLate || sliceCount >= frameSliceCount;
+            const auto data = static_cast<const uint8_t*>(lockBitStream.bitstreamBufferPtr);
+            const auto hasNewSlices = sliceCount > readSliceCount;
+            frame.timings.readyTime = EncoderStatistics::Now();
+
+            // The first slice also holds the parameter sets written before it.
+            for (; readSliceCount < sliceCount && !isDropped; ++readSliceCount)
+            {
+                const auto begin = (readSliceCount == 0) ? 0 : sliceOffsets[readSliceCount];
+                const auto end = (readSliceCount + 1 < sliceCount)
+                    ? sliceOffsets[readSliceCount + 1]
+                    : lockBitStream.bitstreamSizeInBytes;
+
+                // The frame can't be decoded without the slice: drop it whole, like when the queue overflows.
+                // Its next slices are skipped and the ones still queued are dropped.
+                if (end <= begin || end > lockBitStream.bitstreamSizeInBytes)
+                {
+                    WriteFileDebug(LogLevel::Warning, "Warning, encoded frame dropped, the driver returned an invalid slice.\n");
+                    m_FrameQueue.DropWrite(readSliceCount == 0);
+                    isDropped = true;
+                    break;
+                }
+
+                AddEncodedFrame(data + begin,
+                                end - begin,
+                                timestamp,
+                                isKeyFrame,
+                                frame,
+                                readSliceCount,
+                                isComplete && readSliceCount + 1 == sliceCount);
+            }
+            frameSize = lockBitStream.bitstreamSizeInBytes;
+
+            errorCode = m_Nvenc.nvEncUnlockBitstream(m_HEncoder, frame.outputFrame);
+            if (errorCode != NV_ENC_SUCCESS)
+            {
+                WriteFileDebug(LogLevel::Error, "Error, failed to unlock bit stream.\n");
+            }
+
+            if (isComplete)
+                break;
+
+            if (hasNewSlices)
+                pollPeriod = minPollPeriod;
+            else
+                waitForSlice();
         }
 
-        // Add encoded data to a queue.
-        AddEncodedFrame(frame, timestamp, isKeyFrame);
+        m_Statistics.RecordStage(EncoderStage::Encode, frame.timings.submitTime, frame.timings.readyTime);
+        if (frameSize > 0)
+        {
+            WriteFileDebug("Success, encoded size: ", static_cast<int>(frameSize));
+            m_Statistics.RecordEncoded(frameSize, isKeyFrame, frame.timings.readyTime);
+        }
+        return frameSize;
     }
 #pragma endregion
 
 #pragma region Encoded frame actions
-    void NvEncoder::AddEncodedFrame(Frame& frame, unsigned long long int timestamp, bool isKeyFrame)
+    void NvEncoder::AddEncodedFrame(const uint8_t* data, uint32_t size, unsigned long long int timestamp, bool isKeyFrame,
+                                    const Frame& frame, uint32_t sliceIndex, bool isLastSlice)
     {
-        EncodedFrame encodedFrame;
-        encodedFrame.imageData = std::move(frame.encodedFrame);
-        GetSequenceParams(encodedFrame.spsSequence, encodedFrame.ppsSequence);
-        encodedFrame.timestamp = timestamp;
-        encodedFrame.isKeyFrame = isKeyFrame;
-
-        WriteFileDebug("--------\n");
-        WriteFileDebug("IMG SIZE: ", encodedFrame.imageData.size(), true);
-        WriteFileDebug("SPS SIZE: ", encodedFrame.spsSequence.size(), true);
-        WriteFileDebug("PPS SIZE: ", encodedFrame.ppsSequence.size(), true);
-
-        if (m_FrameQueue.size() < k_MaxQueueLength)
+        // The slot keeps the capacity of its previous frames, so this copy doesn't allocate once warmed up.
+        // Once a slice is dropped, the next ones of the same frame are dropped too.
+        auto encodedFrame = m_FrameQueue.BeginWrite(sliceIndex == 0);
+        if (encodedFrame == nullptr)
         {
-            m_FrameQueue.push(std::move(encodedFrame));
-            WriteFileDebug("Info, encoded frame added in the queue.\n");
+            WriteFileDebug(LogLevel::Warning, "Warning, encoded frame dropped, the consumer holds the only free slot.\n");
+            return;
         }
+
+        // The first slice of each frame already carries its timecode SEI message, written by the driver.
+        encodedFrame->imageData.assign(data, data + size);
+        FindNalUnits(m_Codec, data, size, encodedFrame->nalUnits);
+        encodedFrame->timings = frame.timings;
+        encodedFrame->timestamp = timestamp;
+        encodedFrame->isKeyFrame = isKeyFrame;
+        encodedFrame->sliceIndex = sliceIndex;
+        encodedFrame->isLastSlice = isLastSlice;
+
+        // Only key frames carry the parameter sets; they are shared, not copied.
+        if (isKeyFrame && sliceIndex == 0)
+            encodedFrame->parameterSets = std::atomic_load(&m_ParameterSets);
         else
-        {
-            m_FrameQueue.pop();
-            m_FrameQueue.push(std::move(encodedFrame));
+            encodedFrame->parameterSets.reset();
 
-            WriteFileDebug("Warning, too much encoded frames in the queue.\n");
-        }
+        WriteFileDebug("--------\n");
+        WriteFileDebug("IMG SIZE: ", encodedFrame->imageData.size(), true);
+
+        m_FrameQueue.EndWrite();
+        WriteFileDebug(LogLevel::Info, "Info, encoded frame added in the queue.\n");
     }
 
     EncodedFrame* NvEncoder::GetEncodedFrame()
     {
-        if (m_FrameQueue.size() > 0)
+        const auto encodedFrame = m_FrameQueue.Front();
+
+        // The same frame is returned until it is removed, only time the first call.
+        if (encodedFrame != nullptr && encodedFrame->timings.consumeTime == 0)
         {
-            return &m_FrameQueue.front();
+            encodedFrame->timings.consumeTime = EncoderStatistics::Now();
+            m_Statistics.RecordStage(EncoderStage::Queue, encodedFrame->timings.readyTime, encodedFrame->timings.consumeTime);
         }
-        return nullptr;
+        return encodedFrame;
     }
 
     bool NvEncoder::RemoveEncodedFrame()
     {
+        RecordConsumedFrame();
+
         // Should always be true if it was true for the previous call.
-        if (m_FrameQueue.size() > 0)
+        return m_FrameQueue.Pop();
+    }
+
+    void NvEncoder::RecordConsumedFrame()
+    {
+        uint64_t borrowedIndex;
+        if (!m_FrameQueue.GetBorrowedIndex(borrowedIndex))
+            return;
+
+        const auto& timings = m_FrameQueue.Front()->timings;
+        const auto now = EncoderStatistics::Now();
+        m_Statistics.RecordStage(EncoderStage::Consume, timings.consumeTime, now);
+        m_Statistics.RecordStage(EncoderStage::Total, timings.encodeTime, now);
+    }
+
+    bool NvEncoder::AcquireEncodedFrame(EncodedFrameView& view)
+    {
+        const auto encodedFrame = GetEncodedFrame();
+        if (encodedFrame == nullptr)
+            return false;
+
+        // Only the first slice of a key frame carries the parameter sets.
+        static const SequenceInfo k_NoSequenceInfo = {};
+        const auto& parameterSets = encodedFrame->parameterSets;
+        const auto lendParameterSet = [&](const std::vector<uint8_t>* nalUnit, const uint8_t*& data, uint32_t& size)
         {
-            m_FrameQueue.pop();
-            return true;
+            data = (nalUnit != nullptr && !nalUnit->empty()) ? nalUnit->data() : nullptr;
+            size = (data != nullptr) ? static_cast<uint32_t>(nalUnit->size()) : 0;
+        };
+        lendParameterSet(parameterSets ? &parameterSets->vpsSequence : nullptr, view.vps, view.vpsSize);
+        lendParameterSet(parameterSets ? &parameterSets->spsSequence : nullptr, view.sps, view.spsSize);
+        lendParameterSet(parameterSets ? &parameterSets->ppsSequence : nullptr, view.pps, view.ppsSize);
+        view.sequenceInfo = parameterSets ? parameterSets->sequenceInfo : k_NoSequenceInfo;
+
+        m_FrameQueue.GetBorrowedIndex(view.token);
+        view.timestamp = encodedFrame->timestamp;
+        view.image = encodedFrame->imageData.data();
+        view.imageSize = static_cast<uint32_t>(encodedFrame->imageData.size());
+        view.nalUnits = encodedFrame->nalUnits.data();
+        view.nalUnitCount = static_cast<uint32_t>(encodedFrame->nalUnits.size());
+        view.isKeyFrame = encodedFrame->isKeyFrame;
+        view.sliceIndex = encodedFrame->sliceIndex;
+        view.isLastSlice = encodedFrame->isLastSlice;
+        return true;
+    }
+
+    bool NvEncoder::ReleaseEncodedFrame(uint64_t token)
+    {
+        uint64_t borrowedIndex;
+        if (!m_FrameQueue.GetBorrowedIndex(borrowedIndex) || borrowedIndex != token)
+        {
+            WriteFileDebug(LogLevel::Error, "Error, released encoded frame is not the lent one.\n");
+            return false;
+        }
+        return RemoveEncodedFrame();
+    }
+
+    uint64_t NvEncoder::GetDroppedFrameCount() const
+    {
+        return m_FrameQueue.GetDroppedCount();
+    }
+
+    void NvEncoder::GetStats(EncoderStats& stats) const
+    {
+        m_Statistics.GetStats(stats);
+
+        stats.droppedOutputFrameCount = m_FrameQueue.GetDroppedCount();
+        stats.queueDepth = m_FrameQueue.Size();
+        stats.inFlightFrameCount = 0;
+        for (uint32_t i = 0; i < m_BufferedFrameNum; i++)
+        {
+            if (m_BufferedFrames[i].isEncoding)
+                stats.inFlightFrameCount++;
         }
-        return false;
     }
 
-    void NvEncoder::GetSequenceParams(DataSequence& spsSequence, DataSequence& ppsSequence)
+    void NvEncoder::RefreshParameterSets()
+    {
+        auto parameterSets = std::make_shared<ParameterSets>();
+        GetSequenceParams(*parameterSets);
+
+        WriteFileDebug("VPS SIZE: ", parameterSets->vpsSequence.size(), true);
+        WriteFileDebug("SPS SIZE: ", parameterSets->spsSequence.size(), true);
+        WriteFileDebug("PPS SIZE: ", parameterSets->ppsSequence.size(), true);
+        if (!parameterSets->sequenceInfo.isValid)
+            WriteFileDebug(LogLevel::Warning, "Warning, the parameter sets could not be parsed.\n");
+
+        // Frames already queued keep a reference to the previous parameter sets.
+        std::atomic_store(&m_ParameterSets, std::shared_ptr<const ParameterSets>(std::move(parameterSets)));
+    }
+
+    bool NvEncoder::GetSequenceParams(ParameterSets& parameterSets)
     {
-        uint8_t spsppsData[1024]; // Assume maximum spspps data is 1KB or less
-        memset(spsppsData, 0, sizeof(spsppsData));
-        spsSequence.clear();
-        ppsSequence.clear();
+        uint8_t sequenceData[1024]; // Assume the parameter sets are 1KB or less
+        memset(sequenceData, 0, sizeof(sequenceData));
 
         NV_ENC_SEQUENCE_PARAM_PAYLOAD payload = { NV_ENC_SEQUENCE_PARAM_PAYLOAD_VER };
-        uint32_t spsppsSize = 0;
+        uint32_t sequenceSize = 0;
 
-        payload.spsppsBuffer = spsppsData;
-        payload.inBufferSize = sizeof(spsppsData);
-        payload.outSPSPPSPayloadSize = &spsppsSize;
+        payload.spsppsBuffer = sequenceData;
+        payload.inBufferSize = sizeof(sequenceData);
+        payload.outSPSPPSPayloadSize = &sequenceSize;
 
         const auto errorCode = m_Nvenc.nvEncGetSequenceParams(m_HEncoder, &payload);
         if (errorCode != NV_ENC_SUCCESS)
         {
-            WriteFileDebug("Error, nvEncGetSequenceParams failed.\n");
-            return;
+            WriteFileDebug(LogLevel::Error, "Error, nvEncGetSequenceParams failed.\n");
+            return false;
         }
 
-        // Get SPS index
-        auto* sps = spsppsData;
-        unsigned int i_sps = 4;
-
-        while (spsppsData[i_sps] != 0x00
-            || spsppsData[i_sps + 1] != 0x00
-            || spsppsData[i_sps + 2] != 0x00
-            || spsppsData[i_sps + 3] != 0x01)
+        // The driver returns the VPS (HEVC only), the SPS and the PPS as Annex-B NAL units.
+        if (!ExtractParameterSets(m_Codec, sequenceData, sequenceSize, parameterSets))
         {
-            i_sps += 1;
-            if (i_sps >= spsppsSize)
-            {
-                WriteFileDebug("Error, Invalid SPS/PPS.\n");
-                return;
-            }
+            WriteFileDebug(LogLevel::Error, "Error, Invalid SPS/PPS.\n");
+            return false;
         }
 
-        // Get PPS index
-        auto* pps = spsppsData + i_sps;
-        unsigned int i_pps = spsppsSize - i_sps;
-
-        // Allocate memory for SPS
-        spsSequence.clear();
-
-        // Allocate memory for PPS
-        ppsSequence.clear();
-
-        // Insert elements for SPS & PPS
-        spsSequence.insert(spsSequence.begin(), &sps[4], &sps[i_sps]);
-        ppsSequence.insert(ppsSequence.begin(), &pps[4], &pps[i_pps]);
+        // Without a bitstream restriction in the VUI, decoders buffer frames for reordering. The session
+        // encodes no B-frames (frameIntervalP is 1), so they can output each frame as soon as it's decoded.
+        std::vector<uint8_t> spsSequence;
+        const auto& vps = parameterSets.vpsSequence;
+        const auto& pps = parameterSets.ppsSequence;
+        if (RewriteSpsForLowLatency(m_Codec, parameterSets.spsSequence.data(),
+                                    static_cast<uint32_t>(parameterSets.spsSequence.size()), spsSequence))
+        {
+            parameterSets.spsSequence.swap(spsSequence);
+            ParseSequenceInfo(m_Codec,
+                              vps.data(), static_cast<uint32_t>(vps.size()),
+                              parameterSets.spsSequence.data(), static_cast<uint32_t>(parameterSets.spsSequence.size()),
+                              pps.data(), static_cast<uint32_t>(pps.size()),
+                              parameterSets.sequenceInfo);
+        }
+        else
+        {
+            WriteFileDebug(LogLevel::Warning, "Warning, the SPS could not be rewritten for low latency decoding.\n");
+        }
+        return true;
     }
 #pragma endregion 
 
 #pragma region Liberate resources
     void NvEncoder::DestroyResources()
     {
-        auto asyncMode = m_IsAsync;
+        // Submits the frames still queued, the completion thread then drains them.
+        if (m_SubmissionThread != nullptr)
+        {
+            m_SubmissionQueue.Close();
+            delete m_SubmissionThread;
+            m_SubmissionThread = nullptr;
+            m_SubmissionQueue.Reset();
+        }
+
         if (m_IsAsync)
         {
-            m_IsAsync = false;
+            {
+                std::lock_guard<std::mutex> lock(m_PendingLock);
+                m_IsAsync = false;
+            }
+            m_PendingCondition.notify_all();
+
             if (m_Thread != nullptr)
-            delete m_Thread;
+            {
+                delete m_Thread;
+                m_Thread = nullptr;
+            }
 
             DestroyAsyncResources();
         }
 
         ReleaseEncoderResources();
         ClearEncodedFrameQueue();
+        m_Converter.reset();
+        std::atomic_store(&m_ParameterSets, std::shared_ptr<const ParameterSets>());
 
         if (m_HEncoder)
         {
             if (m_Nvenc.nvEncDestroyEncoder(m_HEncoder) != NV_ENC_SUCCESS)
             {
-                WriteFileDebug("Failed to destroy NV encoder interface.\n");
+                WriteFileDebug(LogLevel::Error, "Failed to destroy NV encoder interface.\n");
             }
             m_HEncoder = nullptr;
         }
 
-        UnloadModule();
         m_InitializationResult = ENvencStatus::NotInitialized;
     }
 
-    void NvEncoder::UnloadModule()
-    {
-
-        if (m_HModule != nullptr)
-        {
-#if defined(_WIN32)
-            FreeLibrary((HMODULE)m_HModule);
-#else
-            dlclose(s_hModule);
-#endif
-            m_HModule = nullptr;
-        }
-    }
-
     void NvEncoder::ReleaseEncoderResources()
     {
         if (m_InitializationResult != ENvencStatus::Success)
             return;
 
-        for (Frame& frame : m_BufferedFrames)
+        for (uint32_t i = 0; i < m_BufferedFrameNum; i++)
         {
+            auto& frame = m_BufferedFrames[i];
             ReleaseFrameInputBuffer(frame);
 
             auto errorCode = m_Nvenc.nvEncDestroyBitstreamBuffer(m_HEncoder, frame.outputFrame);
             if (errorCode != NV_ENC_SUCCESS)
             {
-                WriteFileDebug("Error, failed to destroy output buffer bit stream.\n");
+                WriteFileDebug(LogLevel::Error, "Error, failed to destroy output buffer bit stream.\n");
             }
             frame.outputFrame = nullptr;
         }
@@ -874,14 +1549,14 @@ namespace NvencPlugin
             auto errorCode = m_Nvenc.nvEncUnmapInputResource(m_HEncoder, frame.inputFrame.mappedResource);
             if (errorCode != NV_ENC_SUCCESS)
             {
-                WriteFileDebug("Error, failed to unmap input resource.\n");
+                WriteFileDebug(LogLevel::Error, "Error, failed to unmap input resource.\n");
             }
             frame.inputFrame.mappedResource = nullptr;
 
             errorCode = m_Nvenc.nvEncUnregisterResource(m_HEncoder, frame.inputFrame.registeredResource);
             if (errorCode != NV_ENC_SUCCESS)
             {
-                WriteFileDebug("Error, failed to unregister input buffer resource.\n");
+                WriteFileDebug(LogLevel::Error, "Error, failed to unregister input buffer resource.\n");
             }
             frame.inputFrame.registeredResource = nullptr;
         }
@@ -889,10 +1564,7 @@ namespace NvencPlugin
 
     void NvEncoder::ClearEncodedFrameQueue()
     {
-        while (!m_FrameQueue.empty())
-        {
-            m_FrameQueue.pop();
-        }
+        m_FrameQueue.Clear();
     }
 
     void NvEncoder::DestroyAsyncResources()
@@ -904,7 +1576,7 @@ namespace NvencPlugin
                 NV_ENC_EVENT_PARAMS eventParams = { NV_ENC_EVENT_PARAMS_VER };
                 eventParams.completionEvent = m_vpCompletionEvent[i];
                 m_Nvenc.nvEncUnregisterAsyncEvent(m_HEncoder, &eventParams);
-                CloseHandle(m_vpCompletionEvent[i]);
+                DestroyCompletionEvent(m_vpCompletionEvent[i]);
             }
         }
         m_vpCompletionEvent.clear();
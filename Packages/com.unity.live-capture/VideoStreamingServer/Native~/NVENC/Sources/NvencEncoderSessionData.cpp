@@ -27,4 +27,28 @@ namespace NvencPlugin
         bitRate = other.bitRate * BitRateInKilobits;
         gopSize = other.gopSize;
     }
+
+    EncoderPipelineDepth EncoderPipelineDepth::FromSettings(EncoderPipelineMode mode, int framesInFlight, int maxQueueLength)
+    {
+        EncoderPipelineDepth depth;
+        switch (mode)
+        {
+        case EncoderPipelineMode::Latency:
+            depth = { 2, 2 };
+            break;
+        case EncoderPipelineMode::Throughput:
+            depth = { 8, 32 };
+            break;
+        default:
+            depth = { 4, 8 };
+            break;
+        }
+
+        if (framesInFlight > 0)
+            depth.framesInFlight = framesInFlight < static_cast<int>(k_MaxFramesInFlight) ? framesInFlight : k_MaxFramesInFlight;
+        if (maxQueueLength > 0)
+            depth.maxQueueLength = maxQueueLength < static_cast<int>(k_MaxEncodedQueueLength) ? maxQueueLength : k_MaxEncodedQueueLength;
+
+        return depth;
+    }
 };
@@ -0,0 +1,235 @@
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "NvencModule.h"
+#include "PluginUtils.h"
+
+namespace NvencPlugin
+{
+    namespace
+    {
+        using NvEncodeAPICreateInstance_Type = NVENCSTATUS(NVENCAPI*)(NV_ENCODE_API_FUNCTION_LIST*);
+
+        struct CapsEntry
+        {
+            void*       device;
+            GUID        encodeGUID;
+            NV_ENC_CAPS caps;
+            int         value;
+        };
+
+        struct PresetEntry
+        {
+            void*         device;
+            GUID          encodeGUID;
+            GUID          presetGUID;
+            NV_ENC_CONFIG config;
+        };
+
+        struct ModuleState
+        {
+            std::mutex                  lock;
+            HMODULE                     module = nullptr;
+            bool                        isLoaded = false;
+            ENvencSupport               support = ENvencSupport::NoDriver;
+            ENvencStatus                status = ENvencStatus::NotInitialized;
+            NV_ENCODE_API_FUNCTION_LIST functionList = {};
+            std::vector<CapsEntry>      caps;
+            std::vector<PresetEntry>    presets;
+        };
+
+        ModuleState s_State;
+
+        inline bool IsSameGUID(const GUID& a, const GUID& b)
+        {
+            return std::memcmp(&a, &b, sizeof(GUID)) == 0;
+        }
+
+        void* GetModuleFunction(HMODULE module, const char* name)
+        {
+#if defined(_WIN32)
+            return reinterpret_cast<void*>(GetProcAddress(module, name));
+#else
+            return dlsym(module, name);
+#endif
+        }
+    }
+
+    // Must be called under the lock.
+    void NvencModule::Load()
+    {
+        if (s_State.isLoaded)
+            return;
+        s_State.isLoaded = true;
+
+        WriteFileDebug("Start to call: LoadModule\n");
+
+        s_State.module = LoadModule();
+        if (s_State.module == nullptr)
+        {
+            WriteFileDebug(LogLevel::Error, "Error, DriverNotInstalled in NVENC library\n");
+            s_State.support = ENvencSupport::NoDriver;
+            s_State.status = ENvencStatus::DriverNotInstalled;
+            return;
+        }
+
+        if (!CheckDriverVersion(s_State.module))
+        {
+            WriteFileDebug(LogLevel::Error, "Error, DriverVersionDoesNotSupportAPI in NVENC library\n");
+            s_State.support = ENvencSupport::DriverVersionNotSupported;
+            s_State.status = ENvencStatus::DriverVersionDoesNotSupportAPI;
+            return;
+        }
+        s_State.support = ENvencSupport::Supported;
+
+        auto NvEncodeAPICreateInstance = reinterpret_cast<NvEncodeAPICreateInstance_Type>(
+            GetModuleFunction(s_State.module, "NvEncodeAPICreateInstance"));
+        if (!NvEncodeAPICreateInstance)
+        {
+            WriteFileDebug(LogLevel::Error, "Error, APINotFound (NvEncodeAPICreateInstance) in NVENC library\n");
+            s_State.status = ENvencStatus::APINotFound;
+            return;
+        }
+
+        s_State.functionList = { NV_ENCODE_API_FUNCTION_LIST_VER };
+        if (NvEncodeAPICreateInstance(&s_State.functionList) != NV_ENC_SUCCESS)
+        {
+            WriteFileDebug(LogLevel::Error, "Error, APINotFound (NvEncodeAPICreateInstance) in Nvenc.\n");
+            s_State.status = ENvencStatus::APINotFound;
+            return;
+        }
+
+        s_State.status = ENvencStatus::Success;
+        WriteFileDebug("End to call: LoadModule\n");
+    }
+
+    ENvencSupport NvencModule::GetSupport()
+    {
+        std::lock_guard<std::mutex> lock(s_State.lock);
+        Load();
+        return s_State.support;
+    }
+
+    ENvencStatus NvencModule::GetFunctionList(NV_ENCODE_API_FUNCTION_LIST& functionList)
+    {
+        std::lock_guard<std::mutex> lock(s_State.lock);
+        Load();
+        if (s_State.status == ENvencStatus::Success)
+            functionList = s_State.functionList;
+        return s_State.status;
+    }
+
+    int NvencModule::GetEncodeCaps(const NV_ENCODE_API_FUNCTION_LIST& functionList, void* encoder, void* device,
+                                   GUID encodeGUID, NV_ENC_CAPS caps)
+    {
+        std::lock_guard<std::mutex> lock(s_State.lock);
+        for (const auto& entry : s_State.caps)
+        {
+            if (entry.device == device && entry.caps == caps && IsSameGUID(entry.encodeGUID, encodeGUID))
+                return entry.value;
+        }
+
+        NV_ENC_CAPS_PARAM capsParam = { 0 };
+        capsParam.version = NV_ENC_CAPS_PARAM_VER;
+        capsParam.capsToQuery = caps;
+        int value = 0;
+        if (functionList.nvEncGetEncodeCaps(encoder, encodeGUID, &capsParam, &value) != NV_ENC_SUCCESS)
+        {
+            WriteFileDebug(LogLevel::Error, "Error, Failed to get NVEncoder capability params.\n");
+            return 0;
+        }
+
+        s_State.caps.push_back({ device, encodeGUID, caps, value });
+        return value;
+    }
+
+    bool NvencModule::GetPresetConfig(const NV_ENCODE_API_FUNCTION_LIST& functionList, void* encoder, void* device,
+                                      GUID encodeGUID, GUID presetGUID, NV_ENC_CONFIG& config)
+    {
+        std::lock_guard<std::mutex> lock(s_State.lock);
+        for (const auto& entry : s_State.presets)
+        {
+            if (entry.device == device && IsSameGUID(entry.encodeGUID, encodeGUID)
+                && IsSameGUID(entry.presetGUID, presetGUID))
+            {
+                std::memcpy(&config, &entry.config, sizeof(NV_ENC_CONFIG));
+                return true;
+            }
+        }
+
+        NV_ENC_PRESET_CONFIG presetConfig = { NV_ENC_PRESET_CONFIG_VER, { NV_ENC_CONFIG_VER } };
+        if (functionList.nvEncGetEncodePresetConfig(encoder, encodeGUID, presetGUID, &presetConfig) != NV_ENC_SUCCESS)
+        {
+            WriteFileDebug(LogLevel::Error, "Error, Failed to select NVEncoder preset config.\n");
+            return false;
+        }
+
+        std::memcpy(&config, &presetConfig.presetCfg, sizeof(NV_ENC_CONFIG));
+
+        PresetEntry entry;
+        entry.device = device;
+        entry.encodeGUID = encodeGUID;
+        entry.presetGUID = presetGUID;
+        std::memcpy(&entry.config, &presetConfig.presetCfg, sizeof(NV_ENC_CONFIG));
+        s_State.presets.push_back(entry);
+        return true;
+    }
+
+    void NvencModule::Unload()
+    {
+        std::lock_guard<std::mutex> lock(s_State.lock);
+        if (s_State.module != nullptr)
+        {
+#if defined(_WIN32)
+            FreeLibrary(s_State.module);
+#else
+            dlclose(s_State.module);
+#endif
+        }
+
+        s_State.module = nullptr;
+        s_State.isLoaded = false;
+        s_State.support = ENvencSupport::NoDriver;
+        s_State.status = ENvencStatus::NotInitialized;
+        s_State.functionList = {};
+        s_State.caps.clear();
+        s_State.presets.clear();
+    }
+
+    bool NvencModule::CheckDriverVersion(HMODULE module)
+    {
+        using NvEncodeAPIGetMaxSupportedVersion_Type = NVENCSTATUS(NVENCAPI*)(uint32_t*);
+        auto NvEncodeAPIGetMaxSupportedVersion = reinterpret_cast<NvEncodeAPIGetMaxSupportedVersion_Type>(
+            GetModuleFunction(module, "NvEncodeAPIGetMaxSupportedVersion"));
+        if (!NvEncodeAPIGetMaxSupportedVersion)
+            return false;
+
+        uint32_t version = 0;
+        uint32_t currentVersion = (NVENCAPI_MAJOR_VERSION << 4) | NVENCAPI_MINOR_VERSION;
+        NvEncodeAPIGetMaxSupportedVersion(&version);
+        return (currentVersion > version) ? false : true;
+    }
+
+    HMODULE NvencModule::LoadModule()
+    {
+#if defined(NVENC_MODULE_NAME)
+        // Overridden by the build, e.g. to load the mock API.
+#if defined(_WIN32)
+        HMODULE module = LoadLibraryA(NVENC_MODULE_NAME);
+#else
+        void* module = dlopen(NVENC_MODULE_NAME, RTLD_LAZY);
+#endif
+#elif defined(_WIN32)
+#if defined(_WIN64)
+        HMODULE module = LoadLibrary(TEXT("nvEncodeAPI64.dll"));
+#else
+        HMODULE module = LoadLibrary(TEXT("nvEncodeAPI.dll"));
+#endif
+#else
+        void* module = dlopen("libnvidia-encode.so.1", RTLD_LAZY);
+#endif
+
+        return module;
+    }
+}
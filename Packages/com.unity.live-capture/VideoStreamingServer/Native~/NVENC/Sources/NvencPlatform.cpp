@@ -0,0 +1,75 @@
+#include "NvencPlatform.h"
+
+#if !defined(_WIN32)
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#endif
+
+namespace NvencPlugin
+{
+#if defined(_WIN32)
+    void* CreateCompletionEvent()
+    {
+        return CreateEvent(NULL, FALSE, FALSE, NULL);
+    }
+
+    void DestroyCompletionEvent(void* event)
+    {
+        CloseHandle(event);
+    }
+
+    void SignalCompletionEvent(void* event)
+    {
+        SetEvent(event);
+    }
+
+    bool WaitForCompletionEvent(void* event, uint32_t timeoutMs)
+    {
+        return WaitForSingleObject(event, timeoutMs) == WAIT_OBJECT_0;
+    }
+#else
+    struct CompletionEvent
+    {
+        std::mutex              lock;
+        std::condition_variable condition;
+        bool                    isSignaled = false;
+    };
+
+    void* CreateCompletionEvent()
+    {
+        return new CompletionEvent();
+    }
+
+    void DestroyCompletionEvent(void* event)
+    {
+        delete static_cast<CompletionEvent*>(event);
+    }
+
+    void SignalCompletionEvent(void* event)
+    {
+        auto completionEvent = static_cast<CompletionEvent*>(event);
+
+        // Notify under the lock: the waiter may destroy the event as soon as it is released.
+        std::lock_guard<std::mutex> lock(completionEvent->lock);
+        completionEvent->isSignaled = true;
+        completionEvent->condition.notify_one();
+    }
+
+    bool WaitForCompletionEvent(void* event, uint32_t timeoutMs)
+    {
+        auto completionEvent = static_cast<CompletionEvent*>(event);
+
+        std::unique_lock<std::mutex> lock(completionEvent->lock);
+        if (!completionEvent->condition.wait_for(lock,
+                                                 std::chrono::milliseconds(timeoutMs),
+                                                 [completionEvent] { return completionEvent->isSignaled; }))
+        {
+            return false;
+        }
+
+        completionEvent->isSignaled = false;
+        return true;
+    }
+#endif
+}
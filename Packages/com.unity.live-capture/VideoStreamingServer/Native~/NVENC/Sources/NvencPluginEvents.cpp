@@ -2,14 +2,17 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <algorithm>
 
 #include "d3d11.h"
 #include "d3d12.h"
 
 #include "NvencPluginEvents.h"
 #include "NvencEncoder.h"
-#include "ObjectIDMap.h"
+#include "SlotMap.h"
+#include "SessionPool.h"
 #include "PluginUtils.h"
+#include "EncoderProfiler.h"
 
 #include "D3D11EncoderDevice.h"
 #include "D3D12EncoderDevice.h"
@@ -26,7 +29,8 @@ enum class VideoStreamRenderEventID
     Initialize = 0,
     Update,
     Encode,
-    Finalize
+    Finalize,
+    Prewarm
 };
 
 namespace NvencPlugin
@@ -36,23 +40,53 @@ namespace NvencPlugin
     static IUnityGraphicsD3D11*    s_UnityGraphicsD3D11 = nullptr;
     static IUnityGraphicsD3D12v5*  s_UnityGraphicsD3D12 = nullptr;
 
+    // Shared by the encoders: created with the first one and destroyed with the last one. Only
+    // accessed from the render thread.
     static IGraphicsEncoderDevice* s_GraphicsEncoderDevice = nullptr;
+    static uint32_t                s_GraphicsEncoderDeviceRefCount = 0;
     static IUnknown*               s_GraphicsDevice = nullptr;
     static bool                    s_Initialized = false;
 
-    static IDObjectMap<NvEncoder>      s_EncoderMap;
-    static IDObjectMap<EncodedFrame>   s_EncodedFrameMap;
+    // Bound by Initialize and retired by Finalize on the render thread, looked up by the exports on the
+    // main thread.
+    using EncoderMap = Handles::SlotMap<NvEncoder>;
+    static EncoderMap              s_EncoderMap;
+
+    // Sessions created by Prewarm, checked out by Initialize. Each one holds a reference to the
+    // graphics device. Only accessed from the render thread.
+    static SessionPool<NvEncoder>  s_SessionPool;
+
+    static void DestroySessionPool();
+
+    static EncoderMap::Ref AcquireEncoder(const int* id)
+    {
+        return (id != nullptr) ? s_EncoderMap.Acquire(*id) : EncoderMap::Ref();
+    }
 
 #pragma region Low Level Plugin Interface
     // Override the function defining the load of the plugin
     extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API
         UnityPluginLoad(IUnityInterfaces * unityInterfaces)
     {
+        StartLog();
         WriteFileDebug("Load plugin\n", false);
         if (unityInterfaces)
         {
             s_UnityInterfaces = unityInterfaces;
 
+            static const char* const k_ProfilerMarkerNames[] =
+            {
+                "NvEnc.EncodeFrame",
+                "NvEnc.CopyResource",
+                "NvEnc.ConvertRGBToNV12",
+                "NvEnc.EncodePicture",
+                "NvEnc.LockBitstream"
+            };
+            static_assert(sizeof(k_ProfilerMarkerNames) / sizeof(k_ProfilerMarkerNames[0]) == static_cast<uint32_t>(ProfilerMarker::Count),
+                          "A name is required for each profiler marker.");
+            EncoderProfiler::Initialize(unityInterfaces, k_ProfilerMarkerNames, static_cast<uint32_t>(ProfilerMarker::Count),
+                                        "NvEnc.Counters");
+
             const auto unityGraphics = s_UnityInterfaces->Get<IUnityGraphics>();
             if (unityGraphics)
             {
@@ -70,6 +104,10 @@ namespace NvencPlugin
         {
             s_UnityGraphics->UnregisterDeviceEventCallback(OnGraphicsDeviceEvent);
         }
+        DestroySessionPool();
+        NvencModule::Unload();
+        EncoderProfiler::Shutdown();
+        StopLog();
     }
 
     static bool GetRenderDeviceInterface(UnityGfxRenderer renderer)
@@ -85,7 +123,7 @@ namespace NvencPlugin
             s_GraphicsDevice = s_UnityGraphicsD3D12->GetDevice();
             return true;
         default:
-            WriteFileDebug("Error, graphics API not supported.\n");
+            WriteFileDebug(LogLevel::Error, "Error, graphics API not supported.\n");
             return false;
         }
     }
@@ -107,6 +145,7 @@ namespace NvencPlugin
         }
         else if (eventType == kUnityGfxDeviceEventShutdown)
         {
+            DestroySessionPool();
             s_Initialized = false;
             s_UnityGraphicsD3D11 = nullptr;
             s_UnityGraphicsD3D12 = nullptr;
@@ -124,6 +163,7 @@ namespace NvencPlugin
     void Update(void* data);
     void Encode(void* data);
     void Finalize(void* data);
+    void Prewarm(void* data);
 
     // Plugin function to handle a specific rendering event
     static void UNITY_INTERFACE_API OnRenderEvent(int eventID, void* data)
@@ -151,6 +191,11 @@ namespace NvencPlugin
             Finalize(data);
             break;
         }
+        case VideoStreamRenderEventID::Prewarm:
+        {
+            Prewarm(data);
+            break;
+        }
         default:
             break;
         }
@@ -158,24 +203,112 @@ namespace NvencPlugin
 #pragma endregion
 
 #pragma region Render event commands
+    static IGraphicsEncoderDevice* AcquireGraphicsEncoderDevice()
+    {
+        if (s_GraphicsEncoderDevice == nullptr)
+        {
+            IGraphicsEncoderDevice* device = nullptr;
+            if (s_UnityGraphicsD3D11)
+            {
+                auto d3d11Device = static_cast<ID3D11Device*>(s_GraphicsDevice);
+                device = new D3D11EncoderDevice(d3d11Device);
+                WriteFileDebug("D3D11 encoder device succesfully created.\n");
+            }
+            else if (s_UnityGraphicsD3D12)
+            {
+                auto d3d12Device = static_cast<ID3D12Device*>(s_GraphicsDevice);
+                device = new D3D12EncoderDevice(d3d12Device, s_UnityGraphicsD3D12);
+                WriteFileDebug("D3D12 encoder device succesfully created.\n");
+            }
+            else
+            {
+                WriteFileDebug(LogLevel::Error, "Error, graphics API failed to create an Encoder device.\n");
+                return nullptr;
+            }
+
+            if (!device->Initialize())
+            {
+                WriteFileDebug(LogLevel::Error, "Error, Failed to Initialize Graphics encoder device.\n");
+                delete device;
+                return nullptr;
+            }
+
+            s_GraphicsEncoderDevice = device;
+        }
+
+        s_GraphicsEncoderDeviceRefCount++;
+        return s_GraphicsEncoderDevice;
+    }
+
+    // The device is destroyed once the last encoder using it is.
+    static void ReleaseGraphicsEncoderDevice()
+    {
+        if (s_GraphicsEncoderDeviceRefCount == 0 || --s_GraphicsEncoderDeviceRefCount > 0)
+            return;
+
+        s_GraphicsEncoderDevice->Cleanup();
+        delete s_GraphicsEncoderDevice;
+        s_GraphicsEncoderDevice = nullptr;
+        WriteFileDebug("Encoder device destroyed.\n");
+    }
+
     // Verify if the data parameter and the D3D11 Device are valid.
     bool AreParametersValid(void* data)
     {
         if (!data)
         {
-            WriteFileDebug("Error, Data send is null.\n");
+            WriteFileDebug(LogLevel::Error, "Error, Data send is null.\n");
             return true;
         }
 
         if (!s_GraphicsDevice)
         {
-            WriteFileDebug("Error, s_D3D11Device is null.\n");
+            WriteFileDebug(LogLevel::Error, "Error, s_D3D11Device is null.\n");
             return true;
         }
 
         return true;
     }
 
+    static SessionPoolKey GetSessionPoolKey(const EncoderSettingsID& encoderData, IGraphicsEncoderDevice* device)
+    {
+        SessionPoolKey key;
+        key.device = device;
+        key.width = encoderData.settings.width;
+        key.height = encoderData.settings.height;
+        key.codec = encoderData.codec;
+        key.forceNv12 = encoderData.encoderFormat != EncoderFormat::NV12;
+        key.depth = EncoderPipelineDepth::FromSettings(encoderData.pipelineMode,
+                                                       encoderData.framesInFlight,
+                                                       encoderData.maxQueueLength);
+        key.sliceCount = encoderData.sliceCount;
+        key.intraRefreshFrames = encoderData.intraRefreshFrames;
+        return key;
+    }
+
+    static NvEncoder* CreateEncoder(const EncoderSettingsID& encoderData, IGraphicsEncoderDevice* device)
+    {
+        const auto key = GetSessionPoolKey(encoderData, device);
+        return new NvEncoder(_NV_ENC_DEVICE_TYPE::NV_ENC_DEVICE_TYPE_DIRECTX,
+                             encoderData.settings,
+                             device,
+                             key.forceNv12,
+                             key.depth,
+                             key.codec,
+                             key.sliceCount,
+                             key.intraRefreshFrames);
+    }
+
+    static void DestroySessionPool()
+    {
+        while (auto encoder = s_SessionPool.Pop())
+        {
+            encoder->DestroyResources();
+            delete encoder;
+            ReleaseGraphicsEncoderDevice();
+        }
+    }
+
     void Initialize(void* data)
     {
         WriteFileDebug("OnRenderEvent: Initialize\n");
@@ -192,50 +325,55 @@ namespace NvencPlugin
             WriteFileDebug("Initial Bitrate: ", encoderData->settings.bitRate);
             WriteFileDebug("Initial GopSize: ", encoderData->settings.gopSize);
 
-            if (s_GraphicsEncoderDevice == nullptr)
+            // Initializing a live handle again would leak its encoder.
+            if (s_EncoderMap.Acquire(encoderData->id))
             {
-                if (s_UnityGraphicsD3D11)
-                {
-                    auto d3d11Device = static_cast<ID3D11Device*>(s_GraphicsDevice);
-                    s_GraphicsEncoderDevice = new D3D11EncoderDevice(d3d11Device);
-                    WriteFileDebug("D3D11 encoder device succesfully created.\n");
-                }
-                else if (s_UnityGraphicsD3D12)
-                {
-                    auto d3d12Device = static_cast<ID3D12Device*>(s_GraphicsDevice);
-                    s_GraphicsEncoderDevice = new D3D12EncoderDevice(d3d12Device, s_UnityGraphicsD3D12);
-                    WriteFileDebug("D3D12 encoder device succesfully created.\n");
-                }
-                else
-                {
-                    WriteFileDebug("Error, graphics API failed to create an Encoder device.\n");
-                    return;
-                }
+                WriteFileDebug(LogLevel::Warning, "Warning, encoder already initialized: ", encoderData->id);
+                return;
+            }
 
-                if (!s_GraphicsEncoderDevice->Initialize())
+            // The handle reserved by CreateEncoderHandle is freed when the encoder can't be created: the
+            // managed side only finalizes the encoders that initialized.
+            auto device = AcquireGraphicsEncoderDevice();
+            if (device == nullptr)
+            {
+                s_EncoderMap.Retire(encoderData->id);
+                return;
+            }
+
+            // A pooled session holds its own reference to the device.
+            auto encoder = s_SessionPool.Checkout(GetSessionPoolKey(*encoderData, device));
+            if (encoder != nullptr)
+            {
+                ReleaseGraphicsEncoderDevice();
+                encoder->UpdateEncoderSessionData(encoderData->settings);
+                WriteFileDebug(LogLevel::Info, "Info, encoder checked out of the session pool.\n");
+            }
+            else
+            {
+                encoder = CreateEncoder(*encoderData, device);
+                if (encoder->InitEncoder() != NvencPlugin::ENvencStatus::Success)
                 {
-                    WriteFileDebug("Error, Failed to Initialize Graphics encoder device.\n");
+                    WriteFileDebug(LogLevel::Error, "Error, Failed to Initialize 'InitEncoder'\n");
+                    encoder->DestroyResources();
+                    delete encoder;
+                    ReleaseGraphicsEncoderDevice();
+                    s_EncoderMap.Retire(encoderData->id);
                     return;
                 }
             }
 
-            bool forceNV12 = encoderData->encoderFormat != EncoderFormat::NV12;
-
-            auto encoder = new NvEncoder(_NV_ENC_DEVICE_TYPE::NV_ENC_DEVICE_TYPE_DIRECTX,
-                                         encoderData->settings,
-                                         s_GraphicsEncoderDevice,
-                                         forceNV12);
-
-            if (encoder->InitEncoder() != NvencPlugin::ENvencStatus::Success)
+            if (!s_EncoderMap.Bind(encoderData->id, encoder))
             {
-                WriteFileDebug("Error, Failed to Initialize 'InitEncoder'\n");
+                WriteFileDebug(LogLevel::Error, "Error, invalid encoder handle: ", encoderData->id);
+                encoder->DestroyResources();
+                delete encoder;
+                ReleaseGraphicsEncoderDevice();
             }
-
-            s_EncoderMap.Add(encoderData->id, encoder);
         }
         else
         {
-            WriteFileDebug("Error, Initialize: invalid parameters.\n");
+            WriteFileDebug(LogLevel::Error, "Error, Initialize: invalid parameters.\n");
         }
     }
 
@@ -247,15 +385,15 @@ namespace NvencPlugin
         auto encoderData = static_cast<EncoderSettingsID*>(data);
         if (encoderData && encoderData->id > 0)
         {
-            auto encoder = s_EncoderMap.GetInstance(encoderData->id);
+            auto encoder = s_EncoderMap.Acquire(encoderData->id);
             if (encoder && encoder->UpdateEncoderSessionData(encoderData->settings))
             {
-                WriteFileDebug("Info, Data has been updated.\n");
+                WriteFileDebug(LogLevel::Info, "Info, Data has been updated.\n");
             }
         }
         else
         {
-            WriteFileDebug("Error, Update: invalid parameters.\n");
+            WriteFileDebug(LogLevel::Error, "Error, Update: invalid parameters.\n");
         }
     }
 
@@ -267,10 +405,10 @@ namespace NvencPlugin
         auto encoderData = static_cast<EncoderTextureID*>(data);
         if (encoderData && encoderData->id > 0)
         {
-            auto encoder = s_EncoderMap.GetInstance(encoderData->id);
+            auto encoder = s_EncoderMap.Acquire(encoderData->id);
             if (encoder)
             {
-                encoder->EncodeFrame(encoderData->renderTexture, encoderData->timestamp);
+                encoder->EncodeFrame(encoderData->renderTexture, encoderData->timestamp, encoderData->timecode);
             }
         }
     }
@@ -282,35 +420,79 @@ namespace NvencPlugin
         auto id = static_cast<int*>(data);
         if (id && *id > 0)
         {
-            auto encoder = s_EncoderMap.GetInstance(*id);
+            // Returned once the exports running on the main thread are done with the encoder, and no new
+            // call can look it up.
+            auto encoder = s_EncoderMap.Retire(*id);
             if (encoder)
             {
                 encoder->DestroyResources();
                 delete encoder;
                 encoder = nullptr;
-                s_EncoderMap.Remove(*id);
+                ReleaseGraphicsEncoderDevice();
             }
         }
+    }
+
+    // Creates a session that the next Initialize with the same size and creation settings checks out,
+    // e.g. when the server starts, before any client connects. The ID is ignored.
+    void Prewarm(void* data)
+    {
+        WriteFileDebug("OnRenderEvent: Prewarm\n");
+
+        auto encoderData = static_cast<EncoderSettingsID*>(data);
+        if (encoderData == nullptr)
+        {
+            WriteFileDebug(LogLevel::Error, "Error, Prewarm: invalid parameters.\n");
+            return;
+        }
+
+        if (s_SessionPool.IsFull())
+        {
+            WriteFileDebug(LogLevel::Warning, "Warning, the session pool is full.\n");
+            return;
+        }
 
-        if (s_GraphicsEncoderDevice != nullptr)
+        auto device = AcquireGraphicsEncoderDevice();
+        if (device == nullptr)
+            return;
+
+        auto encoder = CreateEncoder(*encoderData, device);
+        if (encoder->InitEncoder() != NvencPlugin::ENvencStatus::Success
+            || !s_SessionPool.Add(GetSessionPoolKey(*encoderData, device), encoder))
         {
-            s_GraphicsEncoderDevice->Cleanup();
-            s_GraphicsEncoderDevice = nullptr;
+            WriteFileDebug(LogLevel::Error, "Error, Failed to prewarm an encoder session.\n");
+            encoder->DestroyResources();
+            delete encoder;
+            ReleaseGraphicsEncoderDevice();
+            return;
         }
 
-        s_Initialized = false;
+        WriteFileDebug(LogLevel::Info, "Info, sessions in the pool: ", static_cast<int>(s_SessionPool.GetCount()));
     }
 #pragma endregion
 
 #pragma region Extern functions
+    // A binary without this export only has the original consume exports: BeginConsume, EndConsume,
+    // GetSps, GetPps, GetEncodedData, GetTimeStamp and GetIsKeyFrame.
+    extern "C" int32_t UNITY_INTERFACE_EXPORT GetApiVersion()
+    {
+        return k_PluginApiVersion;
+    }
+
+    // Reserves the handle of a new encoder, passed as its ID to Initialize. A handle is never valid again
+    // once its encoder is finalized. Returns 0 if there are too many encoders.
+    extern "C" int UNITY_INTERFACE_EXPORT CreateEncoderHandle()
+    {
+        const auto handle = s_EncoderMap.Reserve();
+        if (handle == 0)
+            WriteFileDebug(LogLevel::Error, "Error, too many encoders.\n");
+        return handle;
+    }
+
     extern "C" bool UNITY_INTERFACE_EXPORT EncoderIsInitialized(int* id)
     {
-        if (id && *id > 0)
-        {
-            auto encoder = s_EncoderMap.GetInstance(*id);
-            return (encoder && encoder->IsInitialized());
-        }
-        return false;
+        auto encoder = AcquireEncoder(id);
+        return (encoder && encoder->IsInitialized());
     }
 
     extern "C" int UNITY_INTERFACE_EXPORT EncoderIsCompatible()
@@ -318,71 +500,60 @@ namespace NvencPlugin
         return static_cast<int>(NvencPlugin::NvEncoder::IsEncoderAvailable());
     }
 
-    extern "C" bool UNITY_INTERFACE_EXPORT BeginConsume(int* id)
+    // The frame consumed between BeginConsume and EndConsume is the oldest one, which only EndConsume
+    // removes.
+    static EncodedFrame* GetConsumedFrame(const EncoderMap::Ref& encoder)
     {
-        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
-
-        auto currentFrame = (encoder && encoder->IsInitialized())
-            ? encoder->GetEncodedFrame()
-            : nullptr;
-
-        if (currentFrame != nullptr)
-        {
-            s_EncodedFrameMap.Add(*id, currentFrame);
-        }
-        return currentFrame != nullptr;
+        return (encoder && encoder->IsInitialized()) ? encoder->GetEncodedFrame() : nullptr;
     }
 
-    extern "C" bool UNITY_INTERFACE_EXPORT EndConsume(int* id)
+    extern "C" bool UNITY_INTERFACE_EXPORT BeginConsume(int* id)
     {
-        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
-        if (encoder && encoder->IsInitialized() && s_EncodedFrameMap[*id] != nullptr)
-        {
-            s_EncodedFrameMap.Remove(*id);
-            return encoder->RemoveEncodedFrame();
-        }
-        return false;
+        return GetConsumedFrame(AcquireEncoder(id)) != nullptr;
     }
 
-    EncodedFrame* IsEncodedFrameValid(int* id)
+    extern "C" bool UNITY_INTERFACE_EXPORT EndConsume(int* id)
     {
-        if (id && *id > 0)
-            return s_EncodedFrameMap[*id];
-
-        return nullptr;
+        auto encoder = AcquireEncoder(id);
+        return GetConsumedFrame(encoder) != nullptr && encoder->RemoveEncodedFrame();
     }
 
     extern "C" uint32_t UNITY_INTERFACE_EXPORT GetSps(int* id, uint8_t * spsOut)
     {
-        auto encodedFrame = IsEncodedFrameValid(id);
-        if (encodedFrame == nullptr)
+        auto encoder = AcquireEncoder(id);
+        auto encodedFrame = GetConsumedFrame(encoder);
+        if (encodedFrame == nullptr || encodedFrame->parameterSets == nullptr)
             return 0;
 
-        const auto sizeSpsData = encodedFrame->spsSequence.size();
+        const auto& spsSequence = encodedFrame->parameterSets->spsSequence;
+        const auto sizeSpsData = spsSequence.size();
         if (spsOut != nullptr)
         {
-            memcpy(spsOut, encodedFrame->spsSequence.data(), sizeSpsData);
+            memcpy(spsOut, spsSequence.data(), sizeSpsData);
         }
         return static_cast<uint32_t>(sizeSpsData);
     }
 
     extern "C" uint32_t UNITY_INTERFACE_EXPORT GetPps(int* id, uint8_t * ppsOut)
     {
-        auto encodedFrame = IsEncodedFrameValid(id);
-        if (encodedFrame == nullptr)
+        auto encoder = AcquireEncoder(id);
+        auto encodedFrame = GetConsumedFrame(encoder);
+        if (encodedFrame == nullptr || encodedFrame->parameterSets == nullptr)
             return 0;
 
-        const auto sizePpsData = encodedFrame->ppsSequence.size();
+        const auto& ppsSequence = encodedFrame->parameterSets->ppsSequence;
+        const auto sizePpsData = ppsSequence.size();
         if (ppsOut != nullptr)
         {
-            memcpy(ppsOut, encodedFrame->ppsSequence.data(), sizePpsData);
+            memcpy(ppsOut, ppsSequence.data(), sizePpsData);
         }
         return static_cast<uint32_t>(sizePpsData);
     }
 
     extern "C" uint32_t UNITY_INTERFACE_EXPORT GetEncodedData(int* id, uint8_t * dataOut)
     {
-        auto encodedFrame = IsEncodedFrameValid(id);
+        auto encoder = AcquireEncoder(id);
+        auto encodedFrame = GetConsumedFrame(encoder);
         if (encodedFrame == nullptr)
             return 0;
 
@@ -396,7 +567,8 @@ namespace NvencPlugin
 
     extern "C" unsigned long long int UNITY_INTERFACE_EXPORT GetTimeStamp(int* id)
     {
-        auto encodedFrame = IsEncodedFrameValid(id);
+        auto encoder = AcquireEncoder(id);
+        auto encodedFrame = GetConsumedFrame(encoder);
         if (encodedFrame == nullptr)
             return 0;
 
@@ -405,11 +577,144 @@ namespace NvencPlugin
 
     extern "C" bool UNITY_INTERFACE_EXPORT GetIsKeyFrame(int* id)
     {
-        auto encodedFrame = IsEncodedFrameValid(id);
+        auto encoder = AcquireEncoder(id);
+        auto encodedFrame = GetConsumedFrame(encoder);
         if (encodedFrame == nullptr)
             return 0;
 
         return encodedFrame->isKeyFrame;
     }
+
+    // Fills the frame descriptor and, when dataOut can hold descriptorOut->totalSize bytes, copies the
+    // VPS, SPS, PPS and image data into it and consumes the frame. Otherwise the frame is kept so that the
+    // caller can retry with a larger buffer. Returns true if the frame has been consumed. The descriptor
+    // isn't written when there is no frame.
+    extern "C" bool UNITY_INTERFACE_EXPORT ConsumeEncodedFrame(int* id,
+                                                               EncodedFrameDescriptor* descriptorOut,
+                                                               uint8_t* dataOut,
+                                                               uint32_t dataSize)
+    {
+        auto encoder = AcquireEncoder(id);
+        if (!encoder || !encoder->IsInitialized() || descriptorOut == nullptr)
+            return false;
+
+        auto encodedFrame = encoder->GetEncodedFrame();
+        if (encodedFrame == nullptr)
+            return false;
+
+        static const std::vector<uint8_t> k_Empty;
+        static const SequenceInfo k_NoSequenceInfo = {};
+        const auto& parameterSets = encodedFrame->parameterSets;
+        const auto& vps = parameterSets ? parameterSets->vpsSequence : k_Empty;
+        const auto& sps = parameterSets ? parameterSets->spsSequence : k_Empty;
+        const auto& pps = parameterSets ? parameterSets->ppsSequence : k_Empty;
+
+        auto& descriptor = *descriptorOut;
+        descriptor.timestamp = encodedFrame->timestamp;
+        descriptor.isKeyFrame = encodedFrame->isKeyFrame;
+        descriptor.sliceIndex = encodedFrame->sliceIndex;
+        descriptor.isLastSlice = encodedFrame->isLastSlice;
+        descriptor.sequenceInfo = parameterSets ? parameterSets->sequenceInfo : k_NoSequenceInfo;
+        descriptor.vpsOffset = 0;
+        descriptor.vpsSize = static_cast<uint32_t>(vps.size());
+        descriptor.spsOffset = descriptor.vpsOffset + descriptor.vpsSize;
+        descriptor.spsSize = static_cast<uint32_t>(sps.size());
+        descriptor.ppsOffset = descriptor.spsOffset + descriptor.spsSize;
+        descriptor.ppsSize = static_cast<uint32_t>(pps.size());
+        descriptor.imageOffset = descriptor.ppsOffset + descriptor.ppsSize;
+        descriptor.imageSize = static_cast<uint32_t>(encodedFrame->imageData.size());
+        descriptor.totalSize = descriptor.imageOffset + descriptor.imageSize;
+
+        const auto nalUnitCount = std::min<size_t>(encodedFrame->nalUnits.size(), k_MaxNalUnitCount);
+        descriptor.nalUnitCount = static_cast<uint32_t>(nalUnitCount);
+        std::copy_n(encodedFrame->nalUnits.begin(), nalUnitCount, descriptor.nalUnits);
+
+        if (dataOut == nullptr || dataSize < descriptor.totalSize)
+            return false;
+
+        memcpy(dataOut + descriptor.vpsOffset, vps.data(), descriptor.vpsSize);
+        memcpy(dataOut + descriptor.spsOffset, sps.data(), descriptor.spsSize);
+        memcpy(dataOut + descriptor.ppsOffset, pps.data(), descriptor.ppsSize);
+        memcpy(dataOut + descriptor.imageOffset, encodedFrame->imageData.data(), descriptor.imageSize);
+
+        return encoder->RemoveEncodedFrame();
+    }
+
+    // Lends the oldest encoded frame without copying it: the pointers of the view are owned by the plugin
+    // and stay valid until ReleaseEncodedFrame is called with its token. The next frame can only be
+    // acquired once the lent one is released.
+    extern "C" bool UNITY_INTERFACE_EXPORT AcquireEncodedFrame(int* id, EncodedFrameView* viewOut)
+    {
+        auto encoder = AcquireEncoder(id);
+        if (!encoder || !encoder->IsInitialized() || viewOut == nullptr)
+            return false;
+
+        return encoder->AcquireEncodedFrame(*viewOut);
+    }
+
+    extern "C" bool UNITY_INTERFACE_EXPORT ReleaseEncodedFrame(int* id, unsigned long long int token)
+    {
+        auto encoder = AcquireEncoder(id);
+        return encoder && encoder->IsInitialized() && encoder->ReleaseEncodedFrame(token);
+    }
+
+    // Forces the next frame of the encoder to be an IDR frame, e.g. when a client joins the stream or
+    // reports a loss.
+    extern "C" bool UNITY_INTERFACE_EXPORT RequestKeyFrame(int* id)
+    {
+        auto encoder = AcquireEncoder(id);
+        if (!encoder || !encoder->IsInitialized())
+            return false;
+
+        encoder->RequestKeyFrame();
+        return true;
+    }
+
+    // A client lost the frames encoded from the timestamp onward, e.g. reported by an RTCP NACK: the
+    // next frame references a frame the client still has instead of being an IDR frame when possible.
+    extern "C" bool UNITY_INTERFACE_EXPORT InvalidateReferenceFrames(int* id, unsigned long long int timeStamp)
+    {
+        auto encoder = AcquireEncoder(id);
+        if (!encoder || !encoder->IsInitialized())
+            return false;
+
+        encoder->InvalidateReferenceFrames(timeStamp);
+        return true;
+    }
+
+    extern "C" unsigned long long int UNITY_INTERFACE_EXPORT GetDroppedFrameCount(int* id)
+    {
+        auto encoder = AcquireEncoder(id);
+        return encoder ? encoder->GetDroppedFrameCount() : 0;
+    }
+
+    extern "C" bool UNITY_INTERFACE_EXPORT GetCompletionThreadLoad(int* id, CompletionThreadLoad* loadOut)
+    {
+        auto encoder = AcquireEncoder(id);
+        if (!encoder || loadOut == nullptr)
+            return false;
+
+        *loadOut = encoder->GetCompletionThreadLoad();
+        return true;
+    }
+
+    // Per-stage latencies and throughput of the encoder since it was created. Can be polled at any
+    // time from any thread.
+    extern "C" bool UNITY_INTERFACE_EXPORT GetEncoderStats(int* id, EncoderStats* statsOut)
+    {
+        auto encoder = AcquireEncoder(id);
+        if (!encoder || statsOut == nullptr)
+            return false;
+
+        encoder->GetStats(*statsOut);
+        return true;
+    }
+
+    // Sets the minimum level of the messages written to the debug log: 0 Debug, 1 Info, 2 Warning,
+    // 3 Error, 4 None.
+    extern "C" void UNITY_INTERFACE_EXPORT SetLogLevel(int level)
+    {
+        SetDebugLogLevel(level);
+    }
 #pragma endregion
 }
@@ -1,6 +0,0 @@
-#include "ObjectIDMap.h"
-
-namespace NvencPlugin
-{
-
-}
@@ -1,4 +1,4 @@
-#include "RGBToNV12ConverterD3D11.h"
+#include "PluginUtils.h"
 
 // Disable the 'unscoped enum' Nvenc warnings
 #pragma warning(disable : 26812)
@@ -7,52 +7,50 @@ namespace NvencPlugin
 {
     static const std::string k_FileName = "C:/NvencLogs/Nvenc_debug_file.txt";
 
-    void WriteFileDebug(const char* const message, const bool append)
+    void StartLog()
     {
 #ifdef DEBUG_MODE
-        std::ofstream myfile;
-
-        if (append)
-        {
-            myfile.open(k_FileName, std::ios_base::app | std::ios_base::out);
-        }
-        else
-        {
-            myfile.open(k_FileName);
-        }
-
-        myfile << message;
-        myfile.close();
+        NativeLog::SetLevel(NativeLog::Level::Debug);
 #endif
+        NativeLog::Start(k_FileName, false);
     }
 
-    void WriteFileDebug(const char* const message, int value, const bool append)
+    void StopLog()
     {
-#ifdef DEBUG_MODE
-        std::ofstream myfile;
-
-        if (append)
-        {
-            myfile.open(k_FileName, std::ios_base::app | std::ios_base::out);
-        }
-        else
-        {
-            myfile.open(k_FileName);
-        }
-
-        myfile << message << value << "\n";
-        myfile.close();
-#endif
+        NativeLog::Stop();
     }
 
-    void WriteFileDebug(const char* const message, NVENCSTATUS status, const bool append)
+    void SetDebugLogLevel(int level)
     {
-#ifdef DEBUG_MODE
-        std::ostringstream errorLog;
-        WriteFileDebug(message, append);
-        errorLog << "Error is: " << status << "\n";
-        auto test = errorLog.str();
-        WriteFileDebug(test.c_str(), append);
-#endif
+        NativeLog::SetLevel(static_cast<NativeLog::Level>(level));
+    }
+
+    void WriteFileDebug(const char* const message, const bool /*append*/)
+    {
+        NativeLog::Write(LogLevel::Debug, message);
+    }
+
+    void WriteFileDebug(const char* const message, int value, const bool /*append*/)
+    {
+        NativeLog::Write(LogLevel::Debug, message, value);
+    }
+
+    void WriteFileDebug(LogLevel level, const char* const message, const bool /*append*/)
+    {
+        NativeLog::Write(level, message);
+    }
+
+    void WriteFileDebug(LogLevel level, const char* const message, int value, const bool /*append*/)
+    {
+        NativeLog::Write(level, message, value);
+    }
+
+    void WriteFileDebug(LogLevel level, const char* const message, NVENCSTATUS status, const bool /*append*/)
+    {
+        if (!NativeLog::IsEnabled(level))
+            return;
+
+        NativeLog::Write(level, message);
+        NativeLog::Write(level, "Error is: ", static_cast<int64_t>(status));
     }
 }
@@ -0,0 +1,293 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "AvccConverter.hpp"
+#include "NalUnits.h"
+#include "TimecodeSei.hpp"
+
+// Checks and times the AVCC to Annex-B conversion of the VideoToolbox plugin, which doesn't depend on
+// VideoToolbox. Each access unit is converted the way the output callback used to, NAL unit by NAL unit
+// into a growing vector, and with the converter into a reused buffer; both must give the same bytes and
+// NAL units. With --sample, the access units are read from files holding the data of a VideoToolbox
+// output sample buffer (CMBlockBufferCopyDataBytes), otherwise a synthetic key frame is used.
+//
+// The timecode SEI message of the VideoToolbox plugin must also be the same as the one of the NVENC plugin.
+//
+// Returns a non-zero exit code if a check fails, so it can be used as a CI smoke test.
+
+using namespace MacOsEncodingPlugin;
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+    struct BenchmarkOptions
+    {
+        int                      iterations = 100;
+        int                      codec = 0;
+        std::vector<const char*> samplePaths;
+    };
+
+    bool ParseOptions(int argc, char** argv, BenchmarkOptions& options)
+    {
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            const auto value = std::atoi(argv[i + 1]);
+            if (std::strcmp(argv[i], "--sample") == 0)
+                options.samplePaths.push_back(argv[i + 1]);
+            else if (std::strcmp(argv[i], "--iterations") == 0)
+                options.iterations = value;
+            else if (std::strcmp(argv[i], "--codec") == 0)
+                options.codec = value;
+            else
+                return false;
+        }
+        return (argc % 2) == 1 && options.iterations > 0 && (options.codec == 0 || options.codec == 1);
+    }
+
+    bool ReadSample(const char* path, std::vector<uint8_t>& data)
+    {
+        auto file = std::fopen(path, "rb");
+        if (file == nullptr)
+            return false;
+
+        data.clear();
+        uint8_t buffer[65536];
+        size_t count;
+        while ((count = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+            data.insert(data.end(), buffer, buffer + count);
+
+        std::fclose(file);
+        return !data.empty();
+    }
+
+    void AppendNalUnit(std::vector<uint8_t>& data, uint8_t header, uint32_t size, int lengthSize, std::mt19937& random)
+    {
+        for (int i = lengthSize - 1; i >= 0; --i)
+            data.push_back(static_cast<uint8_t>(size >> (8 * i)));
+
+        data.push_back(header);
+        for (uint32_t i = 1; i < size; ++i)
+            data.push_back(static_cast<uint8_t>(random()));
+    }
+
+    // An SEI and 4 slices of an IDR frame of about 1 MB, like VideoToolbox outputs at high bit rates.
+    std::vector<uint8_t> CreateSyntheticSample(VideoCodec codec, int lengthSize, uint32_t sliceSize)
+    {
+        std::mt19937 random(1234);
+        std::vector<uint8_t> data;
+
+        const auto isHevc = codec == VideoCodec::HEVC;
+        AppendNalUnit(data, isHevc ? 0x4E : 0x06, 24, lengthSize, random);
+        for (int i = 0; i < 4; ++i)
+            AppendNalUnit(data, isHevc ? 0x26 : 0x65, sliceSize, lengthSize, random);
+        return data;
+    }
+
+    // The conversion of the output callback before the converter, 4 bytes length prefixes only.
+    void ConvertByInsertion(VideoCodec codec, const uint8_t* data, size_t size,
+                            std::vector<uint8_t>& output, std::vector<NalUnitEntry>& nalUnits)
+    {
+        static const uint8_t k_AnnexBHeaderBytes[4] = { 0, 0, 0, 1 };
+
+        output.clear();
+        nalUnits.clear();
+        size_t remaining = size;
+        while (remaining > 0)
+        {
+            const uint32_t packetSize = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+            output.insert(output.end(), &k_AnnexBHeaderBytes[0], &k_AnnexBHeaderBytes[4]);
+            nalUnits.push_back({ static_cast<uint32_t>(output.size()), packetSize, GetNalUnitType(codec, data[4]) });
+            output.insert(output.end(), data + 4, data + 4 + packetSize);
+
+            remaining -= packetSize + 4;
+            data += packetSize + 4;
+        }
+    }
+
+    bool IsSameNalUnits(const std::vector<NalUnitEntry>& a, const std::vector<NalUnitEntry>& b)
+    {
+        if (a.size() != b.size())
+            return false;
+
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            if (a[i].offset != b[i].offset || a[i].size != b[i].size || a[i].type != b[i].type)
+                return false;
+        }
+        return true;
+    }
+
+    int CheckShortLengthPrefixes(VideoCodec codec)
+    {
+        int failedChecks = 0;
+        std::vector<uint8_t> output;
+        std::vector<NalUnitEntry> nalUnits;
+        std::vector<uint8_t> expected;
+        std::vector<NalUnitEntry> expectedNalUnits;
+
+        const auto reference = CreateSyntheticSample(codec, 4, 300);
+        ConvertByInsertion(codec, reference.data(), reference.size(), expected, expectedNalUnits);
+
+        for (int lengthSize : { 1, 2 })
+        {
+            // The slices don't fit in a 1 byte length prefix.
+            const auto sliceSize = lengthSize == 1 ? 200u : 300u;
+            const auto sample = CreateSyntheticSample(codec, lengthSize, sliceSize);
+            if (!ConvertAvccToAnnexB(codec, sample.data(), sample.size(), lengthSize, output, nalUnits)
+                || nalUnits.size() != 5 || nalUnits[1].size != sliceSize
+                || output.size() != sample.size() + 5 * (4 - lengthSize))
+            {
+                std::printf("Error, conversion of %d byte(s) length prefixes failed.\n", lengthSize);
+                failedChecks++;
+            }
+        }
+
+        // Same NAL units as with 4 bytes prefixes.
+        const auto sample = CreateSyntheticSample(codec, 2, 300);
+        ConvertAvccToAnnexB(codec, sample.data(), sample.size(), 2, output, nalUnits);
+        if (output != expected || !IsSameNalUnits(nalUnits, expectedNalUnits))
+        {
+            std::printf("Error, 2 bytes length prefixes give a different access unit.\n");
+            failedChecks++;
+        }
+
+        // A length past the end of the data, an empty NAL unit and a truncated prefix.
+        auto truncated = reference;
+        truncated.pop_back();
+        const std::vector<uint8_t> empty = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x65 };
+        const std::vector<uint8_t> partialPrefix = { 0x00, 0x00, 0x00, 0x01, 0x65, 0x00, 0x00 };
+        if (ConvertAvccToAnnexB(codec, truncated.data(), truncated.size(), 4, output, nalUnits)
+            || ConvertAvccToAnnexB(codec, empty.data(), empty.size(), 4, output, nalUnits)
+            || ConvertAvccToAnnexB(codec, partialPrefix.data(), partialPrefix.size(), 4, output, nalUnits)
+            || ConvertAvccToAnnexB(codec, truncated.data(), truncated.size(), 2, output, nalUnits)
+            || ConvertAvccToAnnexB(codec, reference.data(), reference.size(), 3, output, nalUnits))
+        {
+            std::printf("Error, malformed access unit accepted.\n");
+            failedChecks++;
+        }
+        return failedChecks;
+    }
+
+    int CheckTimecodeSei(VideoCodec codec)
+    {
+        // The zero bytes of the timestamp need emulation prevention bytes.
+        const TimecodeSei sei = { 0x8A173B1D, 0x0000000100000002ull, 3 };
+        const NvencPlugin::TimecodeSei nvencSei = { sei.timecode, sei.timestamp, sei.frameCount };
+
+        const auto sample = CreateSyntheticSample(codec, 4, 300);
+        std::vector<uint8_t> output;
+        std::vector<NalUnitEntry> nalUnits;
+        ConvertAvccToAnnexB(codec, sample.data(), sample.size(), 4, output, nalUnits);
+
+        std::vector<uint8_t> expected;
+        std::vector<NvencPlugin::NalUnitEntry> expectedNalUnits;
+        NvencPlugin::CopyWithTimecodeSei(static_cast<NvencPlugin::VideoCodec>(codec), output.data(), static_cast<uint32_t>(output.size()),
+                                         nvencSei, expected, expectedNalUnits);
+
+        auto isSame = InsertTimecodeSei(codec, sei, output, nalUnits) && output == expected && nalUnits.size() == expectedNalUnits.size();
+        for (size_t i = 0; isSame && i < nalUnits.size(); ++i)
+        {
+            isSame = nalUnits[i].offset == expectedNalUnits[i].offset && nalUnits[i].size == expectedNalUnits[i].size
+                && nalUnits[i].type == expectedNalUnits[i].type;
+        }
+
+        // After the SEI of the encoder, before the first slice.
+        if (!isSame || nalUnits.size() != 6 || nalUnits[1].type != (codec == VideoCodec::HEVC ? k_HevcNalPrefixSei : k_H264NalSei))
+        {
+            std::printf("Error, the timecode SEI message differs from the NVENC plugin one.\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    double MicrosecondsPerIteration(Clock::time_point start, int iterations)
+    {
+        return std::chrono::duration<double, std::micro>(Clock::now() - start).count() / iterations;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        std::printf("Usage: %s [--sample PATH]... [--iterations N] [--codec 0 h264|1 hevc]\n", argv[0]);
+        return 2;
+    }
+
+    const auto codec = static_cast<VideoCodec>(options.codec);
+
+    std::vector<std::vector<uint8_t>> samples;
+    for (auto path : options.samplePaths)
+    {
+        samples.emplace_back();
+        if (!ReadSample(path, samples.back()))
+        {
+            std::printf("Error, can't read %s.\n", path);
+            return 2;
+        }
+    }
+    if (samples.empty())
+        samples.push_back(CreateSyntheticSample(codec, 4, 256 * 1024));
+
+    auto failedChecks = CheckShortLengthPrefixes(codec);
+    failedChecks += CheckTimecodeSei(codec);
+
+    std::vector<uint8_t> expected;
+    std::vector<NalUnitEntry> expectedNalUnits;
+    std::vector<uint8_t> output;
+    std::vector<NalUnitEntry> nalUnits;
+    for (size_t i = 0; i < samples.size(); ++i)
+    {
+        const auto& sample = samples[i];
+
+        ConvertByInsertion(codec, sample.data(), sample.size(), expected, expectedNalUnits);
+        if (!ConvertAvccToAnnexB(codec, sample.data(), sample.size(), 4, output, nalUnits)
+            || output != expected || !IsSameNalUnits(nalUnits, expectedNalUnits))
+        {
+            std::printf("Error, sample %zu is converted differently.\n", i);
+            failedChecks++;
+            continue;
+        }
+
+        // The output callback used a new vector for every frame.
+        auto start = Clock::now();
+        for (int iteration = 0; iteration < options.iterations; ++iteration)
+        {
+            std::vector<uint8_t> frameData;
+            ConvertByInsertion(codec, sample.data(), sample.size(), frameData, expectedNalUnits);
+        }
+        const auto insertionUs = MicrosecondsPerIteration(start, options.iterations);
+
+        // The converter writes into a pooled buffer, which keeps its capacity.
+        start = Clock::now();
+        for (int iteration = 0; iteration < options.iterations; ++iteration)
+            ConvertAvccToAnnexB(codec, sample.data(), sample.size(), 4, output, nalUnits);
+        const auto converterUs = MicrosecondsPerIteration(start, options.iterations);
+
+        // The timecode SEI message is inserted in the converted access unit.
+        const TimecodeSei sei = { 0x80000000, 1, 1 };
+        start = Clock::now();
+        for (int iteration = 0; iteration < options.iterations; ++iteration)
+        {
+            ConvertAvccToAnnexB(codec, sample.data(), sample.size(), 4, output, nalUnits);
+            InsertTimecodeSei(codec, sei, output, nalUnits);
+        }
+        const auto seiUs = MicrosecondsPerIteration(start, options.iterations);
+
+        std::printf("Sample %zu: %zu bytes, %zu NAL units, insertion %.1f us, converter %.1f us (%.2f GB/s), with SEI %.1f us\n",
+                    i, sample.size(), nalUnits.size(), insertionUs, converterUs,
+                    sample.size() / (converterUs * 1000.0), seiUs);
+    }
+
+    if (failedChecks > 0)
+    {
+        std::printf("%d checks failed.\n", failedChecks);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,517 @@
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "BitReader.h"
+#include "NalUnits.h"
+#include "ParameterSetParser.h"
+
+// Unit tests of the bitstream helpers, which don't need the NVENC SDK nor a GPU. Returns a non-zero
+// exit code if a check fails.
+
+using namespace NvencPlugin;
+
+namespace
+{
+    int s_FailedChecks = 0;
+
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            s_FailedChecks++; \
+        } \
+    } while (false)
+
+    void TestNalUnitTypes()
+    {
+        CHECK(GetNalUnitType(VideoCodec::H264, 0x67) == k_H264NalSps);
+        CHECK(GetNalUnitType(VideoCodec::H264, 0x68) == k_H264NalPps);
+        CHECK(GetNalUnitType(VideoCodec::H264, 0x65) == k_H264NalIdr);
+        CHECK(GetNalUnitType(VideoCodec::HEVC, 0x40) == k_HevcNalVps);
+        CHECK(GetNalUnitType(VideoCodec::HEVC, 0x42) == k_HevcNalSps);
+        CHECK(GetNalUnitType(VideoCodec::HEVC, 0x44) == k_HevcNalPps);
+        CHECK(GetNalUnitType(VideoCodec::HEVC, 0x26) == k_HevcNalIdrWRadl);
+    }
+
+    void TestFindNalUnits()
+    {
+        // 4 and 3 bytes start codes, the last NAL unit runs to the end of the buffer.
+        const std::vector<uint8_t> data =
+        {
+            0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0x1F,
+            0x00, 0x00, 0x01, 0x68, 0xCE,
+            0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84, 0x00
+        };
+
+        std::vector<NalUnitEntry> nalUnits;
+        FindNalUnits(VideoCodec::H264, data.data(), static_cast<uint32_t>(data.size()), nalUnits);
+
+        CHECK(nalUnits.size() == 3);
+        if (nalUnits.size() != 3)
+            return;
+
+        CHECK(nalUnits[0].offset == 4 && nalUnits[0].size == 3 && nalUnits[0].type == k_H264NalSps);
+        CHECK(nalUnits[1].offset == 10 && nalUnits[1].size == 2 && nalUnits[1].type == k_H264NalPps);
+        CHECK(nalUnits[2].offset == 16 && nalUnits[2].size == 4 && nalUnits[2].type == k_H264NalIdr);
+
+        // A start code at the very end has no payload.
+        const std::vector<uint8_t> truncated = { 0x00, 0x00, 0x01 };
+        FindNalUnits(VideoCodec::H264, truncated.data(), static_cast<uint32_t>(truncated.size()), nalUnits);
+        CHECK(nalUnits.empty());
+    }
+
+    // The byte by byte scan the vectorized one must match.
+    void FindNalUnitsReference(const std::vector<uint8_t>& data, std::vector<NalUnitEntry>& nalUnits)
+    {
+        nalUnits.clear();
+
+        const auto size = static_cast<uint32_t>(data.size());
+        for (uint32_t i = 0; i + 3 <= size; i++)
+        {
+            if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1)
+                continue;
+
+            if (!nalUnits.empty())
+                nalUnits.back().size = ((i > 0 && data[i - 1] == 0) ? i - 1 : i) - nalUnits.back().offset;
+
+            if (i + 3 < size)
+                nalUnits.push_back({ i + 3, size - i - 3, GetNalUnitType(VideoCodec::H264, data[i + 3]) });
+            i += 2;
+        }
+    }
+
+    bool IsSameNalUnits(const std::vector<NalUnitEntry>& a, const std::vector<NalUnitEntry>& b)
+    {
+        if (a.size() != b.size())
+            return false;
+
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            if (a[i].offset != b[i].offset || a[i].size != b[i].size || a[i].type != b[i].type)
+                return false;
+        }
+        return true;
+    }
+
+    void TestFindNalUnitsBlockBoundaries()
+    {
+        // Start codes at every position around the 16 and 32 bytes blocks of the vector loops,
+        // including the last bytes that only the scalar loop reads.
+        std::vector<NalUnitEntry> nalUnits;
+        std::vector<NalUnitEntry> expected;
+        for (uint32_t size = 3; size <= 80; size++)
+        {
+            for (uint32_t position = 0; position + 3 <= size; position++)
+            {
+                std::vector<uint8_t> data(size, 0xFF);
+                data[position] = 0x00;
+                data[position + 1] = 0x00;
+                data[position + 2] = 0x01;
+
+                FindNalUnits(VideoCodec::H264, data.data(), size, nalUnits);
+                FindNalUnitsReference(data, expected);
+                CHECK(IsSameNalUnits(nalUnits, expected));
+            }
+        }
+    }
+
+    void TestFindNalUnitsRandom()
+    {
+        // Mostly zeros and ones, so that start codes, 4 bytes start codes and near misses are frequent.
+        std::mt19937 random(1234);
+        std::uniform_int_distribution<int> byteValue(0, 3);
+        std::uniform_int_distribution<uint32_t> sizes(0, 4096);
+
+        std::vector<NalUnitEntry> nalUnits;
+        std::vector<NalUnitEntry> expected;
+        for (int iteration = 0; iteration < 200; iteration++)
+        {
+            std::vector<uint8_t> data(sizes(random));
+            for (auto& value : data)
+                value = static_cast<uint8_t>(byteValue(random) == 3 ? 0x65 : byteValue(random) % 2);
+
+            FindNalUnits(VideoCodec::H264, data.data(), static_cast<uint32_t>(data.size()), nalUnits);
+            FindNalUnitsReference(data, expected);
+            CHECK(IsSameNalUnits(nalUnits, expected));
+        }
+    }
+
+    void TestExtractH264ParameterSets()
+    {
+        const std::vector<uint8_t> data =
+        {
+            0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xC0, 0x28,
+            0x00, 0x00, 0x00, 0x01, 0x68, 0xCE, 0x3C, 0x80
+        };
+
+        ParameterSets parameterSets;
+        CHECK(ExtractParameterSets(VideoCodec::H264, data.data(), static_cast<uint32_t>(data.size()), parameterSets));
+        CHECK(parameterSets.vpsSequence.empty());
+        CHECK((parameterSets.spsSequence == std::vector<uint8_t>{ 0x67, 0x42, 0xC0, 0x28 }));
+        CHECK((parameterSets.ppsSequence == std::vector<uint8_t>{ 0x68, 0xCE, 0x3C, 0x80 }));
+
+        // The SPS is truncated, which only leaves the sequence info invalid.
+        CHECK(parameterSets.sequenceInfo.isValid == 0);
+
+        // The PPS is missing.
+        CHECK(!ExtractParameterSets(VideoCodec::H264, data.data(), 8, parameterSets));
+    }
+
+    void TestExtractHevcParameterSets()
+    {
+        const std::vector<uint8_t> data =
+        {
+            0x00, 0x00, 0x00, 0x01, 0x40, 0x01, 0x0C, 0x01,
+            0x00, 0x00, 0x01, 0x42, 0x01, 0x01, 0x01,
+            0x00, 0x00, 0x00, 0x01, 0x44, 0x01, 0xC1, 0x72
+        };
+
+        ParameterSets parameterSets;
+        CHECK(ExtractParameterSets(VideoCodec::HEVC, data.data(), static_cast<uint32_t>(data.size()), parameterSets));
+        CHECK((parameterSets.vpsSequence == std::vector<uint8_t>{ 0x40, 0x01, 0x0C, 0x01 }));
+        CHECK((parameterSets.spsSequence == std::vector<uint8_t>{ 0x42, 0x01, 0x01, 0x01 }));
+        CHECK((parameterSets.ppsSequence == std::vector<uint8_t>{ 0x44, 0x01, 0xC1, 0x72 }));
+
+        // Parsed as H.264, the same NAL units are neither SPS nor PPS.
+        CHECK(!ExtractParameterSets(VideoCodec::H264, data.data(), static_cast<uint32_t>(data.size()), parameterSets));
+
+        // An HEVC stream needs its VPS.
+        CHECK(!ExtractParameterSets(VideoCodec::HEVC, data.data() + 8, static_cast<uint32_t>(data.size() - 8), parameterSets));
+    }
+
+    void TestRemoveEmulationPrevention()
+    {
+        const std::vector<uint8_t> data = { 0x00, 0x00, 0x03, 0x01, 0x00, 0x00, 0x03, 0x00, 0x03, 0x00, 0x00, 0x03 };
+        std::vector<uint8_t> rbsp;
+        RemoveEmulationPrevention(data.data(), data.size(), rbsp);
+        CHECK((rbsp == std::vector<uint8_t>{ 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00 }));
+    }
+
+    void TestBitReader()
+    {
+        // ue 0 | ue 1 | se -1 | ue 3 | se -2 | 1, then the trailing bits.
+        const std::vector<uint8_t> data = { 0xA6, 0x42, 0xE0 };
+        BitReader reader(data.data(), data.size());
+        CHECK(reader.ReadUe() == 0);
+        CHECK(reader.ReadUe() == 1);
+        CHECK(reader.ReadSe() == -1);
+        CHECK(reader.ReadUe() == 3);
+        CHECK(reader.ReadSe() == -2);
+        CHECK(reader.ReadFlag());
+        CHECK(reader.IsAtTrailingBits());
+        CHECK(!reader.HasError());
+
+        // Past the end.
+        CHECK(reader.ReadBits(16) == 0x8000);
+        CHECK(reader.HasError());
+    }
+
+    const std::vector<uint8_t> k_H264Pps = { 0x68, 0xCE, 0x3C, 0x80 };
+
+    // High 4.2, 1920x1088 cropped to 1080, 60 fps VUI timing (2 ticks per frame) and a bitstream
+    // restriction without reordering. The timing holds an emulation prevention byte.
+    const std::vector<uint8_t> k_H264HighSps =
+    {
+        0x67, 0x64, 0x00, 0x2A, 0xAC, 0xDA, 0x01, 0xE0, 0x08, 0x9F, 0x96, 0x10,
+        0x00, 0x00, 0x03, 0x00, 0x10, 0x00, 0x00, 0x07, 0x88, 0xDA, 0x08, 0x84, 0x6A
+    };
+
+    // Constrained baseline 3.0, 640x368 cropped to 360, without VUI.
+    const std::vector<uint8_t> k_H264BaselineSps = { 0x67, 0x42, 0xC0, 0x1E, 0xDA, 0x02, 0x80, 0xBF, 0xE5, 0x40 };
+
+    // Main 3.1 1280x720 with 4 reference frames, without VUI.
+    const std::vector<uint8_t> k_H264MainSps = { 0x67, 0x4D, 0x40, 0x1F, 0xEC, 0xA0, 0x28, 0x02, 0xDC, 0x80 };
+
+    // Main 4.1 1920x1080 at 60 Hz with HRD parameters in the VUI, without B-frames (x265).
+    const std::vector<uint8_t> k_HevcVps =
+    {
+        0x40, 0x01, 0x0C, 0x01, 0xFF, 0xFF, 0x01, 0x60, 0x00, 0x00, 0x03, 0x00,
+        0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x7B, 0xBA, 0x02, 0x40
+    };
+    const std::vector<uint8_t> k_HevcSps =
+    {
+        0x42, 0x01, 0x01, 0x01, 0x60, 0x00, 0x00, 0x03, 0x00, 0x90, 0x00, 0x00,
+        0x03, 0x00, 0x00, 0x03, 0x00, 0x7B, 0xA0, 0x03, 0xC0, 0x80, 0x11, 0x07,
+        0xCB, 0x96, 0xE9, 0x29, 0x30, 0xB8, 0x04, 0x00, 0x00, 0x0F, 0xA0, 0x00,
+        0x03, 0xA9, 0x80, 0x20
+    };
+    const std::vector<uint8_t> k_HevcPps = { 0x44, 0x01, 0xC0, 0x71, 0x83, 0x12 };
+
+    // Main 3.1 1280x720 at 29.97 Hz with 3 B-frames (x265).
+    const std::vector<uint8_t> k_HevcBFramesVps =
+    {
+        0x40, 0x01, 0x0C, 0x01, 0xFF, 0xFF, 0x01, 0x60, 0x00, 0x00, 0x03, 0x00,
+        0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x5D, 0x95, 0x94, 0x09
+    };
+    const std::vector<uint8_t> k_HevcBFramesSps =
+    {
+        0x42, 0x01, 0x01, 0x01, 0x60, 0x00, 0x00, 0x03, 0x00, 0x90, 0x00, 0x00,
+        0x03, 0x00, 0x00, 0x03, 0x00, 0x5D, 0xA0, 0x02, 0x80, 0x80, 0x2D, 0x16,
+        0x59, 0x59, 0x64, 0x93, 0x2B, 0x80, 0x40, 0x00, 0x00, 0xFA, 0x40, 0x00,
+        0x1D, 0x4C, 0x02
+    };
+    const std::vector<uint8_t> k_HevcBFramesPps = { 0x44, 0x01, 0xC1, 0x72, 0xB4, 0x62, 0x40 };
+
+    SequenceInfo ParseH264SequenceInfo(const std::vector<uint8_t>& sps)
+    {
+        SequenceInfo info;
+        CHECK(ParseSequenceInfo(VideoCodec::H264, nullptr, 0,
+                                sps.data(), static_cast<uint32_t>(sps.size()),
+                                k_H264Pps.data(), static_cast<uint32_t>(k_H264Pps.size()), info));
+        return info;
+    }
+
+    void TestParseH264Sps()
+    {
+        auto info = ParseH264SequenceInfo(k_H264HighSps);
+        CHECK(info.isValid == 1);
+        CHECK(info.profileIdc == 100 && info.profileCompatibility == 0 && info.levelIdc == 42);
+        CHECK(info.width == 1920 && info.height == 1080);
+        CHECK(info.numUnitsInTick == 1 && info.timeScale == 120);
+        CHECK(info.maxNumReorderFrames == 0 && info.maxDecFrameBuffering == 1);
+
+        info = ParseH264SequenceInfo(k_H264BaselineSps);
+        CHECK(info.profileIdc == 66 && info.profileCompatibility == 0xC0 && info.levelIdc == 30);
+        CHECK(info.width == 640 && info.height == 360);
+        CHECK(info.timeScale == 0);
+
+        // Without VUI, the reordering is inferred from the DPB size of the level.
+        const auto& main = k_H264MainSps;
+        info = ParseH264SequenceInfo(main);
+        CHECK(info.width == 1280 && info.height == 720);
+        CHECK(info.maxNumReorderFrames == 5 && info.maxDecFrameBuffering == 5);
+
+        uint32_t spsId = 1;
+        CHECK(ParseSps(VideoCodec::H264, main.data(), static_cast<uint32_t>(main.size()), info, spsId) && spsId == 0);
+
+        // Truncated, and with bits set past the stop bit.
+        CHECK(!ParseSps(VideoCodec::H264, k_H264HighSps.data(), static_cast<uint32_t>(k_H264HighSps.size() - 3), info, spsId));
+        auto extended = main;
+        extended.back() = 0xC0;
+        CHECK(!ParseSps(VideoCodec::H264, extended.data(), static_cast<uint32_t>(extended.size()), info, spsId));
+
+        // Not an SPS, and the SPS given as PPS.
+        CHECK(!ParseSps(VideoCodec::H264, k_H264Pps.data(), static_cast<uint32_t>(k_H264Pps.size()), info, spsId));
+        CHECK(!ParseSequenceInfo(VideoCodec::H264, nullptr, 0, main.data(), static_cast<uint32_t>(main.size()),
+                                 main.data(), static_cast<uint32_t>(main.size()), info));
+        CHECK(info.isValid == 0);
+    }
+
+    SequenceInfo ParseHevcSequenceInfo(const std::vector<uint8_t>& vps, const std::vector<uint8_t>& sps, const std::vector<uint8_t>& pps)
+    {
+        SequenceInfo info;
+        CHECK(ParseSequenceInfo(VideoCodec::HEVC,
+                                vps.data(), static_cast<uint32_t>(vps.size()),
+                                sps.data(), static_cast<uint32_t>(sps.size()),
+                                pps.data(), static_cast<uint32_t>(pps.size()), info));
+        return info;
+    }
+
+    void TestParseHevcSps()
+    {
+        auto info = ParseHevcSequenceInfo(k_HevcVps, k_HevcSps, k_HevcPps);
+        CHECK(info.isValid == 1);
+        CHECK(info.profileSpace == 0 && info.tierFlag == 0 && info.profileIdc == 1 && info.levelIdc == 123);
+        CHECK(info.profileCompatibility == 0x60000000);
+        CHECK(info.width == 1920 && info.height == 1080);
+        CHECK(info.numUnitsInTick == 1000 && info.timeScale == 60000);
+        CHECK(info.maxNumReorderFrames == 0);
+
+        info = ParseHevcSequenceInfo(k_HevcBFramesVps, k_HevcBFramesSps, k_HevcBFramesPps);
+        CHECK(info.levelIdc == 93);
+        CHECK(info.width == 1280 && info.height == 720);
+        CHECK(info.numUnitsInTick == 1001 && info.timeScale == 30000);
+        CHECK(info.maxNumReorderFrames == 2 && info.maxDecFrameBuffering == 5);
+
+        // The VPS is needed, and a truncated SPS is rejected.
+        const auto& sps = k_HevcSps;
+        CHECK(!ParseSequenceInfo(VideoCodec::HEVC, nullptr, 0, sps.data(), static_cast<uint32_t>(sps.size()),
+                                 k_HevcPps.data(), static_cast<uint32_t>(k_HevcPps.size()), info));
+        uint32_t spsId = 0;
+        CHECK(!ParseSps(VideoCodec::HEVC, sps.data(), static_cast<uint32_t>(sps.size() - 4), info, spsId));
+    }
+
+    SequenceInfo RewriteSps(VideoCodec codec, const std::vector<uint8_t>& sps, std::vector<uint8_t>& rewritten)
+    {
+        SequenceInfo info = {};
+        uint32_t spsId = 0;
+        CHECK(RewriteSpsForLowLatency(codec, sps.data(), static_cast<uint32_t>(sps.size()), rewritten));
+        CHECK(ParseSps(codec, rewritten.data(), static_cast<uint32_t>(rewritten.size()), info, spsId));
+        return info;
+    }
+
+    void TestRewriteH264Sps()
+    {
+        // Already restricted the same way: the SPS is unchanged, emulation prevention included.
+        std::vector<uint8_t> rewritten;
+        auto info = RewriteSps(VideoCodec::H264, k_H264HighSps, rewritten);
+        CHECK(rewritten == k_H264HighSps);
+
+        // A VUI is added, the DPB keeps room for the 4 reference frames.
+        info = RewriteSps(VideoCodec::H264, k_H264MainSps, rewritten);
+        CHECK(info.width == 1280 && info.height == 720 && info.levelIdc == 31);
+        CHECK(info.maxNumReorderFrames == 0 && info.maxDecFrameBuffering == 4);
+        CHECK(std::equal(k_H264MainSps.begin(), k_H264MainSps.end() - 2, rewritten.begin()));
+
+        info = RewriteSps(VideoCodec::H264, k_H264BaselineSps, rewritten);
+        CHECK(info.width == 640 && info.height == 360 && info.timeScale == 0);
+        CHECK(info.maxNumReorderFrames == 0 && info.maxDecFrameBuffering == 1);
+
+        // Rewriting is idempotent.
+        auto rewrittenTwice = rewritten;
+        RewriteSps(VideoCodec::H264, rewritten, rewrittenTwice);
+        CHECK(rewrittenTwice == rewritten);
+
+        CHECK(!RewriteSpsForLowLatency(VideoCodec::H264, k_H264MainSps.data(), 6, rewritten));
+        CHECK(rewritten.empty());
+        CHECK(!RewriteSpsForLowLatency(VideoCodec::H264, k_H264Pps.data(), static_cast<uint32_t>(k_H264Pps.size()), rewritten));
+    }
+
+    void TestRewriteHevcSps()
+    {
+        // The DPB size, timing and HRD parameters are kept.
+        std::vector<uint8_t> rewritten;
+        auto info = RewriteSps(VideoCodec::HEVC, k_HevcBFramesSps, rewritten);
+        CHECK(info.width == 1280 && info.height == 720 && info.levelIdc == 93);
+        CHECK(info.numUnitsInTick == 1001 && info.timeScale == 30000);
+        CHECK(info.maxNumReorderFrames == 0 && info.maxDecFrameBuffering == 5);
+
+        info = RewriteSps(VideoCodec::HEVC, k_HevcSps, rewritten);
+        CHECK(info.width == 1920 && info.height == 1080 && info.timeScale == 60000);
+        CHECK(info.maxNumReorderFrames == 0);
+
+        // The rewritten SPS still belongs to its VPS and PPS.
+        SequenceInfo sequenceInfo;
+        CHECK(ParseSequenceInfo(VideoCodec::HEVC,
+                                k_HevcVps.data(), static_cast<uint32_t>(k_HevcVps.size()),
+                                rewritten.data(), static_cast<uint32_t>(rewritten.size()),
+                                k_HevcPps.data(), static_cast<uint32_t>(k_HevcPps.size()), sequenceInfo));
+
+        CHECK(!RewriteSpsForLowLatency(VideoCodec::HEVC, k_HevcSps.data(), static_cast<uint32_t>(k_HevcSps.size() - 4), rewritten));
+    }
+
+    void TestTimecodeSei()
+    {
+        // Zero bytes in the timestamp and the frame count need emulation prevention bytes.
+        const TimecodeSei sei = { 0x8A173B1D, 0x0000000100000002ull, 3 };
+
+        // The SEI goes after the AUD and the SEI of the encoder, before the first slice.
+        const std::vector<uint8_t> h264 =
+        {
+            0x00, 0x00, 0x00, 0x01, 0x09, 0xF0,
+            0x00, 0x00, 0x01, 0x06, 0x01, 0x01, 0x00, 0x80,
+            0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84, 0x00,
+            0x00, 0x00, 0x01, 0x65, 0x9A, 0x21
+        };
+
+        std::vector<uint8_t> output;
+        std::vector<NalUnitEntry> nalUnits;
+        CopyWithTimecodeSei(VideoCodec::H264, h264.data(), static_cast<uint32_t>(h264.size()), sei, output, nalUnits);
+
+        std::vector<NalUnitEntry> foundNalUnits;
+        FindNalUnits(VideoCodec::H264, output.data(), static_cast<uint32_t>(output.size()), foundNalUnits);
+        CHECK(nalUnits.size() == 5 && foundNalUnits.size() == 5);
+        if (nalUnits.size() != 5 || foundNalUnits.size() != 5)
+            return;
+
+        for (size_t i = 0; i < nalUnits.size(); ++i)
+        {
+            CHECK(nalUnits[i].offset == foundNalUnits[i].offset && nalUnits[i].size == foundNalUnits[i].size);
+            CHECK(nalUnits[i].type == foundNalUnits[i].type);
+        }
+        CHECK(nalUnits[1].type == k_H264NalSei && nalUnits[2].type == k_H264NalSei && nalUnits[3].type == k_H264NalIdr);
+        CHECK(nalUnits[2].size > 1 + 2 + 36 + 1);
+
+        TimecodeSei read = {};
+        CHECK(!ReadTimecodeSei(VideoCodec::H264, output.data() + nalUnits[1].offset, nalUnits[1].size, read));
+        CHECK(ReadTimecodeSei(VideoCodec::H264, output.data() + nalUnits[2].offset, nalUnits[2].size, read));
+        CHECK(read.timecode == sei.timecode && read.timestamp == sei.timestamp && read.frameCount == sei.frameCount);
+
+        // Apart from the SEI and its start code, the access unit is unchanged.
+        const auto seiBegin = output.begin() + nalUnits[2].offset - 4;
+        const auto seiEnd = output.begin() + nalUnits[2].offset + nalUnits[2].size;
+        std::vector<uint8_t> remaining(output.begin(), seiBegin);
+        remaining.insert(remaining.end(), seiEnd, output.end());
+        CHECK(remaining == h264);
+
+        // HEVC prefix SEI before an IDR slice.
+        const std::vector<uint8_t> hevc = { 0x00, 0x00, 0x00, 0x01, 0x26, 0x01, 0xAF, 0x10, 0x00, 0x00, 0x01, 0x02, 0x01, 0xD0 };
+        CopyWithTimecodeSei(VideoCodec::HEVC, hevc.data(), static_cast<uint32_t>(hevc.size()), sei, output, nalUnits);
+        CHECK(nalUnits.size() == 3 && nalUnits[0].type == k_HevcNalPrefixSei && nalUnits[1].type == k_HevcNalIdrWRadl);
+        if (nalUnits.size() == 3)
+        {
+            CHECK(output[nalUnits[0].offset] == 0x4E && output[nalUnits[0].offset + 1] == 0x01);
+            CHECK(ReadTimecodeSei(VideoCodec::HEVC, output.data() + nalUnits[0].offset, nalUnits[0].size, read));
+            CHECK(read.timecode == sei.timecode && read.timestamp == sei.timestamp && read.frameCount == sei.frameCount);
+            CHECK(std::equal(hevc.begin(), hevc.end(), output.begin() + nalUnits[1].offset - 4));
+        }
+
+        // Without slice data, nothing is inserted.
+        const std::vector<uint8_t> parameterSets = { 0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0x1F, 0x00, 0x00, 0x01, 0x68, 0xCE };
+        CopyWithTimecodeSei(VideoCodec::H264, parameterSets.data(), static_cast<uint32_t>(parameterSets.size()), sei, output, nalUnits);
+        CHECK(output == parameterSets && nalUnits.size() == 2);
+    }
+
+    void TestAppendSeiNalUnit()
+    {
+        // The payload the driver receives makes the same NAL unit as the one inserted by CopyWithTimecodeSei.
+        const TimecodeSei sei = { 0x8A173B1D, 0x0000000100000002ull, 3 };
+        uint8_t payload[k_TimecodeSeiPayloadSize];
+        WriteTimecodeSeiPayload(sei, payload);
+
+        std::vector<uint8_t> output;
+        AppendSeiNalUnit(VideoCodec::H264, k_UserDataUnregisteredSei, payload, sizeof(payload), output);
+
+        std::vector<NalUnitEntry> nalUnits;
+        FindNalUnits(VideoCodec::H264, output.data(), static_cast<uint32_t>(output.size()), nalUnits);
+        CHECK(nalUnits.size() == 1 && nalUnits[0].offset == 4 && nalUnits[0].type == k_H264NalSei);
+
+        TimecodeSei read = {};
+        CHECK(ReadTimecodeSei(VideoCodec::H264, output.data() + 4, static_cast<uint32_t>(output.size()) - 4, read));
+        CHECK(read.timecode == sei.timecode && read.timestamp == sei.timestamp && read.frameCount == sei.frameCount);
+
+        const std::vector<uint8_t> slice = { 0x00, 0x00, 0x00, 0x01, 0x65, 0x88, 0x84, 0x00 };
+        std::vector<uint8_t> copy;
+        CopyWithTimecodeSei(VideoCodec::H264, slice.data(), static_cast<uint32_t>(slice.size()), sei, copy, nalUnits);
+        CHECK(std::equal(output.begin(), output.end(), copy.begin()));
+
+        // Sizes of 255 bytes or more are coded with 0xFF bytes.
+        const std::vector<uint8_t> large(300, 0x11);
+        output.clear();
+        AppendSeiNalUnit(VideoCodec::HEVC, k_UserDataUnregisteredSei, large.data(), static_cast<uint32_t>(large.size()), output);
+        CHECK(output.size() == 4 + 2 + 1 + 2 + large.size() + 1);
+        CHECK(output[4] == 0x4E && output[5] == 0x01 && output[6] == 5 && output[7] == 0xFF && output[8] == 300 - 255);
+        CHECK(output.back() == 0x80);
+    }
+}
+
+int main()
+{
+    TestNalUnitTypes();
+    TestFindNalUnits();
+    TestFindNalUnitsBlockBoundaries();
+    TestFindNalUnitsRandom();
+    TestExtractH264ParameterSets();
+    TestExtractHevcParameterSets();
+    TestRemoveEmulationPrevention();
+    TestBitReader();
+    TestParseH264Sps();
+    TestParseHevcSps();
+    TestRewriteH264Sps();
+    TestRewriteHevcSps();
+    TestTimecodeSei();
+    TestAppendSeiNalUnit();
+
+    if (s_FailedChecks > 0)
+    {
+        std::printf("%d checks failed.\n", s_FailedChecks);
+        return 1;
+    }
+
+    std::printf("All checks passed.\n");
+    return 0;
+}
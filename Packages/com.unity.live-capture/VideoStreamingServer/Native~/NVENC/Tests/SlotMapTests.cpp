@@ -0,0 +1,127 @@
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "SlotMap.h"
+
+// Unit tests of the map from the encoder handles to the encoders, shared by the plugins. The concurrent
+// test is meant to run under ThreadSanitizer too. Returns a non-zero exit code if a check fails.
+
+using namespace Handles;
+
+namespace
+{
+    int s_FailedChecks = 0;
+
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            s_FailedChecks++; \
+        } \
+    } while (false)
+
+    struct Encoder
+    {
+        std::atomic<int> value = { 0 };
+    };
+
+    void TestStaleHandles()
+    {
+        SlotMap<Encoder, 4> map;
+        Encoder first, second;
+
+        const auto handle = map.Reserve();
+        CHECK(handle > 0);
+        CHECK(!map.Acquire(handle));
+        CHECK(map.Bind(handle, &first));
+        CHECK(!map.Bind(handle, &second));
+        CHECK(map.Acquire(handle).Get() == &first);
+
+        CHECK(map.Retire(handle) == &first);
+        CHECK(map.Retire(handle) == nullptr);
+        CHECK(!map.Acquire(handle));
+
+        // Every slot is reused before the one of the retired handle, which then has a new generation.
+        std::vector<int> handles;
+        for (int i = 0; i < 4; ++i)
+            handles.push_back(map.Reserve());
+        CHECK(map.Reserve() == 0);
+
+        const auto reused = handles.back();
+        CHECK(reused != handle && (reused & 3) == (handle & 3));
+        CHECK(map.Bind(reused, &second));
+        CHECK(!map.Acquire(handle));
+        CHECK(map.Acquire(reused).Get() == &second);
+
+        // A reserved handle that was never bound frees its slot too.
+        CHECK(map.Retire(handles.front()) == nullptr);
+        CHECK(map.Reserve() > 0);
+
+        CHECK(!map.Acquire(0) && !map.Acquire(-1) && !map.Bind(0, &first));
+    }
+
+    void TestRetireWaitsForReferences()
+    {
+        SlotMap<Encoder> map;
+        const int k_Rounds = 200;
+
+        std::atomic<int> handle = { 0 };
+        std::atomic<bool> done = { false };
+        std::atomic<uint64_t> acquired = { 0 };
+
+        // Like the main thread: uses the encoder while the render thread may finalize it.
+        std::thread reader([&]
+        {
+            while (!done.load())
+            {
+                if (auto encoder = map.Acquire(handle.load()))
+                {
+                    encoder->value.fetch_add(1);
+                    CHECK(encoder->value.load() > 0);
+                    acquired.fetch_add(1);
+                }
+            }
+        });
+
+        for (int round = 0; round < k_Rounds; ++round)
+        {
+            auto encoder = new Encoder();
+            encoder->value = 1;
+
+            const auto current = map.Reserve();
+            CHECK(map.Bind(current, encoder));
+            handle.store(current);
+            std::this_thread::yield();
+
+            auto retired = map.Retire(current);
+            CHECK(retired == encoder);
+
+            // No reference is left: the reader would see the value change or use a deleted encoder.
+            retired->value = -1;
+            delete retired;
+        }
+
+        done.store(true);
+        reader.join();
+        std::printf("slot map: %llu references over %d encoders\n", static_cast<unsigned long long>(acquired.load()), k_Rounds);
+    }
+}
+
+int main()
+{
+    TestStaleHandles();
+    TestRetireWaitsForReferences();
+
+    if (s_FailedChecks > 0)
+    {
+        std::printf("%d checks failed.\n", s_FailedChecks);
+        return 1;
+    }
+
+    std::printf("All checks passed.\n");
+    return 0;
+}
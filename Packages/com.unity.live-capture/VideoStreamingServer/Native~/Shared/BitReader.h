@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Bitstream
+{
+    // Removes the emulation prevention bytes of a NAL unit payload: each 00 00 03 sequence becomes 00 00,
+    // which gives the raw byte sequence payload (RBSP) the syntax elements are read from.
+    inline void RemoveEmulationPrevention(const uint8_t* data, size_t size, std::vector<uint8_t>& rbsp)
+    {
+        rbsp.clear();
+        rbsp.reserve(size);
+
+        uint32_t zeroCount = 0;
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (zeroCount >= 2 && data[i] == 0x03)
+            {
+                zeroCount = 0;
+                continue;
+            }
+
+            zeroCount = data[i] == 0 ? zeroCount + 1 : 0;
+            rbsp.push_back(data[i]);
+        }
+    }
+
+    // Reads the fixed length and exp-Golomb syntax elements of an RBSP, most significant bit first.
+    //
+    // Reading past the end returns zeros and sets the error flag instead of failing each call, so that a
+    // parser checks HasError once after a group of syntax elements.
+    class BitReader final
+    {
+    public:
+        BitReader(const uint8_t* data, size_t size)
+            : m_Data(data)
+            , m_Size(size)
+            , m_Position(0)
+            , m_HasError(false)
+        {
+        }
+
+        // u(n), up to 32 bits.
+        inline uint32_t ReadBits(uint32_t count)
+        {
+            uint32_t value = 0;
+            for (uint32_t i = 0; i < count; ++i)
+                value = (value << 1) | ReadBit();
+            return value;
+        }
+
+        inline bool ReadFlag()
+        {
+            return ReadBit() != 0;
+        }
+
+        // ue(v). Codes longer than 32 bits are not valid in the parameter sets.
+        inline uint32_t ReadUe()
+        {
+            uint32_t leadingZeros = 0;
+            while (ReadBit() == 0)
+            {
+                if (m_HasError || ++leadingZeros > 31)
+                {
+                    m_HasError = true;
+                    return 0;
+                }
+            }
+
+            return ((1u << leadingZeros) - 1) + ReadBits(leadingZeros);
+        }
+
+        // se(v).
+        inline int32_t ReadSe()
+        {
+            const auto code = ReadUe();
+            return (code & 1) ? static_cast<int32_t>((code + 1) / 2) : -static_cast<int32_t>(code / 2);
+        }
+
+        inline void SkipBits(size_t count)
+        {
+            m_Position += count;
+            if (m_Position > m_Size * 8)
+            {
+                m_Position = m_Size * 8;
+                m_HasError = true;
+            }
+        }
+
+        // True if only the rbsp_trailing_bits are left: a one followed by zeros up to the end. Trailing
+        // zero bytes (cabac_zero_words) are accepted.
+        inline bool IsAtTrailingBits() const
+        {
+            if (m_HasError || m_Position >= m_Size * 8 || GetBit(m_Position) == 0)
+                return false;
+
+            for (auto position = m_Position + 1; position < m_Size * 8; ++position)
+            {
+                if (GetBit(position) != 0)
+                    return false;
+            }
+            return true;
+        }
+
+        inline bool HasError() const { return m_HasError; }
+        inline size_t GetPosition() const { return m_Position; }
+
+    private:
+        inline uint32_t GetBit(size_t position) const
+        {
+            return (m_Data[position / 8] >> (7 - position % 8)) & 1;
+        }
+
+        inline uint32_t ReadBit()
+        {
+            if (m_Position >= m_Size * 8)
+            {
+                m_HasError = true;
+                return 0;
+            }
+            return GetBit(m_Position++);
+        }
+
+        const uint8_t* m_Data;
+        size_t         m_Size;
+        size_t         m_Position;
+        bool           m_HasError;
+    };
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "BitReader.h"
+
+namespace Bitstream
+{
+    // Appends a NAL unit payload to the output and inserts the emulation prevention bytes: a 03 byte follows
+    // each 00 00 that precedes a byte of 03 or less. Reverts RemoveEmulationPrevention.
+    inline void AddEmulationPrevention(const uint8_t* rbsp, size_t size, std::vector<uint8_t>& output)
+    {
+        output.reserve(output.size() + size + size / 2);
+
+        uint32_t zeroCount = 0;
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (zeroCount >= 2 && rbsp[i] <= 0x03)
+            {
+                output.push_back(0x03);
+                zeroCount = 0;
+            }
+
+            zeroCount = rbsp[i] == 0 ? zeroCount + 1 : 0;
+            output.push_back(rbsp[i]);
+        }
+    }
+
+    // Writes the syntax elements of an RBSP, most significant bit first. The counterpart of BitReader.
+    class BitWriter final
+    {
+    public:
+        // u(n), up to 32 bits.
+        inline void WriteBits(uint32_t value, uint32_t count)
+        {
+            for (uint32_t i = count; i > 0; --i)
+                WriteBit((value >> (i - 1)) & 1);
+        }
+
+        inline void WriteFlag(bool value)
+        {
+            WriteBit(value ? 1 : 0);
+        }
+
+        // ue(v), for values below 2^32 - 1.
+        inline void WriteUe(uint32_t value)
+        {
+            const auto code = static_cast<uint64_t>(value) + 1;
+            uint32_t length = 0;
+            while ((code >> (length + 1)) != 0)
+                length++;
+
+            WriteBits(0, length);
+            WriteBits(1, 1);
+            WriteBits(static_cast<uint32_t>(code), length);
+        }
+
+        // Copies the next bits of a reader unchanged.
+        inline void CopyBits(BitReader& reader, size_t count)
+        {
+            for (; count >= 32; count -= 32)
+                WriteBits(reader.ReadBits(32), 32);
+            WriteBits(reader.ReadBits(static_cast<uint32_t>(count)), static_cast<uint32_t>(count));
+        }
+
+        // rbsp_trailing_bits: the stop bit, then zeros up to the next byte.
+        inline void WriteTrailingBits()
+        {
+            WriteBit(1);
+            while (m_Position % 8 != 0)
+                WriteBit(0);
+        }
+
+        inline const std::vector<uint8_t>& GetData() const { return m_Data; }
+        inline size_t GetPosition() const { return m_Position; }
+
+    private:
+        inline void WriteBit(uint32_t bit)
+        {
+            if (m_Position % 8 == 0)
+                m_Data.push_back(0);
+
+            m_Data.back() |= static_cast<uint8_t>(bit << (7 - m_Position % 8));
+            m_Position++;
+        }
+
+        std::vector<uint8_t> m_Data;
+        size_t               m_Position = 0;
+    };
+}
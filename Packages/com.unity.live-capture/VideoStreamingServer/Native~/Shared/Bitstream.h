@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+// The bitstream definitions, readers and parsers shared by the encoder plugins. Each plugin compiles the
+// sources of this directory and imports the namespace in its own.
+namespace Bitstream
+{
+    // Compression standard of an encoder session, chosen when it is created.
+    enum class VideoCodec : int32_t
+    {
+        H264 = 0,
+        HEVC
+    };
+
+    // NAL unit types used by the plugins, see ITU-T H.264 table 7-1 and ITU-T H.265 table 7-1.
+    enum NalUnitType : uint32_t
+    {
+        k_H264NalIdr = 5,
+        k_H264NalSei = 6,
+        k_H264NalSps = 7,
+        k_H264NalPps = 8,
+
+        k_HevcNalIdrWRadl = 19,
+        k_HevcNalIdrNLp = 20,
+        k_HevcNalVps = 32,
+        k_HevcNalSps = 33,
+        k_HevcNalPps = 34,
+        k_HevcNalPrefixSei = 39
+    };
+
+    // The NAL unit type stored in the first byte (H.264) or the first two bytes (HEVC) of a NAL unit.
+    inline uint32_t GetNalUnitType(VideoCodec codec, uint8_t header)
+    {
+        return codec == VideoCodec::HEVC ? static_cast<uint32_t>((header >> 1) & 0x3F) : static_cast<uint32_t>(header & 0x1F);
+    }
+
+    // Whether a NAL unit holds slice data.
+    inline bool IsVclNalUnit(VideoCodec codec, uint32_t type)
+    {
+        return codec == VideoCodec::HEVC ? type < 32 : (type >= 1 && type <= 5);
+    }
+
+    // The properties of a stream read from its parameter sets, which describe it to the clients (SDP)
+    // without decoding a frame. All the fields are 0 when the parameter sets can't be parsed.
+    struct SequenceInfo
+    {
+        uint32_t isValid;
+        uint32_t profileIdc;           // H.264 profile_idc, HEVC general_profile_idc.
+        uint32_t profileCompatibility; // H.264 constraint_set flags byte, HEVC general_profile_compatibility_flags.
+        uint32_t levelIdc;             // H.264 level_idc (10 x level), HEVC general_level_idc (30 x level).
+        uint32_t profileSpace;         // HEVC only.
+        uint32_t tierFlag;             // HEVC only.
+        uint32_t width;                // Cropped to the conformance window.
+        uint32_t height;
+        uint32_t numUnitsInTick;       // VUI timing, 0 when the stream doesn't signal it.
+        uint32_t timeScale;
+        uint32_t maxNumReorderFrames;  // Signaled, or inferred from the profile and level for H.264.
+        uint32_t maxDecFrameBuffering;
+    };
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+// Keeps the atomics written by different threads on separate cache lines, shared by the encoder plugins.
+//
+// The members are padded rather than declared alignas(k_CacheLineSize): an over-aligned member makes the
+// class owning it over-aligned as well, and the plugins are built as C++14, where new ignores an alignment
+// above the one of std::max_align_t. A member followed by its padding can't share a cache line with the
+// next member, whatever the address of the instance.
+
+#include <cstddef>
+
+namespace Threading
+{
+    static const size_t k_CacheLineSize = 64;
+
+    // Fills the rest of a cache line after a member of the given size.
+    template <size_t UsedSize> struct CacheLinePadding final
+    {
+        static_assert(UsedSize < k_CacheLineSize, "The member doesn't fit in a cache line.");
+
+        char bytes[k_CacheLineSize - UsedSize];
+    };
+}
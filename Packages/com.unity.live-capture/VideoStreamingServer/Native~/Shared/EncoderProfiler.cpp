@@ -0,0 +1,108 @@
+#include "EncoderProfiler.h"
+
+#include "Unity/IUnityProfiler.h"
+
+namespace Statistics
+{
+    static IUnityProfiler*                s_UnityProfiler = nullptr;
+    static const UnityProfilerMarkerDesc* s_Markers[EncoderProfiler::k_MaxMarkerCount] = {};
+    static const UnityProfilerMarkerDesc* s_CountersMarker = nullptr;
+
+    enum CounterIndex
+    {
+        k_CounterBitRate,
+        k_CounterFrameSize,
+        k_CounterEncodeTime,
+        k_CounterQueueDepth,
+        k_CounterDroppedFrames,
+        k_CounterCount
+    };
+
+    void EncoderProfiler::Initialize(IUnityInterfaces* unityInterfaces,
+                                     const char* const* markerNames,
+                                     uint32_t markerCount,
+                                     const char* countersName)
+    {
+        auto profiler = unityInterfaces ? unityInterfaces->Get<IUnityProfiler>() : nullptr;
+        if (profiler == nullptr || profiler->IsAvailable() == 0 || markerCount > k_MaxMarkerCount)
+            return;
+
+        for (uint32_t i = 0; i < markerCount; ++i)
+        {
+            if (profiler->CreateMarker(&s_Markers[i], markerNames[i], kUnityProfilerCategoryVideo,
+                                       kUnityProfilerMarkerFlagDefault, 0) != 0)
+                return;
+        }
+
+        if (profiler->CreateMarker(&s_CountersMarker, countersName, kUnityProfilerCategoryVideo,
+                                   kUnityProfilerMarkerFlagDefault, k_CounterCount) != 0)
+            return;
+
+        profiler->SetMarkerMetadataName(s_CountersMarker, k_CounterBitRate, "Bit rate (bits/s)",
+                                        kUnityProfilerMarkerDataTypeUInt64, kUnityProfilerMarkerDataUnitCount);
+        profiler->SetMarkerMetadataName(s_CountersMarker, k_CounterFrameSize, "Frame size",
+                                        kUnityProfilerMarkerDataTypeUInt32, kUnityProfilerMarkerDataUnitBytes);
+        profiler->SetMarkerMetadataName(s_CountersMarker, k_CounterEncodeTime, "Encode time",
+                                        kUnityProfilerMarkerDataTypeUInt64, kUnityProfilerMarkerDataUnitTimeNanoseconds);
+        profiler->SetMarkerMetadataName(s_CountersMarker, k_CounterQueueDepth, "Queue depth",
+                                        kUnityProfilerMarkerDataTypeUInt32, kUnityProfilerMarkerDataUnitCount);
+        profiler->SetMarkerMetadataName(s_CountersMarker, k_CounterDroppedFrames, "Dropped frames",
+                                        kUnityProfilerMarkerDataTypeUInt64, kUnityProfilerMarkerDataUnitCount);
+
+        s_UnityProfiler = profiler;
+    }
+
+    void EncoderProfiler::Shutdown()
+    {
+        s_UnityProfiler = nullptr;
+    }
+
+    bool EncoderProfiler::IsEnabled()
+    {
+        return s_UnityProfiler != nullptr && s_UnityProfiler->IsEnabled() != 0;
+    }
+
+    void EncoderProfiler::BeginMarker(uint32_t index)
+    {
+        if (s_UnityProfiler != nullptr)
+            s_UnityProfiler->BeginSample(s_Markers[index]);
+    }
+
+    void EncoderProfiler::EndMarker(uint32_t index)
+    {
+        if (s_UnityProfiler != nullptr)
+            s_UnityProfiler->EndSample(s_Markers[index]);
+    }
+
+    void EncoderProfiler::EmitCounters(const EncoderStats& stats, uint32_t frameSize, uint64_t encodeTimeUs)
+    {
+        if (s_UnityProfiler == nullptr)
+            return;
+
+        const uint64_t bitRate = stats.bytesPerSecond * 8;
+        const uint64_t encodeTime = encodeTimeUs * 1000;
+        const uint32_t queueDepth = stats.queueDepth;
+        const uint64_t droppedFrames = stats.droppedInputFrameCount + stats.droppedOutputFrameCount;
+
+        UnityProfilerMarkerData data[k_CounterCount] = {};
+        data[k_CounterBitRate] = { kUnityProfilerMarkerDataTypeUInt64, 0, 0, sizeof(bitRate), &bitRate };
+        data[k_CounterFrameSize] = { kUnityProfilerMarkerDataTypeUInt32, 0, 0, sizeof(frameSize), &frameSize };
+        data[k_CounterEncodeTime] = { kUnityProfilerMarkerDataTypeUInt64, 0, 0, sizeof(encodeTime), &encodeTime };
+        data[k_CounterQueueDepth] = { kUnityProfilerMarkerDataTypeUInt32, 0, 0, sizeof(queueDepth), &queueDepth };
+        data[k_CounterDroppedFrames] = { kUnityProfilerMarkerDataTypeUInt64, 0, 0, sizeof(droppedFrames), &droppedFrames };
+
+        s_UnityProfiler->EmitEvent(s_CountersMarker, kUnityProfilerMarkerEventTypeSingle, k_CounterCount, data);
+    }
+
+    void EncoderProfiler::RegisterThread(const char* name)
+    {
+        if (s_UnityProfiler != nullptr)
+            s_UnityProfiler->RegisterThread(nullptr, "Live Capture", name);
+    }
+
+    void EncoderProfiler::UnregisterThread()
+    {
+        if (s_UnityProfiler != nullptr)
+            s_UnityProfiler->UnregisterThread(0);
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Unity/IUnityInterface.h"
+#include "EncoderStatistics.h"
+
+namespace Statistics
+{
+    // Unity Profiler instrumentation of an encoder plugin, shared by the plugins. Everything is a no-op
+    // until Initialize finds an available profiler, i.e. in the Editor and in Development players.
+    //
+    // Each plugin declares its own marker enum, ending with Count, and passes the marker names in the same
+    // order to Initialize.
+    class EncoderProfiler final
+    {
+    public:
+        static const uint32_t k_MaxMarkerCount = 8;
+
+        // The counters are published as the metadata of the countersName event, e.g. "NvEnc.Counters".
+        static void Initialize(IUnityInterfaces* unityInterfaces,
+                               const char* const* markerNames,
+                               uint32_t markerCount,
+                               const char* countersName);
+        static void Shutdown();
+
+        static bool IsEnabled();
+
+        template <typename Marker> static inline void BeginSample(Marker marker)
+        {
+            BeginMarker(static_cast<uint32_t>(marker));
+        }
+
+        template <typename Marker> static inline void EndSample(Marker marker)
+        {
+            EndMarker(static_cast<uint32_t>(marker));
+        }
+
+        // Publishes the counters of a session, so they show up in the Profiler next to the frame that
+        // produced them.
+        static void EmitCounters(const EncoderStats& stats, uint32_t frameSize, uint64_t encodeTimeUs);
+
+        // Threads created by the plugin have to be registered for their samples to be recorded.
+        static void RegisterThread(const char* name);
+        static void UnregisterThread();
+
+    private:
+        static void BeginMarker(uint32_t index);
+        static void EndMarker(uint32_t index);
+    };
+
+    class ProfilerScope final
+    {
+    public:
+        template <typename Marker> inline explicit ProfilerScope(Marker marker)
+            : m_Marker(static_cast<uint32_t>(marker))
+        {
+            EncoderProfiler::BeginSample(m_Marker);
+        }
+
+        inline ~ProfilerScope()
+        {
+            EncoderProfiler::EndSample(m_Marker);
+        }
+
+        ProfilerScope(const ProfilerScope&) = delete;
+        ProfilerScope& operator=(const ProfilerScope&) = delete;
+
+    private:
+        uint32_t m_Marker;
+    };
+}
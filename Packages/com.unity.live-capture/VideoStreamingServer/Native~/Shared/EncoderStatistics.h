@@ -0,0 +1,249 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// The per-stage latencies and the output counters of an encoder session, shared by the encoder plugins.
+// Each plugin imports the namespace in its own, EncoderStats is the layout of their GetEncoderStats export.
+namespace Statistics
+{
+    // The stages a frame goes through, timed for every frame by the encoder statistics.
+    enum class EncoderStage : uint32_t
+    {
+        Copy,    // Encode call to the input texture being copied or converted.
+        Submit,  // Copy done to the picture being submitted to the encoder.
+        Encode,  // Submission to the bitstream being ready.
+        Queue,   // Bitstream ready to the frame being picked by the consumer (BeginConsume).
+        Consume, // BeginConsume to EndConsume.
+        Total,   // Encode call to EndConsume.
+        Count
+    };
+
+    static const uint32_t k_EncoderStageCount = static_cast<uint32_t>(EncoderStage::Count);
+
+    // Latency distribution of a stage, in microseconds. The percentiles are the upper bound of the
+    // histogram bucket they fall in, so they overestimate by at most 1/8th of the value.
+    struct StageLatency
+    {
+        uint64_t count;
+        uint32_t p50;
+        uint32_t p99;
+        uint32_t max;
+        uint32_t reserved;
+    };
+
+    // Snapshot of the statistics of an encoder session since it was created.
+    struct EncoderStats
+    {
+        StageLatency stages[k_EncoderStageCount]; // Indexed by EncoderStage.
+        uint64_t     submittedFrameCount;
+        uint64_t     encodedFrameCount;
+        uint64_t     droppedInputFrameCount;      // Frames skipped because all the input buffers were in use.
+        uint64_t     droppedOutputFrameCount;     // Encoded frames discarded because the queue was full.
+        uint64_t     encodedBytes;
+        uint64_t     bytesPerSecond;              // Output rate over the last full second of encoding.
+        uint64_t     keyFrameCount;
+        uint32_t     lastKeyFrameSize;
+        uint32_t     maxKeyFrameSize;
+        uint32_t     averageKeyFrameSize;
+        uint32_t     averageFrameSize;
+        uint32_t     inFlightFrameCount;          // Frames submitted to the encoder and not read back yet.
+        uint32_t     queueDepth;                  // Encoded frames waiting for the consumer.
+    };
+
+    // Times at which a frame went through the stages of the pipeline, see EncoderStatistics::Now.
+    struct FrameTimings
+    {
+        uint64_t encodeTime = 0;
+        uint64_t submitTime = 0;
+        uint64_t readyTime = 0;
+        uint64_t consumeTime = 0;
+    };
+
+    // A lock-free latency histogram with log-linear buckets: values below 8 us are exact, above that
+    // every power of two is split into 8 buckets. Record can be called from any thread.
+    class LatencyHistogram final
+    {
+        static const uint32_t k_SubBucketBits = 3;
+        static const uint32_t k_SubBucketCount = 1 << k_SubBucketBits;
+        static const uint32_t k_BucketCount = k_SubBucketCount * 20; // Up to ~4 seconds.
+
+    public:
+        inline void Record(uint64_t value)
+        {
+            m_Buckets[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+
+            auto max = m_Max.load(std::memory_order_relaxed);
+            while (value > max && !m_Max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        inline StageLatency GetLatency() const
+        {
+            uint64_t counts[k_BucketCount];
+            uint64_t count = 0;
+            for (uint32_t i = 0; i < k_BucketCount; ++i)
+            {
+                counts[i] = m_Buckets[i].load(std::memory_order_relaxed);
+                count += counts[i];
+            }
+
+            const auto max = m_Max.load(std::memory_order_relaxed);
+
+            StageLatency latency = {};
+            latency.count = count;
+            latency.p50 = Percentile(counts, count, max, 50);
+            latency.p99 = Percentile(counts, count, max, 99);
+            latency.max = Clamp(max);
+            return latency;
+        }
+
+    private:
+        static inline uint32_t BucketIndex(uint64_t value)
+        {
+            if (value < k_SubBucketCount)
+                return static_cast<uint32_t>(value);
+
+            uint32_t exponent = k_SubBucketBits;
+            while ((value >> (exponent + 1)) != 0)
+                exponent++;
+
+            const auto subBucket = static_cast<uint32_t>(value >> (exponent - k_SubBucketBits)) & (k_SubBucketCount - 1);
+            const auto index = (exponent - k_SubBucketBits + 1) * k_SubBucketCount + subBucket;
+            return index < k_BucketCount ? index : k_BucketCount - 1;
+        }
+
+        static inline uint64_t BucketUpperBound(uint32_t index)
+        {
+            if (index < k_SubBucketCount)
+                return index;
+
+            const auto shift = index / k_SubBucketCount - 1;
+            const auto lower = static_cast<uint64_t>(k_SubBucketCount + index % k_SubBucketCount) << shift;
+            return lower + (1ull << shift) - 1;
+        }
+
+        static inline uint32_t Percentile(const uint64_t* counts, uint64_t count, uint64_t max, uint32_t percent)
+        {
+            if (count == 0)
+                return 0;
+
+            const auto rank = (count * percent + 99) / 100;
+            uint64_t cumulated = 0;
+            for (uint32_t i = 0; i < k_BucketCount; ++i)
+            {
+                cumulated += counts[i];
+                if (cumulated >= rank)
+                {
+                    const auto bound = BucketUpperBound(i);
+                    return Clamp(bound < max ? bound : max);
+                }
+            }
+            return Clamp(max);
+        }
+
+        static inline uint32_t Clamp(uint64_t value)
+        {
+            return value > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(value);
+        }
+
+        std::atomic<uint64_t> m_Buckets[k_BucketCount] = {};
+        std::atomic<uint64_t> m_Max = { 0 };
+    };
+
+    // Per-session pipeline statistics. The stages are recorded by the thread that completes them and the
+    // counters by the encoder; GetStats can be called from any thread at any time.
+    class EncoderStatistics final
+    {
+    public:
+        // Microseconds on a monotonic clock; 0 is never returned so that it can mean "not recorded".
+        static inline uint64_t Now()
+        {
+            const auto now = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+            return static_cast<uint64_t>(now) + 1;
+        }
+
+        inline void RecordStage(EncoderStage stage, uint64_t start, uint64_t end)
+        {
+            if (start != 0 && end >= start)
+                m_Stages[static_cast<uint32_t>(stage)].Record(end - start);
+        }
+
+        inline void RecordSubmitted() { m_SubmittedFrameCount.fetch_add(1, std::memory_order_relaxed); }
+        inline void RecordInputDropped() { m_DroppedInputFrameCount.fetch_add(1, std::memory_order_relaxed); }
+
+        // Must only be called by the thread producing the encoded frames.
+        inline void RecordEncoded(uint32_t size, bool isKeyFrame, uint64_t now)
+        {
+            m_EncodedFrameCount.fetch_add(1, std::memory_order_relaxed);
+            m_EncodedBytes.fetch_add(size, std::memory_order_relaxed);
+
+            if (isKeyFrame)
+            {
+                m_KeyFrameCount.fetch_add(1, std::memory_order_relaxed);
+                m_KeyFrameBytes.fetch_add(size, std::memory_order_relaxed);
+                m_LastKeyFrameSize.store(size, std::memory_order_relaxed);
+                if (size > m_MaxKeyFrameSize.load(std::memory_order_relaxed))
+                    m_MaxKeyFrameSize.store(size, std::memory_order_relaxed);
+            }
+
+            if (m_WindowStart == 0)
+                m_WindowStart = now;
+
+            m_WindowBytes += size;
+            if (now - m_WindowStart >= k_RateWindow)
+            {
+                m_BytesPerSecond.store(m_WindowBytes * 1000000 / (now - m_WindowStart), std::memory_order_relaxed);
+                m_WindowStart = now;
+                m_WindowBytes = 0;
+            }
+        }
+
+        // Fills everything but the queue and in-flight states, which belong to the encoder.
+        inline void GetStats(EncoderStats& stats) const
+        {
+            for (uint32_t i = 0; i < k_EncoderStageCount; ++i)
+                stats.stages[i] = m_Stages[i].GetLatency();
+
+            const auto encodedFrameCount = m_EncodedFrameCount.load(std::memory_order_relaxed);
+            const auto keyFrameCount = m_KeyFrameCount.load(std::memory_order_relaxed);
+
+            stats.submittedFrameCount = m_SubmittedFrameCount.load(std::memory_order_relaxed);
+            stats.encodedFrameCount = encodedFrameCount;
+            stats.droppedInputFrameCount = m_DroppedInputFrameCount.load(std::memory_order_relaxed);
+            stats.encodedBytes = m_EncodedBytes.load(std::memory_order_relaxed);
+            stats.bytesPerSecond = m_BytesPerSecond.load(std::memory_order_relaxed);
+            stats.keyFrameCount = keyFrameCount;
+            stats.lastKeyFrameSize = m_LastKeyFrameSize.load(std::memory_order_relaxed);
+            stats.maxKeyFrameSize = m_MaxKeyFrameSize.load(std::memory_order_relaxed);
+            stats.averageKeyFrameSize = keyFrameCount > 0
+                ? static_cast<uint32_t>(m_KeyFrameBytes.load(std::memory_order_relaxed) / keyFrameCount)
+                : 0;
+            stats.averageFrameSize = encodedFrameCount > 0
+                ? static_cast<uint32_t>(stats.encodedBytes / encodedFrameCount)
+                : 0;
+        }
+
+    private:
+        static const uint64_t k_RateWindow = 1000000;
+
+        LatencyHistogram      m_Stages[k_EncoderStageCount];
+
+        std::atomic<uint64_t> m_SubmittedFrameCount = { 0 };
+        std::atomic<uint64_t> m_EncodedFrameCount = { 0 };
+        std::atomic<uint64_t> m_DroppedInputFrameCount = { 0 };
+        std::atomic<uint64_t> m_EncodedBytes = { 0 };
+        std::atomic<uint64_t> m_BytesPerSecond = { 0 };
+        std::atomic<uint64_t> m_KeyFrameCount = { 0 };
+        std::atomic<uint64_t> m_KeyFrameBytes = { 0 };
+        std::atomic<uint32_t> m_LastKeyFrameSize = { 0 };
+        std::atomic<uint32_t> m_MaxKeyFrameSize = { 0 };
+
+        // Output rate window, only touched by the producer.
+        uint64_t m_WindowStart = 0;
+        uint64_t m_WindowBytes = 0;
+    };
+}
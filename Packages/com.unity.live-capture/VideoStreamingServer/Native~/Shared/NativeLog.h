@@ -0,0 +1,362 @@
+#pragma once
+
+// Asynchronous logging shared by the native plugins, which all include this file from Native~/Shared of
+// the Live Capture package.
+//
+// A thread that logs copies a fixed-size record into a lock-free ring that it owns, which costs a few
+// hundred nanoseconds and never blocks nor allocates. A background thread drains the rings, formats the
+// records and writes them to the log file. The memory used is bounded: when a ring is full, or when
+// more than k_MaxThreads threads log at the same time, records are dropped and counted.
+//
+// Nothing runs while the level is None: the writer thread is only started, and the log file only
+// opened, once SetLevel enables a level between Start and Stop.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace NativeLog
+{
+    enum class Level : int32_t
+    {
+        Debug = 0,
+        Info,
+        Warning,
+        Error,
+        None
+    };
+
+    namespace Detail
+    {
+        static const uint32_t k_MessageSize = 96;
+        static const uint32_t k_RingCapacity = 256; // Must be a power of two.
+        static const uint32_t k_MaxThreads = 32;
+
+        enum RingState : uint32_t
+        {
+            k_RingFree,
+            k_RingOwned,    // A live thread writes to the ring.
+            k_RingReleased  // The thread exited, the ring is freed once drained.
+        };
+
+        struct Record
+        {
+            uint64_t timestamp; // Microseconds since the first Start.
+            int64_t  value;
+            uint32_t threadIndex;
+            Level    level;
+            bool     hasValue;
+            char     message[k_MessageSize];
+        };
+
+        // Single producer (the owning thread), single consumer (the writer thread).
+        struct Ring
+        {
+            Record                records[k_RingCapacity];
+            std::atomic<uint32_t> head = { 0 };
+            std::atomic<uint32_t> tail = { 0 };
+            std::atomic<uint32_t> state = { k_RingOwned };
+        };
+
+        struct State
+        {
+            std::atomic<int32_t>  level = { static_cast<int32_t>(Level::None) };
+            std::atomic<Ring*>    rings[k_MaxThreads] = {};
+            std::atomic<uint64_t> droppedCount = { 0 };
+            const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+            // Only used to start and stop the writer, never by the logging threads.
+            std::mutex              lock;
+            std::condition_variable condition;
+            std::thread             writer;
+            uint32_t                startCount = 0;
+            bool                    isStopRequested = false;
+            std::FILE*              file = nullptr;
+            std::string             path;
+            bool                    append = false;
+        };
+
+        // Never destroyed: threads can still log while the plugin statics are being destroyed.
+        inline State& GetState()
+        {
+            static State* const s_State = new State();
+            return *s_State;
+        }
+
+        struct ThreadRing
+        {
+            Ring*    ring = nullptr;
+            uint32_t index = 0;
+
+            ~ThreadRing()
+            {
+                if (ring != nullptr)
+                    ring->state.store(k_RingReleased, std::memory_order_release);
+            }
+        };
+
+        inline ThreadRing* AcquireThreadRing()
+        {
+            static thread_local ThreadRing s_ThreadRing;
+            if (s_ThreadRing.ring != nullptr)
+                return &s_ThreadRing;
+
+            auto& state = GetState();
+            for (uint32_t i = 0; i < k_MaxThreads; ++i)
+            {
+                auto ring = state.rings[i].load(std::memory_order_acquire);
+                if (ring == nullptr)
+                {
+                    auto newRing = new Ring();
+                    if (state.rings[i].compare_exchange_strong(ring, newRing))
+                    {
+                        s_ThreadRing.ring = newRing;
+                        s_ThreadRing.index = i;
+                        return &s_ThreadRing;
+                    }
+                    delete newRing;
+                }
+
+                auto expected = static_cast<uint32_t>(k_RingFree);
+                if (ring->state.compare_exchange_strong(expected, k_RingOwned))
+                {
+                    s_ThreadRing.ring = ring;
+                    s_ThreadRing.index = i;
+                    return &s_ThreadRing;
+                }
+            }
+            return nullptr;
+        }
+
+        inline void Push(Level level, const char* message, bool hasValue, int64_t value)
+        {
+            auto& state = GetState();
+            const auto threadRing = AcquireThreadRing();
+            if (threadRing == nullptr)
+            {
+                state.droppedCount.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            auto& ring = *threadRing->ring;
+            const auto tail = ring.tail.load(std::memory_order_relaxed);
+            if (tail - ring.head.load(std::memory_order_acquire) >= k_RingCapacity)
+            {
+                state.droppedCount.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            auto& record = ring.records[tail & (k_RingCapacity - 1)];
+            record.timestamp = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - state.epoch).count());
+            record.value = value;
+            record.threadIndex = threadRing->index;
+            record.level = level;
+            record.hasValue = hasValue;
+
+            uint32_t length = 0;
+            if (message != nullptr)
+            {
+                while (length < k_MessageSize - 1 && message[length] != '\0')
+                {
+                    record.message[length] = message[length];
+                    length++;
+                }
+            }
+            record.message[length] = '\0';
+
+            ring.tail.store(tail + 1, std::memory_order_release);
+        }
+
+        inline void Drain(State& state, std::vector<Record>& batch)
+        {
+            for (auto& ringPtr : state.rings)
+            {
+                auto ring = ringPtr.load(std::memory_order_acquire);
+                if (ring == nullptr)
+                    continue;
+
+                // Read the state first: a released ring is only freed if it was empty after the release.
+                const auto ringState = ring->state.load(std::memory_order_acquire);
+                const auto tail = ring->tail.load(std::memory_order_acquire);
+                auto head = ring->head.load(std::memory_order_relaxed);
+
+                for (; head != tail; ++head)
+                    batch.push_back(ring->records[head & (k_RingCapacity - 1)]);
+                ring->head.store(head, std::memory_order_release);
+
+                if (ringState == k_RingReleased)
+                    ring->state.store(k_RingFree, std::memory_order_release);
+            }
+        }
+
+        inline void WriteBatch(std::FILE* file, std::vector<Record>& batch, uint64_t& reportedDropCount,
+                               uint64_t droppedCount)
+        {
+            static const char* const k_LevelNames[] = { "Debug", "Info", "Warning", "Error" };
+
+            if (file != nullptr)
+            {
+                std::stable_sort(batch.begin(), batch.end(), [](const Record& a, const Record& b)
+                {
+                    return a.timestamp < b.timestamp;
+                });
+
+                for (auto& record : batch)
+                {
+                    // The messages are written without their trailing new lines, one record per line.
+                    auto length = std::char_traits<char>::length(record.message);
+                    while (length > 0 && record.message[length - 1] == '\n')
+                        record.message[--length] = '\0';
+
+                    const auto levelIndex = static_cast<uint32_t>(record.level);
+                    std::fprintf(file, "%10llu.%03llu [%02u] %-7s %s",
+                                 static_cast<unsigned long long>(record.timestamp / 1000),
+                                 static_cast<unsigned long long>(record.timestamp % 1000),
+                                 record.threadIndex,
+                                 levelIndex < 4 ? k_LevelNames[levelIndex] : "",
+                                 record.message);
+                    if (record.hasValue)
+                        std::fprintf(file, "%lld", static_cast<long long>(record.value));
+                    std::fputc('\n', file);
+                }
+
+                if (droppedCount != reportedDropCount)
+                {
+                    std::fprintf(file, "NativeLog: %llu records dropped.\n",
+                                 static_cast<unsigned long long>(droppedCount - reportedDropCount));
+                    reportedDropCount = droppedCount;
+                }
+
+                std::fflush(file);
+            }
+            batch.clear();
+        }
+
+        inline void WriterLoop(State* state)
+        {
+            std::vector<Record> batch;
+            batch.reserve(k_RingCapacity);
+            uint64_t reportedDropCount = state->droppedCount.load();
+
+            for (;;)
+            {
+                bool isStopRequested;
+                {
+                    std::unique_lock<std::mutex> lock(state->lock);
+                    state->condition.wait_for(lock, std::chrono::milliseconds(10), [state]
+                    {
+                        return state->isStopRequested;
+                    });
+                    isStopRequested = state->isStopRequested;
+                }
+
+                Drain(*state, batch);
+                WriteBatch(state->file, batch, reportedDropCount, state->droppedCount.load());
+
+                if (isStopRequested)
+                    break;
+            }
+        }
+
+        // Called with the state lock held.
+        inline void StartWriterIfEnabled(State& state)
+        {
+            if (state.startCount == 0 || state.writer.joinable()
+                || state.level.load(std::memory_order_relaxed) == static_cast<int32_t>(Level::None))
+                return;
+
+            state.file = state.path.empty() ? nullptr : std::fopen(state.path.c_str(), state.append ? "a" : "w");
+            state.isStopRequested = false;
+            state.writer = std::thread(WriterLoop, &state);
+        }
+    }
+
+    // Calls are counted, the log is written to the path of the first one until the matching Stop. The
+    // writer thread and the file only start once a level is enabled.
+    inline void Start(const std::string& path, bool append)
+    {
+        auto& state = Detail::GetState();
+        std::lock_guard<std::mutex> lock(state.lock);
+
+        if (state.startCount++ > 0)
+            return;
+
+        state.path = path;
+        state.append = append;
+        Detail::StartWriterIfEnabled(state);
+    }
+
+    // Writes the pending records and stops the writer thread once every Start has been matched.
+    inline void Stop()
+    {
+        auto& state = Detail::GetState();
+        std::thread writer;
+        {
+            std::lock_guard<std::mutex> lock(state.lock);
+            if (state.startCount == 0 || --state.startCount > 0)
+                return;
+
+            state.isStopRequested = true;
+            writer = std::move(state.writer);
+        }
+
+        if (!writer.joinable())
+            return;
+
+        state.condition.notify_all();
+        writer.join();
+
+        std::lock_guard<std::mutex> lock(state.lock);
+        if (state.file != nullptr)
+        {
+            std::fclose(state.file);
+            state.file = nullptr;
+        }
+    }
+
+    // Starts the writer when a level other than None is set while the log is started.
+    inline void SetLevel(Level level)
+    {
+        auto& state = Detail::GetState();
+        std::lock_guard<std::mutex> lock(state.lock);
+
+        state.level.store(static_cast<int32_t>(level), std::memory_order_relaxed);
+        Detail::StartWriterIfEnabled(state);
+    }
+
+    inline Level GetLevel()
+    {
+        return static_cast<Level>(Detail::GetState().level.load(std::memory_order_relaxed));
+    }
+
+    inline bool IsEnabled(Level level)
+    {
+        return level != Level::None
+            && static_cast<int32_t>(level) >= Detail::GetState().level.load(std::memory_order_relaxed);
+    }
+
+    inline uint64_t GetDroppedCount()
+    {
+        return Detail::GetState().droppedCount.load(std::memory_order_relaxed);
+    }
+
+    inline void Write(Level level, const char* message)
+    {
+        if (IsEnabled(level))
+            Detail::Push(level, message, false, 0);
+    }
+
+    inline void Write(Level level, const char* message, int64_t value)
+    {
+        if (IsEnabled(level))
+            Detail::Push(level, message, true, value);
+    }
+}
@@ -0,0 +1,766 @@
+#include <algorithm>
+#include <vector>
+
+#include "BitReader.h"
+#include "BitWriter.h"
+#include "ParameterSetParser.h"
+
+namespace Bitstream
+{
+    namespace
+    {
+        // Upper bounds of the list sizes, which keep a corrupted parameter set from looping for long.
+        const uint32_t k_MaxH264SpsId = 31;
+        const uint32_t k_MaxH264PpsId = 255;
+        const uint32_t k_MaxHevcSpsId = 15;
+        const uint32_t k_MaxHevcPpsId = 63;
+        const uint32_t k_MaxRefFramesInPocCycle = 255;
+        const uint32_t k_MaxCpbCount = 32;
+        const uint32_t k_MaxShortTermRefPicSets = 64;
+        const uint32_t k_MaxLongTermRefPics = 32;
+        const uint32_t k_MaxDeltaPocs = 16;
+        const uint32_t k_MaxLayerSets = 1024;
+
+        // Where the syntax elements replaced by RewriteSpsForLowLatency are, in bits from the start of the RBSP.
+        struct SpsLayout
+        {
+            size_t   vuiPosition = 0;                  // H.264 vui_parameters_present_flag.
+            size_t   bitstreamRestrictionPosition = 0; // H.264 bitstream_restriction_flag, 0 without VUI.
+            uint32_t maxNumRefFrames = 0;              // H.264 max_num_ref_frames.
+            size_t   orderingInfoPosition = 0;         // HEVC sub-layer ordering info, first entry.
+            size_t   orderingInfoEnd = 0;
+            uint32_t orderingInfoCount = 0;
+            uint32_t maxDecPicBufferingMinus1[8] = {};
+        };
+
+        // Extracts the RBSP of a NAL unit of the expected type and skips its header.
+        bool OpenRbsp(VideoCodec codec, const uint8_t* data, uint32_t size, uint32_t nalUnitType, std::vector<uint8_t>& rbsp)
+        {
+            const uint32_t headerSize = codec == VideoCodec::HEVC ? 2 : 1;
+            if (data == nullptr || size <= headerSize || GetNalUnitType(codec, data[0]) != nalUnitType)
+                return false;
+
+            RemoveEmulationPrevention(data + headerSize, size - headerSize, rbsp);
+            return true;
+        }
+
+        // MaxDpbMbs of ITU-T H.264 table A-1, by level_idc.
+        uint32_t GetH264MaxDpbMbs(uint32_t levelIdc)
+        {
+            switch (levelIdc)
+            {
+                case 9:
+                case 10: return 396;
+                case 11: return 900;
+                case 12:
+                case 13:
+                case 20: return 2376;
+                case 21: return 4752;
+                case 22:
+                case 30: return 8100;
+                case 31: return 18000;
+                case 32: return 20480;
+                case 40:
+                case 41: return 32768;
+                case 42: return 34816;
+                case 50: return 110400;
+                case 51:
+                case 52: return 184320;
+                case 60:
+                case 61:
+                case 62: return 696320;
+                default: return 0;
+            }
+        }
+
+        void SkipH264ScalingList(BitReader& reader, uint32_t size)
+        {
+            int32_t lastScale = 8;
+            int32_t nextScale = 8;
+            for (uint32_t j = 0; j < size && !reader.HasError(); ++j)
+            {
+                if (nextScale != 0)
+                    nextScale = (lastScale + reader.ReadSe() + 256) % 256;
+                lastScale = nextScale == 0 ? lastScale : nextScale;
+            }
+        }
+
+        bool SkipH264HrdParameters(BitReader& reader)
+        {
+            const auto cpbCount = reader.ReadUe() + 1;
+            if (cpbCount > k_MaxCpbCount)
+                return false;
+
+            reader.SkipBits(8); // bit_rate_scale, cpb_size_scale
+            for (uint32_t i = 0; i < cpbCount; ++i)
+            {
+                reader.ReadUe(); // bit_rate_value_minus1
+                reader.ReadUe(); // cpb_size_value_minus1
+                reader.SkipBits(1); // cbr_flag
+            }
+            reader.SkipBits(20); // The 4 delay and offset lengths.
+            return !reader.HasError();
+        }
+
+        bool ParseH264Vui(BitReader& reader, SequenceInfo& info, SpsLayout& layout, bool& hasBitstreamRestriction)
+        {
+            if (reader.ReadFlag()) // aspect_ratio_info_present_flag
+            {
+                const auto aspectRatioIdc = reader.ReadBits(8);
+                if (aspectRatioIdc == 255) // Extended_SAR
+                    reader.SkipBits(32);
+            }
+            if (reader.ReadFlag()) // overscan_info_present_flag
+                reader.SkipBits(1);
+            if (reader.ReadFlag()) // video_signal_type_present_flag
+            {
+                reader.SkipBits(4); // video_format, video_full_range_flag
+                if (reader.ReadFlag()) // colour_description_present_flag
+                    reader.SkipBits(24);
+            }
+            if (reader.ReadFlag()) // chroma_loc_info_present_flag
+            {
+                reader.ReadUe();
+                reader.ReadUe();
+            }
+            if (reader.ReadFlag()) // timing_info_present_flag
+            {
+                info.numUnitsInTick = reader.ReadBits(32);
+                info.timeScale = reader.ReadBits(32);
+                reader.SkipBits(1); // fixed_frame_rate_flag
+            }
+
+            const auto hasNalHrd = reader.ReadFlag();
+            if (hasNalHrd && !SkipH264HrdParameters(reader))
+                return false;
+            const auto hasVclHrd = reader.ReadFlag();
+            if (hasVclHrd && !SkipH264HrdParameters(reader))
+                return false;
+            if (hasNalHrd || hasVclHrd)
+                reader.SkipBits(1); // low_delay_hrd_flag
+            reader.SkipBits(1); // pic_struct_present_flag
+
+            layout.bitstreamRestrictionPosition = reader.GetPosition();
+            hasBitstreamRestriction = reader.ReadFlag();
+            if (hasBitstreamRestriction)
+            {
+                reader.SkipBits(1); // motion_vectors_over_pic_boundaries_flag
+                reader.ReadUe(); // max_bytes_per_pic_denom
+                reader.ReadUe(); // max_bits_per_mb_denom
+                reader.ReadUe(); // log2_max_mv_length_horizontal
+                reader.ReadUe(); // log2_max_mv_length_vertical
+                info.maxNumReorderFrames = reader.ReadUe();
+                info.maxDecFrameBuffering = reader.ReadUe();
+            }
+            return !reader.HasError();
+        }
+
+        bool ParseH264Sps(BitReader& reader, SequenceInfo& info, SpsLayout& layout, uint32_t& spsId)
+        {
+            info.profileIdc = reader.ReadBits(8);
+            info.profileCompatibility = reader.ReadBits(8);
+            info.levelIdc = reader.ReadBits(8);
+            spsId = reader.ReadUe();
+            if (spsId > k_MaxH264SpsId)
+                return false;
+
+            uint32_t chromaFormatIdc = 1;
+            bool hasSeparateColourPlane = false;
+            switch (info.profileIdc)
+            {
+                case 100: case 110: case 122: case 244: case 44: case 83:
+                case 86: case 118: case 128: case 138: case 139: case 134: case 135:
+                {
+                    chromaFormatIdc = reader.ReadUe();
+                    if (chromaFormatIdc > 3)
+                        return false;
+                    if (chromaFormatIdc == 3)
+                        hasSeparateColourPlane = reader.ReadFlag();
+                    reader.ReadUe(); // bit_depth_luma_minus8
+                    reader.ReadUe(); // bit_depth_chroma_minus8
+                    reader.SkipBits(1); // qpprime_y_zero_transform_bypass_flag
+                    if (reader.ReadFlag()) // seq_scaling_matrix_present_flag
+                    {
+                        const uint32_t listCount = chromaFormatIdc != 3 ? 8 : 12;
+                        for (uint32_t i = 0; i < listCount; ++i)
+                        {
+                            if (reader.ReadFlag()) // seq_scaling_list_present_flag
+                                SkipH264ScalingList(reader, i < 6 ? 16 : 64);
+                        }
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+
+            reader.ReadUe(); // log2_max_frame_num_minus4
+            const auto picOrderCntType = reader.ReadUe();
+            if (picOrderCntType == 0)
+            {
+                reader.ReadUe(); // log2_max_pic_order_cnt_lsb_minus4
+            }
+            else if (picOrderCntType == 1)
+            {
+                reader.SkipBits(1); // delta_pic_order_always_zero_flag
+                reader.ReadSe(); // offset_for_non_ref_pic
+                reader.ReadSe(); // offset_for_top_to_bottom_field
+                const auto refFramesInPocCycle = reader.ReadUe();
+                if (refFramesInPocCycle > k_MaxRefFramesInPocCycle)
+                    return false;
+                for (uint32_t i = 0; i < refFramesInPocCycle; ++i)
+                    reader.ReadSe();
+            }
+            else if (picOrderCntType != 2)
+            {
+                return false;
+            }
+
+            layout.maxNumRefFrames = reader.ReadUe();
+            reader.SkipBits(1); // gaps_in_frame_num_value_allowed_flag
+            const auto widthInMbs = reader.ReadUe() + 1;
+            const auto heightInMapUnits = reader.ReadUe() + 1;
+            const auto frameMbsOnly = reader.ReadFlag();
+            if (!frameMbsOnly)
+                reader.SkipBits(1); // mb_adaptive_frame_field_flag
+            reader.SkipBits(1); // direct_8x8_inference_flag
+
+            const uint32_t frameHeightInMbs = (frameMbsOnly ? 1 : 2) * heightInMapUnits;
+            info.width = widthInMbs * 16;
+            info.height = frameHeightInMbs * 16;
+
+            if (reader.ReadFlag()) // frame_cropping_flag
+            {
+                // ChromaArrayType is 0 for monochrome and separate colour planes.
+                const auto chromaArrayType = hasSeparateColourPlane ? 0 : chromaFormatIdc;
+                const uint32_t cropUnitX = (chromaArrayType == 1 || chromaArrayType == 2) ? 2 : 1;
+                const uint32_t cropUnitY = (chromaArrayType == 1 ? 2 : 1) * (frameMbsOnly ? 1 : 2);
+
+                const auto left = reader.ReadUe();
+                const auto right = reader.ReadUe();
+                const auto top = reader.ReadUe();
+                const auto bottom = reader.ReadUe();
+                const auto cropX = static_cast<uint64_t>(cropUnitX) * (left + right);
+                const auto cropY = static_cast<uint64_t>(cropUnitY) * (top + bottom);
+                if (cropX >= info.width || cropY >= info.height)
+                    return false;
+
+                info.width -= static_cast<uint32_t>(cropX);
+                info.height -= static_cast<uint32_t>(cropY);
+            }
+
+            bool hasBitstreamRestriction = false;
+            layout.vuiPosition = reader.GetPosition();
+            if (reader.ReadFlag() && !ParseH264Vui(reader, info, layout, hasBitstreamRestriction)) // vui_parameters_present_flag
+                return false;
+
+            if (!hasBitstreamRestriction)
+            {
+                // Inferred as MaxDpbFrames (E.2.1), or 0 for the intra profiles.
+                const auto maxDpbMbs = GetH264MaxDpbMbs(info.levelIdc);
+                const auto maxDpbFrames = maxDpbMbs == 0 ? 16u : (std::min)(maxDpbMbs / (widthInMbs * frameHeightInMbs), 16u);
+                const auto isIntraProfile = (info.profileCompatibility & 0x10) != 0
+                    && (info.profileIdc == 44 || info.profileIdc == 86 || info.profileIdc == 100
+                        || info.profileIdc == 110 || info.profileIdc == 122 || info.profileIdc == 244);
+
+                info.maxDecFrameBuffering = isIntraProfile ? 0 : maxDpbFrames;
+                info.maxNumReorderFrames = isIntraProfile ? 0 : maxDpbFrames;
+            }
+
+            return reader.IsAtTrailingBits();
+        }
+
+        bool ParseProfileTierLevel(BitReader& reader, uint32_t maxSubLayersMinus1, SequenceInfo& info)
+        {
+            info.profileSpace = reader.ReadBits(2);
+            info.tierFlag = reader.ReadBits(1);
+            info.profileIdc = reader.ReadBits(5);
+            info.profileCompatibility = reader.ReadBits(32);
+            reader.SkipBits(48); // Source and constraint flags.
+            info.levelIdc = reader.ReadBits(8);
+
+            bool subLayerProfilePresent[8] = {};
+            bool subLayerLevelPresent[8] = {};
+            for (uint32_t i = 0; i < maxSubLayersMinus1; ++i)
+            {
+                subLayerProfilePresent[i] = reader.ReadFlag();
+                subLayerLevelPresent[i] = reader.ReadFlag();
+            }
+            if (maxSubLayersMinus1 > 0)
+                reader.SkipBits(2 * (8 - maxSubLayersMinus1)); // reserved_zero_2bits
+
+            for (uint32_t i = 0; i < maxSubLayersMinus1; ++i)
+            {
+                if (subLayerProfilePresent[i])
+                    reader.SkipBits(88);
+                if (subLayerLevelPresent[i])
+                    reader.SkipBits(8);
+            }
+            return !reader.HasError();
+        }
+
+        void SkipHevcSubLayerHrdParameters(BitReader& reader, uint32_t cpbCount, bool hasSubPicParams)
+        {
+            for (uint32_t i = 0; i < cpbCount; ++i)
+            {
+                reader.ReadUe(); // bit_rate_value_minus1
+                reader.ReadUe(); // cpb_size_value_minus1
+                if (hasSubPicParams)
+                {
+                    reader.ReadUe(); // cpb_size_du_value_minus1
+                    reader.ReadUe(); // bit_rate_du_value_minus1
+                }
+                reader.SkipBits(1); // cbr_flag
+            }
+        }
+
+        // hrd_parameters() with commonInfPresentFlag set, as in the VUI.
+        bool SkipHevcHrdParameters(BitReader& reader, uint32_t maxSubLayersMinus1)
+        {
+            const auto hasNalHrd = reader.ReadFlag();
+            const auto hasVclHrd = reader.ReadFlag();
+            bool hasSubPicParams = false;
+            if (hasNalHrd || hasVclHrd)
+            {
+                hasSubPicParams = reader.ReadFlag();
+                if (hasSubPicParams)
+                    reader.SkipBits(19); // tick_divisor_minus2 to dpb_output_delay_du_length_minus1
+                reader.SkipBits(8); // bit_rate_scale, cpb_size_scale
+                if (hasSubPicParams)
+                    reader.SkipBits(4); // cpb_size_du_scale
+                reader.SkipBits(15); // The 3 delay lengths.
+            }
+
+            for (uint32_t i = 0; i <= maxSubLayersMinus1; ++i)
+            {
+                const auto fixedPicRateGeneral = reader.ReadFlag();
+                const auto fixedPicRateWithinCvs = fixedPicRateGeneral ? true : reader.ReadFlag();
+                bool lowDelayHrd = false;
+                if (fixedPicRateWithinCvs)
+                    reader.ReadUe(); // elemental_duration_in_tc_minus1
+                else
+                    lowDelayHrd = reader.ReadFlag();
+
+                const auto cpbCount = lowDelayHrd ? 1 : reader.ReadUe() + 1;
+                if (cpbCount > k_MaxCpbCount)
+                    return false;
+
+                if (hasNalHrd)
+                    SkipHevcSubLayerHrdParameters(reader, cpbCount, hasSubPicParams);
+                if (hasVclHrd)
+                    SkipHevcSubLayerHrdParameters(reader, cpbCount, hasSubPicParams);
+            }
+            return !reader.HasError();
+        }
+
+        bool ParseHevcVui(BitReader& reader, uint32_t maxSubLayersMinus1, SequenceInfo& info)
+        {
+            if (reader.ReadFlag()) // aspect_ratio_info_present_flag
+            {
+                const auto aspectRatioIdc = reader.ReadBits(8);
+                if (aspectRatioIdc == 255) // EXTENDED_SAR
+                    reader.SkipBits(32);
+            }
+            if (reader.ReadFlag()) // overscan_info_present_flag
+                reader.SkipBits(1);
+            if (reader.ReadFlag()) // video_signal_type_present_flag
+            {
+                reader.SkipBits(4); // video_format, video_full_range_flag
+                if (reader.ReadFlag()) // colour_description_present_flag
+                    reader.SkipBits(24);
+            }
+            if (reader.ReadFlag()) // chroma_loc_info_present_flag
+            {
+                reader.ReadUe();
+                reader.ReadUe();
+            }
+            reader.SkipBits(3); // neutral_chroma_indication_flag, field_seq_flag, frame_field_info_present_flag
+            if (reader.ReadFlag()) // default_display_window_flag
+            {
+                for (int i = 0; i < 4; ++i)
+                    reader.ReadUe();
+            }
+            if (reader.ReadFlag()) // vui_timing_info_present_flag
+            {
+                info.numUnitsInTick = reader.ReadBits(32);
+                info.timeScale = reader.ReadBits(32);
+                if (reader.ReadFlag()) // vui_poc_proportional_to_timing_flag
+                    reader.ReadUe();
+                if (reader.ReadFlag() && !SkipHevcHrdParameters(reader, maxSubLayersMinus1)) // vui_hrd_parameters_present_flag
+                    return false;
+            }
+            if (reader.ReadFlag()) // bitstream_restriction_flag
+            {
+                reader.SkipBits(3); // tiles_fixed_structure_flag to restricted_ref_pic_lists_flag
+                for (int i = 0; i < 5; ++i)
+                    reader.ReadUe(); // min_spatial_segmentation_idc to log2_max_mv_length_vertical
+            }
+            return !reader.HasError();
+        }
+
+        void SkipHevcScalingListData(BitReader& reader)
+        {
+            for (uint32_t sizeId = 0; sizeId < 4; ++sizeId)
+            {
+                for (uint32_t matrixId = 0; matrixId < 6; matrixId += (sizeId == 3) ? 3 : 1)
+                {
+                    if (!reader.ReadFlag()) // scaling_list_pred_mode_flag
+                    {
+                        reader.ReadUe(); // scaling_list_pred_matrix_id_delta
+                        continue;
+                    }
+
+                    const auto coefCount = (std::min)(64u, 1u << (4 + (sizeId << 1)));
+                    if (sizeId > 1)
+                        reader.ReadSe(); // scaling_list_dc_coef_minus8
+                    for (uint32_t i = 0; i < coefCount; ++i)
+                        reader.ReadSe(); // scaling_list_delta_coef
+                }
+            }
+        }
+
+        // st_ref_pic_set() as found in the SPS, where an inter predicted set refers to the previous one.
+        bool SkipHevcShortTermRefPicSet(BitReader& reader, uint32_t index, uint32_t* deltaPocCounts)
+        {
+            const auto isInterPredicted = index != 0 && reader.ReadFlag();
+            if (isInterPredicted)
+            {
+                reader.SkipBits(1); // delta_rps_sign
+                reader.ReadUe(); // abs_delta_rps_minus1
+
+                uint32_t deltaPocCount = 0;
+                for (uint32_t j = 0; j <= deltaPocCounts[index - 1]; ++j)
+                {
+                    const auto usedByCurrPic = reader.ReadFlag();
+                    const auto useDelta = usedByCurrPic ? true : reader.ReadFlag();
+                    if (usedByCurrPic || useDelta)
+                        deltaPocCount++;
+                }
+                deltaPocCounts[index] = deltaPocCount;
+                return !reader.HasError() && deltaPocCount <= k_MaxDeltaPocs;
+            }
+
+            const auto negativeCount = reader.ReadUe();
+            const auto positiveCount = reader.ReadUe();
+            if (negativeCount > k_MaxDeltaPocs || positiveCount > k_MaxDeltaPocs)
+                return false;
+
+            for (uint32_t i = 0; i < negativeCount + positiveCount; ++i)
+            {
+                reader.ReadUe(); // delta_poc_s0_minus1 / delta_poc_s1_minus1
+                reader.SkipBits(1); // used_by_curr_pic_s0_flag / used_by_curr_pic_s1_flag
+            }
+            deltaPocCounts[index] = negativeCount + positiveCount;
+            return !reader.HasError();
+        }
+
+        bool ParseHevcSps(BitReader& reader, SequenceInfo& info, SpsLayout& layout, uint32_t& spsId, uint32_t& vpsId)
+        {
+            vpsId = reader.ReadBits(4);
+            const auto maxSubLayersMinus1 = reader.ReadBits(3);
+            reader.SkipBits(1); // sps_temporal_id_nesting_flag
+            if (maxSubLayersMinus1 > 6 || !ParseProfileTierLevel(reader, maxSubLayersMinus1, info))
+                return false;
+
+            spsId = reader.ReadUe();
+            const auto chromaFormatIdc = reader.ReadUe();
+            if (spsId > k_MaxHevcSpsId || chromaFormatIdc > 3)
+                return false;
+
+            const auto hasSeparateColourPlane = chromaFormatIdc == 3 && reader.ReadFlag();
+            info.width = reader.ReadUe();
+            info.height = reader.ReadUe();
+
+            if (reader.ReadFlag()) // conformance_window_flag
+            {
+                const auto chromaArrayType = hasSeparateColourPlane ? 0 : chromaFormatIdc;
+                const uint32_t subWidthC = (chromaArrayType == 1 || chromaArrayType == 2) ? 2 : 1;
+                const uint32_t subHeightC = chromaArrayType == 1 ? 2 : 1;
+
+                const auto left = reader.ReadUe();
+                const auto right = reader.ReadUe();
+                const auto top = reader.ReadUe();
+                const auto bottom = reader.ReadUe();
+                const auto cropX = static_cast<uint64_t>(subWidthC) * (left + right);
+                const auto cropY = static_cast<uint64_t>(subHeightC) * (top + bottom);
+                if (cropX >= info.width || cropY >= info.height)
+                    return false;
+
+                info.width -= static_cast<uint32_t>(cropX);
+                info.height -= static_cast<uint32_t>(cropY);
+            }
+
+            reader.ReadUe(); // bit_depth_luma_minus8
+            reader.ReadUe(); // bit_depth_chroma_minus8
+            const auto log2MaxPocLsb = reader.ReadUe() + 4;
+            if (log2MaxPocLsb > 16)
+                return false;
+
+            // The values of the highest sub-layer apply to the whole stream.
+            const auto hasSubLayerOrderingInfo = reader.ReadFlag();
+            layout.orderingInfoPosition = reader.GetPosition();
+            for (uint32_t i = hasSubLayerOrderingInfo ? 0 : maxSubLayersMinus1; i <= maxSubLayersMinus1; ++i)
+            {
+                const auto maxDecPicBufferingMinus1 = reader.ReadUe();
+                layout.maxDecPicBufferingMinus1[layout.orderingInfoCount++] = maxDecPicBufferingMinus1;
+                info.maxDecFrameBuffering = maxDecPicBufferingMinus1 + 1;
+                info.maxNumReorderFrames = reader.ReadUe();
+                reader.ReadUe(); // sps_max_latency_increase_plus1
+            }
+            layout.orderingInfoEnd = reader.GetPosition();
+
+            for (int i = 0; i < 6; ++i)
+                reader.ReadUe(); // log2_min_luma_coding_block_size_minus3 to max_transform_hierarchy_depth_intra
+
+            if (reader.ReadFlag() && reader.ReadFlag()) // scaling_list_enabled_flag, sps_scaling_list_data_present_flag
+                SkipHevcScalingListData(reader);
+
+            reader.SkipBits(2); // amp_enabled_flag, sample_adaptive_offset_enabled_flag
+            if (reader.ReadFlag()) // pcm_enabled_flag
+            {
+                reader.SkipBits(8); // pcm_sample_bit_depth_luma_minus1, pcm_sample_bit_depth_chroma_minus1
+                reader.ReadUe(); // log2_min_pcm_luma_coding_block_size_minus3
+                reader.ReadUe(); // log2_diff_max_min_pcm_luma_coding_block_size
+                reader.SkipBits(1); // pcm_loop_filter_disabled_flag
+            }
+
+            const auto shortTermRefPicSetCount = reader.ReadUe();
+            if (shortTermRefPicSetCount > k_MaxShortTermRefPicSets)
+                return false;
+
+            uint32_t deltaPocCounts[k_MaxShortTermRefPicSets] = {};
+            for (uint32_t i = 0; i < shortTermRefPicSetCount; ++i)
+            {
+                if (!SkipHevcShortTermRefPicSet(reader, i, deltaPocCounts))
+                    return false;
+            }
+
+            if (reader.ReadFlag()) // long_term_ref_pics_present_flag
+            {
+                const auto longTermRefPicCount = reader.ReadUe();
+                if (longTermRefPicCount > k_MaxLongTermRefPics)
+                    return false;
+                reader.SkipBits(longTermRefPicCount * (log2MaxPocLsb + 1)); // lt_ref_pic_poc_lsb_sps, used_by_curr_pic_lt_sps_flag
+            }
+            reader.SkipBits(2); // sps_temporal_mvp_enabled_flag, strong_intra_smoothing_enabled_flag
+
+            if (reader.ReadFlag() && !ParseHevcVui(reader, maxSubLayersMinus1, info)) // vui_parameters_present_flag
+                return false;
+
+            // The extensions are not parsed, only a stream without them is checked to end where expected.
+            if (reader.ReadFlag()) // sps_extension_present_flag
+                return !reader.HasError();
+            return reader.IsAtTrailingBits();
+        }
+
+        bool ParseHevcVps(BitReader& reader, SequenceInfo& info, uint32_t& vpsId)
+        {
+            vpsId = reader.ReadBits(4);
+            reader.SkipBits(8); // vps_base_layer_internal_flag, vps_base_layer_available_flag, vps_max_layers_minus1
+            const auto maxSubLayersMinus1 = reader.ReadBits(3);
+            reader.SkipBits(17); // vps_temporal_id_nesting_flag, vps_reserved_0xffff_16bits
+            if (maxSubLayersMinus1 > 6 || !ParseProfileTierLevel(reader, maxSubLayersMinus1, info))
+                return false;
+
+            const auto hasSubLayerOrderingInfo = reader.ReadFlag();
+            for (uint32_t i = hasSubLayerOrderingInfo ? 0 : maxSubLayersMinus1; i <= maxSubLayersMinus1; ++i)
+            {
+                reader.ReadUe(); // vps_max_dec_pic_buffering_minus1
+                reader.ReadUe(); // vps_max_num_reorder_pics
+                reader.ReadUe(); // vps_max_latency_increase_plus1
+            }
+
+            const auto maxLayerId = reader.ReadBits(6);
+            const auto layerSetCount = reader.ReadUe() + 1;
+            if (layerSetCount > k_MaxLayerSets)
+                return false;
+            reader.SkipBits(static_cast<size_t>(layerSetCount - 1) * (maxLayerId + 1)); // layer_id_included_flag
+
+            if (reader.ReadFlag()) // vps_timing_info_present_flag
+            {
+                info.numUnitsInTick = reader.ReadBits(32);
+                info.timeScale = reader.ReadBits(32);
+            }
+            return !reader.HasError();
+        }
+
+        // Position of the rbsp_stop_one_bit, the last bit set in the RBSP.
+        size_t GetStopBitPosition(const std::vector<uint8_t>& rbsp)
+        {
+            auto size = rbsp.size();
+            while (size > 0 && rbsp[size - 1] == 0)
+                size--;
+            if (size == 0)
+                return 0;
+
+            uint32_t trailingZeros = 0;
+            while (((rbsp[size - 1] >> trailingZeros) & 1) == 0)
+                trailingZeros++;
+            return size * 8 - 1 - trailingZeros;
+        }
+    }
+
+    bool ParseSps(VideoCodec codec, const uint8_t* data, uint32_t size, SequenceInfo& info, uint32_t& spsId)
+    {
+        const auto isHevc = codec == VideoCodec::HEVC;
+        std::vector<uint8_t> rbsp;
+        if (!OpenRbsp(codec, data, size, isHevc ? k_HevcNalSps : k_H264NalSps, rbsp))
+            return false;
+
+        BitReader reader(rbsp.data(), rbsp.size());
+        SpsLayout layout;
+        uint32_t vpsId = 0;
+        return isHevc ? ParseHevcSps(reader, info, layout, spsId, vpsId) : ParseH264Sps(reader, info, layout, spsId);
+    }
+
+    bool ParsePps(VideoCodec codec, const uint8_t* data, uint32_t size, uint32_t& ppsId, uint32_t& spsId)
+    {
+        const auto isHevc = codec == VideoCodec::HEVC;
+        std::vector<uint8_t> rbsp;
+        if (!OpenRbsp(codec, data, size, isHevc ? k_HevcNalPps : k_H264NalPps, rbsp))
+            return false;
+
+        BitReader reader(rbsp.data(), rbsp.size());
+        ppsId = reader.ReadUe();
+        spsId = reader.ReadUe();
+        return !reader.HasError()
+            && ppsId <= (isHevc ? k_MaxHevcPpsId : k_MaxH264PpsId)
+            && spsId <= (isHevc ? k_MaxHevcSpsId : k_MaxH264SpsId);
+    }
+
+    bool ParseVps(const uint8_t* data, uint32_t size, SequenceInfo& info, uint32_t& vpsId)
+    {
+        std::vector<uint8_t> rbsp;
+        if (!OpenRbsp(VideoCodec::HEVC, data, size, k_HevcNalVps, rbsp))
+            return false;
+
+        BitReader reader(rbsp.data(), rbsp.size());
+        return ParseHevcVps(reader, info, vpsId);
+    }
+
+    bool ParseSequenceInfo(VideoCodec codec,
+                           const uint8_t* vps, uint32_t vpsSize,
+                           const uint8_t* sps, uint32_t spsSize,
+                           const uint8_t* pps, uint32_t ppsSize,
+                           SequenceInfo& info)
+    {
+        info = {};
+
+        const auto isHevc = codec == VideoCodec::HEVC;
+        std::vector<uint8_t> rbsp;
+        if (!OpenRbsp(codec, sps, spsSize, isHevc ? k_HevcNalSps : k_H264NalSps, rbsp))
+            return false;
+
+        SequenceInfo sequenceInfo = {};
+        SpsLayout layout;
+        uint32_t spsId = 0;
+        uint32_t spsVpsId = 0;
+        BitReader reader(rbsp.data(), rbsp.size());
+        if (!(isHevc ? ParseHevcSps(reader, sequenceInfo, layout, spsId, spsVpsId) : ParseH264Sps(reader, sequenceInfo, layout, spsId)))
+            return false;
+
+        uint32_t ppsId = 0;
+        uint32_t ppsSpsId = 0;
+        if (!ParsePps(codec, pps, ppsSize, ppsId, ppsSpsId) || ppsSpsId != spsId)
+            return false;
+
+        if (isHevc)
+        {
+            SequenceInfo vpsInfo = {};
+            uint32_t vpsId = 0;
+            if (!ParseVps(vps, vpsSize, vpsInfo, vpsId) || vpsId != spsVpsId)
+                return false;
+
+            if (sequenceInfo.timeScale == 0)
+            {
+                sequenceInfo.numUnitsInTick = vpsInfo.numUnitsInTick;
+                sequenceInfo.timeScale = vpsInfo.timeScale;
+            }
+        }
+
+        info = sequenceInfo;
+        info.isValid = 1;
+        return true;
+    }
+
+    bool RewriteSpsForLowLatency(VideoCodec codec, const uint8_t* data, uint32_t size, std::vector<uint8_t>& output)
+    {
+        output.clear();
+
+        const auto isHevc = codec == VideoCodec::HEVC;
+        std::vector<uint8_t> rbsp;
+        if (!OpenRbsp(codec, data, size, isHevc ? k_HevcNalSps : k_H264NalSps, rbsp))
+            return false;
+
+        SequenceInfo info = {};
+        SpsLayout layout;
+        uint32_t spsId = 0;
+        uint32_t vpsId = 0;
+        BitReader reader(rbsp.data(), rbsp.size());
+        if (!(isHevc ? ParseHevcSps(reader, info, layout, spsId, vpsId) : ParseH264Sps(reader, info, layout, spsId)))
+            return false;
+
+        // The syntax elements before and after the rewritten ones are copied bit for bit.
+        BitReader source(rbsp.data(), rbsp.size());
+        BitWriter writer;
+        if (isHevc)
+        {
+            // The DPB size of each sub-layer is kept for its references.
+            writer.CopyBits(source, layout.orderingInfoPosition);
+            for (uint32_t i = 0; i < layout.orderingInfoCount; ++i)
+            {
+                writer.WriteUe(layout.maxDecPicBufferingMinus1[i]);
+                writer.WriteUe(0); // sps_max_num_reorder_pics
+                writer.WriteUe(0); // sps_max_latency_increase_plus1
+            }
+            source.SkipBits(layout.orderingInfoEnd - layout.orderingInfoPosition);
+            writer.CopyBits(source, GetStopBitPosition(rbsp) - layout.orderingInfoEnd);
+        }
+        else
+        {
+            // The bitstream restriction ends the VUI, which ends the SPS.
+            const auto hasVui = layout.bitstreamRestrictionPosition != 0;
+            writer.CopyBits(source, hasVui ? layout.bitstreamRestrictionPosition : layout.vuiPosition);
+            if (!hasVui)
+            {
+                writer.WriteFlag(true); // vui_parameters_present_flag
+                writer.WriteBits(0, 8); // aspect_ratio_info_present_flag to pic_struct_present_flag
+            }
+
+            // The motion vector limits are kept, or set to their inferred values.
+            bool motionVectorsOverPicBoundaries = true;
+            uint32_t motionVectorLimits[4] = { 2, 1, 16, 16 };
+            if (hasVui && source.ReadFlag())
+            {
+                motionVectorsOverPicBoundaries = source.ReadFlag();
+                for (auto& limit : motionVectorLimits)
+                    limit = source.ReadUe();
+            }
+
+            writer.WriteFlag(true); // bitstream_restriction_flag
+            writer.WriteFlag(motionVectorsOverPicBoundaries);
+            for (auto limit : motionVectorLimits)
+                writer.WriteUe(limit);
+            writer.WriteUe(0); // max_num_reorder_frames
+            writer.WriteUe((std::max)(1u, layout.maxNumRefFrames)); // max_dec_frame_buffering
+        }
+        writer.WriteTrailingBits();
+
+        const uint32_t headerSize = isHevc ? 2 : 1;
+        output.assign(data, data + headerSize);
+        AddEmulationPrevention(writer.GetData().data(), writer.GetData().size(), output);
+
+        // Checks that only the reordering changed.
+        SequenceInfo rewrittenInfo = {};
+        uint32_t rewrittenSpsId = 0;
+        if (!ParseSps(codec, output.data(), static_cast<uint32_t>(output.size()), rewrittenInfo, rewrittenSpsId)
+            || rewrittenSpsId != spsId || rewrittenInfo.maxNumReorderFrames != 0
+            || rewrittenInfo.width != info.width || rewrittenInfo.height != info.height
+            || rewrittenInfo.timeScale != info.timeScale || rewrittenInfo.levelIdc != info.levelIdc)
+        {
+            output.clear();
+            return false;
+        }
+        return true;
+    }
+}
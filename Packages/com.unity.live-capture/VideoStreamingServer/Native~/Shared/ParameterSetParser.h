@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Bitstream.h"
+
+namespace Bitstream
+{
+    // Parsers and rewriter of the parameter sets that describe a stream, see ITU-T H.264 7.3.2.1 & E.1
+    // and ITU-T H.265 7.3.2 & E.2. The NAL units are given without their start code but with their
+    // header and emulation prevention bytes.
+    //
+    // The functions return false if a NAL unit is truncated, has the wrong type or an out of range value.
+
+    // Fills every field of the SequenceInfo but isValid, and the id of the SPS.
+    bool ParseSps(VideoCodec codec, const uint8_t* data, uint32_t size, SequenceInfo& info, uint32_t& spsId);
+
+    // The id of the PPS and of the SPS it refers to.
+    bool ParsePps(VideoCodec codec, const uint8_t* data, uint32_t size, uint32_t& ppsId, uint32_t& spsId);
+
+    // Fills the profile, tier & level fields of the SequenceInfo, and its timing when the VPS signals it.
+    bool ParseVps(const uint8_t* data, uint32_t size, SequenceInfo& info, uint32_t& vpsId);
+
+    // Parses the parameter sets of a session: the PPS must refer to the SPS, and for HEVC the SPS to the
+    // VPS. The VPS timing is used when the SPS has none. info is zeroed on failure.
+    bool ParseSequenceInfo(VideoCodec codec,
+                           const uint8_t* vps, uint32_t vpsSize,
+                           const uint8_t* sps, uint32_t spsSize,
+                           const uint8_t* pps, uint32_t ppsSize,
+                           SequenceInfo& info);
+
+    // Rewrites an SPS so that decoders output each picture as soon as it is decoded instead of filling their
+    // DPB first. For H.264, the VUI gets a bitstream restriction with max_num_reorder_frames 0 and
+    // max_dec_frame_buffering max(1, max_num_ref_frames), a VUI is added if there is none. For HEVC, which
+    // signals the reordering in the sub-layer ordering info, sps_max_num_reorder_pics and
+    // sps_max_latency_increase_plus1 are set to 0. The other syntax elements are copied bit for bit.
+    //
+    // Only valid for streams without frame reordering (no B-frames). Returns false, and an empty output, if
+    // the SPS can't be parsed.
+    bool RewriteSpsForLowLatency(VideoCodec codec, const uint8_t* data, uint32_t size, std::vector<uint8_t>& output);
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+// The map from the encoder handles held by the managed side to the native encoders, shared by the encoder
+// plugins.
+//
+// A handle packs the index of a slot and the generation the slot had when it was reserved. Reserving a
+// slot again bumps its generation: a stale handle, e.g. held by an encoder that was finalized, selects the
+// slot but no longer matches the handle stored in it.
+//
+// The main thread looks entries up while the render thread binds and retires them. Acquire is lock-free
+// and returns a reference that keeps the instance alive: Retire unpublishes the handle, then waits for the
+// references taken before to be released, so that the caller can destroy the instance right after.
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+namespace Handles
+{
+    template <typename T, uint32_t Capacity = 64> class SlotMap final
+    {
+        static_assert(Capacity > 1 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two.");
+
+        struct Slot;
+
+    public:
+        // Keeps the instance of an entry alive until destroyed, see Retire.
+        class Ref final
+        {
+        public:
+            Ref() = default;
+            Ref(const Ref&) = delete;
+            Ref& operator=(const Ref&) = delete;
+
+            Ref(Ref&& other) noexcept
+                : m_Slot(other.m_Slot)
+                , m_Instance(other.m_Instance)
+            {
+                other.m_Slot = nullptr;
+                other.m_Instance = nullptr;
+            }
+
+            ~Ref()
+            {
+                if (m_Slot != nullptr)
+                    m_Slot->refCount.fetch_sub(1, std::memory_order_release);
+            }
+
+            inline T* Get() const { return m_Instance; }
+            inline T* operator->() const { return m_Instance; }
+            inline T& operator*() const { return *m_Instance; }
+            inline explicit operator bool() const { return m_Instance != nullptr; }
+
+        private:
+            friend class SlotMap;
+
+            Ref(Slot* slot, T* instance)
+                : m_Slot(slot)
+                , m_Instance(instance)
+            {
+            }
+
+            Slot* m_Slot = nullptr;
+            T*    m_Instance = nullptr;
+        };
+
+        SlotMap() = default;
+        SlotMap(const SlotMap&) = delete;
+        SlotMap& operator=(const SlotMap&) = delete;
+
+        // Returns a new handle, always positive, or 0 if every slot is in use. The handle has no instance
+        // until Bind is called.
+        inline int Reserve()
+        {
+            std::lock_guard<std::mutex> guard(m_WriteLock);
+
+            // The slots are reused in turn rather than lowest first, so that the generations of a slot
+            // wrap as late as possible.
+            for (uint32_t i = 0; i < Capacity; ++i)
+            {
+                const auto index = (m_NextIndex + i) & k_IndexMask;
+                auto& slot = m_Slots[index];
+                if (slot.handle.load(std::memory_order_relaxed) != k_Free)
+                    continue;
+
+                slot.generation = slot.generation % k_MaxGeneration + 1;
+                const auto handle = static_cast<int>((slot.generation << k_IndexBits) | index);
+                slot.handle.store(handle, std::memory_order_release);
+                m_NextIndex = index + 1;
+                return handle;
+            }
+            return k_Free;
+        }
+
+        // Publishes the instance of a reserved handle. Returns false if the handle is stale or already bound.
+        inline bool Bind(int handle, T* instance)
+        {
+            if (handle <= 0 || instance == nullptr)
+                return false;
+
+            std::lock_guard<std::mutex> guard(m_WriteLock);
+
+            auto& slot = m_Slots[handle & k_IndexMask];
+            if (slot.handle.load(std::memory_order_relaxed) != handle
+                || slot.instance.load(std::memory_order_relaxed) != nullptr)
+                return false;
+
+            slot.instance.store(instance, std::memory_order_release);
+            return true;
+        }
+
+        // Returns a reference to the instance bound to the handle, empty if the handle is stale, retired or
+        // not bound yet.
+        inline Ref Acquire(int handle) const
+        {
+            if (handle <= 0)
+                return Ref();
+
+            auto& slot = m_Slots[handle & k_IndexMask];
+
+            // Counted before the handle is checked: Retire either sees the reference, or it unpublished the
+            // handle before and the check fails. Both sides must be sequentially consistent for that.
+            slot.refCount.fetch_add(1, std::memory_order_seq_cst);
+            auto instance = slot.handle.load(std::memory_order_seq_cst) == handle
+                ? slot.instance.load(std::memory_order_acquire)
+                : nullptr;
+
+            if (instance == nullptr)
+            {
+                slot.refCount.fetch_sub(1, std::memory_order_release);
+                return Ref();
+            }
+            return Ref(&slot, instance);
+        }
+
+        // Frees the slot of the handle and returns its instance, nullptr if the handle is stale or wasn't
+        // bound, once the references acquired before are released. Must not be called by a thread that holds
+        // a reference.
+        inline T* Retire(int handle)
+        {
+            if (handle <= 0)
+                return nullptr;
+
+            std::lock_guard<std::mutex> guard(m_WriteLock);
+
+            auto& slot = m_Slots[handle & k_IndexMask];
+            if (slot.handle.load(std::memory_order_relaxed) != handle)
+                return nullptr;
+
+            slot.handle.store(k_Free, std::memory_order_seq_cst);
+
+            // The references are held for the duration of an export call.
+            while (slot.refCount.load(std::memory_order_seq_cst) != 0)
+                std::this_thread::yield();
+
+            return slot.instance.exchange(nullptr, std::memory_order_acquire);
+        }
+
+    private:
+        static constexpr uint32_t Log2(uint32_t value)
+        {
+            return value > 1 ? 1 + Log2(value >> 1) : 0;
+        }
+
+        static const int      k_Free = 0;
+        static const uint32_t k_IndexBits = Log2(Capacity);
+        static const uint32_t k_IndexMask = Capacity - 1;
+        static const uint32_t k_MaxGeneration = (1u << (31 - k_IndexBits)) - 1;
+
+        struct Slot
+        {
+            std::atomic<int>      handle = { k_Free };
+            std::atomic<T*>       instance = { nullptr };
+            std::atomic<uint32_t> refCount = { 0 };
+            uint32_t              generation = 0; // Only accessed under the lock.
+        };
+
+        mutable Slot m_Slots[Capacity];
+        uint32_t     m_NextIndex = 0;
+        std::mutex   m_WriteLock;
+    };
+}
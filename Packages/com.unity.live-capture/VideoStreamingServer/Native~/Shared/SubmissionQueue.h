@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+#include "CacheLine.h"
+
+namespace Threading
+{
+    // A bounded single-producer/single-consumer queue of commands handed over by the render thread to
+    // the submission thread of an encoder, shared by the encoder plugins.
+    //
+    // Push never blocks: it writes the command into a preallocated slot and only takes the lock to wake
+    // up the consumer when it is sleeping. The consumer calls Done once a popped command is processed,
+    // which lets the producer wait with WaitIdle until everything pushed so far has been processed.
+    template <typename T, uint32_t Capacity> class SubmissionQueue final
+    {
+    public:
+        SubmissionQueue() = default;
+        SubmissionQueue(const SubmissionQueue&) = delete;
+        SubmissionQueue& operator=(const SubmissionQueue&) = delete;
+
+        // Producer: returns false if the queue is full or closed.
+        inline bool Push(const T& command)
+        {
+            const auto tail = m_Tail.load(std::memory_order_relaxed);
+            if (m_IsClosed.load() || tail - m_Head.load(std::memory_order_acquire) >= Capacity)
+                return false;
+
+            m_Commands[tail % Capacity] = command;
+            m_Tail.store(tail + 1);
+
+            // Pairs with the consumer, which publishes that it sleeps before checking the queue again.
+            if (m_IsConsumerWaiting.load())
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_Lock);
+                }
+                m_Condition.notify_one();
+            }
+            return true;
+        }
+
+        // Consumer: blocks until a command is available. Returns false once the queue is closed and empty.
+        inline bool WaitPop(T& command)
+        {
+            if (TryPop(command))
+                return true;
+
+            std::unique_lock<std::mutex> lock(m_Lock);
+            for (;;)
+            {
+                m_IsConsumerWaiting.store(true);
+                if (TryPop(command))
+                {
+                    m_IsConsumerWaiting.store(false);
+                    return true;
+                }
+
+                if (m_IsClosed.load())
+                {
+                    m_IsConsumerWaiting.store(false);
+                    return false;
+                }
+
+                m_Condition.wait(lock);
+            }
+        }
+
+        // Consumer: the last popped command has been processed.
+        inline void Done()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_Lock);
+                m_DoneCount++;
+            }
+            m_IdleCondition.notify_all();
+        }
+
+        // Producer: blocks until every command pushed so far has been processed.
+        inline void WaitIdle()
+        {
+            const auto tail = m_Tail.load(std::memory_order_relaxed);
+
+            std::unique_lock<std::mutex> lock(m_Lock);
+            m_IdleCondition.wait(lock, [this, tail] { return m_DoneCount >= tail; });
+        }
+
+        // Wakes up the consumer, which stops once the pending commands are processed.
+        inline void Close()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_Lock);
+                m_IsClosed = true;
+            }
+            m_Condition.notify_all();
+        }
+
+        // Must not be called while a producer or consumer is active.
+        inline void Reset()
+        {
+            m_Head = 0;
+            m_Tail = 0;
+            m_DoneCount = 0;
+            m_IsClosed = false;
+        }
+
+    private:
+        inline bool TryPop(T& command)
+        {
+            const auto head = m_Head.load(std::memory_order_relaxed);
+            if (head == m_Tail.load())
+                return false;
+
+            command = m_Commands[head % Capacity];
+            m_Head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        T m_Commands[Capacity];
+
+        // Each on its own cache line, see CacheLine.h.
+        CacheLinePadding<0>                                 m_FirstPadding;
+        std::atomic<uint64_t>                               m_Head = { 0 };
+        CacheLinePadding<sizeof(std::atomic<uint64_t>)>     m_HeadPadding;
+        std::atomic<uint64_t>                               m_Tail = { 0 };
+        CacheLinePadding<sizeof(std::atomic<uint64_t>)>     m_TailPadding;
+        std::atomic<bool>                                   m_IsConsumerWaiting = { false };
+        std::atomic<bool>                                   m_IsClosed = { false };
+        CacheLinePadding<2 * sizeof(std::atomic<bool>)>     m_FlagsPadding;
+
+        std::mutex              m_Lock;
+        std::condition_variable m_Condition;
+        std::condition_variable m_IdleCondition;
+        uint64_t                m_DoneCount = 0;
+    };
+}
@@ -33,7 +33,8 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         /// <summary>
         /// The number of frames in each group of pictures, which consists of one keyframe (I-frame) followed
         /// by delta frames (P-frames and B-frames). With larger values, you get a higher quality for a given bit rate,
-        /// but the stream takes longer to recover after a dropped frame.
+        /// but the stream takes longer to recover after a dropped frame. Zero only encodes key frames on request, see
+        /// <see cref="ILossRecoveryEncoder"/>.
         /// </summary>
         public int gopSize;
 
@@ -47,6 +48,20 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                 gopSize == other.gopSize;
         }
 
+        /// <summary>
+        /// Checks if the settings only differ by their bit rate or frame rate, which an encoder can apply
+        /// to its current stream.
+        /// </summary>
+        /// <param name="other">The settings to compare with.</param>
+        /// <returns>True if the video size and the group of pictures are the same.</returns>
+        public bool HasSameStreamLayout(in EncoderSettings other)
+        {
+            return
+                width == other.width &&
+                height == other.height &&
+                gopSize == other.gopSize;
+        }
+
         public override bool Equals(object obj)
         {
             return obj is EncoderSettings other && Equals(other);
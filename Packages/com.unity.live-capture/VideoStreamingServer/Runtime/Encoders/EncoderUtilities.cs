@@ -112,5 +112,44 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                     return null;
             }
         }
+
+        /// <summary>
+        /// Gets the version of the exports of a native encoder plugin.
+        /// </summary>
+        /// <param name="getApiVersion">The GetApiVersion export of the plugin.</param>
+        /// <returns>
+        /// The version of the plugin, or 0 if it was built before GetApiVersion was exported. Such a plugin
+        /// only has the exports that consume whole frames one field at a time.
+        /// </returns>
+        public static int GetPluginApiVersion(Func<int> getApiVersion)
+        {
+            try
+            {
+                return getApiVersion();
+            }
+            catch (EntryPointNotFoundException)
+            {
+                return 0;
+            }
+        }
+
+        /// <summary>
+        /// Packs a timecode the way the native encoders write it in the timecode SEI message of a frame.
+        /// </summary>
+        /// <param name="hours">The hours, from 0 to 23.</param>
+        /// <param name="minutes">The minutes, from 0 to 59.</param>
+        /// <param name="seconds">The seconds, from 0 to 59.</param>
+        /// <param name="frames">The frames, from 0 to 255.</param>
+        /// <param name="isDropFrame">Whether the timecode uses drop frame counting.</param>
+        /// <returns>The packed timecode, which is never 0.</returns>
+        public static uint PackTimecode(int hours, int minutes, int seconds, int frames, bool isDropFrame)
+        {
+            return 1u << 31
+                | (isDropFrame ? 1u << 30 : 0u)
+                | ((uint)hours & 0x3f) << 24
+                | ((uint)minutes & 0xff) << 16
+                | ((uint)seconds & 0xff) << 8
+                | (uint)frames & 0xff;
+        }
     }
 }
@@ -1,30 +1,236 @@
 using System;
+using System.Runtime.InteropServices;
 using UnityEngine;
 
 namespace Unity.LiveCapture.VideoStreaming.Server
 {
     /// <summary>
-    /// Stores a single frame of H264 video.
+    /// The location of a NAL unit in <see cref="H264EncodedFrame.imageNalu"/>, start code excluded.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    struct NalUnitEntry
+    {
+        public uint offset;
+        public uint size;
+        public uint type;
+    }
+
+    /// <summary>
+    /// The properties of a stream read from its parameter sets by the encoder plugin. All the fields are 0 when the
+    /// encoder doesn't provide them.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    struct SequenceInfo
+    {
+        public uint isValid;
+        public uint profileIdc;
+        public uint profileCompatibility;
+        public uint levelIdc;
+        public uint profileSpace;
+        public uint tierFlag;
+        public uint width;
+        public uint height;
+        public uint numUnitsInTick;
+        public uint timeScale;
+        public uint maxNumReorderFrames;
+        public uint maxDecFrameBuffering;
+    }
+
+    /// <summary>
+    /// Describes a frame consumed with the ConsumeEncodedFrame export of an encoder plugin. The offsets locate the
+    /// parameter sets and the image in the data buffer passed with it, laid out in that order.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    unsafe struct EncodedFrameDescriptor
+    {
+        /// <summary>
+        /// The maximum number of NAL units the plugin locates in the image.
+        /// </summary>
+        public const int k_MaxNalUnitCount = 32;
+
+        public ulong timestamp;
+        public uint spsOffset;
+        public uint spsSize;
+        public uint ppsOffset;
+        public uint ppsSize;
+        public uint imageOffset;
+        public uint imageSize;
+        public uint totalSize;
+        public uint isKeyFrame;
+        public uint nalUnitCount;
+        public fixed uint nalUnits[k_MaxNalUnitCount * 3]; // NalUnitEntry values.
+        public uint vpsOffset;
+        public uint vpsSize;
+        public uint sliceIndex;
+        public uint isLastSlice;
+        public SequenceInfo sequenceInfo;
+    }
+
+    /// <summary>
+    /// Describes a frame lent by the AcquireEncodedFrame export of an encoder plugin. The pointers are owned by the
+    /// plugin and stay valid until the frame is given back with the token. The parameter sets are null unless the
+    /// image is the first slice of a key frame.
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    unsafe struct EncodedFrameView
+    {
+        public ulong timestamp;
+        public ulong token;
+        public byte* vps;
+        public byte* sps;
+        public byte* pps;
+        public byte* image;
+        public NalUnitEntry* nalUnits;
+        public uint vpsSize;
+        public uint spsSize;
+        public uint ppsSize;
+        public uint imageSize;
+        public uint nalUnitCount;
+        public uint isKeyFrame;
+        public uint sliceIndex;
+        public uint isLastSlice;
+        public SequenceInfo sequenceInfo;
+    }
+
+    /// <summary>
+    /// Stores a single frame of H264 or HEVC video.
     /// </summary>
     class H264EncodedFrame
     {
+        /// <summary>
+        /// The video parameter set of the key frames. Only HEVC streams have one.
+        /// </summary>
+        public ArraySegment<byte> vpsNalu;
         public ArraySegment<byte> spsNalu;
         public ArraySegment<byte> ppsNalu;
         public ArraySegment<byte> imageNalu;
 
         /// <summary>
-        /// Allocates the buffer so it can contain a number of bytes.
+        /// The profile, level, resolution and timing read from the parameter sets, updated with them on key frames.
+        /// </summary>
+        public SequenceInfo sequenceInfo;
+
+        /// <summary>
+        /// The NAL units of <see cref="imageNalu"/> when the encoder located them. Empty otherwise, the image is then
+        /// scanned for start codes when it is sent.
+        /// </summary>
+        public ArraySegment<NalUnitEntry> imageNalUnits;
+
+        /// <summary>
+        /// False when the frame is encoded slice by slice and more slices of the same frame follow. Only the first
+        /// slice of a key frame has the parameter sets.
+        /// </summary>
+        public bool isLastSlice = true;
+
+        /// <summary>
+        /// The buffer a plugin writes the parameter sets and the image to when the frame is consumed with a
+        /// <see cref="EncodedFrameDescriptor"/>. The NAL unit segments of the frame then point into it.
+        /// </summary>
+        public ArraySegment<byte> data;
+
+        EncodedFrameView m_View;
+        bool m_IsLent;
+
+        /// <summary>
+        /// The SPS of the frame, in the plugin buffers when the frame is lent or in <see cref="spsNalu"/> otherwise.
+        /// </summary>
+        public unsafe ReadOnlySpan<byte> sps => m_IsLent ? new ReadOnlySpan<byte>(m_View.sps, (int)m_View.spsSize) : spsNalu;
+
+        /// <summary>
+        /// The PPS of the frame, in the plugin buffers when the frame is lent or in <see cref="ppsNalu"/> otherwise.
+        /// </summary>
+        public unsafe ReadOnlySpan<byte> pps => m_IsLent ? new ReadOnlySpan<byte>(m_View.pps, (int)m_View.ppsSize) : ppsNalu;
+
+        /// <summary>
+        /// The image of the frame, in the plugin buffers when the frame is lent or in <see cref="imageNalu"/> otherwise.
+        /// </summary>
+        public unsafe ReadOnlySpan<byte> image => m_IsLent ? new ReadOnlySpan<byte>(m_View.image, (int)m_View.imageSize) : imageNalu;
+
+        /// <summary>
+        /// The NAL units of <see cref="image"/>, in the plugin buffers when the frame is lent or in <see cref="imageNalUnits"/> otherwise.
+        /// </summary>
+        public unsafe ReadOnlySpan<NalUnitEntry> nalUnits => m_IsLent
+            ? new ReadOnlySpan<NalUnitEntry>(m_View.nalUnits, (int)m_View.nalUnitCount)
+            : imageNalUnits;
+
+        /// <summary>
+        /// Points the frame at the buffers of a frame lent by a plugin, until <see cref="ClearView"/> is called when
+        /// the frame is given back.
+        /// </summary>
+        /// <param name="view">The view filled by the plugin when the frame was acquired.</param>
+        public void SetFromView(in EncodedFrameView view)
+        {
+            m_View = view;
+            m_IsLent = true;
+
+            if (view.isKeyFrame != 0 && view.sliceIndex == 0)
+                sequenceInfo = view.sequenceInfo;
+
+            isLastSlice = view.isLastSlice != 0;
+        }
+
+        /// <summary>
+        /// Forgets the buffers of the lent frame, which must not be read once the frame is given back.
+        /// </summary>
+        public void ClearView()
+        {
+            m_View = default;
+            m_IsLent = false;
+        }
+
+        /// <summary>
+        /// Points the frame at the parameter sets, image and NAL units a plugin wrote to <see cref="data"/>.
+        /// </summary>
+        /// <param name="descriptor">The descriptor filled by the plugin when the frame was consumed.</param>
+        public unsafe void SetFromDescriptor(in EncodedFrameDescriptor descriptor)
+        {
+            ClearView();
+
+            var array = data.Array;
+
+            // Only the first slice of a key frame has parameter sets, the ones of the last key frame must not be
+            // sent again with the next slices or frames.
+            if (descriptor.isKeyFrame != 0 && descriptor.sliceIndex == 0)
+            {
+                vpsNalu = new ArraySegment<byte>(array, (int)descriptor.vpsOffset, (int)descriptor.vpsSize);
+                spsNalu = new ArraySegment<byte>(array, (int)descriptor.spsOffset, (int)descriptor.spsSize);
+                ppsNalu = new ArraySegment<byte>(array, (int)descriptor.ppsOffset, (int)descriptor.ppsSize);
+                sequenceInfo = descriptor.sequenceInfo;
+            }
+            else
+            {
+                vpsNalu = new ArraySegment<byte>(array, 0, 0);
+                spsNalu = new ArraySegment<byte>(array, 0, 0);
+                ppsNalu = new ArraySegment<byte>(array, 0, 0);
+            }
+
+            imageNalu = new ArraySegment<byte>(array, (int)descriptor.imageOffset, (int)descriptor.imageSize);
+            isLastSlice = descriptor.isLastSlice != 0;
+
+            var nalUnitCount = (int)Math.Min(descriptor.nalUnitCount, EncodedFrameDescriptor.k_MaxNalUnitCount);
+            SetSize(ref imageNalUnits, nalUnitCount);
+
+            fixed(uint* nalUnits = descriptor.nalUnits)
+            {
+                var entries = (NalUnitEntry*)nalUnits;
+                for (var i = 0; i < nalUnitCount; i++)
+                    imageNalUnits.Array[i] = entries[i];
+            }
+        }
+
+        /// <summary>
+        /// Allocates the buffer so it can contain a number of elements.
         /// </summary>
         /// <param name="buffer">The buffer to reallocate if required.</param>
-        /// <param name="size">The minimum number of bytes the reallocated buffer must contain.</param>
-        public void SetSize(ref ArraySegment<byte> buffer, int size)
+        /// <param name="size">The minimum number of elements the reallocated buffer must contain.</param>
+        public void SetSize<T>(ref ArraySegment<T> buffer, int size)
         {
             var array = buffer.Array;
 
             if (array == null || array.Length < size)
-                array = new byte[Mathf.NextPowerOfTwo(size)];
+                array = new T[Mathf.NextPowerOfTwo(size)];
 
-            buffer = new ArraySegment<byte>(array, 0, size);
+            buffer = new ArraySegment<T>(array, 0, size);
         }
     };
 }
@@ -46,6 +46,45 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         R8G8B8,
     }
 
+    /// <summary>
+    /// The video compression standards of the hardware encoders.
+    /// </summary>
+    enum VideoCodec
+    {
+        /// <summary>
+        /// H.264 / AVC, supported by every encoder.
+        /// </summary>
+        H264 = 0,
+
+        /// <summary>
+        /// H.265 / HEVC, which needs about half the bit rate of H.264 for the same quality. The encoded
+        /// frames carry a video parameter set (VPS) in addition to the SPS and the PPS. Only the native plugins
+        /// support it, the RTSP server doesn't implement the packetization of RFC 7798.
+        /// </summary>
+        HEVC,
+    }
+
+    /// <summary>
+    /// The trade-off between latency and throughput of an encoder, chosen when it is set up.
+    /// </summary>
+    enum EncoderPipelineMode
+    {
+        /// <summary>
+        /// The default number of frames in flight and waiting to be consumed.
+        /// </summary>
+        Default = 0,
+
+        /// <summary>
+        /// Keeps few frames in flight and drops frames as soon as the encoder or the consumer falls behind.
+        /// </summary>
+        Latency,
+
+        /// <summary>
+        /// Keeps a deep pipeline, for recording. Frames are only dropped under sustained overload.
+        /// </summary>
+        Throughput,
+    }
+
     /// <summary>
     /// Indicates the status of the current encoder instance.
     /// </summary>
@@ -125,14 +164,69 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         /// </summary>
         /// <param name="renderTexture">The texture to encode.</param>
         /// <param name="timestamp">The time in nanoseconds the image was sampled at since the start of the video stream.</param>
-        void Encode(RenderTexture renderTexture, ulong timestamp);
+        /// <param name="timecode">The timecode of the image packed by <see cref="EncoderUtilities.PackTimecode"/>, or 0 if it has none.</param>
+        void Encode(RenderTexture renderTexture, ulong timestamp, uint timecode);
 
         /// <summary>
         /// Retrieves the data of the first encoded frame found in the plugin.
         /// </summary>
+        /// <remarks>
+        /// The encoder can lend its own buffers to the frame instead of copying the data: they are then only valid
+        /// until the next call.
+        /// </remarks>
         /// <param name="frame">The returned frame containing the encoded data.</param>
         /// <param name="timestamp">The time in nanoseconds the image was sampled at since the start of the video stream.</param>
         /// <returns>True if an encoded frame has been found; false otherwise.</returns>
         bool ConsumeData(H264EncodedFrame frame, out ulong timestamp);
     }
+
+    /// <summary>
+    /// The interface of the encoders that recover from the frames lost by a client without waiting for the next key frame.
+    /// </summary>
+    interface ILossRecoveryEncoder
+    {
+        /// <summary>
+        /// Whether the encoder applies the requests below. The stream then only needs a key frame when a client
+        /// starts playing or can't recover otherwise.
+        /// </summary>
+        bool isLossRecoverySupported { get; }
+
+        /// <summary>
+        /// Forces the next encoded frame to be a key frame.
+        /// </summary>
+        void RequestKeyFrame();
+
+        /// <summary>
+        /// Stops referencing the frames encoded from a timestamp onward, because a client lost them. The next frame
+        /// references an older frame the client still has, or is a key frame if there is none.
+        /// </summary>
+        /// <param name="timestamp">The time in nanoseconds of the first lost frame, as given to the encoder.</param>
+        void InvalidateReferenceFrames(ulong timestamp);
+    }
+
+    /// <summary>
+    /// The interface of the encoders that can replace key frames with gradual intra refreshes.
+    /// </summary>
+    interface IIntraRefreshEncoder
+    {
+        /// <summary>
+        /// The number of frames each intra refresh is spread over. Zero disables intra refresh. Only read when the
+        /// encoder is set up.
+        /// </summary>
+        int intraRefreshFrames { get; set; }
+    }
+
+    /// <summary>
+    /// The interface of the encoders that can create their native sessions before a stream starts.
+    /// </summary>
+    interface IPrewarmEncoder
+    {
+        /// <summary>
+        /// Queues the creation of a native encoder session, which the next <see cref="IEncoder.Setup"/> call with the
+        /// same video size and format uses instead of creating one when the first frame is encoded.
+        /// </summary>
+        /// <param name="settings">The expected configuration of the encoder. The frame rate, bit rate and GOP size can differ at setup.</param>
+        /// <param name="encoderFormat">The texture format the encoder uses for input.</param>
+        void Prewarm(EncoderSettings settings, EncoderFormat encoderFormat);
+    }
 }
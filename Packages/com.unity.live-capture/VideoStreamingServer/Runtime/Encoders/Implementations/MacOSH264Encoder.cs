@@ -10,6 +10,40 @@ namespace Unity.LiveCapture.VideoStreaming.Server
     {
         internal const string MacOSLib = "MacOSEncoderBundle";
 
+        /// <summary>
+        /// The version of the exports called below, see <see cref="isApiSupported"/>.
+        /// </summary>
+        const int k_ApiVersion = 2;
+
+        /// <summary>
+        /// The version where the plugin issues the encoder IDs, see <see cref="isHandleSupported"/>.
+        /// </summary>
+        const int k_HandleApiVersion = 3;
+
+        static readonly Lazy<int> s_ApiVersion = new Lazy<int>(() => EncoderUtilities.GetPluginApiVersion(GetApiVersion));
+
+        /// <summary>
+        /// Whether the loaded plugin has every export declared here. An older plugin only has the exports that
+        /// consume whole frames: BeginConsume, EndConsume, GetSps, GetPps, GetEncodedData, GetTimeStamp and
+        /// GetIsKeyFrame. The other ones must not be called, they would throw an <see cref="EntryPointNotFoundException"/>.
+        /// </summary>
+        public static bool isApiSupported => s_ApiVersion.Value >= k_ApiVersion;
+
+        /// <summary>
+        /// Whether the encoder IDs must be created with CreateEncoderHandle. An older plugin takes any ID that
+        /// wasn't used before.
+        /// </summary>
+        public static bool isHandleSupported => s_ApiVersion.Value >= k_HandleApiVersion;
+
+        [DllImport(MacOSLib)]
+        extern public static int CreateEncoderHandle();
+
+        [DllImport(MacOSLib)]
+        extern public unsafe static bool ConsumeEncodedFrame(IntPtr encoder, EncodedFrameDescriptor* descriptor, byte* data, uint dataSize);
+
+        [DllImport(MacOSLib)]
+        extern static int GetApiVersion();
+
         [DllImport(MacOSLib)]
         extern public static IntPtr GetRenderEventFunc();
 
@@ -100,6 +134,26 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             /// Should the encoder expect SRGB textures.
             /// </summary>
             public bool useSRGB;
+
+            /// <summary>
+            /// The latency and throughput preset of the encoder. Only read when the encoder is initialized.
+            /// </summary>
+            public EncoderPipelineMode pipelineMode;
+
+            /// <summary>
+            /// The number of frames the encoder works on at the same time. Zero uses the value of the preset.
+            /// </summary>
+            public int framesInFlight;
+
+            /// <summary>
+            /// The number of encoded frames kept until they are consumed. Zero uses the value of the preset.
+            /// </summary>
+            public int maxQueueLength;
+
+            /// <summary>
+            /// The compression standard of the encoded stream. Only read when the encoder is initialized.
+            /// </summary>
+            public VideoCodec codec;
         }
 
         /// <summary>
@@ -123,6 +177,11 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             /// The frame time stamp.
             /// </summary>
             public ulong timestamp;
+
+            /// <summary>
+            /// The frame timecode written in the timecode SEI message, packed by <see cref="EncoderUtilities.PackTimecode"/>.
+            /// </summary>
+            public uint timecode;
         }
 
         EncoderSettingsID m_SettingsID;
@@ -134,6 +193,22 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         /// <inheritdoc/>
         public EncoderFormat encoderFormat => EncoderFormat.R8G8B8;
 
+        /// <summary>
+        /// The compression standard of the encoded stream. Changes are applied by the next <see cref="Setup"/> call.
+        /// </summary>
+        /// <exception cref="NotSupportedException">Thrown for HEVC, which the RTSP server can't packetize yet.</exception>
+        public VideoCodec codec
+        {
+            get => m_SettingsID.codec;
+            set
+            {
+                if (value != VideoCodec.H264)
+                    throw new NotSupportedException($"{value} streams can't be sent: the RTSP server only packetizes H264 (RFC 6184).");
+
+                m_SettingsID.codec = value;
+            }
+        }
+
         /// <inheritdoc/>
         unsafe public EncoderStatus initialized
         {
@@ -161,7 +236,8 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         /// </summary>
         unsafe public void Dispose()
         {
-            if (m_EncoderStatus != EncoderStatus.Initialized)
+            // An encoder still initializing is finalized too, which frees its ID.
+            if (m_EncoderStatus != EncoderStatus.Initialized && m_EncoderStatus != EncoderStatus.InProgress)
                 return;
 
             m_FinalizeID = m_SettingsID.encoderId;
@@ -181,13 +257,22 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         unsafe public void Setup(EncoderSettings settings, EncoderFormat encoderFormat)
         {
             m_SettingsID.settings = settings;
-            m_SettingsID.encoderId = m_Counter++;
+            m_SettingsID.encoderId = MacOSH264EncoderPlugin.isHandleSupported
+                ? MacOSH264EncoderPlugin.CreateEncoderHandle()
+                : m_Counter++;
             m_SettingsID.encoderFormat = encoderFormat;
             m_SettingsID.useSRGB = QualitySettings.activeColorSpace != ColorSpace.Gamma;
 
             if (m_CommandBuffer != null)
                 DisposeCommandBuffer();
 
+            // The plugin has too many encoders.
+            if (m_SettingsID.encoderId == 0)
+            {
+                m_EncoderStatus = EncoderStatus.Failed;
+                return;
+            }
+
             m_CommandBuffer = new CommandBuffer();
 
             fixed(EncoderSettingsID* encoderPtr = &m_SettingsID)
@@ -206,15 +291,27 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             if (m_EncoderStatus == EncoderStatus.Failed)
                 throw new InvalidOperationException("Encoder is disposed and needs to be setup before encoding a frame.");
 
-            if (m_SettingsID.settings != settings)
+            if (m_SettingsID.settings == settings)
+                return;
+
+            // The bit rate and frame rate are changed on the live session, without a key frame.
+            if (m_EncoderStatus == EncoderStatus.Initialized && m_SettingsID.settings.HasSameStreamLayout(settings))
             {
-                Dispose();
-                Setup(settings, m_SettingsID.encoderFormat);
+                m_SettingsID.settings = settings;
+
+                fixed(EncoderSettingsID* encoderPtr = &m_SettingsID)
+                {
+                    ExecuteMacOSCommand(EMacOSRenderEvent.Update, "Mac OS Encoder Update", (IntPtr)encoderPtr);
+                }
+                return;
             }
+
+            Dispose();
+            Setup(settings, m_SettingsID.encoderFormat);
         }
 
         /// <inheritdoc/>
-        unsafe public void Encode(RenderTexture renderTexture, ulong timestamp)
+        unsafe public void Encode(RenderTexture renderTexture, ulong timestamp, uint timecode)
         {
             if (m_EncoderStatus == EncoderStatus.Failed)
                 throw new InvalidOperationException("Encoder is disposed and needs to be setup before encoding a frame.");
@@ -224,6 +321,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                 m_TextureID.encoderId = m_SettingsID.encoderId;
                 m_TextureID.renderTexture = renderTexture.GetNativeTexturePtr();
                 m_TextureID.timestamp = timestamp;
+                m_TextureID.timecode = timecode;
 
                 ExecuteMacOSCommand(EMacOSRenderEvent.Encode, "Mac OS Encoder Encode", (IntPtr)encoderPtr);
             }
@@ -237,51 +335,112 @@ namespace Unity.LiveCapture.VideoStreaming.Server
 
             fixed(int* encoderPtr = &m_SettingsID.encoderId)
             {
-                timestamp = 0;
+                return MacOSH264EncoderPlugin.isApiSupported
+                    ? ConsumeFrame((IntPtr)encoderPtr, frame, out timestamp)
+                    : ConsumeLegacyFrame((IntPtr)encoderPtr, frame, out timestamp);
+            }
+        }
 
-                var existingFrame = MacOSH264EncoderPlugin.BeginConsume((IntPtr)encoderPtr);
-                if (existingFrame)
+        /// <summary>
+        /// Copies the next frame and its description with a single plugin call. The data buffer of the frame grows
+        /// when the plugin reports that the frame doesn't fit, the frame is then kept in the plugin until the next try.
+        /// </summary>
+        unsafe bool ConsumeFrame(IntPtr encoderPtr, H264EncodedFrame frame, out ulong timestamp)
+        {
+            var descriptor = default(EncodedFrameDescriptor);
+
+            while (true)
+            {
+                // Not written by the plugin when there is no frame to consume.
+                descriptor.totalSize = 0;
+
+                var capacity = frame.data.Array?.Length ?? 0;
+                bool consumed;
+                fixed(byte* data = frame.data.Array)
                 {
-                    var isKeyFrame = MacOSH264EncoderPlugin.GetIsKeyFrame((IntPtr)encoderPtr);
-                    var imageSize = MacOSH264EncoderPlugin.GetEncodedData((IntPtr)encoderPtr, null);
+                    consumed = MacOSH264EncoderPlugin.ConsumeEncodedFrame(encoderPtr, &descriptor, data, (uint)capacity);
+                }
 
-                    // Allocation of Encoded Image & Retrieve data.
-                    frame.SetSize(ref frame.imageNalu, (int)imageSize);
-                    using (var buffer = new PinnedBufferScope(frame.imageNalu))
-                    {
-                        MacOSH264EncoderPlugin.GetEncodedData((IntPtr)encoderPtr, buffer.pointer);
-                    }
+                if (consumed)
+                {
+                    frame.SetFromDescriptor(descriptor);
+                    timestamp = descriptor.timestamp;
+                    return true;
+                }
 
-                    // Retrieve the timestamp.
-                    timestamp = MacOSH264EncoderPlugin.GetTimeStamp((IntPtr)encoderPtr);
+                if (descriptor.totalSize <= capacity)
+                {
+                    timestamp = 0;
+                    return false;
+                }
 
-                    if (isKeyFrame)
+                frame.SetSize(ref frame.data, (int)descriptor.totalSize);
+            }
+        }
+
+        /// <summary>
+        /// Consumes the next frame with the exports of the plugins older than <see cref="MacOSH264EncoderPlugin.isApiSupported"/>,
+        /// which only output whole H.264 frames.
+        /// </summary>
+        unsafe bool ConsumeLegacyFrame(IntPtr encoderPtr, H264EncodedFrame frame, out ulong timestamp)
+        {
+            timestamp = 0;
+
+            var existingFrame = MacOSH264EncoderPlugin.BeginConsume(encoderPtr);
+            if (existingFrame)
+            {
+                var isKeyFrame = MacOSH264EncoderPlugin.GetIsKeyFrame(encoderPtr);
+                var imageSize = MacOSH264EncoderPlugin.GetEncodedData(encoderPtr, null);
+
+                // Allocation of Encoded Image & Retrieve data.
+                frame.SetSize(ref frame.imageNalu, (int)imageSize);
+                using (var buffer = new PinnedBufferScope(frame.imageNalu))
+                {
+                    MacOSH264EncoderPlugin.GetEncodedData(encoderPtr, buffer.pointer);
+                }
+
+                // The NAL units aren't located, the image is scanned when it is sent.
+                frame.SetSize(ref frame.imageNalUnits, 0);
+                frame.isLastSlice = true;
+
+                // Retrieve the timestamp.
+                timestamp = MacOSH264EncoderPlugin.GetTimeStamp(encoderPtr);
+
+                // There is no VPS nor sequence information without HEVC support.
+                frame.SetSize(ref frame.vpsNalu, 0);
+                frame.sequenceInfo = default;
+
+                if (isKeyFrame)
+                {
+                    // Getting buffer size for pre-allocation
+                    var spsSize = MacOSH264EncoderPlugin.GetSps(encoderPtr, null);
+                    var ppsSize = MacOSH264EncoderPlugin.GetPps(encoderPtr, null);
+
+                    // Allocation of SPS & Retrieve data.
+                    frame.SetSize(ref frame.spsNalu, (int)spsSize);
+                    using (var buffer = new PinnedBufferScope(frame.spsNalu))
                     {
-                        // Getting buffer size for pre-allocation
-                        var spsSize = MacOSH264EncoderPlugin.GetSps((IntPtr)encoderPtr, null);
-                        var ppsSize = MacOSH264EncoderPlugin.GetPps((IntPtr)encoderPtr, null);
-
-
-                        // Allocation of SPS & Retrieve data.
-                        frame.SetSize(ref frame.spsNalu, (int)spsSize);
-                        using (var buffer = new PinnedBufferScope(frame.spsNalu))
-                        {
-                            MacOSH264EncoderPlugin.GetSps((IntPtr)encoderPtr, buffer.pointer);
-                        }
-
-                        // Allocation of PPS & Retrieve data.
-                        frame.SetSize(ref frame.ppsNalu, (int)ppsSize);
-                        using (var buffer = new PinnedBufferScope(frame.ppsNalu))
-                        {
-                            MacOSH264EncoderPlugin.GetPps((IntPtr)encoderPtr, buffer.pointer);
-                        }
+                        MacOSH264EncoderPlugin.GetSps(encoderPtr, buffer.pointer);
                     }
 
-                    // Liberate the current encoded frame in the Plugin.
-                    MacOSH264EncoderPlugin.EndConsume((IntPtr)encoderPtr);
+                    // Allocation of PPS & Retrieve data.
+                    frame.SetSize(ref frame.ppsNalu, (int)ppsSize);
+                    using (var buffer = new PinnedBufferScope(frame.ppsNalu))
+                    {
+                        MacOSH264EncoderPlugin.GetPps(encoderPtr, buffer.pointer);
+                    }
                 }
-                return existingFrame;
+                else
+                {
+                    // The frame is reused: the parameter sets of the last key frame must not be sent again.
+                    frame.SetSize(ref frame.spsNalu, 0);
+                    frame.SetSize(ref frame.ppsNalu, 0);
+                }
+
+                // Liberate the current encoded frame in the Plugin.
+                MacOSH264EncoderPlugin.EndConsume(encoderPtr);
             }
+            return existingFrame;
         }
 
         /// <summary>
@@ -10,6 +10,24 @@ namespace Unity.LiveCapture.VideoStreaming.Server
 {
     struct MediaFoundationH264EncoderPlugin
     {
+        /// <summary>
+        /// The version of the exports called below, see <see cref="isApiSupported"/>.
+        /// </summary>
+        const int k_ApiVersion = 1;
+
+        static readonly Lazy<bool> s_IsApiSupported = new Lazy<bool>(
+            () => EncoderUtilities.GetPluginApiVersion(GetApiVersion) >= k_ApiVersion);
+
+        /// <summary>
+        /// Whether the loaded plugin has every export declared here. An older plugin only has Create, Destroy, Encode,
+        /// BeginConsume, EndConsume, GetSps and GetPps. The other ones must not be called, they would throw an
+        /// <see cref="EntryPointNotFoundException"/>.
+        /// </summary>
+        public static bool isApiSupported => s_IsApiSupported.Value;
+
+        [DllImport("H264Encoder", EntryPoint = "GetApiVersion")]
+        extern static int GetApiVersion();
+
         [DllImport("H264Encoder", EntryPoint = "Create")]
         extern public static IntPtr CreateEncoder(uint width, uint height, uint frameRateNumerator, uint frameRateDenominator, uint averageBitRate, uint gopSize);
 
@@ -33,6 +51,10 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             out ulong timeStampNs,
             [MarshalAs(UnmanagedType.U1)] out bool isKeyFrame);
 
+        [DllImport("H264Encoder", EntryPoint = "UpdateRateControl")]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool UpdateRateControl(IntPtr encoder, uint frameRateNumerator, uint frameRateDenominator, uint averageBitRate);
+
         [DllImport("H264Encoder", EntryPoint = "GetSps")]
         extern public unsafe static uint GetSpsNAL(IntPtr encoder, byte* spsData);
 
@@ -81,7 +103,18 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         public void UpdateSettings(in EncoderSettings settings)
         {
             if (m_Settings != settings)
-                Dispose();
+            {
+                // The bit rate and frame rate are changed on the current stream, without a key frame.
+                if (m_Encoder != IntPtr.Zero && m_Settings.HasSameStreamLayout(settings) && MediaFoundationH264EncoderPlugin.isApiSupported &&
+                    MediaFoundationH264EncoderPlugin.UpdateRateControl(m_Encoder, (uint)settings.frameRate, 1, (uint)settings.bitRate * 1000))
+                {
+                    m_Settings = settings;
+                }
+                else
+                {
+                    Dispose();
+                }
+            }
 
             if (m_Encoder == IntPtr.Zero)
             {
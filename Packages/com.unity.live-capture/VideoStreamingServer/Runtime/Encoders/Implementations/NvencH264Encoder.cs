@@ -16,6 +16,57 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         const string k_NvEncLib = "";
 #endif
 
+        /// <summary>
+        /// The version of the exports called below, see <see cref="isApiSupported"/>.
+        /// </summary>
+        const int k_ApiVersion = 2;
+
+        /// <summary>
+        /// The version adding the exports that lend encoded frames, see <see cref="isLendingSupported"/>.
+        /// </summary>
+        const int k_LendingApiVersion = 3;
+
+        /// <summary>
+        /// The version where the plugin issues the encoder IDs, see <see cref="isHandleSupported"/>.
+        /// </summary>
+        const int k_HandleApiVersion = 4;
+
+        static readonly Lazy<int> s_ApiVersion = new Lazy<int>(() => EncoderUtilities.GetPluginApiVersion(GetApiVersion));
+
+        /// <summary>
+        /// Whether the loaded plugin has every export declared here. An older plugin only has the exports that
+        /// consume whole frames: BeginConsume, EndConsume, GetSps, GetPps, GetEncodedData, GetTimeStamp and
+        /// GetIsKeyFrame. The other ones must not be called, they would throw an <see cref="EntryPointNotFoundException"/>.
+        /// </summary>
+        public static bool isApiSupported => s_ApiVersion.Value >= k_ApiVersion;
+
+        /// <summary>
+        /// Whether the loaded plugin can lend its encoded frames with AcquireEncodedFrame and ReleaseEncodedFrame,
+        /// instead of copying them with ConsumeEncodedFrame.
+        /// </summary>
+        public static bool isLendingSupported => s_ApiVersion.Value >= k_LendingApiVersion;
+
+        /// <summary>
+        /// Whether the encoder IDs must be created with CreateEncoderHandle. An older plugin takes any ID that
+        /// wasn't used before.
+        /// </summary>
+        public static bool isHandleSupported => s_ApiVersion.Value >= k_HandleApiVersion;
+
+        [DllImport(k_NvEncLib)]
+        extern public static int CreateEncoderHandle();
+
+        [DllImport(k_NvEncLib)]
+        extern public unsafe static bool ConsumeEncodedFrame(IntPtr id, EncodedFrameDescriptor* descriptor, byte* data, uint dataSize);
+
+        [DllImport(k_NvEncLib)]
+        extern public unsafe static bool AcquireEncodedFrame(IntPtr id, EncodedFrameView* view);
+
+        [DllImport(k_NvEncLib)]
+        extern public static bool ReleaseEncodedFrame(IntPtr id, ulong token);
+
+        [DllImport(k_NvEncLib)]
+        extern static int GetApiVersion();
+
         [DllImport(k_NvEncLib)]
         extern public static IntPtr GetRenderEventFunc();
 
@@ -45,12 +96,18 @@ namespace Unity.LiveCapture.VideoStreaming.Server
 
         [DllImport(k_NvEncLib)]
         extern public unsafe static bool GetIsKeyFrame(IntPtr id);
+
+        [DllImport(k_NvEncLib)]
+        extern public static bool RequestKeyFrame(IntPtr id);
+
+        [DllImport(k_NvEncLib)]
+        extern public static bool InvalidateReferenceFrames(IntPtr id, ulong timestamp);
     }
 
     /// <summary>
     /// An encoder that can convert RGB or NV12 frames to H264 video.
     /// </summary>
-    class NvencH264Encoder : IHardwareEncoder
+    class NvencH264Encoder : IHardwareEncoder, ILossRecoveryEncoder, IIntraRefreshEncoder, IPrewarmEncoder
     {
         /// <summary>
         /// Determines the Nvenc command used in the Low Level Native Plugin.
@@ -76,6 +133,12 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             /// Liberates resources and destroys the encoder session.
             /// </summary>
             Finalize,
+
+            /// <summary>
+            /// Creates an encoder session kept in a pool, which the next <see cref="Initialize"/> with the same size
+            /// and creation settings uses.
+            /// </summary>
+            Prewarm,
         };
 
         /// <summary>
@@ -99,6 +162,39 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             /// Gets the encoder supported format.
             /// </summary>
             public EncoderFormat encoderFormat;
+
+            /// <summary>
+            /// The latency and throughput preset of the encoder. Only read when the encoder is initialized.
+            /// </summary>
+            public EncoderPipelineMode pipelineMode;
+
+            /// <summary>
+            /// The number of frames the encoder works on at the same time. Zero uses the value of the preset.
+            /// </summary>
+            public int framesInFlight;
+
+            /// <summary>
+            /// The number of encoded frames kept until they are consumed. Zero uses the value of the preset.
+            /// </summary>
+            public int maxQueueLength;
+
+            /// <summary>
+            /// The compression standard of the encoded stream. Only read when the encoder is initialized.
+            /// </summary>
+            public VideoCodec codec;
+
+            /// <summary>
+            /// The number of slices of each frame, each one consumed as soon as it is encoded. Zero or one
+            /// consumes whole frames. Only read when the encoder is initialized.
+            /// </summary>
+            public int sliceCount;
+
+            /// <summary>
+            /// The number of frames each intra refresh is spread over, replacing the periodic key frames.
+            /// The refreshes follow each other, or start every GOP when it is longer. Zero uses periodic
+            /// key frames. Only read when the encoder is initialized.
+            /// </summary>
+            public int intraRefreshFrames;
         }
 
         /// <summary>
@@ -122,17 +218,62 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             /// The frame time stamp.
             /// </summary>
             public ulong timestamp;
+
+            /// <summary>
+            /// The frame timecode written in the timecode SEI message, packed by <see cref="EncoderUtilities.PackTimecode"/>.
+            /// </summary>
+            public uint timecode;
         }
 
         EncoderSettingsID m_SettingsID;
+        EncoderSettingsID m_PrewarmID;
         EncoderTextureID  m_TextureID;
         static int        m_Counter = 1;
         EncoderStatus     m_EncoderStatus;
         CommandBuffer     m_CommandBuffer;
+        H264EncodedFrame  m_LentFrame;
+        ulong             m_LentToken;
 
         /// <inheritdoc/>
         public EncoderFormat encoderFormat => EncoderFormat.R8G8B8;
 
+        /// <summary>
+        /// The compression standard of the encoded stream. Changes are applied by the next <see cref="Setup"/> call.
+        /// </summary>
+        /// <exception cref="NotSupportedException">Thrown for HEVC, which the RTSP server can't packetize yet.</exception>
+        public VideoCodec codec
+        {
+            get => m_SettingsID.codec;
+            set
+            {
+                if (value != VideoCodec.H264)
+                    throw new NotSupportedException($"{value} streams can't be sent: the RTSP server only packetizes H264 (RFC 6184).");
+
+                m_SettingsID.codec = value;
+            }
+        }
+
+        /// <summary>
+        /// The number of slices each frame is split in, so that the first ones can be sent while the next ones are
+        /// encoded. Zero or one consumes whole frames. Changes are applied by the next <see cref="Setup"/> call.
+        /// </summary>
+        public int sliceCount
+        {
+            get => m_SettingsID.sliceCount;
+            set => m_SettingsID.sliceCount = value;
+        }
+
+        /// <inheritdoc/>
+        /// <remarks>
+        /// A decoder then recovers without the size peak of a key frame. The refreshes follow each other, or start
+        /// every GOP when it is longer than a refresh.
+        /// </remarks>
+        public int intraRefreshFrames
+        {
+            get => m_SettingsID.intraRefreshFrames;
+            set => m_SettingsID.intraRefreshFrames = value;
+        }
+
         /// <inheritdoc/>
         public unsafe EncoderStatus initialized
         {
@@ -160,11 +301,13 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         /// </summary>
         public unsafe void Dispose()
         {
-            if (m_EncoderStatus != EncoderStatus.Initialized)
+            // An encoder still initializing is finalized too, which frees its ID.
+            if (m_EncoderStatus != EncoderStatus.Initialized && m_EncoderStatus != EncoderStatus.InProgress)
                 return;
 
             fixed(int* encoderPtr = &m_SettingsID.encoderId)
             {
+                ReleaseLentFrame((IntPtr)encoderPtr);
                 ExecuteNvencCommand(ENvencRenderEvent.Finalize, "NVENC Finalize", (IntPtr)encoderPtr);
             }
 
@@ -175,10 +318,20 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         public unsafe void Setup(EncoderSettings settings, EncoderFormat encoderFormat)
         {
             m_SettingsID.settings = settings;
-            m_SettingsID.encoderId = ++m_Counter;
+            m_SettingsID.encoderId = NvencH264EncoderPlugin.isHandleSupported
+                ? NvencH264EncoderPlugin.CreateEncoderHandle()
+                : ++m_Counter;
             m_SettingsID.encoderFormat = encoderFormat;
 
             DisposeCommandBuffer();
+
+            // The plugin has too many encoders.
+            if (m_SettingsID.encoderId == 0)
+            {
+                m_EncoderStatus = EncoderStatus.Failed;
+                return;
+            }
+
             m_CommandBuffer = new CommandBuffer();
 
             fixed(EncoderSettingsID* encoderPtr = &m_SettingsID)
@@ -188,6 +341,24 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             }
         }
 
+        /// <inheritdoc/>
+        public unsafe void Prewarm(EncoderSettings settings, EncoderFormat encoderFormat)
+        {
+            if (m_CommandBuffer == null)
+                m_CommandBuffer = new CommandBuffer();
+
+            // The session is created with the current creation settings, the ID isn't used.
+            m_PrewarmID = m_SettingsID;
+            m_PrewarmID.settings = settings;
+            m_PrewarmID.encoderId = 0;
+            m_PrewarmID.encoderFormat = encoderFormat;
+
+            fixed(EncoderSettingsID* encoderPtr = &m_PrewarmID)
+            {
+                ExecuteNvencCommand(ENvencRenderEvent.Prewarm, "NVENC Prewarm", (IntPtr)encoderPtr);
+            }
+        }
+
         /// <inheritdoc/>
         public unsafe void UpdateSettings(in EncoderSettings settings)
         {
@@ -206,7 +377,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         }
 
         /// <inheritdoc/>
-        public unsafe void Encode(RenderTexture renderTexture, ulong timestamp)
+        public unsafe void Encode(RenderTexture renderTexture, ulong timestamp, uint timecode)
         {
             if (m_EncoderStatus == EncoderStatus.Failed)
                 throw new InvalidOperationException("Encoder is disposed and needs to be setup before encoding a frame.");
@@ -216,6 +387,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                 m_TextureID.encoderId = m_SettingsID.encoderId;
                 m_TextureID.renderTexture = renderTexture.GetNativeTexturePtr();
                 m_TextureID.timestamp = timestamp;
+                m_TextureID.timecode = timecode;
 
                 ExecuteNvencCommand(ENvencRenderEvent.Encode, "NVENC Encode", (IntPtr)encoderPtr);
             }
@@ -228,50 +400,178 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                 throw new InvalidOperationException("Encoder is disposed and needs to be setup before encoding a frame.");
 
             fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                // The frame lent by the previous call has been sent.
+                ReleaseLentFrame((IntPtr)encoderPtr);
+
+                if (NvencH264EncoderPlugin.isLendingSupported)
+                    return LendFrame((IntPtr)encoderPtr, frame, out timestamp);
+
+                return NvencH264EncoderPlugin.isApiSupported
+                    ? ConsumeFrame((IntPtr)encoderPtr, frame, out timestamp)
+                    : ConsumeLegacyFrame((IntPtr)encoderPtr, frame, out timestamp);
+            }
+        }
+
+        /// <summary>
+        /// Points the frame at the next frame in the plugin buffers without copying it. The frame stays lent until the
+        /// next <see cref="ConsumeData"/> or <see cref="Dispose"/> call.
+        /// </summary>
+        unsafe bool LendFrame(IntPtr encoderPtr, H264EncodedFrame frame, out ulong timestamp)
+        {
+            var view = default(EncodedFrameView);
+            if (!NvencH264EncoderPlugin.AcquireEncodedFrame(encoderPtr, &view))
             {
                 timestamp = 0;
+                return false;
+            }
+
+            frame.SetFromView(view);
+            m_LentFrame = frame;
+            m_LentToken = view.token;
+            timestamp = view.timestamp;
+            return true;
+        }
+
+        /// <summary>
+        /// Gives the frame lent by <see cref="LendFrame"/> back to the plugin, which can then reuse its buffers.
+        /// </summary>
+        void ReleaseLentFrame(IntPtr encoderPtr)
+        {
+            if (m_LentFrame == null)
+                return;
+
+            m_LentFrame.ClearView();
+            m_LentFrame = null;
+            NvencH264EncoderPlugin.ReleaseEncodedFrame(encoderPtr, m_LentToken);
+        }
+
+        /// <summary>
+        /// Copies the next frame and its description with a single plugin call. The data buffer of the frame grows
+        /// when the plugin reports that the frame doesn't fit, the frame is then kept in the plugin until the next try.
+        /// </summary>
+        unsafe bool ConsumeFrame(IntPtr encoderPtr, H264EncodedFrame frame, out ulong timestamp)
+        {
+            var descriptor = default(EncodedFrameDescriptor);
+
+            while (true)
+            {
+                // Not written by the plugin when there is no frame to consume.
+                descriptor.totalSize = 0;
 
-                var existingFrame = NvencH264EncoderPlugin.BeginConsume((IntPtr)encoderPtr);
-                if (existingFrame)
+                var capacity = frame.data.Array?.Length ?? 0;
+                bool consumed;
+                fixed(byte* data = frame.data.Array)
                 {
-                    var isKeyFrame = NvencH264EncoderPlugin.GetIsKeyFrame((IntPtr)encoderPtr);
-                    var imageSize = NvencH264EncoderPlugin.GetEncodedData((IntPtr)encoderPtr, null);
+                    consumed = NvencH264EncoderPlugin.ConsumeEncodedFrame(encoderPtr, &descriptor, data, (uint)capacity);
+                }
 
-                    // Allocation of Encoded Image & Retrieve data.
-                    frame.SetSize(ref frame.imageNalu, (int)imageSize);
-                    using (var buffer = new PinnedBufferScope(frame.imageNalu))
-                    {
-                        NvencH264EncoderPlugin.GetEncodedData((IntPtr)encoderPtr, buffer.pointer);
-                    }
+                if (consumed)
+                {
+                    frame.SetFromDescriptor(descriptor);
+                    timestamp = descriptor.timestamp;
+                    return true;
+                }
+
+                if (descriptor.totalSize <= capacity)
+                {
+                    timestamp = 0;
+                    return false;
+                }
+
+                frame.SetSize(ref frame.data, (int)descriptor.totalSize);
+            }
+        }
+
+        /// <summary>
+        /// Consumes the next frame with the exports of the plugins older than <see cref="NvencH264EncoderPlugin.isApiSupported"/>,
+        /// which only output whole H.264 frames.
+        /// </summary>
+        unsafe bool ConsumeLegacyFrame(IntPtr encoderPtr, H264EncodedFrame frame, out ulong timestamp)
+        {
+            timestamp = 0;
+
+            var existingFrame = NvencH264EncoderPlugin.BeginConsume(encoderPtr);
+            if (existingFrame)
+            {
+                var isKeyFrame = NvencH264EncoderPlugin.GetIsKeyFrame(encoderPtr);
+                var imageSize = NvencH264EncoderPlugin.GetEncodedData(encoderPtr, null);
+
+                // Allocation of Encoded Image & Retrieve data.
+                frame.SetSize(ref frame.imageNalu, (int)imageSize);
+                using (var buffer = new PinnedBufferScope(frame.imageNalu))
+                {
+                    NvencH264EncoderPlugin.GetEncodedData(encoderPtr, buffer.pointer);
+                }
+
+                // The NAL units aren't located, the image is scanned when it is sent.
+                frame.SetSize(ref frame.imageNalUnits, 0);
+                frame.isLastSlice = true;
+
+                // Retrieve the timestamp.
+                timestamp = NvencH264EncoderPlugin.GetTimeStamp(encoderPtr);
 
-                    // Retrieve the timestamp.
-                    timestamp = NvencH264EncoderPlugin.GetTimeStamp((IntPtr)encoderPtr);
+                // There is no VPS nor sequence information without HEVC support.
+                frame.SetSize(ref frame.vpsNalu, 0);
+                frame.sequenceInfo = default;
+
+                if (isKeyFrame)
+                {
+                    // Getting buffer size for pre-allocation
+                    var spsSize = NvencH264EncoderPlugin.GetSps(encoderPtr, null);
+                    var ppsSize = NvencH264EncoderPlugin.GetPps(encoderPtr, null);
 
-                    if (isKeyFrame)
+                    // Allocation of SPS & Retrieve data.
+                    frame.SetSize(ref frame.spsNalu, (int)spsSize);
+                    using (var buffer = new PinnedBufferScope(frame.spsNalu))
                     {
-                        // Getting buffer size for pre-allocation
-                        var spsSize = NvencH264EncoderPlugin.GetSps((IntPtr)encoderPtr, null);
-                        var ppsSize = NvencH264EncoderPlugin.GetPps((IntPtr)encoderPtr, null);
-
-                        // Allocation of SPS & Retrieve data.
-                        frame.SetSize(ref frame.spsNalu, (int)spsSize);
-                        using (var buffer = new PinnedBufferScope(frame.spsNalu))
-                        {
-                            NvencH264EncoderPlugin.GetSps((IntPtr)encoderPtr, buffer.pointer);
-                        }
-
-                        // Allocation of PPS & Retrieve data.
-                        frame.SetSize(ref frame.ppsNalu, (int)ppsSize);
-                        using (var buffer = new PinnedBufferScope(frame.ppsNalu))
-                        {
-                            NvencH264EncoderPlugin.GetPps((IntPtr)encoderPtr, buffer.pointer);
-                        }
+                        NvencH264EncoderPlugin.GetSps(encoderPtr, buffer.pointer);
                     }
 
-                    // Liberate the current encoded frame in the Plugin.
-                    NvencH264EncoderPlugin.EndConsume((IntPtr)encoderPtr);
+                    // Allocation of PPS & Retrieve data.
+                    frame.SetSize(ref frame.ppsNalu, (int)ppsSize);
+                    using (var buffer = new PinnedBufferScope(frame.ppsNalu))
+                    {
+                        NvencH264EncoderPlugin.GetPps(encoderPtr, buffer.pointer);
+                    }
                 }
-                return existingFrame;
+                else
+                {
+                    // The frame is reused: the parameter sets of the last key frame must not be sent again.
+                    frame.SetSize(ref frame.spsNalu, 0);
+                    frame.SetSize(ref frame.ppsNalu, 0);
+                }
+
+                // Liberate the current encoded frame in the Plugin.
+                NvencH264EncoderPlugin.EndConsume(encoderPtr);
+            }
+            return existingFrame;
+        }
+
+        /// <inheritdoc/>
+        public bool isLossRecoverySupported => NvencH264EncoderPlugin.isApiSupported;
+
+        /// <inheritdoc/>
+        public unsafe void RequestKeyFrame()
+        {
+            if (!NvencH264EncoderPlugin.isApiSupported)
+                return;
+
+            fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                NvencH264EncoderPlugin.RequestKeyFrame((IntPtr)encoderPtr);
+            }
+        }
+
+        /// <inheritdoc/>
+        public unsafe void InvalidateReferenceFrames(ulong timestamp)
+        {
+            if (!NvencH264EncoderPlugin.isApiSupported)
+                return;
+
+            fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                NvencH264EncoderPlugin.InvalidateReferenceFrames((IntPtr)encoderPtr, timestamp);
             }
         }
 
@@ -1,5 +1,6 @@
 using System;
 using System.Diagnostics.Contracts;
+using System.Globalization;
 using System.Net;
 using System.Net.Sockets;
 using System.Threading;
@@ -36,12 +37,27 @@ namespace Unity.LiveCapture.VideoStreaming.Server
 
         const uint global_ssrc = 0x4321FADE; // 8 hex digits
 
+        // RTCP feedback messages (RFC 4585 and RFC 5104).
+        const int rtcp_transport_feedback = 205;
+        const int rtcp_payload_feedback = 206;
+        const int rtcp_generic_nack = 1;
+        const int rtcp_picture_loss_indication = 1;
+        const int rtcp_full_intra_request = 4;
+
         private TcpListener _RTSPServerListener;
         private ManualResetEvent _Stopping;
         private Thread _ListenTread;
 
         private ArraySegment<byte> raw_video_nal;
 
+        // The parameter sets the SDP is built from, and the media attributes of the SDP. Null until the encoder
+        // outputs its first key frame.
+        readonly object sdp_lock = new object();
+        byte[] sdp_sps = new byte[0];
+        byte[] sdp_pps = new byte[0];
+        bool sdp_has_sequence_info = false;
+        string sdp_media_attributes = null;
+
         List<RTSPConnection> rtsp_list = new List<RTSPConnection>(); // list of RTSP Listeners
 
         System.Random rnd = new System.Random();
@@ -51,6 +67,18 @@ namespace Unity.LiveCapture.VideoStreaming.Server
 
         public int port => _RTSPServerListener.LocalEndpoint is IPEndPoint endPoint ? endPoint.Port : 0;
 
+        /// <summary>
+        /// Raised when a client reports lost RTP packets with an RTCP NACK. The argument is the timestamp in nanoseconds
+        /// of the first frame the client lost. Raised on a network thread.
+        /// </summary>
+        public event Action<ulong> FramesLost;
+
+        /// <summary>
+        /// Raised when a client starts playing the stream, asks for a key frame with an RTCP PLI or FIR, or reports the
+        /// loss of packets too old to find their frame. Raised on a network thread.
+        /// </summary>
+        public event Action KeyFrameRequested;
+
         /// <summary>
         /// Initializes a new instance of the <see cref="RTSPServer"/> class.
         /// </summary>
@@ -113,6 +141,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                     var rtsp_socket = new RtspTcpTransport(oneClient);
                     RtspListener newListener = new RtspListener(rtsp_socket);
                     newListener.MessageReceived += RTSP_Message_Received;
+                    newListener.DataReceived += RTCP_Data_Received;
 
                     //RTSPDispatcher.Instance.AddListener(newListener);
 
@@ -257,24 +286,26 @@ namespace Unity.LiveCapture.VideoStreaming.Server
 
                 // TODO. Check the requsted_url is valid. In this example we accept any RTSP URL
 
-                // Make the Base64 SPS and PPS
-                String sps_str = Convert.ToBase64String(new byte[0]);
-                String pps_str = Convert.ToBase64String(new byte[0]);
+                // The media attributes are built from the parameter sets of the stream when it starts. Until then, the
+                // client is told to expect H264 and reads the parameter sets in band.
+                String media_attributes;
+                lock (sdp_lock)
+                {
+                    media_attributes = sdp_media_attributes;
+                }
+                if (media_attributes == null)
+                    media_attributes = "a=rtpmap:96 H264/90000\na=fmtp:96 profile-level-id=42A01E; packetization-mode=1;\n";
 
-                //Debug.LogFormat("sps: {0}, pps: {1}", sps_str, pps_str);
                 StringBuilder sdp = new StringBuilder();
 
                 // Generate the SDP
-                // The sprop-parameter-sets provide the SPS and PPS for H264 video
-                // The packetization-mode defines the H264 over RTP payloads used but is Optional
                 sdp.Append("v=0\n");
                 sdp.Append("o=user 123 0 IN IP4 0.0.0.0\n");
                 sdp.Append("s=SharpRTSP Test Camera\n");
                 sdp.Append("m=video 0 RTP/AVP 96\n");
                 sdp.Append("c=IN IP4 0.0.0.0\n");
                 sdp.Append("a=control:trackID=0\n");
-                sdp.Append("a=rtpmap:96 H264/90000\n");
-                sdp.Append("a=fmtp:96 profile-level-id=42A01E; sprop-parameter-sets=" + sps_str + "," + pps_str + ";\n");
+                sdp.Append(media_attributes);
 
                 byte[] sdp_bytes = Encoding.ASCII.GetBytes(sdp.ToString());
 
@@ -336,6 +367,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                         }
                     }
 
+                    udp_pair.DataReceived += RTCP_Data_Received;
                     udp_pair.Start(); // start listening for data on the UDP ports
 
                     // Pass the Port of the two sockets back in the reply
@@ -412,10 +444,11 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             // Handle PLAY message (Sent with a Session ID)
             if (message is Messages.RtspRequestPlay)
             {
+                bool session_found = false;
+
                 lock (rtsp_list)
                 {
                     // Search for the Session in the Sessions List. Change the state to "PLAY"
-                    bool session_found = false;
                     foreach (RTSPConnection connection in rtsp_list)
                     {
                         if (message.Session == connection.video_session_id) /* OR AUDIO_SESSION_ID */
@@ -445,6 +478,11 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                         listener.SendMessage(play_failed_response);
                     }
                 }
+
+                // The stream mostly has key frames on request, the client can't decode anything before the next one.
+                // Raised outside of the lock, the handlers can take their time.
+                if (session_found)
+                    KeyFrameRequested?.Invoke();
             }
 
             // Handle PAUSE message (Sent with a Session ID)
@@ -507,7 +545,90 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             }
         }
 
-        private void AddSTAPANalu(ArraySegment<byte> nalu, int naluStartByteIdx, int naluEndByteIdx, List<byte> rtp_packet, bool includeSize = true)
+        private void RTCP_Data_Received(object sender, RtspChunkEventArgs e)
+        {
+            var data = e.Message as Messages.RtspData;
+            if (data == null || data.Data == null)
+                return;
+
+            ulong lost_timestamp = ulong.MaxValue;
+            bool is_key_frame_requested = false;
+
+            lock (rtsp_list)
+            {
+                foreach (RTSPConnection connection in rtsp_list)
+                {
+                    if (connection.video_transport_reply == null)
+                        continue;
+
+                    // RTCP comes on the second interleaved channel over TCP, and on the control port over UDP
+                    bool is_tcp_rtcp = connection.listener == sender
+                        && connection.video_transport_reply.LowerTransport == Messages.RtspTransport.LowerTransportType.TCP
+                        && data.Channel == connection.video_transport_reply.Interleaved.Second;
+                    bool is_udp_rtcp = connection.video_udp_pair != null && connection.video_udp_pair == sender
+                        && data.Channel == connection.video_udp_pair.control_port;
+
+                    if (is_tcp_rtcp || is_udp_rtcp)
+                    {
+                        connection.video_time_since_last_rtcp_keepalive = DateTime.UtcNow;
+                        ReadRtcpFeedback(data.Data, connection, ref lost_timestamp, ref is_key_frame_requested);
+                        break;
+                    }
+                }
+            }
+
+            // Raised outside of the lock, the handlers can take their time.
+            if (is_key_frame_requested)
+                KeyFrameRequested?.Invoke();
+            else if (lost_timestamp != ulong.MaxValue)
+                FramesLost?.Invoke(lost_timestamp);
+        }
+
+        // Reads the feedback messages of a compound RTCP packet. The generic NACKs give the lost sequence numbers,
+        // which are mapped back to the timestamp of their frame, the earliest one is kept.
+        private static void ReadRtcpFeedback(byte[] packet, RTSPConnection connection, ref ulong lost_timestamp, ref bool is_key_frame_requested)
+        {
+            int offset = 0;
+            while (offset + 4 <= packet.Length)
+            {
+                int version = packet[offset] >> 6;
+                int format = packet[offset] & 0x1F;
+                int packet_type = packet[offset + 1];
+                int length = (((packet[offset + 2] << 8) | packet[offset + 3]) + 1) * 4;
+                if (version != 2 || offset + length > packet.Length)
+                    break;
+
+                if (packet_type == rtcp_transport_feedback && format == rtcp_generic_nack)
+                {
+                    // After the sender and media SSRCs, each entry is a lost packet ID and a bitmask of the 16 next lost ones
+                    for (int fci = offset + 12; fci + 4 <= offset + length; fci += 4)
+                    {
+                        UInt16 packet_id = (UInt16)((packet[fci] << 8) | packet[fci + 1]);
+                        int bitmask = (packet[fci + 2] << 8) | packet[fci + 3];
+
+                        for (int i = -1; i < 16; i++)
+                        {
+                            if (i >= 0 && (bitmask & (1 << i)) == 0)
+                                continue;
+
+                            UInt16 sequence_number = (UInt16)(packet_id + i + 1);
+                            if (connection.TryGetSentTimestamp(sequence_number, out ulong timestamp))
+                                lost_timestamp = Math.Min(lost_timestamp, timestamp);
+                            else
+                                is_key_frame_requested = true;
+                        }
+                    }
+                }
+                else if (packet_type == rtcp_payload_feedback && (format == rtcp_picture_loss_indication || format == rtcp_full_intra_request))
+                {
+                    is_key_frame_requested = true;
+                }
+
+                offset += length;
+            }
+        }
+
+        private void AddSTAPANalu(ReadOnlySpan<byte> nalu, int naluStartByteIdx, int naluEndByteIdx, List<byte> rtp_packet, bool includeSize = true)
         {
             //Debug.Log($"Found NALU {nalu[naluStartByteIdx] & 0x1F}, NRI = {(nalu[naluStartByteIdx] & 0x60) >> 5}, at [{naluStartByteIdx}, {naluEndByteIdx}]");
 
@@ -519,10 +640,81 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             }
 
             for (var i = naluStartByteIdx; i < naluEndByteIdx; ++i)
-                rtp_packet.Add(nalu.Array[i]);
+                rtp_packet.Add(nalu[i]);
+        }
+
+        /// <summary>
+        /// Describes the stream with the parameter sets of the encoder in the SDP of the clients that connect from now
+        /// on. The SDP is only rebuilt when the parameter sets change.
+        /// </summary>
+        /// <remarks>
+        /// Only H264 streams are described: the NAL units are packetized as defined by RFC 6184, HEVC streams would need
+        /// the packetization of RFC 7798.
+        /// </remarks>
+        /// <param name="sequenceInfo">The properties the encoder read from the parameter sets, if it provides them.</param>
+        public void SetParameterSets(ReadOnlySpan<byte> spsNalu, ReadOnlySpan<byte> ppsNalu, SequenceInfo sequenceInfo)
+        {
+            if (spsNalu.Length == 0 || ppsNalu.Length == 0)
+                return;
+
+            var has_sequence_info = sequenceInfo.isValid != 0;
+
+            lock (sdp_lock)
+            {
+                if (sdp_media_attributes != null && sdp_has_sequence_info == has_sequence_info
+                    && IsSameNalu(sdp_sps, spsNalu) && IsSameNalu(sdp_pps, ppsNalu))
+                    return;
+
+                sdp_sps = spsNalu.ToArray();
+                sdp_pps = ppsNalu.ToArray();
+                sdp_has_sequence_info = has_sequence_info;
+                sdp_media_attributes = BuildMediaAttributes(sdp_sps, sdp_pps, sequenceInfo);
+            }
+        }
+
+        private static bool IsSameNalu(byte[] nalu, ReadOnlySpan<byte> other)
+        {
+            return other.SequenceEqual(nalu);
         }
 
-        public void SendNALUs(ulong timeStampNs, ArraySegment<byte> spsNalu, ArraySegment<byte> ppsNalu, ArraySegment<byte> imageNalu)
+        // The rtpmap and fmtp attributes of RFC 6184, followed by the frame size and rate when the encoder parsed them
+        // from the SPS.
+        private static string BuildMediaAttributes(byte[] sps, byte[] pps, SequenceInfo sequenceInfo)
+        {
+            var has_sequence_info = sequenceInfo.isValid != 0;
+
+            // Without the parsed values, profile_idc, the constraint flags and level_idc are the 3 bytes following
+            // the NAL unit header of the SPS.
+            var profile_level_id = has_sequence_info
+                ? $"{sequenceInfo.profileIdc:X2}{sequenceInfo.profileCompatibility:X2}{sequenceInfo.levelIdc:X2}"
+                : sps.Length >= 4 ? $"{sps[1]:X2}{sps[2]:X2}{sps[3]:X2}" : "42A01E";
+
+            StringBuilder attributes = new StringBuilder();
+            attributes.Append("a=rtpmap:96 H264/90000\n");
+            attributes.AppendFormat("a=fmtp:96 profile-level-id={0}; packetization-mode=1; sprop-parameter-sets={1},{2};\n",
+                profile_level_id, Convert.ToBase64String(sps), Convert.ToBase64String(pps));
+
+            if (has_sequence_info)
+            {
+                attributes.AppendFormat(CultureInfo.InvariantCulture, "a=framesize:96 {0}-{1}\n", sequenceInfo.width, sequenceInfo.height);
+
+                // An H264 frame lasts 2 ticks.
+                if (sequenceInfo.timeScale != 0 && sequenceInfo.numUnitsInTick != 0)
+                {
+                    var frame_rate = sequenceInfo.timeScale / (double)(sequenceInfo.numUnitsInTick * 2);
+                    attributes.AppendFormat(CultureInfo.InvariantCulture, "a=framerate:{0:0.##}\n", frame_rate);
+                }
+            }
+            return attributes.ToString();
+        }
+
+        /// <summary>
+        /// Packetizes and sends an access unit, or a part of it.
+        /// </summary>
+        /// <param name="isEndOfFrame">False when more NAL units of the same frame follow, the RTP marker bit is then left unset.</param>
+        /// <param name="imageNalUnits">The NAL units the encoder found in the image. When empty, the image is scanned for start codes.</param>
+        public void SendNALUs(ulong timeStampNs, ReadOnlySpan<byte> spsNalu, ReadOnlySpan<byte> ppsNalu, ReadOnlySpan<byte> imageNalu, bool isEndOfFrame = true,
+            ReadOnlySpan<NalUnitEntry> imageNalUnits = default)
         {
             UInt32 rtp_timestamp = (UInt32)(timeStampNs * 9 / 100000); // 90kHz clock
 
@@ -530,26 +722,27 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             // The last packet will have the M bit set to '1'
             List<byte[]> rtp_packets = new List<byte[]>();
 
-            var nal_array = new[] { spsNalu, ppsNalu, imageNalu };
+            // The SPS, the PPS and the image.
+            const int nal_count = 3;
 
-            for (int x = 0; x < nal_array.Length; x++)
+            for (int x = 0; x < nal_count; x++)
             {
-                var raw_nal = nal_array[x];
+                var raw_nal = x == 0 ? spsNalu : x == 1 ? ppsNalu : imageNalu;
 
-                if (raw_nal == null || raw_nal.Count == 0)
+                if (raw_nal.Length == 0)
                     continue;
 
                 Boolean last_nal = false;
-                if (x == nal_array.Length - 1)
+                if (x == nal_count - 1)
                 {
-                    last_nal = true; // last NAL in our nal_array
+                    last_nal = true; // the image comes last
                 }
 
                 // The H264 Payload could be sent as one large RTP packet (assuming the receiver can handle it)
                 // or as a Fragmented Data, split over several RTP packets with the same Timestamp.
                 bool fragmenting = false;
                 int packetMTU = kMaxNalUnitSize;
-                if (raw_nal.Count > packetMTU) fragmenting = true;
+                if (raw_nal.Length > packetMTU) fragmenting = true;
 
                 //Debug.LogFormat("Sending NALU {0}, size = {1}, fragmenting={2}", x, raw_nal.Length, fragmenting);
 
@@ -561,7 +754,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                     // Note some receivers will have maximum buffers and be unable to handle large RTP packets.
                     // Also with RTP over RTSP there is a limit of 65535 bytes for the RTP packet.
                     var stapHeaderSize = 0; // Disabling stap logic to try slicing instead // last_nal ? 1 : 0;
-                    byte[] rtp_packet = new byte[12 + stapHeaderSize + raw_nal.Count]; // 12 is header size when there are no CSRCs or extensions
+                    byte[] rtp_packet = new byte[12 + stapHeaderSize + raw_nal.Length]; // 12 is header size when there are no CSRCs or extensions
 
                     // Create an single RTP fragment
 
@@ -577,7 +770,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                     int rtp_padding = 0;
                     int rtp_extension = 0;
                     int rtp_csrc_count = 0;
-                    int rtp_marker = (last_nal == true ? 1 : 0); // set to 1 if the last NAL in the array
+                    int rtp_marker = (last_nal && isEndOfFrame ? 1 : 0); // set to 1 if the last NAL of the frame
                     int rtp_payload_type = 96;
 
                     RTPPacketUtil.WriteHeader(rtp_packet, rtp_version, rtp_padding, rtp_extension, rtp_csrc_count, rtp_marker, rtp_payload_type);
@@ -594,7 +787,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                     if (enableSTAP && !last_nal)
                     {
                         // First 2 NALUs are SPS/PPS. Each fits in a single rtp packet.
-                        Array.Copy(raw_nal.Array, 0, rtp_packet, 12, raw_nal.Count);
+                        raw_nal.CopyTo(rtp_packet.AsSpan(12));
                         rtp_packets.Add(rtp_packet);
                     }
                     else if (enableSTAP)
@@ -618,37 +811,43 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                         int nalEndByteIdx = 0;
 
                         int naluCount = 0;
-                        for (var i = 0; i < raw_nal.Count;)
+                        if (last_nal && imageNalUnits.Length > 0)
                         {
-                            nalEndByteIdx = i;
-                            if (raw_nal.Array[i++] != 0)
-                                continue;
-                            if (i >= raw_nal.Count || raw_nal.Array[i++] != 0)
-                                continue;
-                            if (i >= raw_nal.Count || raw_nal.Array[i++] != 0)
-                                continue;
-                            if (i >= raw_nal.Count || raw_nal.Array[i++] != 1)
-                                continue;
-
-                            // Found NALU start. Copy previous NALU into packet with its size as shown in
-                            // Figure 7 of RFC 3984.
-                            if (nalStartByteIdx < nalEndByteIdx)
+                            // The encoder already located the NAL units, the image isn't scanned again.
+                            for (var i = 0; i < imageNalUnits.Length; ++i)
                             {
-                                AddSTAPANalu(raw_nal, nalStartByteIdx, nalEndByteIdx, rtpPacket);
+                                var nalUnit = imageNalUnits[i];
+                                AddSTAPANalu(raw_nal, (int)nalUnit.offset, (int)(nalUnit.offset + nalUnit.size), rtpPacket);
                                 ++naluCount;
                             }
-                            else if (nalEndByteIdx > 0)
+
+                            nalStartByteIdx = raw_nal.Length;
+                        }
+                        else
+                        {
+                            for (var i = 0; i + 2 < raw_nal.Length; ++i)
                             {
-                                //Debug.Log($"Found empty NALU at {nalStartByteIdx}");
-                            }
+                                if (raw_nal[i] != 0 || raw_nal[i + 1] != 0 || raw_nal[i + 2] != 1)
+                                    continue;
 
-                            nalStartByteIdx = nalEndByteIdx = i;
+                                // Found NALU start, the zero byte preceding a 3 bytes start code belongs to a 4 bytes one.
+                                // Copy previous NALU into packet with its size as shown in Figure 7 of RFC 3984.
+                                nalEndByteIdx = (i > nalStartByteIdx && raw_nal[i - 1] == 0) ? i - 1 : i;
+                                if (nalStartByteIdx < nalEndByteIdx)
+                                {
+                                    AddSTAPANalu(raw_nal, nalStartByteIdx, nalEndByteIdx, rtpPacket);
+                                    ++naluCount;
+                                }
+
+                                nalStartByteIdx = i + 3;
+                                i += 2;
+                            }
                         }
 
-                        if (nalStartByteIdx < (raw_nal.Count - 1))
+                        if (nalStartByteIdx < (raw_nal.Length - 1))
                         {
                             //Debug.Log("Handling ending NALU");
-                            AddSTAPANalu(raw_nal, nalStartByteIdx, raw_nal.Count, rtpPacket);
+                            AddSTAPANalu(raw_nal, nalStartByteIdx, raw_nal.Length, rtpPacket);
                             ++naluCount;
                         }
 
@@ -664,16 +863,16 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                         // The STAP-A variant doesn't work as of this writing, so here's a different approach.
                         int nalStartByteIdx = 0;
                         int nalEndByteIdx = 0;
-                        for (var i = 0; i < raw_nal.Count;)
+                        for (var i = 0; i < raw_nal.Length;)
                         {
                             nalEndByteIdx = i;
-                            if (raw_nal.Array[i++] != 0)
+                            if (raw_nal[i++] != 0)
                                 continue;
-                            if (i >= raw_nal.Count || raw_nal.Array[i++] != 0)
+                            if (i >= raw_nal.Length || raw_nal[i++] != 0)
                                 continue;
-                            if (i >= raw_nal.Count || raw_nal.Array[i++] != 0)
+                            if (i >= raw_nal.Length || raw_nal[i++] != 0)
                                 continue;
-                            if (i >= raw_nal.Count || raw_nal.Array[i++] != 1)
+                            if (i >= raw_nal.Length || raw_nal[i++] != 1)
                                 continue;
 
                             var rtpPacket = new List<byte>(12);
@@ -695,13 +894,13 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                             nalStartByteIdx = nalEndByteIdx = i;
                         }
 
-                        if (nalStartByteIdx < (raw_nal.Count - 1))
+                        if (nalStartByteIdx < (raw_nal.Length - 1))
                         {
                             //Debug.Log("Handling ending NALU");
                             var rtpPacket = new List<byte>(12);
                             for (int i = 0; i < 12; ++i)
                                 rtpPacket.Add(rtp_packet[i]);
-                            AddSTAPANalu(raw_nal, nalStartByteIdx, raw_nal.Count, rtpPacket);
+                            AddSTAPANalu(raw_nal, nalStartByteIdx, raw_nal.Length, rtpPacket);
                             rtp_packets.Add(rtpPacket.ToArray());
                         }
                     }
@@ -709,13 +908,13 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                 else
                 {
                     Profiler.BeginSample("Create fragmented RTP packet");
-                    int data_remaining = raw_nal.Count;
+                    int data_remaining = raw_nal.Length;
                     int nal_pointer = 0;
                     int start_bit = 1;
                     int end_bit = 0;
 
                     // consume first byte of the raw_nal. It is used in the FU header
-                    byte first_byte = raw_nal.Array[0];
+                    byte first_byte = raw_nal[0];
                     nal_pointer++;
                     data_remaining--;
 
@@ -738,7 +937,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                         int rtp_padding = 0;
                         int rtp_extension = 0;
                         int rtp_csrc_count = 0;
-                        int rtp_marker = (last_nal == true ? 1 : 0); // Marker set to 1 on last packet
+                        int rtp_marker = (last_nal && isEndOfFrame ? 1 : 0); // Marker set to 1 on last packet
                         int rtp_payload_type = 96;
 
                         RTPPacketUtil.WriteHeader(rtp_packet, rtp_version, rtp_padding, rtp_extension, rtp_csrc_count, rtp_marker, rtp_payload_type);
@@ -759,7 +958,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                         rtp_packet[12] = (byte)((f_bit << 7) + (nri << 5) + type);
                         rtp_packet[13] = (byte)((start_bit << 7) + (end_bit << 6) + (0 << 5) + (first_byte & 0x1F));
 
-                        Array.Copy(raw_nal.Array, nal_pointer, rtp_packet, 14, payload_size);
+                        raw_nal.Slice(nal_pointer, payload_size).CopyTo(rtp_packet.AsSpan(14));
                         nal_pointer = nal_pointer + payload_size;
                         data_remaining = data_remaining - payload_size;
 
@@ -792,6 +991,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
 
                         // Add the specific data for each transmission
                         RTPPacketUtil.WriteSequenceNumber(rtp_packet, connection.video_sequence_number);
+                        connection.AddSentPacket(connection.video_sequence_number, timeStampNs);
                         connection.video_sequence_number++;
 
                         // Add the specific SSRC for each transmission
@@ -925,6 +1125,26 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             public UDPSocket video_udp_pair = null; // Pair of UDP sockets (data and control) used when sending via UDP
             public DateTime video_time_since_last_rtcp_keepalive = DateTime.UtcNow; // Time since last RTCP message received - used to spot dead UDP clients
 
+            // Sequence numbers and frame timestamps of the last RTP packets sent, used to find the frames lost by the client
+            // (stored plus one, so that 0 is an empty entry)
+            const int sent_packet_history = 1024;
+            readonly int[] video_sent_sequence_numbers = new int[sent_packet_history];
+            readonly ulong[] video_sent_timestamps = new ulong[sent_packet_history];
+
+            public void AddSentPacket(UInt16 sequence_number, ulong timestamp)
+            {
+                int index = sequence_number % sent_packet_history;
+                video_sent_sequence_numbers[index] = sequence_number + 1;
+                video_sent_timestamps[index] = timestamp;
+            }
+
+            public bool TryGetSentTimestamp(UInt16 sequence_number, out ulong timestamp)
+            {
+                int index = sequence_number % sent_packet_history;
+                timestamp = video_sent_timestamps[index];
+                return video_sent_sequence_numbers[index] == sequence_number + 1;
+            }
+
             // TODO - Add Audio
         }
     }
@@ -88,9 +88,14 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         /// </summary>
         const int k_MaxBufferedFrameCount = 3;
 
-        // we want a low gop size to recover quickly if packets are dropped
+        // The GOP size of the encoders that can't be asked for a key frame: a low one lets the clients that start
+        // playing or drop packets recover quickly. The other encoders use a long GOP, see GetGopSize.
         const int k_GopSize = 2;
 
+        // The GOP size of the encoders that recover from losses without key frames: a few seconds of frames, so that
+        // a client that lost part of a key frame, or whose requests were lost, still recovers eventually.
+        const int k_LossRecoveryGopSize = 300;
+
         struct BufferedFrame
         {
             public EncoderSettings settings;
@@ -101,6 +106,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
 
         VideoEncoder m_RequestedEncoder = VideoEncoder.NoEncoder;
         VideoEncoder m_ActiveEncoder = VideoEncoder.NoEncoder;
+        int m_IntraRefreshFrames;
         IEncoder m_Encoder = null;
         readonly QueuedLock m_EncoderLock = new QueuedLock();
         bool m_Disposed;
@@ -109,6 +115,11 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         RtspServer m_Server;
         BlockingCollection<BufferedFrame> m_BufferedFrames;
 
+        // The losses reported by the clients, applied to the encoder by the server thread.
+        readonly object m_LossLock = new object();
+        ulong m_LostTimestamp = ulong.MaxValue;
+        bool m_KeyFrameRequested;
+
         /// <summary>
         /// Gets if the server is currently running.
         /// </summary>
@@ -161,23 +172,52 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                 {
                     m_ActiveEncoder = encoderToUse;
 
-                    try
-                    {
-                        m_EncoderLock.Enter();
+                    RecreateEncoder();
+                }
+            }
+        }
 
-                        m_Encoder?.Dispose();
-                        m_Encoder = EncoderUtilities.InitializeEncoder(encoderToUse);
-                    }
-                    finally
-                    {
-                        m_EncoderLock.Exit();
-                    }
+        /// <summary>
+        /// The number of frames each intra refresh is spread over, for the encoders that can replace key frames with
+        /// gradual intra refreshes. Zero disables intra refresh. The encoder is recreated when the value changes.
+        /// </summary>
+        public int intraRefreshFrames
+        {
+            get => m_IntraRefreshFrames;
+            set
+            {
+                value = Math.Max(0, value);
 
-                    DisposeFramesQueue();
+                if (m_IntraRefreshFrames != value)
+                {
+                    m_IntraRefreshFrames = value;
+
+                    if (m_Encoder is IIntraRefreshEncoder)
+                        RecreateEncoder();
                 }
             }
         }
 
+        void RecreateEncoder()
+        {
+            try
+            {
+                m_EncoderLock.Enter();
+
+                m_Encoder?.Dispose();
+                m_Encoder = EncoderUtilities.InitializeEncoder(m_ActiveEncoder);
+
+                if (m_Encoder is IIntraRefreshEncoder encoder)
+                    encoder.intraRefreshFrames = m_IntraRefreshFrames;
+            }
+            finally
+            {
+                m_EncoderLock.Exit();
+            }
+
+            DisposeFramesQueue();
+        }
+
         /// <summary>
         /// Creates a new <see cref="VideoStreamingServer"/> instance.
         /// </summary>
@@ -212,6 +252,8 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             try
             {
                 m_Server = new RtspServer(port, null, null);
+                m_Server.FramesLost += OnFramesLost;
+                m_Server.KeyFrameRequested += OnKeyFrameRequested;
                 m_Server.StartListen();
 
                 isRunning = true;
@@ -289,6 +331,43 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             }
         }
 
+        /// <summary>
+        /// Prepares the encoder for a stream of the given size, so that encoding the first frame doesn't wait for the
+        /// encoder to be created. Does nothing if the encoder is already set up or can't be prepared in advance.
+        /// </summary>
+        /// <param name="width">The expected width of the video stream, in pixels.</param>
+        /// <param name="height">The expected height of the video stream, in pixels.</param>
+        /// <param name="frameRate">The frame rate in Hz of the video stream.</param>
+        /// <param name="bitRate">The target bit rate of the video stream in kilobits per second.</param>
+        public void PrewarmEncoder(int width, int height, int frameRate, int bitRate)
+        {
+            if (m_Disposed)
+                throw new ObjectDisposedException(nameof(VideoStreamingServer));
+
+            var settings = new EncoderSettings
+            {
+                width = width,
+                height = height,
+                frameRate = frameRate,
+                bitRate = bitRate,
+                gopSize = GetGopSize(),
+            };
+
+            try
+            {
+                m_EncoderLock.Enter();
+
+                if (m_Encoder is IPrewarmEncoder encoder && m_Encoder.initialized == EncoderStatus.NotInitialized)
+                {
+                    encoder.Prewarm(settings, m_Encoder.encoderFormat);
+                }
+            }
+            finally
+            {
+                m_EncoderLock.Exit();
+            }
+        }
+
         /// <summary>
         /// Enqueue a frame for encoding into the stream.
         /// </summary>
@@ -312,7 +391,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                         height = frame.height,
                         frameRate = frameRate,
                         bitRate = bitRate,
-                        gopSize = k_GopSize,
+                        gopSize = GetGopSize(),
                     },
                     encoderFormat = frame.format,
                     // We need to copy the frame data, since the request data could be cleared if the frame ends
@@ -337,7 +416,8 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         /// <param name="frame">The frame to encode.</param>
         /// <param name="frameRate">The frame rate in Hz of the video stream.</param>
         /// <param name="bitRate">The target bit rate of the video stream in kilobits per second.</param>
-        public void EnqueueFrame(DirectAccessVideoFrameRequest frame, int frameRate, int bitRate)
+        /// <param name="timecode">The timecode of the frame packed by <see cref="EncoderUtilities.PackTimecode"/>, or 0 if it has none.</param>
+        public void EnqueueFrame(DirectAccessVideoFrameRequest frame, int frameRate, int bitRate, uint timecode = 0)
         {
             if (m_Disposed)
                 throw new ObjectDisposedException(nameof(VideoStreamingServer));
@@ -350,7 +430,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                 height = frame.height,
                 frameRate = frameRate,
                 bitRate = bitRate,
-                gopSize = k_GopSize,
+                gopSize = GetGopSize(),
             };
             var texture = frame.renderTexture;
             var timestamp = (ulong)(frame.elapsedTime * 1000000000);
@@ -373,7 +453,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                     }
 
                     encoder.UpdateSettings(settings);
-                    encoder.Encode(texture, timestamp);
+                    encoder.Encode(texture, timestamp, timecode);
 
                     Profiler.EndSample();
                 }
@@ -405,6 +485,8 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                         {
                             m_EncoderLock.Enter();
 
+                            RecoverLostFrames(m_Encoder);
+
                             switch (m_Encoder)
                             {
                                 case ISoftwareEncoder softwareEncoder:
@@ -457,11 +539,13 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                 Profiler.EndSample();
                 Profiler.BeginSample($"Send NALUs");
 
+                m_Server.SetParameterSets(encodedFrame.sps, encodedFrame.pps, encodedFrame.sequenceInfo);
+
                 m_Server.SendNALUs(
                     frame.timestamp,
-                    encodedFrame.spsNalu,
-                    encodedFrame.ppsNalu,
-                    encodedFrame.imageNalu
+                    encodedFrame.sps,
+                    encodedFrame.pps,
+                    encodedFrame.image
                 );
 
                 frame.data.Dispose();
@@ -470,17 +554,77 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             }
         }
 
+        // Key frames are mostly encoded on request when the encoder supports it, the clients ask for one when they
+        // start playing and when they can't recover from a loss with the frames they have. The GOP size doesn't depend
+        // on the frame rate, so that a frame rate change doesn't reconfigure the encoder.
+        int GetGopSize()
+        {
+            if (m_Encoder is ILossRecoveryEncoder encoder && encoder.isLossRecoverySupported)
+            {
+                // The intra refreshes follow each other without a GOP, any client recovers after one of them.
+                return m_Encoder is IIntraRefreshEncoder && m_IntraRefreshFrames > 0 ? 0 : k_LossRecoveryGopSize;
+            }
+            return k_GopSize;
+        }
+
+        void OnFramesLost(ulong timestamp)
+        {
+            lock (m_LossLock)
+            {
+                m_LostTimestamp = Math.Min(m_LostTimestamp, timestamp);
+            }
+        }
+
+        void OnKeyFrameRequested()
+        {
+            lock (m_LossLock)
+            {
+                m_KeyFrameRequested = true;
+            }
+        }
+
+        void RecoverLostFrames(IEncoder encoder)
+        {
+            ulong lostTimestamp;
+            bool keyFrameRequested;
+
+            lock (m_LossLock)
+            {
+                lostTimestamp = m_LostTimestamp;
+                keyFrameRequested = m_KeyFrameRequested;
+                m_LostTimestamp = ulong.MaxValue;
+                m_KeyFrameRequested = false;
+            }
+
+            if (!keyFrameRequested && lostTimestamp == ulong.MaxValue)
+                return;
+
+            // The other encoders recover with their next key frame.
+            if (encoder is ILossRecoveryEncoder recoveryEncoder && encoder.initialized == EncoderStatus.Initialized)
+            {
+                if (keyFrameRequested)
+                    recoveryEncoder.RequestKeyFrame();
+                else if (lostTimestamp != ulong.MaxValue)
+                    recoveryEncoder.InvalidateReferenceFrames(lostTimestamp);
+            }
+        }
+
         void ProcessHardwareEncoderFrames(IHardwareEncoder hardwareEncoder, H264EncodedFrame encodedFrame)
         {
             while (hardwareEncoder.ConsumeData(encodedFrame, out var timestamp))
             {
                 Profiler.BeginSample($"Send NALUs");
 
+                // The data can be lent by the encoder: it is only valid until the next frame is consumed.
+                m_Server.SetParameterSets(encodedFrame.sps, encodedFrame.pps, encodedFrame.sequenceInfo);
+
                 m_Server.SendNALUs(
                     timestamp,
-                    encodedFrame.spsNalu,
-                    encodedFrame.ppsNalu,
-                    encodedFrame.imageNalu
+                    encodedFrame.sps,
+                    encodedFrame.pps,
+                    encodedFrame.image,
+                    encodedFrame.isLastSlice,
+                    encodedFrame.nalUnits
                 );
 
                 Profiler.EndSample();